@@ -202,6 +202,97 @@ typedef VOID
     _In_ BOOLEAN        Locked
     );
 
+/*! \typedef XENBUS_CACHE_GET_BATCH
+    \brief Populate an array with objects from a \a Cache
+
+    \param Interface The interface header
+    \param Cache The cache handle
+    \param Objects Array to receive the objects
+    \param Count The number of elements in \a Objects
+    \param Locked If mutually exclusive access to the cache is already
+    guaranteed then set this to TRUE
+    \return The number of objects placed in \a Objects, which will only
+    be less than \a Count if the cache could not be grown
+
+    This is equivalent to \a Count calls to XENBUS_CACHE_GET but the cache
+    lock (or the callback supplied to XENBUS_CACHE_CREATE) is acquired at
+    most once.
+*/
+typedef ULONG
+(*XENBUS_CACHE_GET_BATCH)(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache,
+    _Out_writes_to_(Count, return) PVOID *Objects,
+    _In_ ULONG          Count,
+    _In_ BOOLEAN        Locked
+    );
+
+/*! \typedef XENBUS_CACHE_PUT_BATCH
+    \brief Return an array of objects to a \a Cache
+
+    \param Interface The interface header
+    \param Cache The cache handle
+    \param Objects Array of objects to return
+    \param Count The number of elements in \a Objects
+    \param Locked If mutually exclusive access to the cache is already
+    guaranteed then set this to TRUE
+
+    This is equivalent to \a Count calls to XENBUS_CACHE_PUT but the cache
+    lock (or the callback supplied to XENBUS_CACHE_CREATE) is acquired at
+    most once.
+*/
+typedef VOID
+(*XENBUS_CACHE_PUT_BATCH)(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache,
+    _In_reads_(Count) PVOID *Objects,
+    _In_ ULONG          Count,
+    _In_ BOOLEAN        Locked
+    );
+
+/*! \struct _XENBUS_CACHE_STATISTICS
+    \brief A snapshot of the statistics of a \a Cache
+
+    The hit counts record how each Get or Put was satisfied: from the
+    CPU's magazines, by exchanging magazines with the depot, or directly
+    from (or to) the slabs. \a LockHoldTime is in microseconds and is
+    estimated from a sample of the acquisitions of the cache lock.
+*/
+typedef struct _XENBUS_CACHE_STATISTICS {
+    ULONG       Size;
+    ULONG       Reservation;
+    ULONG       Cap;
+    ULONG       Count;
+    ULONG       CurrentObjects;
+    ULONG       MaximumObjects;
+    ULONG       CurrentSlabs;
+    ULONG       MaximumSlabs;
+    ULONG       MagazineSize;
+    ULONGLONG   MagazineHits;
+    ULONGLONG   DepotHits;
+    ULONGLONG   SlabHits;
+    ULONGLONG   SlabCreations;
+    ULONGLONG   CtorCalls;
+    ULONGLONG   LockAcquisitions;
+    ULONGLONG   LockHoldTime;
+} XENBUS_CACHE_STATISTICS, *PXENBUS_CACHE_STATISTICS;
+
+/*! \typedef XENBUS_CACHE_QUERY_STATISTICS
+    \brief Take a snapshot of the statistics of a \a Cache
+
+    \param Interface The interface header
+    \param Cache The cache handle
+    \param Statistics Buffer to receive the statistics
+
+    The counters are aggregated across all CPUs at the time of the call.
+*/
+typedef VOID
+(*XENBUS_CACHE_QUERY_STATISTICS)(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_CACHE              Cache,
+    _Out_ PXENBUS_CACHE_STATISTICS  Statistics
+    );
+
 /*! \typedef XENBUS_CACHE_DESTROY
     \brief Destroy a \a Cache
 
@@ -248,7 +339,40 @@ struct _XENBUS_CACHE_INTERFACE_V2 {
     XENBUS_CACHE_DESTROY    CacheDestroy;
 };
 
-typedef struct _XENBUS_CACHE_INTERFACE_V2 XENBUS_CACHE_INTERFACE, *PXENBUS_CACHE_INTERFACE;
+/*! \struct _XENBUS_CACHE_INTERFACE_V3
+    \brief CACHE interface version 3
+    \ingroup interfaces
+*/
+struct _XENBUS_CACHE_INTERFACE_V3 {
+    INTERFACE               Interface;
+    XENBUS_CACHE_ACQUIRE    CacheAcquire;
+    XENBUS_CACHE_RELEASE    CacheRelease;
+    XENBUS_CACHE_CREATE     CacheCreate;
+    XENBUS_CACHE_GET        CacheGet;
+    XENBUS_CACHE_PUT        CachePut;
+    XENBUS_CACHE_GET_BATCH  CacheGetBatch;
+    XENBUS_CACHE_PUT_BATCH  CachePutBatch;
+    XENBUS_CACHE_DESTROY    CacheDestroy;
+};
+
+/*! \struct _XENBUS_CACHE_INTERFACE_V4
+    \brief CACHE interface version 4
+    \ingroup interfaces
+*/
+struct _XENBUS_CACHE_INTERFACE_V4 {
+    INTERFACE                       Interface;
+    XENBUS_CACHE_ACQUIRE            CacheAcquire;
+    XENBUS_CACHE_RELEASE            CacheRelease;
+    XENBUS_CACHE_CREATE             CacheCreate;
+    XENBUS_CACHE_GET                CacheGet;
+    XENBUS_CACHE_PUT                CachePut;
+    XENBUS_CACHE_GET_BATCH          CacheGetBatch;
+    XENBUS_CACHE_PUT_BATCH          CachePutBatch;
+    XENBUS_CACHE_QUERY_STATISTICS   CacheQueryStatistics;
+    XENBUS_CACHE_DESTROY            CacheDestroy;
+};
+
+typedef struct _XENBUS_CACHE_INTERFACE_V4 XENBUS_CACHE_INTERFACE, *PXENBUS_CACHE_INTERFACE;
 
 /*! \def XENBUS_CACHE
     \brief Macro at assist in method invocation
@@ -259,6 +383,6 @@ typedef struct _XENBUS_CACHE_INTERFACE_V2 XENBUS_CACHE_INTERFACE, *PXENBUS_CACHE
 #endif  // _WINDLL
 
 #define XENBUS_CACHE_INTERFACE_VERSION_MIN  1
-#define XENBUS_CACHE_INTERFACE_VERSION_MAX  2
+#define XENBUS_CACHE_INTERFACE_VERSION_MAX  4
 
 #endif  // _XENBUS_CACHE_INTERFACE_H
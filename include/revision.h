@@ -52,6 +52,17 @@
     DEFINE_REVISION(0x09000009,  1,  4,  9,  1,  2,  1,  2,  4,  1,  1,  2), \
     DEFINE_REVISION(0x0900000A,  1,  4,  9,  1,  2,  1,  2,  4,  2,  1,  2), \
     DEFINE_REVISION(0x0900000B,  1,  4,  9,  1,  2,  1,  2,  4,  3,  1,  2), \
-    DEFINE_REVISION(0x0900000C,  1,  4,  9,  1,  2,  1,  2,  4,  3,  1,  3)
+    DEFINE_REVISION(0x0900000C,  1,  4,  9,  1,  2,  1,  2,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x0900000D,  1,  4,  9,  1,  2,  1,  3,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x0900000E,  1,  4,  9,  1,  2,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x0900000F,  1,  4,  9,  1,  3,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000010,  1,  4,  9,  1,  4,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000011,  1,  4,  9,  1,  5,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000012,  1,  4,  9,  1,  6,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000013,  1,  4,  9,  1,  7,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000014,  1,  4,  9,  1,  8,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000015,  1,  4,  9,  1,  9,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000016,  1,  4,  9,  1, 10,  1,  4,  4,  3,  1,  3), \
+    DEFINE_REVISION(0x09000017,  1,  4,  9,  1, 11,  1,  4,  4,  3,  1,  3)
 
 #endif  // _REVISION_H
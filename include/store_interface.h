@@ -51,6 +51,11 @@ typedef struct _XENBUS_STORE_TRANSACTION    XENBUS_STORE_TRANSACTION, *PXENBUS_S
 */
 typedef struct _XENBUS_STORE_WATCH          XENBUS_STORE_WATCH, *PXENBUS_STORE_WATCH;
 
+/*! \typedef XENBUS_STORE_ENUMERATOR
+    \brief XenStore directory enumerator handle
+*/
+typedef struct _XENBUS_STORE_ENUMERATOR     XENBUS_STORE_ENUMERATOR, *PXENBUS_STORE_ENUMERATOR;
+
 /*! \typedef XENBUS_STORE_PERMISSION_MASK
     \brief Bitmask of XenStore key permissions
 */
@@ -287,6 +292,420 @@ typedef NTSTATUS
     _In_ ULONG                          NumberPermissions
     );
 
+/*! \typedef XENBUS_STORE_COMPLETION_FUNCTION
+    \brief Completion function for an asynchronous XenStore request
+
+    \param Argument Context \a Argument supplied when the request was
+    submitted
+    \param Status The result of the request
+    \param Value For a read, the value read (otherwise NULL)
+
+    Completion functions are invoked with IRQL == DISPATCH_LEVEL. The
+    \a Value buffer is only valid for the duration of the call.
+*/
+typedef VOID
+(*XENBUS_STORE_COMPLETION_FUNCTION)(
+    _In_opt_ PVOID      Argument,
+    _In_ NTSTATUS       Status,
+    _In_opt_z_ PSTR     Value
+    );
+
+/*! \typedef XENBUS_STORE_READ_ASYNC
+    \brief Asynchronously read a value from XenStore
+
+    \param Interface The interface header
+    \param Transaction The transaction handle (NULL if this read is not
+    part of a transaction)
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the XenStore key to read
+    \param Function The completion function
+    \param Argument An optional context argument passed to the function
+
+    If this method succeeds then \a Function will be invoked exactly once,
+    when the response arrives. The caller does not wait for XenStore.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_READ_ASYNC)(
+    _In_ PINTERFACE                         Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_opt_ PSTR                           Prefix,
+    _In_ PSTR                               Node,
+    _In_ XENBUS_STORE_COMPLETION_FUNCTION   Function,
+    _In_opt_ PVOID                          Argument
+    );
+
+/*! \typedef XENBUS_STORE_PRINTF_ASYNC
+    \brief Asynchronously write a value to XenStore
+
+    \param Interface The interface header
+    \param Transaction The transaction handle (NULL if this write is not
+    part of a transaction)
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the XenStore key to write
+    \param Function The completion function
+    \param Argument An optional context argument passed to the function
+    \param Format A format specifier
+    \param ... Additional parameters required by \a Format
+
+    If this method succeeds then \a Function will be invoked exactly once,
+    when the response arrives. The caller does not wait for XenStore.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_PRINTF_ASYNC)(
+    _In_ PINTERFACE                         Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_opt_ PSTR                           Prefix,
+    _In_ PSTR                               Node,
+    _In_ XENBUS_STORE_COMPLETION_FUNCTION   Function,
+    _In_opt_ PVOID                          Argument,
+    _In_ PCSTR                              Format,
+    ...
+    );
+
+/*! \enum _XENBUS_STORE_OPERATION_TYPE
+    \brief Type of operation in a XenStore batch
+*/
+typedef enum _XENBUS_STORE_OPERATION_TYPE {
+    XENBUS_STORE_OPERATION_TYPE_INVALID = 0,
+    XENBUS_STORE_OPERATION_TYPE_READ,   /*!< Read */
+    XENBUS_STORE_OPERATION_TYPE_WRITE,  /*!< Write */
+    XENBUS_STORE_OPERATION_TYPE_REMOVE  /*!< Remove */
+} XENBUS_STORE_OPERATION_TYPE, *PXENBUS_STORE_OPERATION_TYPE;
+
+/*! \struct _XENBUS_STORE_OPERATION
+    \brief A single operation in a XenStore batch
+
+    For a write \a Value must point at the value to write. For a
+    successful read \a Value is initialized with a memory buffer
+    containing the value read, which should be freed using
+    \a XENBUS_STORE_FREE. \a Status receives the result of the
+    operation.
+*/
+typedef struct _XENBUS_STORE_OPERATION {
+    XENBUS_STORE_OPERATION_TYPE Type;
+    PSTR                        Prefix;
+    PSTR                        Node;
+    PSTR                        Value;
+    NTSTATUS                    Status;
+} XENBUS_STORE_OPERATION, *PXENBUS_STORE_OPERATION;
+
+/*! \typedef XENBUS_STORE_SUBMIT_BATCH
+    \brief Perform a batch of XenStore operations
+
+    \param Interface The interface header
+    \param Transaction The transaction handle (NULL if this batch is not
+    part of a transaction)
+    \param Operations An array of operations
+    \param NumberOperations Number of elements in the \a Operations array
+    (must be non-zero)
+
+    All operations are placed in the ring together and XenStore is
+    notified once, so the batch costs roughly a single round trip.
+    The method returns when all operations have completed. If any
+    operation failed then the status of the first failure is returned,
+    but the values of any successful reads must still be freed.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_SUBMIT_BATCH)(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _Inout_updates_(NumberOperations)
+    PXENBUS_STORE_OPERATION             Operations,
+    _In_ ULONG                          NumberOperations
+    );
+
+/*! \typedef XENBUS_STORE_WATCH_ADD_QUEUED
+    \brief Add a XenStore watch that records the paths that fire
+
+    \param Interface The interface header
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the XenStore key to watch
+    \param Event A pointer to an event object to be signalled when the
+    watch fires
+    \param QueueDepth The maximum number of paths to hold in the queue
+    \param Watch A pointer to a watch handle to be initialized
+
+    As well as signalling \a Event, the path that fired is added to a
+    queue belonging to the watch. Paths are retrieved using
+    \a XENBUS_STORE_WATCH_DEQUEUE. The watch is removed using
+    \a XENBUS_STORE_WATCH_REMOVE.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_WATCH_ADD_QUEUED)(
+    _In_ PINTERFACE                 Interface,
+    _In_opt_ PSTR                   Prefix,
+    _In_ PSTR                       Node,
+    _In_ PKEVENT                    Event,
+    _In_ ULONG                      QueueDepth,
+    _Outptr_ PXENBUS_STORE_WATCH    *Watch
+    );
+
+/*! \typedef XENBUS_STORE_WATCH_DEQUEUE
+    \brief Retrieve the oldest path queued by a watch
+
+    \param Interface The interface header
+    \param Watch The watch handle
+    \param Path A buffer to receive the path
+    \param Length The length of the \a Path buffer
+    \param Overflow Set to TRUE if paths were discarded because the queue
+    was full (or the VM was resumed) since the previous call
+
+    STATUS_NO_MORE_ENTRIES is returned if the queue is empty. If
+    \a Overflow is TRUE then the caller should re-scan the watched
+    subtree since the queued paths are incomplete.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_WATCH_DEQUEUE)(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_WATCH        Watch,
+    _Out_writes_z_(Length) PSTR     Path,
+    _In_ ULONG                      Length,
+    _Out_ PBOOLEAN                  Overflow
+    );
+
+/*! \typedef XENBUS_STORE_READ_BUFFER
+    \brief Read a value from XenStore into a caller-supplied buffer
+
+    \param Interface The interface header
+    \param Transaction The transaction handle (NULL if this read is not
+    part of a transaction)
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the XenStore key to read
+    \param Value A buffer to receive the NUL terminated value
+    \param Length The length of the \a Value buffer
+    \param ValueLength An optional pointer to receive the length of the
+    value, not including the NUL terminator
+
+    The value is copied directly from the shared ring into \a Value, so
+    the buffer must remain resident (e.g. non-paged pool or the caller's
+    stack) until the method returns. STATUS_BUFFER_OVERFLOW is returned
+    if \a Value is too small, in which case \a ValueLength still
+    receives the length of the value.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_READ_BUFFER)(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _Out_writes_z_(Length) PSTR         Value,
+    _In_ ULONG                          Length,
+    _Out_opt_ PULONG                    ValueLength
+    );
+
+/*! \typedef XENBUS_STORE_ENUMERATE_START
+    \brief Start enumerating the immediate child keys of a XenStore key
+
+    \param Interface The interface header
+    \param Transaction The transaction handle (NULL if this enumeration is
+    not part of a transaction)
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the XenStore key to enumerate
+    \param Enumerator A pointer to an enumerator handle to be initialized
+
+    Unlike \a XENBUS_STORE_DIRECTORY the number of children is not
+    limited by the size of a single XenStore message. The enumerator
+    must be destroyed using \a XENBUS_STORE_ENUMERATE_END.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_ENUMERATE_START)(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _Outptr_ PXENBUS_STORE_ENUMERATOR   *Enumerator
+    );
+
+/*! \typedef XENBUS_STORE_ENUMERATE_NEXT
+    \brief Retrieve the next page of child key names
+
+    \param Interface The interface header
+    \param Enumerator The enumerator handle
+    \param Names A pointer to a pointer that will be initialized with a
+    NUL separated list of key names
+
+    The \a Names buffer belongs to the enumerator and is only valid until
+    the next call. STATUS_NO_MORE_ENTRIES is returned once all children
+    have been enumerated. STATUS_RETRY is returned if the key changed
+    during enumeration, in which case the names seen so far should be
+    discarded; the next call starts again from the first child.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_ENUMERATE_NEXT)(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_ENUMERATOR   Enumerator,
+    _Outptr_result_z_ PSTR          *Names
+    );
+
+/*! \typedef XENBUS_STORE_ENUMERATE_END
+    \brief Destroy a directory enumerator
+
+    \param Interface The interface header
+    \param Enumerator The enumerator handle
+*/
+typedef VOID
+(*XENBUS_STORE_ENUMERATE_END)(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_ENUMERATOR   Enumerator
+    );
+
+/*! \typedef XENBUS_STORE_READ_TREE
+    \brief Read all the values in a XenStore subtree
+
+    \param Interface The interface header
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the root of the subtree
+    \param Depth The number of levels beneath the root to read (1 reads
+    only the immediate children)
+    \param Buffer A pointer to a pointer that will be initialized with a
+    memory buffer containing the packed key/value pairs
+
+    The subtree is read within a single transaction, with the requests
+    for each level of the tree pipelined, so the result is a consistent
+    snapshot. Each key is returned as its path relative to the root
+    followed by its value, both NUL terminated. The list is terminated by
+    an empty path. Keys that cannot be read are omitted. If the
+    transaction keeps clashing with other updates the subtree is re-read
+    a bounded number of times, with a backoff in between, after which
+    STATUS_RETRY is returned.
+
+    The \a Buffer should be freed using \a XENBUS_STORE_FREE
+
+    This method must be invoked with IRQL < DISPATCH_LEVEL.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_READ_TREE)(
+    _In_ PINTERFACE             Interface,
+    _In_opt_ PSTR               Prefix,
+    _In_ PSTR                   Node,
+    _In_ ULONG                  Depth,
+    _Outptr_result_z_ PSTR      *Buffer
+    );
+
+#define XENBUS_STORE_LATENCY_TYPES      32
+#define XENBUS_STORE_LATENCY_BUCKETS    24
+
+/*! \struct _XENBUS_STORE_LATENCY
+    \brief Latency histograms for one type of XenStore request
+
+    \a QueueTime covers the time from a request being prepared until it
+    has been completely copied into the shared ring, and \a ServiceTime
+    the time from then until the response arrived. Bucket N counts
+    requests taking less than 2^(N+1) microseconds (and at least 2^N,
+    for N > 0). The last bucket counts everything slower. \a Stalls
+    counts requests that had to wait for space in the ring.
+*/
+typedef struct _XENBUS_STORE_LATENCY {
+    ULONGLONG   Count;
+    ULONGLONG   Stalls;
+    ULONGLONG   QueueTime[XENBUS_STORE_LATENCY_BUCKETS];
+    ULONGLONG   ServiceTime[XENBUS_STORE_LATENCY_BUCKETS];
+} XENBUS_STORE_LATENCY, *PXENBUS_STORE_LATENCY;
+
+/*! \typedef XENBUS_STORE_QUERY_LATENCY
+    \brief Take a snapshot of the latency histograms for a request type
+
+    \param Interface The interface header
+    \param Type The XenStore message type (see xs_wire.h)
+    \param Latency Buffer to receive the histograms
+
+    STATUS_INVALID_PARAMETER is returned if \a Type is not less than
+    XENBUS_STORE_LATENCY_TYPES.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_QUERY_LATENCY)(
+    _In_ PINTERFACE                 Interface,
+    _In_ ULONG                      Type,
+    _Out_ PXENBUS_STORE_LATENCY     Latency
+    );
+
+/*! \typedef XENBUS_STORE_TRANSACTION_FUNCTION
+    \brief Body of a XenStore transaction
+
+    \param Argument Context \a Argument supplied to
+    \a XENBUS_STORE_TRANSACTION_RUN
+    \param Transaction The transaction handle to use for all accesses
+
+    The function may be invoked more than once so it must not have side
+    effects outside the transaction. Returning a failure status aborts
+    the transaction (STATUS_RETRY causes it to be re-run).
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_TRANSACTION_FUNCTION)(
+    _In_opt_ PVOID                  Argument,
+    _In_ PXENBUS_STORE_TRANSACTION  Transaction
+    );
+
+/*! \typedef XENBUS_STORE_TRANSACTION_RUN
+    \brief Run a function inside a XenStore transaction
+
+    \param Interface The interface header
+    \param Function The transaction body
+    \param Argument An optional context argument passed to the function
+
+    The transaction is committed if \a Function succeeds. If it clashes
+    then \a Function is re-run, after a randomized, exponentially
+    increasing delay, up to a bounded number of attempts. STATUS_RETRY
+    is returned if all attempts clash.
+
+    This method must be invoked with IRQL < DISPATCH_LEVEL.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_TRANSACTION_RUN)(
+    _In_ PINTERFACE                         Interface,
+    _In_ XENBUS_STORE_TRANSACTION_FUNCTION  Function,
+    _In_opt_ PVOID                          Argument
+    );
+
+/*! \typedef XENBUS_STORE_WATCH_ADD_DEBOUNCED
+    \brief Add a XenStore watch that collapses bursts of events
+
+    \param Interface The interface header
+    \param Prefix An optional prefix for the \a Node
+    \param Node The concatenation of the \a Prefix and this value specifies
+    the XenStore key to watch
+    \param Event A pointer to an event object to be signalled when the
+    watch fires
+    \param Interval The debounce interval in milliseconds
+    \param Watch A pointer to a watch handle to be initialized
+
+    The first event signals \a Event immediately. Further events that
+    arrive within \a Interval are collapsed into a single signal when
+    the interval expires, and so on until an interval passes without
+    any events. The watch is removed using \a XENBUS_STORE_WATCH_REMOVE,
+    which must then be invoked with IRQL == PASSIVE_LEVEL.
+*/
+typedef NTSTATUS
+(*XENBUS_STORE_WATCH_ADD_DEBOUNCED)(
+    _In_ PINTERFACE                 Interface,
+    _In_opt_ PSTR                   Prefix,
+    _In_ PSTR                       Node,
+    _In_ PKEVENT                    Event,
+    _In_ ULONG                      Interval,
+    _Outptr_ PXENBUS_STORE_WATCH    *Watch
+    );
+
+/*! \typedef XENBUS_STORE_WATCH_SUPPRESSED
+    \brief Get the number of events collapsed by a debounced watch
+
+    \param Interface The interface header
+    \param Watch The watch handle
+
+    \return The number of events since the watch was added that did not
+    result in a separate signal
+*/
+typedef ULONG
+(*XENBUS_STORE_WATCH_SUPPRESSED)(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_STORE_WATCH    Watch
+    );
+
 // {86824C3B-D34E-4753-B281-2F1E3AD214D7}
 DEFINE_GUID(GUID_XENBUS_STORE_INTERFACE,
 0x86824c3b, 0xd34e, 0x4753, 0xb2, 0x81, 0x2f, 0x1e, 0x3a, 0xd2, 0x14, 0xd7);
@@ -312,7 +731,268 @@ struct _XENBUS_STORE_INTERFACE_V2 {
     XENBUS_STORE_POLL               StorePoll;
 };
 
-typedef struct _XENBUS_STORE_INTERFACE_V2 XENBUS_STORE_INTERFACE, *PXENBUS_STORE_INTERFACE;
+/*! \struct _XENBUS_STORE_INTERFACE_V3
+    \brief STORE interface version 3
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V3 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V4
+    \brief STORE interface version 4
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V4 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V5
+    \brief STORE interface version 5
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V5 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V6
+    \brief STORE interface version 6
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V6 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+    XENBUS_STORE_READ_BUFFER        StoreReadBuffer;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V7
+    \brief STORE interface version 7
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V7 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+    XENBUS_STORE_READ_BUFFER        StoreReadBuffer;
+    XENBUS_STORE_ENUMERATE_START    StoreEnumerateStart;
+    XENBUS_STORE_ENUMERATE_NEXT     StoreEnumerateNext;
+    XENBUS_STORE_ENUMERATE_END      StoreEnumerateEnd;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V8
+    \brief STORE interface version 8
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V8 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+    XENBUS_STORE_READ_BUFFER        StoreReadBuffer;
+    XENBUS_STORE_ENUMERATE_START    StoreEnumerateStart;
+    XENBUS_STORE_ENUMERATE_NEXT     StoreEnumerateNext;
+    XENBUS_STORE_ENUMERATE_END      StoreEnumerateEnd;
+    XENBUS_STORE_READ_TREE          StoreReadTree;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V9
+    \brief STORE interface version 9
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V9 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+    XENBUS_STORE_READ_BUFFER        StoreReadBuffer;
+    XENBUS_STORE_ENUMERATE_START    StoreEnumerateStart;
+    XENBUS_STORE_ENUMERATE_NEXT     StoreEnumerateNext;
+    XENBUS_STORE_ENUMERATE_END      StoreEnumerateEnd;
+    XENBUS_STORE_READ_TREE          StoreReadTree;
+    XENBUS_STORE_QUERY_LATENCY      StoreQueryLatency;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V10
+    \brief STORE interface version 10
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V10 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+    XENBUS_STORE_READ_BUFFER        StoreReadBuffer;
+    XENBUS_STORE_ENUMERATE_START    StoreEnumerateStart;
+    XENBUS_STORE_ENUMERATE_NEXT     StoreEnumerateNext;
+    XENBUS_STORE_ENUMERATE_END      StoreEnumerateEnd;
+    XENBUS_STORE_READ_TREE          StoreReadTree;
+    XENBUS_STORE_QUERY_LATENCY      StoreQueryLatency;
+    XENBUS_STORE_TRANSACTION_RUN    StoreTransactionRun;
+};
+
+/*! \struct _XENBUS_STORE_INTERFACE_V11
+    \brief STORE interface version 11
+    \ingroup interfaces
+*/
+struct _XENBUS_STORE_INTERFACE_V11 {
+    INTERFACE                       Interface;
+    XENBUS_STORE_ACQUIRE            StoreAcquire;
+    XENBUS_STORE_RELEASE            StoreRelease;
+    XENBUS_STORE_FREE               StoreFree;
+    XENBUS_STORE_READ               StoreRead;
+    XENBUS_STORE_PRINTF             StorePrintf;
+    XENBUS_STORE_PERMISSIONS_SET    StorePermissionsSet;
+    XENBUS_STORE_REMOVE             StoreRemove;
+    XENBUS_STORE_DIRECTORY          StoreDirectory;
+    XENBUS_STORE_TRANSACTION_START  StoreTransactionStart;
+    XENBUS_STORE_TRANSACTION_END    StoreTransactionEnd;
+    XENBUS_STORE_WATCH_ADD          StoreWatchAdd;
+    XENBUS_STORE_WATCH_REMOVE       StoreWatchRemove;
+    XENBUS_STORE_POLL               StorePoll;
+    XENBUS_STORE_READ_ASYNC         StoreReadAsync;
+    XENBUS_STORE_PRINTF_ASYNC       StorePrintfAsync;
+    XENBUS_STORE_SUBMIT_BATCH       StoreSubmitBatch;
+    XENBUS_STORE_WATCH_ADD_QUEUED   StoreWatchAddQueued;
+    XENBUS_STORE_WATCH_DEQUEUE      StoreWatchDequeue;
+    XENBUS_STORE_READ_BUFFER        StoreReadBuffer;
+    XENBUS_STORE_ENUMERATE_START    StoreEnumerateStart;
+    XENBUS_STORE_ENUMERATE_NEXT     StoreEnumerateNext;
+    XENBUS_STORE_ENUMERATE_END      StoreEnumerateEnd;
+    XENBUS_STORE_READ_TREE          StoreReadTree;
+    XENBUS_STORE_QUERY_LATENCY      StoreQueryLatency;
+    XENBUS_STORE_TRANSACTION_RUN    StoreTransactionRun;
+    XENBUS_STORE_WATCH_ADD_DEBOUNCED StoreWatchAddDebounced;
+    XENBUS_STORE_WATCH_SUPPRESSED   StoreWatchSuppressed;
+};
+
+typedef struct _XENBUS_STORE_INTERFACE_V11 XENBUS_STORE_INTERFACE, *PXENBUS_STORE_INTERFACE;
 
 /*! \def XENBUS_STORE
     \brief Macro at assist in method invocation
@@ -323,6 +1003,6 @@ typedef struct _XENBUS_STORE_INTERFACE_V2 XENBUS_STORE_INTERFACE, *PXENBUS_STORE
 #endif  // _WINDLL
 
 #define XENBUS_STORE_INTERFACE_VERSION_MIN  2
-#define XENBUS_STORE_INTERFACE_VERSION_MAX  2
+#define XENBUS_STORE_INTERFACE_VERSION_MAX  11
 
 #endif  // _XENBUS_STORE_INTERFACE_H
@@ -180,9 +180,10 @@ __FreePoolWithTag(
 }
 
 static FORCEINLINE PMDL
-__AllocatePages(
+__AllocateNodePages(
     _In_ ULONG          Count,
-    _In_ BOOLEAN        Contiguous
+    _In_ BOOLEAN        Contiguous,
+    _In_ ULONG          Node
     )
 {
     PHYSICAL_ADDRESS    LowAddress;
@@ -206,12 +207,21 @@ __AllocatePages(
         Flags = MM_ALLOCATE_FULLY_REQUIRED;
     }
 
-    Mdl = MmAllocatePagesForMdlEx(LowAddress,
-                                  HighAddress,
-                                  SkipBytes,
-                                  TotalBytes,
-                                  MmCached,
-                                  Flags);
+    if (Node == MM_ANY_NODE_OK)
+        Mdl = MmAllocatePagesForMdlEx(LowAddress,
+                                      HighAddress,
+                                      SkipBytes,
+                                      TotalBytes,
+                                      MmCached,
+                                      Flags);
+    else
+        Mdl = MmAllocateNodePagesForMdlEx(LowAddress,
+                                          HighAddress,
+                                          SkipBytes,
+                                          TotalBytes,
+                                          MmCached,
+                                          Node,
+                                          Flags);
 
     status = STATUS_NO_MEMORY;
     if (Mdl == NULL)
@@ -255,6 +265,9 @@ fail1:
     return NULL;
 }
 
+#define __AllocatePages(_Count, _Contiguous) \
+        __AllocateNodePages((_Count), (_Contiguous), MM_ANY_NODE_OK)
+
 #define __AllocatePage()    __AllocatePages(1, FALSE)
 
 static FORCEINLINE VOID
@@ -0,0 +1,71 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _COMMON_DBG_PRINT_H
+#define _COMMON_DBG_PRINT_H
+
+// Stands in for src/common/dbg_print.h, which relies on MSVC treating
+// __FUNCTION__ as a string literal that can be concatenated.
+
+#include <ntddk.h>
+#include <stdarg.h>
+
+#define stringify_literal(_text) #_text
+#define stringify(_text) stringify_literal(_text)
+#define __MODULE__ stringify(PROJECT)
+
+extern VOID
+__DbgPrint(
+    _In_ ULONG      Level,
+    _In_ PCSTR      Module,
+    _In_ PCSTR      Function,
+    _In_ PCSTR      Format,
+    ...
+    );
+
+#define Error(...)  \
+        __DbgPrint(DPFLTR_ERROR_LEVEL, __MODULE__, __func__, __VA_ARGS__)
+
+#define Warning(...)  \
+        __DbgPrint(DPFLTR_WARNING_LEVEL, __MODULE__, __func__, __VA_ARGS__)
+
+#if DBG
+#define Trace(...)  \
+        __DbgPrint(DPFLTR_TRACE_LEVEL, __MODULE__, __func__, __VA_ARGS__)
+#else   // DBG
+#define Trace(...)  (VOID)(__VA_ARGS__)
+#endif  // DBG
+
+#define Info(...)  \
+        __DbgPrint(DPFLTR_INFO_LEVEL, __MODULE__, __func__, __VA_ARGS__)
+
+#endif  // _COMMON_DBG_PRINT_H
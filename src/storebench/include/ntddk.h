@@ -0,0 +1,849 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+// Just enough of the WDK for src/xenbus/store.c to build as a Linux
+// user-mode object. The kernel primitives are implemented in wdk.c.
+
+#ifndef _STOREBENCH_NTDDK_H
+#define _STOREBENCH_NTDDK_H
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+// src/common/util.h has its own __strtok_r()
+#define __strtok_r  __glibc_strtok_r
+#include <string.h>
+#undef  __strtok_r
+
+// SAL annotations
+
+#define _In_
+#define _In_opt_
+#define _In_opt_z_
+#define _In_z_
+#define _In_range_(...)
+#define _In_reads_(...)
+#define _In_reads_bytes_(...)
+#define _In_reads_bytes_opt_(...)
+#define _Inout_
+#define _Inout_opt_
+#define _Inout_updates_(...)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(...)
+#define _Out_writes_bytes_(...)
+#define _Out_writes_to_(...)
+#define _Out_writes_z_(...)
+#define _Outptr_
+#define _Outptr_opt_
+#define _Outptr_result_z_
+#define _Outptr_result_maybenull_
+#define _Outptr_result_maybenull_z_
+#define _At_(...)
+#define _When_(...)
+#define _Check_return_
+#define _Must_inspect_result_
+#define _Function_class_(...)
+#define _IRQL_requires_(...)
+#define _IRQL_requires_max_(...)
+#define _IRQL_requires_min_(...)
+#define _IRQL_requires_same_
+#define _IRQL_raises_(...)
+#define _IRQL_saves_
+#define _IRQL_restores_
+#define _Analysis_assume_(...)
+#define _Acquires_lock_(...)
+#define _Releases_lock_(...)
+#define _Requires_lock_held_(...)
+#define _Use_decl_annotations_
+#define _Post_satisfies_(...)
+#define _Success_(...)
+#define __in
+#define __inout
+#define __out
+#define __out_opt
+#define __in_opt
+
+// Calling conventions and storage classes
+
+#define NTAPI
+#define __stdcall
+#define __cdecl
+#define __fastcall
+#define __inline            inline
+#define FORCEINLINE         __inline__
+#define DECLSPEC_NOINLINE   __attribute__((noinline))
+#define DECLSPEC_ALIGN(_x)  __attribute__((aligned(_x)))
+#define __declspec(_x)
+#define __forceinline       inline __attribute__((always_inline))
+
+#define UNREFERENCED_PARAMETER(_p)  ((void)(_p))
+
+#define __annotation(...)   ((void)0)
+
+// Basic types, sized as on 64-bit Windows (LLP64)
+
+#define VOID    void
+
+typedef void            *PVOID, **PPVOID;
+typedef const void      *PCVOID;
+typedef char            CHAR, *PCHAR, *PSTR, *LPSTR;
+typedef const char      *PCSTR, *LPCSTR, *PCCHAR;
+typedef unsigned char   UCHAR, *PUCHAR, BYTE, *PBYTE;
+typedef short           SHORT, *PSHORT, CSHORT;
+typedef unsigned short  USHORT, *PUSHORT, WCHAR, *PWCHAR, *PWSTR;
+typedef const unsigned short *PCWSTR;
+typedef int             LONG, *PLONG, INT, NTSTATUS, *PNTSTATUS;
+typedef unsigned int    ULONG, *PULONG, DWORD, UINT, *PUINT;
+typedef long            LONG64, *PLONG64, LONGLONG, *PLONGLONG, LONG_PTR, INT_PTR;
+typedef unsigned long   ULONG64, *PULONG64, ULONGLONG, *PULONGLONG,
+                        ULONG_PTR, *PULONG_PTR, UINT_PTR, SIZE_T, *PSIZE_T,
+                        KAFFINITY, PFN_NUMBER, *PPFN_NUMBER, DWORD64;
+typedef unsigned char   BOOLEAN, *PBOOLEAN;
+typedef int             BOOL;
+typedef void            *HANDLE, **PHANDLE;
+typedef UCHAR           KIRQL, *PKIRQL;
+typedef CHAR            KPROCESSOR_MODE;
+typedef LONG            KPRIORITY;
+typedef ULONG           ACCESS_MASK;
+
+#define TRUE    1
+#define FALSE   0
+
+#define MAXULONG    0xffffffffu
+#define MAXUSHORT   0xffffu
+#define MAXUCHAR    0xffu
+#define MAXLONG     0x7fffffff
+#define MAXULONG64  (~(ULONG64)0)
+#define MAXLONGLONG 0x7fffffffffffffffll
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG   LowPart;
+        LONG    HighPart;
+    };
+    LONGLONG    QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER, PHYSICAL_ADDRESS, *PPHYSICAL_ADDRESS;
+
+typedef union _ULARGE_INTEGER {
+    struct {
+        ULONG   LowPart;
+        ULONG   HighPart;
+    };
+    ULONGLONG   QuadPart;
+} ULARGE_INTEGER, *PULARGE_INTEGER;
+
+typedef struct _GUID {
+    ULONG   Data1;
+    USHORT  Data2;
+    USHORT  Data3;
+    UCHAR   Data4[8];
+} GUID, *PGUID;
+
+typedef const GUID *LPCGUID;
+
+typedef struct _UNICODE_STRING {
+    USHORT  Length;
+    USHORT  MaximumLength;
+    PWSTR   Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef struct _ANSI_STRING {
+    USHORT  Length;
+    USHORT  MaximumLength;
+    PSTR    Buffer;
+} ANSI_STRING, *PANSI_STRING;
+
+#define FIELD_OFFSET(_type, _field) offsetof(_type, _field)
+#define RTL_FIELD_SIZE(_type, _field) (sizeof (((_type *)0)->_field))
+#define ARRAYSIZE(_a)   (sizeof (_a) / sizeof ((_a)[0]))
+#define RTL_NUMBER_OF(_a)   ARRAYSIZE(_a)
+
+#define CONTAINING_RECORD(_address, _type, _field) \
+        ((_type *)((PUCHAR)(_address) - offsetof(_type, _field)))
+
+#define C_ASSERT(_e) _Static_assert((_e), #_e)
+
+#define min(_a, _b) (((_a) < (_b)) ? (_a) : (_b))
+#define max(_a, _b) (((_a) > (_b)) ? (_a) : (_b))
+#define __min(_a, _b)   min((_a), (_b))
+#define __max(_a, _b)   max((_a), (_b))
+
+#define _strtoui64  strtoull
+
+extern PWSTR
+wcschr(
+    PCWSTR  String,
+    WCHAR   Character
+    );
+
+// Status codes
+
+#define NT_SUCCESS(_status) (((NTSTATUS)(_status)) >= 0)
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000)
+#define STATUS_WAIT_0                   ((NTSTATUS)0x00000000)
+#define STATUS_ALERTED                  ((NTSTATUS)0x00000101)
+#define STATUS_TIMEOUT                  ((NTSTATUS)0x00000102)
+#define STATUS_PENDING                  ((NTSTATUS)0x00000103)
+#define STATUS_MORE_ENTRIES             ((NTSTATUS)0x00000105)
+#define STATUS_BUFFER_OVERFLOW          ((NTSTATUS)0x80000005)
+#define STATUS_NO_MORE_ENTRIES          ((NTSTATUS)0x8000001A)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000D)
+#define STATUS_NO_MEMORY                ((NTSTATUS)0xC0000017)
+#define STATUS_ACCESS_DENIED            ((NTSTATUS)0xC0000022)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023)
+#define STATUS_OBJECT_NAME_INVALID      ((NTSTATUS)0xC0000033)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS)0xC0000034)
+#define STATUS_OBJECT_NAME_COLLISION    ((NTSTATUS)0xC0000035)
+#define STATUS_OBJECT_PATH_NOT_FOUND    ((NTSTATUS)0xC000003A)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009A)
+#define STATUS_FILE_IS_A_DIRECTORY      ((NTSTATUS)0xC00000BA)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BB)
+#define STATUS_INTERNAL_ERROR           ((NTSTATUS)0xC00000E5)
+#define STATUS_INVALID_PARAMETER_1      ((NTSTATUS)0xC00000EF)
+#define STATUS_DIRECTORY_NOT_EMPTY      ((NTSTATUS)0xC0000101)
+#define STATUS_NOT_A_DIRECTORY          ((NTSTATUS)0xC0000103)
+#define STATUS_CANCELLED                ((NTSTATUS)0xC0000120)
+#define STATUS_INVALID_DEVICE_REQUEST   ((NTSTATUS)0xC0000010)
+#define STATUS_INVALID_BUFFER_SIZE      ((NTSTATUS)0xC0000206)
+#define STATUS_NOT_FOUND                ((NTSTATUS)0xC0000225)
+#define STATUS_RETRY                    ((NTSTATUS)0xC000022D)
+#define STATUS_CONNECTION_REFUSED       ((NTSTATUS)0xC0000236)
+#define STATUS_TOO_MANY_LINKS           ((NTSTATUS)0xC0000265)
+#define STATUS_DEVICE_NOT_READY         ((NTSTATUS)0xC00000A3)
+#define STATUS_IO_DEVICE_ERROR          ((NTSTATUS)0xC0000185)
+#define STATUS_INTEGER_OVERFLOW         ((NTSTATUS)0xC0000095)
+#define STATUS_QUOTA_EXCEEDED           ((NTSTATUS)0xC0000044)
+#define STATUS_NO_SUCH_FILE             ((NTSTATUS)0xC000000F)
+#define STATUS_FILE_TOO_LARGE           ((NTSTATUS)0xC0000904)
+#define STATUS_DISK_FULL                ((NTSTATUS)0xC000007F)
+#define STATUS_NO_SUCH_DEVICE           ((NTSTATUS)0xC000000E)
+#define STATUS_SHARING_VIOLATION        ((NTSTATUS)0xC0000043)
+#define STATUS_INVALID_ADDRESS          ((NTSTATUS)0xC0000141)
+#define STATUS_ILLEGAL_FUNCTION         ((NTSTATUS)0xC00000AF)
+#define STATUS_NOT_SAME_DEVICE          ((NTSTATUS)0xC00000D4)
+#define STATUS_NAME_TOO_LONG            ((NTSTATUS)0xC0000106)
+#define STATUS_NOT_EMPTY                STATUS_DIRECTORY_NOT_EMPTY
+#define STATUS_OBJECT_TYPE_MISMATCH     ((NTSTATUS)0xC0000024)
+#define STATUS_CONNECTION_RESET         ((NTSTATUS)0xC000020D)
+#define STATUS_DEVICE_BUSY              ((NTSTATUS)0x80000011)
+#define STATUS_INVALID_SYSTEM_SERVICE   ((NTSTATUS)0xC000001C)
+#define STATUS_RANGE_NOT_FOUND          ((NTSTATUS)0xC000028C)
+#define STATUS_NOT_A_REPARSE_POINT      ((NTSTATUS)0xC0000275)
+#define STATUS_OBJECTID_EXISTS          ((NTSTATUS)0xC000022B)
+#define STATUS_UNEXPECTED_IO_ERROR      ((NTSTATUS)0xC00000E9)
+#define STATUS_MEDIA_WRITE_PROTECTED    ((NTSTATUS)0xC00000A2)
+#define STATUS_PIPE_BUSY                ((NTSTATUS)0xC00000AE)
+#define STATUS_PIPE_CONNECTED           ((NTSTATUS)0xC00000B2)
+
+// IRQLs
+
+#define PASSIVE_LEVEL   0
+#define APC_LEVEL       1
+#define DISPATCH_LEVEL  2
+#define HIGH_LEVEL      15
+
+// Doubly linked lists
+
+typedef struct _LIST_ENTRY {
+    struct _LIST_ENTRY  *Flink;
+    struct _LIST_ENTRY  *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+static inline VOID
+InitializeListHead(
+    PLIST_ENTRY ListHead
+    )
+{
+    ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+static inline BOOLEAN
+IsListEmpty(
+    const LIST_ENTRY    *ListHead
+    )
+{
+    return (BOOLEAN)(ListHead->Flink == ListHead);
+}
+
+static inline BOOLEAN
+RemoveEntryList(
+    PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY Flink = Entry->Flink;
+    PLIST_ENTRY Blink = Entry->Blink;
+
+    Blink->Flink = Flink;
+    Flink->Blink = Blink;
+    return (BOOLEAN)(Flink == Blink);
+}
+
+static inline PLIST_ENTRY
+RemoveHeadList(
+    PLIST_ENTRY ListHead
+    )
+{
+    PLIST_ENTRY Entry = ListHead->Flink;
+
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+static inline PLIST_ENTRY
+RemoveTailList(
+    PLIST_ENTRY ListHead
+    )
+{
+    PLIST_ENTRY Entry = ListHead->Blink;
+
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+static inline VOID
+InsertTailList(
+    PLIST_ENTRY ListHead,
+    PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY Blink = ListHead->Blink;
+
+    Entry->Flink = ListHead;
+    Entry->Blink = Blink;
+    Blink->Flink = Entry;
+    ListHead->Blink = Entry;
+}
+
+static inline VOID
+InsertHeadList(
+    PLIST_ENTRY ListHead,
+    PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY Flink = ListHead->Flink;
+
+    Entry->Flink = Flink;
+    Entry->Blink = ListHead;
+    Flink->Blink = Entry;
+    ListHead->Flink = Entry;
+}
+
+// Memory
+
+#define PAGE_SHIFT  12
+#define PAGE_SIZE   (1ul << PAGE_SHIFT)
+
+#define PAGE_ALIGN(_va) ((PVOID)((ULONG_PTR)(_va) & ~(PAGE_SIZE - 1)))
+#define BYTE_OFFSET(_va) ((ULONG)((ULONG_PTR)(_va) & (PAGE_SIZE - 1)))
+#define ROUND_TO_PAGES(_size) \
+        (((ULONG_PTR)(_size) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#define RtlZeroMemory(_d, _l)       memset((_d), 0, (_l))
+#define RtlFillMemory(_d, _l, _f)   memset((_d), (_f), (_l))
+#define RtlCopyMemory(_d, _s, _l)   memcpy((_d), (_s), (_l))
+#define RtlMoveMemory(_d, _s, _l)   memmove((_d), (_s), (_l))
+#define RtlEqualMemory(_d, _s, _l)  (!memcmp((_d), (_s), (_l)))
+
+typedef enum _POOL_TYPE {
+    NonPagedPool,
+    PagedPool,
+    NonPagedPoolNx = 512
+} POOL_TYPE;
+
+typedef enum _MEMORY_CACHING_TYPE {
+    MmNonCached,
+    MmCached,
+    MmWriteCombined
+} MEMORY_CACHING_TYPE;
+
+typedef enum _MM_PAGE_PRIORITY {
+    LowPagePriority,
+    NormalPagePriority = 16,
+    HighPagePriority = 32
+} MM_PAGE_PRIORITY;
+
+typedef struct _MDL {
+    struct _MDL *Next;
+    CSHORT      Size;
+    CSHORT      MdlFlags;
+    PVOID       Process;
+    PVOID       MappedSystemVa;
+    PVOID       StartVa;
+    ULONG       ByteCount;
+    ULONG       ByteOffset;
+} MDL, *PMDL;
+
+#define MDL_MAPPED_TO_SYSTEM_VA     0x0001
+#define MDL_SOURCE_IS_NONPAGED_POOL 0x0004
+#define MDL_PARTIAL                 0x0010
+#define MDL_PARTIAL_HAS_BEEN_MAPPED 0x0020
+#define MDL_IO_SPACE                0x0800
+#define MDL_PARENT_MAPPED_SYSTEM_VA 0x0100
+
+#define MM_ALLOCATE_FULLY_REQUIRED              0x00000004
+#define MM_ALLOCATE_REQUIRE_CONTIGUOUS_CHUNKS   0x00000020
+#define MM_ANY_NODE_OK                          0x80000000
+
+#define KernelMode  0
+#define UserMode    1
+
+extern PVOID
+ExAllocatePoolWithTag(
+    POOL_TYPE   PoolType,
+    SIZE_T      NumberOfBytes,
+    ULONG       Tag
+    );
+
+#define ExAllocatePoolUninitialized ExAllocatePoolWithTag
+
+extern VOID
+ExFreePoolWithTag(
+    PVOID   Buffer,
+    ULONG   Tag
+    );
+
+#define ExFreePool(_b)  ExFreePoolWithTag((_b), 0)
+
+extern PMDL
+MmAllocatePagesForMdlEx(
+    PHYSICAL_ADDRESS    LowAddress,
+    PHYSICAL_ADDRESS    HighAddress,
+    PHYSICAL_ADDRESS    SkipBytes,
+    SIZE_T              TotalBytes,
+    MEMORY_CACHING_TYPE CacheType,
+    ULONG               Flags
+    );
+
+extern PMDL
+MmAllocateNodePagesForMdlEx(
+    PHYSICAL_ADDRESS    LowAddress,
+    PHYSICAL_ADDRESS    HighAddress,
+    PHYSICAL_ADDRESS    SkipBytes,
+    SIZE_T              TotalBytes,
+    MEMORY_CACHING_TYPE CacheType,
+    ULONG               IdealNode,
+    ULONG               Flags
+    );
+
+extern PVOID
+MmMapLockedPagesSpecifyCache(
+    PMDL                Mdl,
+    KPROCESSOR_MODE     AccessMode,
+    MEMORY_CACHING_TYPE CacheType,
+    PVOID               RequestedAddress,
+    ULONG               BugCheckOnFailure,
+    ULONG               Priority
+    );
+
+extern VOID
+MmUnmapLockedPages(
+    PVOID   BaseAddress,
+    PMDL    Mdl
+    );
+
+extern VOID
+MmFreePagesFromMdl(
+    PMDL    Mdl
+    );
+
+extern PVOID
+MmMapIoSpace(
+    PHYSICAL_ADDRESS    PhysicalAddress,
+    SIZE_T              NumberOfBytes,
+    MEMORY_CACHING_TYPE CacheType
+    );
+
+extern VOID
+MmUnmapIoSpace(
+    PVOID   BaseAddress,
+    SIZE_T  NumberOfBytes
+    );
+
+// Interlocked operations and barriers
+
+#define KeMemoryBarrier()               __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define KeMemoryBarrierWithoutFence()   __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define _ReadWriteBarrier()             __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define MemoryBarrier()                 KeMemoryBarrier()
+
+#define InterlockedIncrement(_p)    __atomic_add_fetch((_p), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(_p)    __atomic_sub_fetch((_p), 1, __ATOMIC_SEQ_CST)
+#define InterlockedIncrement64      InterlockedIncrement
+#define InterlockedDecrement64      InterlockedDecrement
+#define InterlockedAdd(_p, _v)      __atomic_add_fetch((_p), (_v), __ATOMIC_SEQ_CST)
+#define InterlockedAdd64            InterlockedAdd
+#define InterlockedExchangeAdd(_p, _v) \
+        __atomic_fetch_add((_p), (_v), __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd64    InterlockedExchangeAdd
+#define InterlockedExchange(_p, _v) __atomic_exchange_n((_p), (_v), __ATOMIC_SEQ_CST)
+#define InterlockedExchange64       InterlockedExchange
+#define InterlockedExchangePointer  InterlockedExchange
+#define InterlockedOr(_p, _v)       __atomic_fetch_or((_p), (_v), __ATOMIC_SEQ_CST)
+#define InterlockedAnd(_p, _v)      __atomic_fetch_and((_p), (_v), __ATOMIC_SEQ_CST)
+#define InterlockedCompareExchange(_p, _new, _old) \
+        __sync_val_compare_and_swap((_p), (_old), (_new))
+#define InterlockedCompareExchange64        InterlockedCompareExchange
+#define InterlockedCompareExchangePointer   InterlockedCompareExchange
+
+#define ReadNoFence(_p)             __atomic_load_n((_p), __ATOMIC_RELAXED)
+#define ReadULongNoFence            ReadNoFence
+#define ReadULong64NoFence          ReadNoFence
+#define ReadPointerNoFence          ReadNoFence
+#define ReadAcquire(_p)             __atomic_load_n((_p), __ATOMIC_ACQUIRE)
+#define WriteNoFence(_p, _v)        __atomic_store_n((_p), (_v), __ATOMIC_RELAXED)
+#define WriteULongNoFence           WriteNoFence
+#define WriteULong64NoFence         WriteNoFence
+#define WritePointerNoFence         WriteNoFence
+#define WriteRelease(_p, _v)        __atomic_store_n((_p), (_v), __ATOMIC_RELEASE)
+
+#define YieldProcessor()            __builtin_ia32_pause()
+
+// Dispatcher objects, spin locks, DPCs and timers
+
+typedef ULONG_PTR   KSPIN_LOCK, *PKSPIN_LOCK;
+
+typedef struct _KLOCK_QUEUE_HANDLE {
+    PKSPIN_LOCK Lock;
+    KIRQL       OldIrql;
+} KLOCK_QUEUE_HANDLE, *PKLOCK_QUEUE_HANDLE;
+
+typedef enum _EVENT_TYPE {
+    NotificationEvent,
+    SynchronizationEvent
+} EVENT_TYPE;
+
+typedef enum _KWAIT_REASON {
+    Executive,
+    UserRequest = 6
+} KWAIT_REASON;
+
+typedef enum _KDPC_IMPORTANCE {
+    LowImportance,
+    MediumImportance,
+    HighImportance
+} KDPC_IMPORTANCE;
+
+// Waiters all share one condition variable in wdk.c
+typedef struct _KEVENT {
+    LONG    Type;
+    LONG    Signalled;
+} KEVENT, *PKEVENT, *PRKEVENT;
+
+typedef struct _KDPC    KDPC, *PKDPC, *PRKDPC;
+
+typedef VOID
+(KDEFERRED_ROUTINE)(
+    PKDPC   Dpc,
+    PVOID   DeferredContext,
+    PVOID   SystemArgument1,
+    PVOID   SystemArgument2
+    );
+
+typedef KDEFERRED_ROUTINE *PKDEFERRED_ROUTINE;
+
+struct _KDPC {
+    LIST_ENTRY          ListEntry;
+    PKDEFERRED_ROUTINE  DeferredRoutine;
+    PVOID               DeferredContext;
+    PVOID               SystemArgument1;
+    PVOID               SystemArgument2;
+    LONG                Inserted;
+};
+
+typedef struct _KTIMER {
+    LIST_ENTRY  ListEntry;
+    PKDPC       Dpc;
+    LONGLONG    DueTime;
+    BOOLEAN     Inserted;
+} KTIMER, *PKTIMER;
+
+typedef struct _KINTERRUPT  KINTERRUPT, *PKINTERRUPT;
+
+typedef BOOLEAN
+(KSERVICE_ROUTINE)(
+    PKINTERRUPT Interrupt,
+    PVOID       ServiceContext
+    );
+
+typedef KSERVICE_ROUTINE *PKSERVICE_ROUTINE;
+
+typedef enum _KINTERRUPT_MODE {
+    LevelSensitive,
+    Latched
+} KINTERRUPT_MODE;
+
+typedef struct _PROCESSOR_NUMBER {
+    USHORT  Group;
+    UCHAR   Number;
+    UCHAR   Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+#define ALL_PROCESSOR_GROUPS    0xffff
+
+extern KIRQL
+KeGetCurrentIrql(
+    VOID
+    );
+
+extern VOID
+KeRaiseIrql(
+    KIRQL   NewIrql,
+    PKIRQL  OldIrql
+    );
+
+extern VOID
+KeLowerIrql(
+    KIRQL   NewIrql
+    );
+
+extern VOID
+KeInitializeSpinLock(
+    PKSPIN_LOCK Lock
+    );
+
+extern VOID
+KeAcquireSpinLock(
+    PKSPIN_LOCK Lock,
+    PKIRQL      OldIrql
+    );
+
+extern VOID
+KeReleaseSpinLock(
+    PKSPIN_LOCK Lock,
+    KIRQL       NewIrql
+    );
+
+extern VOID
+KeAcquireSpinLockAtDpcLevel(
+    PKSPIN_LOCK Lock
+    );
+
+extern VOID
+KeReleaseSpinLockFromDpcLevel(
+    PKSPIN_LOCK Lock
+    );
+
+extern VOID
+KeInitializeEvent(
+    PRKEVENT    Event,
+    EVENT_TYPE  Type,
+    BOOLEAN     State
+    );
+
+extern LONG
+KeSetEvent(
+    PRKEVENT    Event,
+    KPRIORITY   Increment,
+    BOOLEAN     Wait
+    );
+
+extern VOID
+KeClearEvent(
+    PRKEVENT    Event
+    );
+
+extern NTSTATUS
+KeWaitForSingleObject(
+    PVOID           Object,
+    KWAIT_REASON    WaitReason,
+    KPROCESSOR_MODE WaitMode,
+    BOOLEAN         Alertable,
+    PLARGE_INTEGER  Timeout
+    );
+
+extern NTSTATUS
+KeDelayExecutionThread(
+    KPROCESSOR_MODE WaitMode,
+    BOOLEAN         Alertable,
+    PLARGE_INTEGER  Interval
+    );
+
+extern VOID
+KeInitializeDpc(
+    PRKDPC              Dpc,
+    PKDEFERRED_ROUTINE  DeferredRoutine,
+    PVOID               DeferredContext
+    );
+
+extern BOOLEAN
+KeInsertQueueDpc(
+    PRKDPC  Dpc,
+    PVOID   SystemArgument1,
+    PVOID   SystemArgument2
+    );
+
+extern VOID
+KeFlushQueuedDpcs(
+    VOID
+    );
+
+extern VOID
+KeInitializeTimer(
+    PKTIMER Timer
+    );
+
+extern BOOLEAN
+KeSetTimer(
+    PKTIMER         Timer,
+    LARGE_INTEGER   DueTime,
+    PKDPC           Dpc
+    );
+
+extern BOOLEAN
+KeCancelTimer(
+    PKTIMER Timer
+    );
+
+extern VOID
+KeQuerySystemTime(
+    PLARGE_INTEGER  CurrentTime
+    );
+
+extern LARGE_INTEGER
+KeQueryPerformanceCounter(
+    PLARGE_INTEGER  PerformanceFrequency
+    );
+
+extern VOID
+KeBugCheckEx(
+    ULONG       BugCheckCode,
+    ULONG_PTR   BugCheckParameter1,
+    ULONG_PTR   BugCheckParameter2,
+    ULONG_PTR   BugCheckParameter3,
+    ULONG_PTR   BugCheckParameter4
+    );
+
+extern VOID
+DbgRaiseAssertionFailure(
+    VOID
+    );
+
+// Debug output
+
+#define DPFLTR_IHVDRIVER_ID     77
+#define DPFLTR_ERROR_LEVEL      0
+#define DPFLTR_WARNING_LEVEL    1
+#define DPFLTR_TRACE_LEVEL      2
+#define DPFLTR_INFO_LEVEL       3
+
+extern ULONG
+vDbgPrintExWithPrefix(
+    PCSTR   Prefix,
+    ULONG   ComponentId,
+    ULONG   Level,
+    PCSTR   Format,
+    va_list Arguments
+    );
+
+extern NTSTATUS
+DbgSetDebugFilterState(
+    ULONG   ComponentId,
+    ULONG   Level,
+    BOOLEAN State
+    );
+
+// Run-time library
+
+extern USHORT
+RtlCaptureStackBackTrace(
+    ULONG   FramesToSkip,
+    ULONG   FramesToCapture,
+    PVOID   *BackTrace,
+    PULONG  BackTraceHash
+    );
+
+// Objects the surrounding headers refer to by pointer only
+
+typedef struct _DRIVER_OBJECT   DRIVER_OBJECT, *PDRIVER_OBJECT;
+typedef struct _DEVICE_OBJECT   DEVICE_OBJECT, *PDEVICE_OBJECT;
+typedef struct _IRP             IRP, *PIRP;
+typedef struct _DMA_ADAPTER     DMA_ADAPTER, *PDMA_ADAPTER;
+typedef struct _DEVICE_DESCRIPTION DEVICE_DESCRIPTION, *PDEVICE_DESCRIPTION;
+typedef struct _KTHREAD         KTHREAD, *PKTHREAD;
+typedef struct _ETHREAD         ETHREAD, *PETHREAD;
+typedef struct _KAPC            KAPC, *PKAPC;
+
+typedef enum _DEVICE_POWER_STATE {
+    PowerDeviceUnspecified = 0,
+    PowerDeviceD0,
+    PowerDeviceD1,
+    PowerDeviceD2,
+    PowerDeviceD3,
+    PowerDeviceMaximum
+} DEVICE_POWER_STATE, *PDEVICE_POWER_STATE;
+
+typedef enum _SYSTEM_POWER_STATE {
+    PowerSystemUnspecified = 0,
+    PowerSystemWorking,
+    PowerSystemSleeping1,
+    PowerSystemSleeping2,
+    PowerSystemSleeping3,
+    PowerSystemHibernate,
+    PowerSystemShutdown,
+    PowerSystemMaximum
+} SYSTEM_POWER_STATE, *PSYSTEM_POWER_STATE;
+
+typedef enum _INTERFACE_TYPE {
+    InterfaceTypeUndefined = -1,
+    Internal,
+    Isa,
+    PCIBus = 5
+} INTERFACE_TYPE;
+
+typedef VOID
+(*PINTERFACE_REFERENCE)(
+    PVOID   Context
+    );
+
+typedef VOID
+(*PINTERFACE_DEREFERENCE)(
+    PVOID   Context
+    );
+
+typedef struct _INTERFACE {
+    USHORT                  Size;
+    USHORT                  Version;
+    PVOID                   Context;
+    PINTERFACE_REFERENCE    InterfaceReference;
+    PINTERFACE_DEREFERENCE  InterfaceDereference;
+} INTERFACE, *PINTERFACE;
+
+#define DEFINE_GUID(_name, _l, _w1, _w2, _b1, _b2, _b3, _b4, _b5, _b6, _b7, _b8) \
+        static const GUID _name __attribute__((unused)) = \
+        { _l, _w1, _w2, { _b1, _b2, _b3, _b4, _b5, _b6, _b7, _b8 } }
+
+#endif  // _STOREBENCH_NTDDK_H
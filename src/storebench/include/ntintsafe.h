@@ -0,0 +1,98 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STOREBENCH_NTINTSAFE_H
+#define _STOREBENCH_NTINTSAFE_H
+
+#include <ntddk.h>
+
+static inline NTSTATUS
+RtlULongAdd(
+    ULONG   Augend,
+    ULONG   Addend,
+    PULONG  Result
+    )
+{
+    if (__builtin_add_overflow(Augend, Addend, Result)) {
+        *Result = MAXULONG;
+        return STATUS_INTEGER_OVERFLOW;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static inline NTSTATUS
+RtlULongMult(
+    ULONG   Multiplicand,
+    ULONG   Multiplier,
+    PULONG  Result
+    )
+{
+    if (__builtin_mul_overflow(Multiplicand, Multiplier, Result)) {
+        *Result = MAXULONG;
+        return STATUS_INTEGER_OVERFLOW;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static inline NTSTATUS
+RtlSizeTAdd(
+    SIZE_T  Augend,
+    SIZE_T  Addend,
+    PSIZE_T Result
+    )
+{
+    if (__builtin_add_overflow(Augend, Addend, Result)) {
+        *Result = (SIZE_T)-1;
+        return STATUS_INTEGER_OVERFLOW;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static inline NTSTATUS
+RtlSizeTMult(
+    SIZE_T  Multiplicand,
+    SIZE_T  Multiplier,
+    PSIZE_T Result
+    )
+{
+    if (__builtin_mul_overflow(Multiplicand, Multiplier, Result)) {
+        *Result = (SIZE_T)-1;
+        return STATUS_INTEGER_OVERFLOW;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+#endif  // _STOREBENCH_NTINTSAFE_H
@@ -0,0 +1,74 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STOREBENCH_NTSTRSAFE_H
+#define _STOREBENCH_NTSTRSAFE_H
+
+#include <ntddk.h>
+
+#define NTSTRSAFE_MAX_CCH   2147483647
+
+extern NTSTATUS
+RtlStringCbVPrintfA(
+    PSTR    Destination,
+    SIZE_T  Size,
+    PCSTR   Format,
+    va_list Arguments
+    );
+
+extern NTSTATUS
+RtlStringCbPrintfA(
+    PSTR    Destination,
+    SIZE_T  Size,
+    PCSTR   Format,
+    ...
+    );
+
+extern NTSTATUS
+RtlStringCbPrintfExA(
+    PSTR    Destination,
+    SIZE_T  Size,
+    PSTR    *End,
+    PSIZE_T Remaining,
+    ULONG   Flags,
+    PCSTR   Format,
+    ...
+    );
+
+extern NTSTATUS
+RtlStringCbCopyA(
+    PSTR    Destination,
+    SIZE_T  Size,
+    PCSTR   Source
+    );
+
+#endif  // _STOREBENCH_NTSTRSAFE_H
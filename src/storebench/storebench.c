@@ -0,0 +1,804 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+// Benchmarks for the XENBUS STORE interface, built from the unmodified
+// src/xenbus/store.c and run against the mock xenstored.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ntddk.h>
+#include <xen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "store.h"
+#include "dbg_print.h"
+#include "assert.h"
+
+#include "storebench.h"
+
+#define MAXIMUM_THREADS     64
+#define MAXIMUM_SIZES       16
+#define PIPELINE_DEPTH      16
+#define BATCH_SIZE          16
+#define DIRECTORY_CHILDREN  64
+
+static XENBUS_STORE_INTERFACE   StoreInterface;
+
+static ULONG    Iterations = 10000;
+static ULONG    Threads = 1;
+static ULONG    Sizes[MAXIMUM_SIZES] = { 16, 128, 512, 1024, 2048, 4000 };
+static ULONG    NumberSizes = 6;
+
+typedef struct _BENCHMARK {
+    PCSTR       Name;
+    ULONG       Size;
+    ULONG       Operations;     // Per iteration
+    ULONGLONG   *Latency;       // One entry per iteration, in ns
+    ULONG       Count;
+    ULONGLONG   Elapsed;
+    XENSTORED_STATISTICS    Before;
+} BENCHMARK, *PBENCHMARK;
+
+static ULONGLONG
+Now(
+    VOID
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (ULONGLONG)Time.tv_sec * 1000000000ull + Time.tv_nsec;
+}
+
+static VOID
+Fail(
+    _In_ PCSTR      What,
+    _In_ NTSTATUS   status
+    )
+{
+    fprintf(stderr, "storebench: %s failed (%08x)\n", What, status);
+    exit(1);
+}
+
+static PSTR
+MakeValue(
+    _In_ ULONG  Size
+    )
+{
+    PSTR        Value;
+    ULONG       Index;
+
+    Value = malloc(Size + 1);
+    if (Value == NULL)
+        Fail("malloc", STATUS_NO_MEMORY);
+
+    for (Index = 0; Index < Size; Index++)
+        Value[Index] = 'a' + (Index % 26);
+
+    Value[Size] = '\0';
+    return Value;
+}
+
+static VOID
+BenchmarkStart(
+    _Out_ PBENCHMARK    Benchmark,
+    _In_ PCSTR          Name,
+    _In_ ULONG          Size,
+    _In_ ULONG          Operations,
+    _In_ ULONG          Count
+    )
+{
+    RtlZeroMemory(Benchmark, sizeof (BENCHMARK));
+
+    Benchmark->Name = Name;
+    Benchmark->Size = Size;
+    Benchmark->Operations = Operations;
+    Benchmark->Count = Count;
+
+    Benchmark->Latency = calloc(Count, sizeof (ULONGLONG));
+    if (Benchmark->Latency == NULL)
+        Fail("calloc", STATUS_NO_MEMORY);
+
+    XenstoredQueryStatistics(&Benchmark->Before);
+    Benchmark->Elapsed = Now();
+}
+
+static int
+CompareLatency(
+    const void  *First,
+    const void  *Second
+    )
+{
+    ULONGLONG   A = *(const ULONGLONG *)First;
+    ULONGLONG   B = *(const ULONGLONG *)Second;
+
+    return (A > B) - (A < B);
+}
+
+static double
+Percentile(
+    _In_ PBENCHMARK Benchmark,
+    _In_ double     Fraction
+    )
+{
+    ULONG           Index = (ULONG)(Fraction * (Benchmark->Count - 1) + 0.5);
+
+    return Benchmark->Latency[Index] / 1000.0;
+}
+
+static VOID
+BenchmarkEnd(
+    _In_ PBENCHMARK         Benchmark
+    )
+{
+    XENSTORED_STATISTICS    After;
+    ULONGLONG               Operations;
+    double                  Seconds;
+
+    Benchmark->Elapsed = Now() - Benchmark->Elapsed;
+    XenstoredQueryStatistics(&After);
+
+    qsort(Benchmark->Latency, Benchmark->Count, sizeof (ULONGLONG),
+          CompareLatency);
+
+    Operations = (ULONGLONG)Benchmark->Count * Benchmark->Operations;
+    Seconds = Benchmark->Elapsed / 1e9;
+
+    printf("%-12s %6u %10.0f %9.1f %9.1f %9.1f %9.1f %9.3f %9.3f %7llu\n",
+           Benchmark->Name,
+           Benchmark->Size,
+           Operations / Seconds,
+           Percentile(Benchmark, 0.5),
+           Percentile(Benchmark, 0.99),
+           Percentile(Benchmark, 0.999),
+           Benchmark->Latency[Benchmark->Count - 1] / 1000.0,
+           (double)(After.RequestWraps - Benchmark->Before.RequestWraps) /
+           Operations,
+           (double)(After.ResponseWraps - Benchmark->Before.ResponseWraps) /
+           Operations,
+           (unsigned long long)(After.ResponseStalls -
+                                Benchmark->Before.ResponseStalls));
+
+    free(Benchmark->Latency);
+}
+
+static VOID
+PrintHeader(
+    VOID
+    )
+{
+    printf("%-12s %6s %10s %9s %9s %9s %9s %9s %9s %7s\n",
+           "benchmark", "size", "ops/s",
+           "p50(us)", "p99(us)", "p99.9(us)", "max(us)",
+           "reqwrap", "rspwrap", "stalls");
+}
+
+// Values written with Printf are limited to this by StoreFormatValue()
+#define PRINTF_MAXIMUM_SIZE 1023
+
+// Values of any size can be written as a single operation batch
+static NTSTATUS
+Write(
+    _In_opt_ PSTR           Prefix,
+    _In_ PSTR               Node,
+    _In_ PSTR               Value
+    )
+{
+    XENBUS_STORE_OPERATION  Operation;
+
+    RtlZeroMemory(&Operation, sizeof (Operation));
+    Operation.Type = XENBUS_STORE_OPERATION_TYPE_WRITE;
+    Operation.Prefix = Prefix;
+    Operation.Node = Node;
+    Operation.Value = Value;
+
+    return XENBUS_STORE(SubmitBatch, &StoreInterface, NULL, &Operation, 1);
+}
+
+// Synchronous reads and writes, optionally from several threads at once
+
+typedef enum _WORKER_TYPE {
+    WORKER_TYPE_READ,
+    WORKER_TYPE_PRINTF,
+    WORKER_TYPE_WRITE
+} WORKER_TYPE;
+
+static PCSTR    WorkerName[] = { "read", "printf", "write" };
+
+typedef struct _WORKER {
+    pthread_t   Thread;
+    PBENCHMARK  Benchmark;
+    WORKER_TYPE Type;
+    ULONG       Index;
+    PSTR        Path;
+    PSTR        Value;
+} WORKER, *PWORKER;
+
+static PVOID
+WorkerFunction(
+    PVOID       Argument
+    )
+{
+    PWORKER     Worker = Argument;
+    PBENCHMARK  Benchmark = Worker->Benchmark;
+    ULONG       Iteration;
+
+    for (Iteration = Worker->Index;
+         Iteration < Benchmark->Count;
+         Iteration += Threads) {
+        ULONGLONG   Start;
+        PSTR        Value;
+        NTSTATUS    status;
+
+        Start = Now();
+
+        switch (Worker->Type) {
+        case WORKER_TYPE_READ:
+            status = XENBUS_STORE(Read, &StoreInterface, NULL, NULL,
+                                  Worker->Path, &Value);
+            if (!NT_SUCCESS(status))
+                Fail("Read", status);
+
+            if (strcmp(Value, Worker->Value) != 0)
+                Fail("Read (value mismatch)", STATUS_UNSUCCESSFUL);
+
+            XENBUS_STORE(Free, &StoreInterface, Value);
+            break;
+
+        case WORKER_TYPE_PRINTF:
+            status = XENBUS_STORE(Printf, &StoreInterface, NULL, NULL,
+                                  Worker->Path, "%s", Worker->Value);
+            if (!NT_SUCCESS(status))
+                Fail("Printf", status);
+            break;
+
+        case WORKER_TYPE_WRITE:
+            status = Write(NULL, Worker->Path, Worker->Value);
+            if (!NT_SUCCESS(status))
+                Fail("Write", status);
+            break;
+        }
+
+        Benchmark->Latency[Iteration] = Now() - Start;
+    }
+
+    return NULL;
+}
+
+static VOID
+RunWorkers(
+    _In_ WORKER_TYPE    Type,
+    _In_ ULONG          Size
+    )
+{
+    WORKER          Worker[MAXIMUM_THREADS];
+    BENCHMARK       Benchmark;
+    PSTR            Value;
+    ULONG           Index;
+    NTSTATUS        status;
+
+    Value = MakeValue(Size);
+
+    for (Index = 0; Index < Threads; Index++) {
+        Worker[Index].Benchmark = &Benchmark;
+        Worker[Index].Type = Type;
+        Worker[Index].Index = Index;
+        Worker[Index].Value = Value;
+
+        Worker[Index].Path = malloc(64);
+        if (Worker[Index].Path == NULL)
+            Fail("malloc", STATUS_NO_MEMORY);
+
+        (VOID) snprintf(Worker[Index].Path, 64, "bench/rw/%u/%u", Size, Index);
+
+        status = Write(NULL, Worker[Index].Path, Value);
+        if (!NT_SUCCESS(status))
+            Fail("Write", status);
+    }
+
+    BenchmarkStart(&Benchmark, WorkerName[Type], Size, 1, Iterations);
+
+    for (Index = 0; Index < Threads; Index++)
+        pthread_create(&Worker[Index].Thread, NULL, WorkerFunction, &Worker[Index]);
+
+    for (Index = 0; Index < Threads; Index++)
+        pthread_join(Worker[Index].Thread, NULL);
+
+    BenchmarkEnd(&Benchmark);
+
+    for (Index = 0; Index < Threads; Index++) {
+        (VOID) XENBUS_STORE(Remove, &StoreInterface, NULL, NULL,
+                            Worker[Index].Path);
+        free(Worker[Index].Path);
+    }
+
+    free(Value);
+}
+
+// Reads pipelined through ReadAsync, PIPELINE_DEPTH at a time
+
+typedef struct _PIPELINE {
+    KEVENT      Event;
+    LONG        Outstanding;
+    ULONG       Size;
+    ULONGLONG   Start;
+    ULONGLONG   *Latency;
+} PIPELINE, *PPIPELINE;
+
+static VOID
+PipelineCompletion(
+    _In_opt_ PVOID      Argument,
+    _In_ NTSTATUS       status,
+    _In_opt_z_ PSTR     Value
+    )
+{
+    PPIPELINE           Pipeline = Argument;
+    ULONGLONG           Latency = Now() - Pipeline->Start;
+
+    if (!NT_SUCCESS(status))
+        Fail("ReadAsync", status);
+
+    if (strlen(Value) != Pipeline->Size)
+        Fail("ReadAsync (value mismatch)", STATUS_UNSUCCESSFUL);
+
+    if (Latency > *Pipeline->Latency)
+        *Pipeline->Latency = Latency;
+
+    if (InterlockedDecrement(&Pipeline->Outstanding) == 0)
+        (VOID) KeSetEvent(&Pipeline->Event, 0, FALSE);
+}
+
+static VOID
+RunPipeline(
+    _In_ ULONG  Size
+    )
+{
+    BENCHMARK   Benchmark;
+    PIPELINE    Pipeline;
+    PSTR        Value;
+    ULONG       Iteration;
+    NTSTATUS    status;
+
+    Value = MakeValue(Size);
+
+    status = Write(NULL, "bench/async", Value);
+    if (!NT_SUCCESS(status))
+        Fail("Write", status);
+
+    KeInitializeEvent(&Pipeline.Event, SynchronizationEvent, FALSE);
+    Pipeline.Size = Size;
+
+    // Latency is recorded for the whole pipeline
+    BenchmarkStart(&Benchmark, "async", Size, PIPELINE_DEPTH,
+                   Iterations / PIPELINE_DEPTH);
+
+    for (Iteration = 0; Iteration < Benchmark.Count; Iteration++) {
+        ULONG   Index;
+
+        Pipeline.Outstanding = PIPELINE_DEPTH;
+        Pipeline.Latency = &Benchmark.Latency[Iteration];
+        Pipeline.Start = Now();
+
+        for (Index = 0; Index < PIPELINE_DEPTH; Index++) {
+            status = XENBUS_STORE(ReadAsync, &StoreInterface, NULL, NULL,
+                                  "bench/async", PipelineCompletion,
+                                  &Pipeline);
+            if (!NT_SUCCESS(status))
+                Fail("ReadAsync", status);
+        }
+
+        (VOID) KeWaitForSingleObject(&Pipeline.Event, Executive,
+                                     KernelMode, FALSE, NULL);
+    }
+
+    BenchmarkEnd(&Benchmark);
+
+    (VOID) XENBUS_STORE(Remove, &StoreInterface, NULL, NULL, "bench/async");
+    free(Value);
+}
+
+// BATCH_SIZE reads in a single SubmitBatch
+
+static VOID
+RunBatch(
+    _In_ ULONG              Size
+    )
+{
+    XENBUS_STORE_OPERATION  Operation[BATCH_SIZE];
+    CHAR                    Node[BATCH_SIZE][16];
+    BENCHMARK               Benchmark;
+    PSTR                    Value;
+    ULONG                   Iteration;
+    ULONG                   Index;
+    NTSTATUS                status;
+
+    Value = MakeValue(Size);
+
+    for (Index = 0; Index < BATCH_SIZE; Index++) {
+        (VOID) snprintf(Node[Index], sizeof (Node[Index]), "%u", Index);
+
+        status = Write("bench/batch", Node[Index], Value);
+        if (!NT_SUCCESS(status))
+            Fail("Write", status);
+    }
+
+    BenchmarkStart(&Benchmark, "batch", Size, BATCH_SIZE,
+                   Iterations / BATCH_SIZE);
+
+    for (Iteration = 0; Iteration < Benchmark.Count; Iteration++) {
+        ULONGLONG   Start;
+
+        RtlZeroMemory(Operation, sizeof (Operation));
+        for (Index = 0; Index < BATCH_SIZE; Index++) {
+            Operation[Index].Type = XENBUS_STORE_OPERATION_TYPE_READ;
+            Operation[Index].Prefix = "bench/batch";
+            Operation[Index].Node = Node[Index];
+        }
+
+        Start = Now();
+
+        status = XENBUS_STORE(SubmitBatch, &StoreInterface, NULL,
+                              Operation, BATCH_SIZE);
+        if (!NT_SUCCESS(status))
+            Fail("SubmitBatch", status);
+
+        Benchmark.Latency[Iteration] = Now() - Start;
+
+        for (Index = 0; Index < BATCH_SIZE; Index++) {
+            if (strcmp(Operation[Index].Value, Value) != 0)
+                Fail("SubmitBatch (value mismatch)", STATUS_UNSUCCESSFUL);
+
+            XENBUS_STORE(Free, &StoreInterface, Operation[Index].Value);
+        }
+    }
+
+    BenchmarkEnd(&Benchmark);
+
+    (VOID) XENBUS_STORE(Remove, &StoreInterface, NULL, NULL, "bench/batch");
+    free(Value);
+}
+
+// Directory of a key with DIRECTORY_CHILDREN children
+
+static VOID
+RunDirectory(
+    VOID
+    )
+{
+    BENCHMARK   Benchmark;
+    ULONG       Iteration;
+    ULONG       Index;
+    NTSTATUS    status;
+
+    for (Index = 0; Index < DIRECTORY_CHILDREN; Index++) {
+        CHAR    Node[32];
+
+        (VOID) snprintf(Node, sizeof (Node), "child%u", Index);
+
+        status = XENBUS_STORE(Printf, &StoreInterface, NULL, "bench/dir",
+                              Node, "%u", Index);
+        if (!NT_SUCCESS(status))
+            Fail("Printf", status);
+    }
+
+    BenchmarkStart(&Benchmark, "directory", DIRECTORY_CHILDREN, 1, Iterations);
+
+    for (Iteration = 0; Iteration < Benchmark.Count; Iteration++) {
+        ULONGLONG   Start;
+        PSTR        Names;
+        PSTR        Name;
+
+        Start = Now();
+
+        status = XENBUS_STORE(Directory, &StoreInterface, NULL, NULL,
+                              "bench/dir", &Names);
+        if (!NT_SUCCESS(status))
+            Fail("Directory", status);
+
+        Benchmark.Latency[Iteration] = Now() - Start;
+
+        Index = 0;
+        for (Name = Names; *Name != '\0'; Name += strlen(Name) + 1)
+            Index++;
+
+        if (Index != DIRECTORY_CHILDREN)
+            Fail("Directory (child count mismatch)", STATUS_UNSUCCESSFUL);
+
+        XENBUS_STORE(Free, &StoreInterface, Names);
+    }
+
+    BenchmarkEnd(&Benchmark);
+
+    (VOID) XENBUS_STORE(Remove, &StoreInterface, NULL, NULL, "bench/dir");
+}
+
+// Time from a write to the watch on it being signalled
+
+static VOID
+RunWatch(
+    VOID
+    )
+{
+    BENCHMARK           Benchmark;
+    KEVENT              Event;
+    PXENBUS_STORE_WATCH Watch;
+    ULONG               Iteration;
+    NTSTATUS            status;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+
+    status = XENBUS_STORE(WatchAdd, &StoreInterface, NULL, "bench/watch",
+                          &Event, &Watch);
+    if (!NT_SUCCESS(status))
+        Fail("WatchAdd", status);
+
+    // Swallow the event that fires when the watch is added
+    (VOID) KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+
+    BenchmarkStart(&Benchmark, "watch", 0, 1, Iterations);
+
+    for (Iteration = 0; Iteration < Benchmark.Count; Iteration++) {
+        ULONGLONG   Start;
+
+        KeClearEvent(&Event);
+
+        Start = Now();
+
+        status = XENBUS_STORE(Printf, &StoreInterface, NULL, "bench/watch",
+                              "key", "%u", Iteration);
+        if (!NT_SUCCESS(status))
+            Fail("Printf", status);
+
+        (VOID) KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE,
+                                     NULL);
+
+        Benchmark.Latency[Iteration] = Now() - Start;
+    }
+
+    BenchmarkEnd(&Benchmark);
+
+    (VOID) XENBUS_STORE(WatchRemove, &StoreInterface, Watch);
+    (VOID) XENBUS_STORE(Remove, &StoreInterface, NULL, NULL, "bench/watch");
+}
+
+// A read-modify-write of a counter using TransactionRun
+
+static NTSTATUS
+TransactionFunction(
+    _In_opt_ PVOID                  Argument,
+    _In_ PXENBUS_STORE_TRANSACTION  Transaction
+    )
+{
+    PSTR                            Value;
+    ULONG                           Counter;
+    NTSTATUS                        status;
+
+    UNREFERENCED_PARAMETER(Argument);
+
+    status = XENBUS_STORE(Read, &StoreInterface, Transaction, NULL,
+                          "bench/txn", &Value);
+    if (!NT_SUCCESS(status))
+        return status;
+
+    Counter = (ULONG)strtoul(Value, NULL, 10);
+    XENBUS_STORE(Free, &StoreInterface, Value);
+
+    return XENBUS_STORE(Printf, &StoreInterface, Transaction, NULL,
+                        "bench/txn", "%u", Counter + 1);
+}
+
+static VOID
+RunTransaction(
+    VOID
+    )
+{
+    BENCHMARK   Benchmark;
+    ULONG       Iteration;
+    NTSTATUS    status;
+
+    status = XENBUS_STORE(Printf, &StoreInterface, NULL, NULL,
+                          "bench/txn", "%u", 0);
+    if (!NT_SUCCESS(status))
+        Fail("Printf", status);
+
+    BenchmarkStart(&Benchmark, "transaction", 0, 1, Iterations);
+
+    for (Iteration = 0; Iteration < Benchmark.Count; Iteration++) {
+        ULONGLONG   Start;
+
+        Start = Now();
+
+        status = XENBUS_STORE(TransactionRun, &StoreInterface,
+                              TransactionFunction, NULL);
+        if (!NT_SUCCESS(status) && status != STATUS_RETRY)
+            Fail("TransactionRun", status);
+
+        Benchmark.Latency[Iteration] = Now() - Start;
+    }
+
+    BenchmarkEnd(&Benchmark);
+
+    (VOID) XENBUS_STORE(Remove, &StoreInterface, NULL, NULL, "bench/txn");
+}
+
+static VOID
+Usage(
+    VOID
+    )
+{
+    fprintf(stderr,
+            "usage: storebench [-n iterations] [-t threads] [-s size[,size...]]\n"
+            "                  [-d delay_us] [-r conflict_percent] [-c] [-v]\n"
+            "\n"
+            "  -n  iterations of each benchmark (default 10000)\n"
+            "  -t  threads issuing synchronous reads and writes (default 1)\n"
+            "  -s  payload sizes in bytes, at most %u (default 16,128,512,1024,2048,4000)\n"
+            "  -d  time the mock xenstored spends on each request\n"
+            "  -r  percentage of transaction commits that fail with EAGAIN\n"
+            "  -c  enable the STORE read cache\n"
+            "  -v  dump the STORE debug callback at the end\n",
+            XENSTORE_PAYLOAD_MAX - 96);
+    exit(2);
+}
+
+int
+main(
+    int                     argc,
+    char                    **argv
+    )
+{
+    ULONG                   Delay = 0;
+    ULONG                   ConflictRate = 0;
+    BOOLEAN                 CacheEnabled = FALSE;
+    BOOLEAN                 Verbose = FALSE;
+    PXENBUS_STORE_CONTEXT   Context;
+    PVOID                   Shared;
+    ULONG                   Index;
+    int                     Option;
+    NTSTATUS                status;
+
+    while ((Option = getopt(argc, argv, "n:t:s:d:r:cvh")) != -1) {
+        switch (Option) {
+        case 'n':
+            Iterations = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 't':
+            Threads = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 's': {
+            PSTR    Size = strtok(optarg, ",");
+
+            NumberSizes = 0;
+            while (Size != NULL && NumberSizes < MAXIMUM_SIZES) {
+                Sizes[NumberSizes++] = (ULONG)strtoul(Size, NULL, 0);
+                Size = strtok(NULL, ",");
+            }
+            break;
+        }
+        case 'd':
+            Delay = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'r':
+            ConflictRate = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'c':
+            CacheEnabled = TRUE;
+            break;
+
+        case 'v':
+            Verbose = TRUE;
+            break;
+
+        default:
+            Usage();
+        }
+    }
+
+    if (Iterations < BATCH_SIZE || Threads == 0 || Threads > MAXIMUM_THREADS ||
+        NumberSizes == 0 || ConflictRate > 100)
+        Usage();
+
+    for (Index = 0; Index < NumberSizes; Index++)
+        if (Sizes[Index] == 0 || Sizes[Index] > XENSTORE_PAYLOAD_MAX - 96)
+            Usage();
+
+    WdkInitialize();
+
+    Shared = XenstoredInitialize(Delay, ConflictRate);
+    if (Shared == NULL)
+        Fail("XenstoredInitialize", STATUS_UNSUCCESSFUL);
+
+    XenbusInitialize(Shared, CacheEnabled);
+
+    status = StoreInitialize((PXENBUS_FDO)(ULONG_PTR)0x1, &Context);
+    if (!NT_SUCCESS(status))
+        Fail("StoreInitialize", status);
+
+    status = StoreGetInterface(Context,
+                               XENBUS_STORE_INTERFACE_VERSION_MAX,
+                               (PINTERFACE)&StoreInterface,
+                               sizeof (StoreInterface));
+    if (!NT_SUCCESS(status))
+        Fail("StoreGetInterface", status);
+
+    status = XENBUS_STORE(Acquire, &StoreInterface);
+    if (!NT_SUCCESS(status))
+        Fail("Acquire", status);
+
+    printf("iterations %u threads %u delay %uus conflicts %u%% cache %s\n\n",
+           Iterations, Threads, Delay, ConflictRate,
+           CacheEnabled ? "on" : "off");
+
+    PrintHeader();
+
+    for (Index = 0; Index < NumberSizes; Index++)
+        RunWorkers(WORKER_TYPE_READ, Sizes[Index]);
+
+    for (Index = 0; Index < NumberSizes; Index++)
+        if (Sizes[Index] <= PRINTF_MAXIMUM_SIZE)
+            RunWorkers(WORKER_TYPE_PRINTF, Sizes[Index]);
+
+    for (Index = 0; Index < NumberSizes; Index++)
+        RunWorkers(WORKER_TYPE_WRITE, Sizes[Index]);
+
+    for (Index = 0; Index < NumberSizes; Index++)
+        RunPipeline(Sizes[Index]);
+
+    for (Index = 0; Index < NumberSizes; Index++)
+        RunBatch(Sizes[Index]);
+
+    RunDirectory();
+    RunWatch();
+    RunTransaction();
+
+    if (Verbose) {
+        printf("\n");
+        XenbusDebugDump();
+    }
+
+    XENBUS_STORE(Release, &StoreInterface);
+
+    StoreTeardown(Context);
+    XenbusTeardown();
+    XenstoredTeardown();
+    WdkTeardown();
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STOREBENCH_H
+#define _STOREBENCH_H
+
+#include <ntddk.h>
+
+// wdk.c
+
+extern VOID
+WdkInitialize(
+    VOID
+    );
+
+extern VOID
+WdkTeardown(
+    VOID
+    );
+
+extern VOID
+WdkBug(
+    _In_ PCSTR      Text,
+    _In_ ULONG_PTR  Parameter1,
+    _In_ ULONG_PTR  Parameter2
+    );
+
+// xenbus.c
+
+extern VOID
+XenbusInitialize(
+    _In_ PVOID      Shared,
+    _In_ BOOLEAN    CacheEnabled
+    );
+
+extern VOID
+XenbusTeardown(
+    VOID
+    );
+
+extern VOID
+XenbusNotifyGuest(
+    VOID
+    );
+
+extern VOID
+XenbusDebugDump(
+    VOID
+    );
+
+// xenstored.c
+
+typedef struct _XENSTORED_STATISTICS {
+    ULONGLONG   Requests;
+    ULONGLONG   Responses;
+    ULONGLONG   WatchEvents;
+    ULONGLONG   RequestBytes;
+    ULONGLONG   ResponseBytes;
+    ULONGLONG   RequestWraps;   // Messages split across the end of the ring
+    ULONGLONG   ResponseWraps;
+    ULONGLONG   ResponseStalls; // Times the response ring was full
+    ULONGLONG   Notifications;  // Sent to the guest
+    ULONGLONG   Wakeups;        // Received from the guest
+} XENSTORED_STATISTICS, *PXENSTORED_STATISTICS;
+
+extern PVOID
+XenstoredInitialize(
+    _In_ ULONG  Delay,          // Microseconds spent on each request
+    _In_ ULONG  ConflictRate    // Percentage of commits that fail
+    );
+
+extern VOID
+XenstoredTeardown(
+    VOID
+    );
+
+extern VOID
+XenstoredNotify(
+    VOID
+    );
+
+extern VOID
+XenstoredQueryStatistics(
+    _Out_ PXENSTORED_STATISTICS Statistics
+    );
+
+#endif  // _STOREBENCH_H
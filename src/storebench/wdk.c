@@ -0,0 +1,987 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+// Kernel primitives for the user-mode build of store.c. IRQL is tracked
+// per thread so the IRQL assertions in store.c still mean something,
+// spin locks spin (yielding after a while, since a holder can be
+// preempted here), and DPCs and timers are run by a single thread that
+// stands in for a processor at DISPATCH_LEVEL.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ntddk.h>
+#include <ntstrsafe.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "storebench.h"
+
+static __thread KIRQL   CurrentIrql;
+
+KIRQL
+KeGetCurrentIrql(
+    VOID
+    )
+{
+    return CurrentIrql;
+}
+
+VOID
+KeRaiseIrql(
+    _In_ KIRQL      NewIrql,
+    _Out_ PKIRQL    OldIrql
+    )
+{
+    if (NewIrql < CurrentIrql)
+        WdkBug("KeRaiseIrql", NewIrql, CurrentIrql);
+
+    *OldIrql = CurrentIrql;
+    CurrentIrql = NewIrql;
+}
+
+VOID
+KeLowerIrql(
+    _In_ KIRQL  NewIrql
+    )
+{
+    if (NewIrql > CurrentIrql)
+        WdkBug("KeLowerIrql", NewIrql, CurrentIrql);
+
+    CurrentIrql = NewIrql;
+}
+
+#define SPIN_LOCK_YIELD_COUNT   1024
+
+VOID
+KeInitializeSpinLock(
+    _Out_ PKSPIN_LOCK   Lock
+    )
+{
+    __atomic_store_n(Lock, 0, __ATOMIC_RELEASE);
+}
+
+VOID
+KeAcquireSpinLockAtDpcLevel(
+    _Inout_ PKSPIN_LOCK Lock
+    )
+{
+    ULONG               Count;
+
+    if (CurrentIrql < DISPATCH_LEVEL)
+        WdkBug("KeAcquireSpinLockAtDpcLevel", CurrentIrql, 0);
+
+    Count = 0;
+    while (__atomic_exchange_n(Lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        do {
+            if (++Count % SPIN_LOCK_YIELD_COUNT == 0)
+                sched_yield();
+            else
+                YieldProcessor();
+        } while (__atomic_load_n(Lock, __ATOMIC_RELAXED) != 0);
+    }
+}
+
+VOID
+KeReleaseSpinLockFromDpcLevel(
+    _Inout_ PKSPIN_LOCK Lock
+    )
+{
+    if (__atomic_load_n(Lock, __ATOMIC_RELAXED) == 0)
+        WdkBug("KeReleaseSpinLockFromDpcLevel", 0, 0);
+
+    __atomic_store_n(Lock, 0, __ATOMIC_RELEASE);
+}
+
+VOID
+KeAcquireSpinLock(
+    _Inout_ PKSPIN_LOCK Lock,
+    _Out_ PKIRQL        OldIrql
+    )
+{
+    KeRaiseIrql(DISPATCH_LEVEL, OldIrql);
+    KeAcquireSpinLockAtDpcLevel(Lock);
+}
+
+VOID
+KeReleaseSpinLock(
+    _Inout_ PKSPIN_LOCK Lock,
+    _In_ KIRQL          NewIrql
+    )
+{
+    KeReleaseSpinLockFromDpcLevel(Lock);
+    KeLowerIrql(NewIrql);
+}
+
+// Time is kept in the kernel's 100ns units
+
+#define TICKS_PER_SECOND    10000000ll
+#define NS_PER_TICK         100ll
+
+// Seconds between 1601-01-01 and 1970-01-01
+#define EPOCH_DIFFERENCE    11644473600ll
+
+static LONGLONG
+__Now(
+    _In_ clockid_t  Clock
+    )
+{
+    struct timespec Now;
+
+    clock_gettime(Clock, &Now);
+    return ((LONGLONG)Now.tv_sec * TICKS_PER_SECOND) +
+           (Now.tv_nsec / NS_PER_TICK);
+}
+
+VOID
+KeQuerySystemTime(
+    _Out_ PLARGE_INTEGER    CurrentTime
+    )
+{
+    CurrentTime->QuadPart = __Now(CLOCK_REALTIME) +
+                            (EPOCH_DIFFERENCE * TICKS_PER_SECOND);
+}
+
+LARGE_INTEGER
+KeQueryPerformanceCounter(
+    _Out_opt_ PLARGE_INTEGER    PerformanceFrequency
+    )
+{
+    struct timespec             Now;
+    LARGE_INTEGER               Counter;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    Counter.QuadPart = ((LONGLONG)Now.tv_sec * 1000000000ll) + Now.tv_nsec;
+
+    if (PerformanceFrequency != NULL)
+        PerformanceFrequency->QuadPart = 1000000000ll;
+
+    return Counter;
+}
+
+// Convert a kernel timeout (negative for relative, positive for an
+// absolute system time) into an absolute CLOCK_MONOTONIC deadline
+static struct timespec
+__Deadline(
+    _In_ PLARGE_INTEGER Timeout
+    )
+{
+    LARGE_INTEGER       SystemTime;
+    LONGLONG            Ticks;
+    struct timespec     Deadline;
+
+    if (Timeout->QuadPart < 0) {
+        Ticks = -Timeout->QuadPart;
+    } else {
+        KeQuerySystemTime(&SystemTime);
+        Ticks = (Timeout->QuadPart > SystemTime.QuadPart) ?
+                Timeout->QuadPart - SystemTime.QuadPart :
+                0;
+    }
+
+    Ticks += __Now(CLOCK_MONOTONIC);
+
+    Deadline.tv_sec = Ticks / TICKS_PER_SECOND;
+    Deadline.tv_nsec = (Ticks % TICKS_PER_SECOND) * NS_PER_TICK;
+
+    return Deadline;
+}
+
+NTSTATUS
+KeDelayExecutionThread(
+    _In_ KPROCESSOR_MODE    WaitMode,
+    _In_ BOOLEAN            Alertable,
+    _In_ PLARGE_INTEGER     Interval
+    )
+{
+    struct timespec         Deadline;
+
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+
+    if (CurrentIrql >= DISPATCH_LEVEL)
+        WdkBug("KeDelayExecutionThread", CurrentIrql, 0);
+
+    Deadline = __Deadline(Interval);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC,
+                           TIMER_ABSTIME,
+                           &Deadline,
+                           NULL) != 0)
+        ;
+
+    return STATUS_SUCCESS;
+}
+
+// Events are rare enough that one lock and condition variable serves
+// all of them
+
+static pthread_mutex_t  EventLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   EventCondition;
+
+static VOID
+__EventInitialize(
+    VOID
+    )
+{
+    pthread_condattr_t  Attributes;
+
+    pthread_condattr_init(&Attributes);
+    pthread_condattr_setclock(&Attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&EventCondition, &Attributes);
+    pthread_condattr_destroy(&Attributes);
+}
+
+VOID
+KeInitializeEvent(
+    _Out_ PRKEVENT      Event,
+    _In_ EVENT_TYPE     Type,
+    _In_ BOOLEAN        State
+    )
+{
+    Event->Type = Type;
+    Event->Signalled = State;
+}
+
+LONG
+KeSetEvent(
+    _Inout_ PRKEVENT    Event,
+    _In_ KPRIORITY      Increment,
+    _In_ BOOLEAN        Wait
+    )
+{
+    LONG                Previous;
+
+    UNREFERENCED_PARAMETER(Increment);
+    UNREFERENCED_PARAMETER(Wait);
+
+    pthread_mutex_lock(&EventLock);
+    Previous = Event->Signalled;
+    Event->Signalled = TRUE;
+    pthread_cond_broadcast(&EventCondition);
+    pthread_mutex_unlock(&EventLock);
+
+    return Previous;
+}
+
+VOID
+KeClearEvent(
+    _Inout_ PRKEVENT    Event
+    )
+{
+    pthread_mutex_lock(&EventLock);
+    Event->Signalled = FALSE;
+    pthread_mutex_unlock(&EventLock);
+}
+
+NTSTATUS
+KeWaitForSingleObject(
+    _In_ PVOID              Object,
+    _In_ KWAIT_REASON       WaitReason,
+    _In_ KPROCESSOR_MODE    WaitMode,
+    _In_ BOOLEAN            Alertable,
+    _In_opt_ PLARGE_INTEGER Timeout
+    )
+{
+    PKEVENT                 Event = Object;
+    struct timespec         Deadline;
+    NTSTATUS                status;
+
+    UNREFERENCED_PARAMETER(WaitReason);
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+
+    if (Timeout != NULL)
+        Deadline = __Deadline(Timeout);
+
+    // A zero timeout just tests the state, as it can at DISPATCH_LEVEL
+    if (CurrentIrql >= DISPATCH_LEVEL &&
+        (Timeout == NULL || Timeout->QuadPart != 0))
+        WdkBug("KeWaitForSingleObject", CurrentIrql, 0);
+
+    pthread_mutex_lock(&EventLock);
+
+    status = STATUS_SUCCESS;
+    while (!Event->Signalled) {
+        if (Timeout == NULL) {
+            pthread_cond_wait(&EventCondition, &EventLock);
+        } else if (pthread_cond_timedwait(&EventCondition,
+                                          &EventLock,
+                                          &Deadline) != 0) {
+            if (!Event->Signalled)
+                status = STATUS_TIMEOUT;
+            break;
+        }
+    }
+
+    if (status == STATUS_SUCCESS && Event->Type == SynchronizationEvent)
+        Event->Signalled = FALSE;
+
+    pthread_mutex_unlock(&EventLock);
+
+    return status;
+}
+
+// DPCs and timers
+
+static pthread_mutex_t  DpcLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   DpcCondition;
+static pthread_cond_t   DpcIdleCondition;
+static LIST_ENTRY       DpcList;
+static LIST_ENTRY       TimerList;
+static BOOLEAN          DpcRunning;
+static BOOLEAN          DpcStopping;
+static pthread_t        DpcThread;
+
+VOID
+KeInitializeDpc(
+    _Out_ PRKDPC                Dpc,
+    _In_ PKDEFERRED_ROUTINE     DeferredRoutine,
+    _In_opt_ PVOID              DeferredContext
+    )
+{
+    RtlZeroMemory(Dpc, sizeof (KDPC));
+    Dpc->DeferredRoutine = DeferredRoutine;
+    Dpc->DeferredContext = DeferredContext;
+}
+
+// Must be called with DpcLock held
+static BOOLEAN
+__InsertQueueDpc(
+    _Inout_ PRKDPC      Dpc,
+    _In_opt_ PVOID      SystemArgument1,
+    _In_opt_ PVOID      SystemArgument2
+    )
+{
+    if (Dpc->Inserted)
+        return FALSE;
+
+    Dpc->Inserted = TRUE;
+    Dpc->SystemArgument1 = SystemArgument1;
+    Dpc->SystemArgument2 = SystemArgument2;
+    InsertTailList(&DpcList, &Dpc->ListEntry);
+
+    pthread_cond_signal(&DpcCondition);
+    return TRUE;
+}
+
+BOOLEAN
+KeInsertQueueDpc(
+    _Inout_ PRKDPC      Dpc,
+    _In_opt_ PVOID      SystemArgument1,
+    _In_opt_ PVOID      SystemArgument2
+    )
+{
+    BOOLEAN             Inserted;
+
+    pthread_mutex_lock(&DpcLock);
+    Inserted = __InsertQueueDpc(Dpc, SystemArgument1, SystemArgument2);
+    pthread_mutex_unlock(&DpcLock);
+
+    return Inserted;
+}
+
+VOID
+KeFlushQueuedDpcs(
+    VOID
+    )
+{
+    if (CurrentIrql != PASSIVE_LEVEL)
+        WdkBug("KeFlushQueuedDpcs", CurrentIrql, 0);
+
+    pthread_mutex_lock(&DpcLock);
+    while (!IsListEmpty(&DpcList) || DpcRunning)
+        pthread_cond_wait(&DpcIdleCondition, &DpcLock);
+    pthread_mutex_unlock(&DpcLock);
+}
+
+VOID
+KeInitializeTimer(
+    _Out_ PKTIMER   Timer
+    )
+{
+    RtlZeroMemory(Timer, sizeof (KTIMER));
+}
+
+// Must be called with DpcLock held
+static BOOLEAN
+__CancelTimer(
+    _Inout_ PKTIMER Timer
+    )
+{
+    if (!Timer->Inserted)
+        return FALSE;
+
+    RemoveEntryList(&Timer->ListEntry);
+    Timer->Inserted = FALSE;
+    return TRUE;
+}
+
+BOOLEAN
+KeSetTimer(
+    _Inout_ PKTIMER     Timer,
+    _In_ LARGE_INTEGER  DueTime,
+    _In_opt_ PKDPC      Dpc
+    )
+{
+    struct timespec     Deadline;
+    BOOLEAN             Inserted;
+
+    Deadline = __Deadline(&DueTime);
+
+    pthread_mutex_lock(&DpcLock);
+    Inserted = __CancelTimer(Timer);
+
+    Timer->Dpc = Dpc;
+    Timer->DueTime = ((LONGLONG)Deadline.tv_sec * TICKS_PER_SECOND) +
+                     (Deadline.tv_nsec / NS_PER_TICK);
+    Timer->Inserted = TRUE;
+    InsertTailList(&TimerList, &Timer->ListEntry);
+
+    pthread_cond_signal(&DpcCondition);
+    pthread_mutex_unlock(&DpcLock);
+
+    return Inserted;
+}
+
+BOOLEAN
+KeCancelTimer(
+    _Inout_ PKTIMER Timer
+    )
+{
+    BOOLEAN         Cancelled;
+
+    pthread_mutex_lock(&DpcLock);
+    Cancelled = __CancelTimer(Timer);
+    pthread_mutex_unlock(&DpcLock);
+
+    return Cancelled;
+}
+
+// Must be called with DpcLock held. Returns the time at which the next
+// timer expires, or 0 if none are set.
+static LONGLONG
+__ExpireTimers(
+    VOID
+    )
+{
+    LONGLONG        Now = __Now(CLOCK_MONOTONIC);
+    LONGLONG        Next;
+    PLIST_ENTRY     ListEntry;
+
+    Next = 0;
+
+    ListEntry = TimerList.Flink;
+    while (ListEntry != &TimerList) {
+        PKTIMER     Timer = CONTAINING_RECORD(ListEntry, KTIMER, ListEntry);
+
+        ListEntry = ListEntry->Flink;
+
+        if (Timer->DueTime <= Now) {
+            (VOID) __CancelTimer(Timer);
+
+            if (Timer->Dpc != NULL)
+                (VOID) __InsertQueueDpc(Timer->Dpc, NULL, NULL);
+        } else if (Next == 0 || Timer->DueTime < Next) {
+            Next = Timer->DueTime;
+        }
+    }
+
+    return Next;
+}
+
+static PVOID
+DpcThreadFunction(
+    PVOID       Argument
+    )
+{
+    UNREFERENCED_PARAMETER(Argument);
+
+    CurrentIrql = DISPATCH_LEVEL;
+
+    pthread_mutex_lock(&DpcLock);
+
+    while (!DpcStopping) {
+        LONGLONG        Next;
+        PLIST_ENTRY     ListEntry;
+        PKDPC           Dpc;
+
+        Next = __ExpireTimers();
+
+        if (IsListEmpty(&DpcList)) {
+            pthread_cond_broadcast(&DpcIdleCondition);
+
+            if (Next == 0) {
+                pthread_cond_wait(&DpcCondition, &DpcLock);
+            } else {
+                struct timespec Deadline;
+
+                Deadline.tv_sec = Next / TICKS_PER_SECOND;
+                Deadline.tv_nsec = (Next % TICKS_PER_SECOND) * NS_PER_TICK;
+
+                (VOID) pthread_cond_timedwait(&DpcCondition,
+                                              &DpcLock,
+                                              &Deadline);
+            }
+
+            continue;
+        }
+
+        ListEntry = RemoveHeadList(&DpcList);
+        Dpc = CONTAINING_RECORD(ListEntry, KDPC, ListEntry);
+        Dpc->Inserted = FALSE;
+
+        DpcRunning = TRUE;
+        pthread_mutex_unlock(&DpcLock);
+
+        Dpc->DeferredRoutine(Dpc,
+                             Dpc->DeferredContext,
+                             Dpc->SystemArgument1,
+                             Dpc->SystemArgument2);
+
+        if (CurrentIrql != DISPATCH_LEVEL)
+            WdkBug("DPC returned at wrong IRQL", CurrentIrql, 0);
+
+        pthread_mutex_lock(&DpcLock);
+        DpcRunning = FALSE;
+    }
+
+    pthread_mutex_unlock(&DpcLock);
+
+    return NULL;
+}
+
+VOID
+WdkInitialize(
+    VOID
+    )
+{
+    pthread_condattr_t  Attributes;
+
+    __EventInitialize();
+
+    pthread_condattr_init(&Attributes);
+    pthread_condattr_setclock(&Attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&DpcCondition, &Attributes);
+    pthread_cond_init(&DpcIdleCondition, &Attributes);
+    pthread_condattr_destroy(&Attributes);
+
+    InitializeListHead(&DpcList);
+    InitializeListHead(&TimerList);
+
+    pthread_create(&DpcThread, NULL, DpcThreadFunction, NULL);
+}
+
+VOID
+WdkTeardown(
+    VOID
+    )
+{
+    pthread_mutex_lock(&DpcLock);
+    DpcStopping = TRUE;
+    pthread_cond_signal(&DpcCondition);
+    pthread_mutex_unlock(&DpcLock);
+
+    pthread_join(DpcThread, NULL);
+}
+
+// Pool
+
+PVOID
+ExAllocatePoolWithTag(
+    _In_ POOL_TYPE  PoolType,
+    _In_ SIZE_T     NumberOfBytes,
+    _In_ ULONG      Tag
+    )
+{
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+
+    return malloc(NumberOfBytes);
+}
+
+VOID
+ExFreePoolWithTag(
+    _In_ PVOID  Buffer,
+    _In_ ULONG  Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    free(Buffer);
+}
+
+// The only I/O space mapped is the shared ring, which the mock grant
+// table identifies by the frame number of its (page aligned) address
+
+PVOID
+MmMapIoSpace(
+    _In_ PHYSICAL_ADDRESS       PhysicalAddress,
+    _In_ SIZE_T                 NumberOfBytes,
+    _In_ MEMORY_CACHING_TYPE    CacheType
+    )
+{
+    UNREFERENCED_PARAMETER(NumberOfBytes);
+    UNREFERENCED_PARAMETER(CacheType);
+
+    return (PVOID)(ULONG_PTR)PhysicalAddress.QuadPart;
+}
+
+VOID
+MmUnmapIoSpace(
+    _In_ PVOID  BaseAddress,
+    _In_ SIZE_T NumberOfBytes
+    )
+{
+    UNREFERENCED_PARAMETER(BaseAddress);
+    UNREFERENCED_PARAMETER(NumberOfBytes);
+}
+
+// Run-time library
+
+USHORT
+RtlCaptureStackBackTrace(
+    _In_ ULONG      FramesToSkip,
+    _In_ ULONG      FramesToCapture,
+    _Out_ PVOID     *BackTrace,
+    _Out_opt_ PULONG BackTraceHash
+    )
+{
+    UNREFERENCED_PARAMETER(FramesToSkip);
+
+    if (FramesToCapture == 0)
+        return 0;
+
+    // Callers are only used as identifiers, so the call site in store.c
+    // is as good as its caller
+    BackTrace[0] = __builtin_return_address(0);
+
+    if (BackTraceHash != NULL)
+        *BackTraceHash = (ULONG)(ULONG_PTR)BackTrace[0];
+
+    return 1;
+}
+
+ULONG
+RtlRandomEx(
+    _Inout_ PULONG  Seed
+    )
+{
+    *Seed = (ULONG)(((ULONGLONG)*Seed * 0x7fffffedull + 0x7fffffc3ull) %
+                    0x7fffffffull);
+    return *Seed;
+}
+
+// Rewrite an MSVC format string for glibc: ULONG is 32 bits so the 'l'
+// modifier is dropped, I64 becomes ll, and %p is printed as MSVC does
+// (zero padded upper case hex, no prefix), which store.c relies on for
+// the length of watch tokens
+static VOID
+__TranslateFormat(
+    _In_ PCSTR  Format,
+    _Out_ PSTR  Buffer,
+    _In_ SIZE_T Size
+    )
+{
+    SIZE_T      Length;
+
+    Length = 0;
+    while (*Format != '\0' && Length + 8 < Size) {
+        if (*Format != '%') {
+            Buffer[Length++] = *Format++;
+            continue;
+        }
+
+        Buffer[Length++] = *Format++;
+
+        if (*Format == '%') {
+            Buffer[Length++] = *Format++;
+            continue;
+        }
+
+        while (strchr("-+ #0123456789.*", *Format) != NULL &&
+               *Format != '\0')
+            Buffer[Length++] = *Format++;
+
+        if (Format[0] == 'l' && Format[1] == 'l') {
+            Buffer[Length++] = *Format++;
+            Buffer[Length++] = *Format++;
+        } else if (Format[0] == 'l') {
+            Format++;
+        } else if (strncmp(Format, "I64", 3) == 0) {
+            Buffer[Length++] = 'l';
+            Buffer[Length++] = 'l';
+            Format += 3;
+        } else if (strncmp(Format, "I32", 3) == 0) {
+            Format += 3;
+        } else if (Format[0] == 'I') {
+            Buffer[Length++] = 'z';
+            Format++;
+        }
+
+        if (*Format == 'p') {
+            memcpy(&Buffer[Length], "016lX", 5);
+            Length += 5;
+            Format++;
+            continue;
+        }
+
+        if (*Format != '\0')
+            Buffer[Length++] = *Format++;
+    }
+
+    Buffer[Length] = '\0';
+}
+
+#define FORMAT_LENGTH   512
+
+static int
+__VPrintf(
+    _Out_writes_(Size) PSTR Destination,
+    _In_ SIZE_T             Size,
+    _In_ PCSTR              Format,
+    _In_ va_list            Arguments
+    )
+{
+    CHAR                    Translated[FORMAT_LENGTH];
+    va_list                 Copy;
+    int                     Length;
+
+    __TranslateFormat(Format, Translated, sizeof (Translated));
+
+    // On x64 Windows a va_list is passed by value, so callers (e.g.
+    // StoreFormatValue()) may use it again after a failure. A SysV
+    // va_list is consumed, so work on a copy.
+    va_copy(Copy, Arguments);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    Length = vsnprintf(Destination, Size, Translated, Copy);
+#pragma GCC diagnostic pop
+
+    va_end(Copy);
+
+    return Length;
+}
+
+NTSTATUS
+RtlStringCbVPrintfA(
+    _Out_writes_bytes_(Size) PSTR   Destination,
+    _In_ SIZE_T                     Size,
+    _In_ PCSTR                      Format,
+    _In_ va_list                    Arguments
+    )
+{
+    int                             Length;
+
+    if (Size == 0)
+        return STATUS_INVALID_PARAMETER;
+
+    Length = __VPrintf(Destination, Size, Format, Arguments);
+    if (Length < 0)
+        return STATUS_INVALID_PARAMETER;
+
+    return ((SIZE_T)Length >= Size) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+}
+
+NTSTATUS
+RtlStringCbPrintfA(
+    _Out_writes_bytes_(Size) PSTR   Destination,
+    _In_ SIZE_T                     Size,
+    _In_ PCSTR                      Format,
+    ...
+    )
+{
+    va_list                         Arguments;
+    NTSTATUS                        status;
+
+    va_start(Arguments, Format);
+    status = RtlStringCbVPrintfA(Destination, Size, Format, Arguments);
+    va_end(Arguments);
+
+    return status;
+}
+
+NTSTATUS
+RtlStringCbPrintfExA(
+    _Out_writes_bytes_(Size) PSTR   Destination,
+    _In_ SIZE_T                     Size,
+    _Out_opt_ PSTR                  *End,
+    _Out_opt_ PSIZE_T               Remaining,
+    _In_ ULONG                      Flags,
+    _In_ PCSTR                      Format,
+    ...
+    )
+{
+    va_list                         Arguments;
+    SIZE_T                          Length;
+    NTSTATUS                        status;
+
+    UNREFERENCED_PARAMETER(Flags);
+
+    va_start(Arguments, Format);
+    status = RtlStringCbVPrintfA(Destination, Size, Format, Arguments);
+    va_end(Arguments);
+
+    Length = (Size != 0) ? strlen(Destination) : 0;
+
+    if (End != NULL)
+        *End = Destination + Length;
+
+    if (Remaining != NULL)
+        *Remaining = Size - Length;
+
+    return status;
+}
+
+NTSTATUS
+RtlStringCbCopyA(
+    _Out_writes_bytes_(Size) PSTR   Destination,
+    _In_ SIZE_T                     Size,
+    _In_ PCSTR                      Source
+    )
+{
+    SIZE_T                          Length;
+
+    if (Size == 0)
+        return STATUS_INVALID_PARAMETER;
+
+    Length = strlen(Source);
+    if (Length >= Size) {
+        memcpy(Destination, Source, Size - 1);
+        Destination[Size - 1] = '\0';
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    memcpy(Destination, Source, Length + 1);
+    return STATUS_SUCCESS;
+}
+
+// Debug output. Errors and warnings always go to stderr; the rest only
+// if STOREBENCH_VERBOSE is set in the environment.
+
+static BOOLEAN
+__Verbose(
+    VOID
+    )
+{
+    static int  Verbose = -1;
+
+    if (Verbose < 0)
+        Verbose = (getenv("STOREBENCH_VERBOSE") != NULL) ? 1 : 0;
+
+    return (BOOLEAN)Verbose;
+}
+
+ULONG
+vDbgPrintExWithPrefix(
+    _In_ PCSTR      Prefix,
+    _In_ ULONG      ComponentId,
+    _In_ ULONG      Level,
+    _In_ PCSTR      Format,
+    _In_ va_list    Arguments
+    )
+{
+    CHAR            Buffer[1024];
+
+    UNREFERENCED_PARAMETER(ComponentId);
+
+    if (Level > DPFLTR_WARNING_LEVEL && !__Verbose())
+        return 0;
+
+    (VOID) __VPrintf(Buffer, sizeof (Buffer), Format, Arguments);
+    fprintf(stderr, "%s%s", Prefix, Buffer);
+
+    return 0;
+}
+
+VOID
+__DbgPrint(
+    _In_ ULONG      Level,
+    _In_ PCSTR      Module,
+    _In_ PCSTR      Function,
+    _In_ PCSTR      Format,
+    ...
+    )
+{
+    CHAR            Prefix[128];
+    va_list         Arguments;
+
+    (VOID) snprintf(Prefix, sizeof (Prefix), "%s|%s: ", Module, Function);
+
+    va_start(Arguments, Format);
+    (VOID) vDbgPrintExWithPrefix(Prefix,
+                                 DPFLTR_IHVDRIVER_ID,
+                                 Level,
+                                 Format,
+                                 Arguments);
+    va_end(Arguments);
+}
+
+VOID
+WdkBug(
+    _In_ PCSTR      Text,
+    _In_ ULONG_PTR  Parameter1,
+    _In_ ULONG_PTR  Parameter2
+    )
+{
+    fprintf(stderr, "BUG: %s (%lx, %lx)\n", Text, Parameter1, Parameter2);
+    abort();
+}
+
+VOID
+KeBugCheckEx(
+    _In_ ULONG      BugCheckCode,
+    _In_ ULONG_PTR  BugCheckParameter1,
+    _In_ ULONG_PTR  BugCheckParameter2,
+    _In_ ULONG_PTR  BugCheckParameter3,
+    _In_ ULONG_PTR  BugCheckParameter4
+    )
+{
+    fprintf(stderr,
+            "BUGCHECK %08x: %s (%s:%lu) %lx\n",
+            BugCheckCode,
+            (PCSTR)BugCheckParameter1,
+            (PCSTR)BugCheckParameter2,
+            BugCheckParameter3,
+            BugCheckParameter4);
+    abort();
+}
+
+VOID
+DbgRaiseAssertionFailure(
+    VOID
+    )
+{
+    abort();
+}
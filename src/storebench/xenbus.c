@@ -0,0 +1,1029 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+// Stand-ins for the parts of XENBUS that store.c depends on: the FDO,
+// the EVTCHN, GNTTAB, SUSPEND, DEBUG and CACHE interfaces, the registry
+// and the thread helpers. The event channel is wired to the mock
+// xenstored, everything else does the minimum.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ntddk.h>
+#include <xen.h>
+#include <ntstrsafe.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#include "fdo.h"
+#include "thread.h"
+#include "registry.h"
+#include "dbg_print.h"
+#include "assert.h"
+
+#include "storebench.h"
+
+// Any non-NULL value will do for the contexts since the mock interfaces
+// keep their state in the statics below
+#define XENBUS_CONTEXT  ((PVOID)(ULONG_PTR)0x1)
+
+static PVOID    StoreShared;
+static BOOLEAN  StoreCacheEnabled;
+
+// EVTCHN
+
+#define STORE_EVTCHN_PORT   1
+
+struct _XENBUS_EVTCHN_CHANNEL {
+    PKSERVICE_ROUTINE   Function;
+    PVOID               Argument;
+    ULONG               Port;
+    ULONG               Count;
+};
+
+static XENBUS_EVTCHN_CHANNEL    StoreChannel;
+static BOOLEAN                  StoreChannelOpen;
+static pthread_mutex_t          StoreChannelLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           StoreChannelCondition;
+
+static NTSTATUS
+EvtchnAcquire(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+EvtchnRelease(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+}
+
+static PXENBUS_EVTCHN_CHANNEL
+EvtchnOpen(
+    _In_ PINTERFACE         Interface,
+    _In_ XENBUS_EVTCHN_TYPE Type,
+    _In_ PKSERVICE_ROUTINE  Function,
+    _In_opt_ PVOID          Argument,
+    ...
+    )
+{
+    va_list                 Arguments;
+
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3U(Type, ==, XENBUS_EVTCHN_TYPE_FIXED);
+
+    pthread_mutex_lock(&StoreChannelLock);
+
+    ASSERT(!StoreChannelOpen);
+
+    StoreChannel.Function = Function;
+    StoreChannel.Argument = Argument;
+
+    va_start(Arguments, Argument);
+    StoreChannel.Port = va_arg(Arguments, ULONG);
+    va_end(Arguments);
+
+    ASSERT3U(StoreChannel.Port, ==, STORE_EVTCHN_PORT);
+
+    StoreChannelOpen = TRUE;
+
+    pthread_mutex_unlock(&StoreChannelLock);
+
+    return &StoreChannel;
+}
+
+static BOOLEAN
+EvtchnUnmask(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel,
+    _In_ BOOLEAN                InCallback,
+    _In_ BOOLEAN                Force
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+    UNREFERENCED_PARAMETER(Channel);
+    UNREFERENCED_PARAMETER(InCallback);
+    UNREFERENCED_PARAMETER(Force);
+
+    return FALSE;
+}
+
+static VOID
+EvtchnSend(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3P(Channel, ==, &StoreChannel);
+
+    XenstoredNotify();
+}
+
+static ULONG
+EvtchnGetCount(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    return __atomic_load_n(&Channel->Count, __ATOMIC_ACQUIRE);
+}
+
+static NTSTATUS
+EvtchnWait(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel,
+    _In_ ULONG                  Count,
+    _In_opt_ PLARGE_INTEGER     Timeout
+    )
+{
+    struct timespec             Deadline;
+    NTSTATUS                    status;
+
+    UNREFERENCED_PARAMETER(Interface);
+
+    if (Timeout != NULL) {
+        LONGLONG    Ticks;
+
+        // Only relative timeouts are used by store.c
+        ASSERT3S(Timeout->QuadPart, <=, 0);
+        Ticks = -Timeout->QuadPart;
+
+        clock_gettime(CLOCK_MONOTONIC, &Deadline);
+        Deadline.tv_sec += Ticks / 10000000ll;
+        Deadline.tv_nsec += (Ticks % 10000000ll) * 100;
+        if (Deadline.tv_nsec >= 1000000000l) {
+            Deadline.tv_sec++;
+            Deadline.tv_nsec -= 1000000000l;
+        }
+    }
+
+    pthread_mutex_lock(&StoreChannelLock);
+
+    // The real thing spins at DISPATCH_LEVEL; sleeping is fairer to the
+    // other threads when they share a processor
+    status = STATUS_SUCCESS;
+    while ((LONG)(Channel->Count - Count) < 0) {
+        if (Timeout == NULL) {
+            pthread_cond_wait(&StoreChannelCondition, &StoreChannelLock);
+        } else if (pthread_cond_timedwait(&StoreChannelCondition,
+                                          &StoreChannelLock,
+                                          &Deadline) != 0) {
+            if ((LONG)(Channel->Count - Count) < 0)
+                status = STATUS_TIMEOUT;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&StoreChannelLock);
+
+    return status;
+}
+
+static VOID
+EvtchnClose(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3P(Channel, ==, &StoreChannel);
+
+    pthread_mutex_lock(&StoreChannelLock);
+    StoreChannelOpen = FALSE;
+    pthread_mutex_unlock(&StoreChannelLock);
+}
+
+// Called by the mock xenstored to raise the event channel
+VOID
+XenbusNotifyGuest(
+    VOID
+    )
+{
+    KIRQL   Irql;
+    BOOLEAN Open;
+
+    pthread_mutex_lock(&StoreChannelLock);
+    __atomic_add_fetch(&StoreChannel.Count, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&StoreChannelCondition);
+    Open = StoreChannelOpen;
+    pthread_mutex_unlock(&StoreChannelLock);
+
+    if (!Open)
+        return;
+
+    KeRaiseIrql(HIGH_LEVEL, &Irql);
+    (VOID) StoreChannel.Function(NULL, StoreChannel.Argument);
+    KeLowerIrql(Irql);
+}
+
+NTSTATUS
+EvtchnGetInterface(
+    _In_ PXENBUS_EVTCHN_CONTEXT Context,
+    _In_ ULONG                  Version,
+    _Inout_ PINTERFACE          Interface,
+    _In_ ULONG                  Size
+    )
+{
+    PXENBUS_EVTCHN_INTERFACE    EvtchnInterface;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Version != XENBUS_EVTCHN_INTERFACE_VERSION_MAX ||
+        Size < sizeof (XENBUS_EVTCHN_INTERFACE))
+        return STATUS_NOT_SUPPORTED;
+
+    EvtchnInterface = (PXENBUS_EVTCHN_INTERFACE)Interface;
+    RtlZeroMemory(EvtchnInterface, sizeof (XENBUS_EVTCHN_INTERFACE));
+
+    EvtchnInterface->Interface.Size = sizeof (XENBUS_EVTCHN_INTERFACE);
+    EvtchnInterface->Interface.Version = (USHORT)Version;
+    EvtchnInterface->Interface.Context = XENBUS_CONTEXT;
+    EvtchnInterface->EvtchnAcquire = EvtchnAcquire;
+    EvtchnInterface->EvtchnRelease = EvtchnRelease;
+    EvtchnInterface->EvtchnOpen = EvtchnOpen;
+    EvtchnInterface->EvtchnUnmask = EvtchnUnmask;
+    EvtchnInterface->EvtchnSend = EvtchnSend;
+    EvtchnInterface->EvtchnGetCount = EvtchnGetCount;
+    EvtchnInterface->EvtchnWait = EvtchnWait;
+    EvtchnInterface->EvtchnClose = EvtchnClose;
+
+    return STATUS_SUCCESS;
+}
+
+// GNTTAB
+
+static NTSTATUS
+GnttabAcquire(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+GnttabRelease(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+}
+
+// The shared page is "mapped" by MmMapIoSpace() in wdk.c, which just
+// turns the frame number back into its address
+static NTSTATUS
+GnttabQueryReference(
+    _In_ PINTERFACE         Interface,
+    _In_ ULONG              Reference,
+    _Out_opt_ PPFN_NUMBER   Pfn,
+    _Out_opt_ PBOOLEAN      ReadOnly
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3U(Reference, ==, XENBUS_GNTTAB_STORE_REFERENCE);
+    ASSERT3P(StoreShared, ==, PAGE_ALIGN(StoreShared));
+
+    if (Pfn != NULL)
+        *Pfn = (PFN_NUMBER)((ULONG_PTR)StoreShared >> PAGE_SHIFT);
+
+    if (ReadOnly != NULL)
+        *ReadOnly = FALSE;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+GnttabGetInterface(
+    _In_ PXENBUS_GNTTAB_CONTEXT Context,
+    _In_ ULONG                  Version,
+    _Inout_ PINTERFACE          Interface,
+    _In_ ULONG                  Size
+    )
+{
+    PXENBUS_GNTTAB_INTERFACE    GnttabInterface;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Version != XENBUS_GNTTAB_INTERFACE_VERSION_MAX ||
+        Size < sizeof (XENBUS_GNTTAB_INTERFACE))
+        return STATUS_NOT_SUPPORTED;
+
+    GnttabInterface = (PXENBUS_GNTTAB_INTERFACE)Interface;
+    RtlZeroMemory(GnttabInterface, sizeof (XENBUS_GNTTAB_INTERFACE));
+
+    GnttabInterface->Interface.Size = sizeof (XENBUS_GNTTAB_INTERFACE);
+    GnttabInterface->Interface.Version = (USHORT)Version;
+    GnttabInterface->Interface.Context = XENBUS_CONTEXT;
+    GnttabInterface->GnttabAcquire = GnttabAcquire;
+    GnttabInterface->GnttabRelease = GnttabRelease;
+    GnttabInterface->GnttabQueryReference = GnttabQueryReference;
+
+    return STATUS_SUCCESS;
+}
+
+// SUSPEND: the VM never suspends
+
+struct _XENBUS_SUSPEND_CALLBACK {
+    XENBUS_SUSPEND_FUNCTION Function;
+    PVOID                   Argument;
+};
+
+static NTSTATUS
+SuspendAcquire(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+SuspendRelease(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+}
+
+static NTSTATUS
+SuspendRegister(
+    _In_ PINTERFACE                     Interface,
+    _In_ XENBUS_SUSPEND_CALLBACK_TYPE   Type,
+    _In_ XENBUS_SUSPEND_FUNCTION        Function,
+    _In_opt_ PVOID                      Argument,
+    _Outptr_ PXENBUS_SUSPEND_CALLBACK   *Callback
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+    UNREFERENCED_PARAMETER(Type);
+
+    *Callback = calloc(1, sizeof (XENBUS_SUSPEND_CALLBACK));
+    if (*Callback == NULL)
+        return STATUS_NO_MEMORY;
+
+    (*Callback)->Function = Function;
+    (*Callback)->Argument = Argument;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+SuspendDeregister(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_SUSPEND_CALLBACK   Callback
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    free(Callback);
+}
+
+NTSTATUS
+SuspendGetInterface(
+    _In_ PXENBUS_SUSPEND_CONTEXT    Context,
+    _In_ ULONG                      Version,
+    _Inout_ PINTERFACE              Interface,
+    _In_ ULONG                      Size
+    )
+{
+    PXENBUS_SUSPEND_INTERFACE       SuspendInterface;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Version != XENBUS_SUSPEND_INTERFACE_VERSION_MAX ||
+        Size < sizeof (XENBUS_SUSPEND_INTERFACE))
+        return STATUS_NOT_SUPPORTED;
+
+    SuspendInterface = (PXENBUS_SUSPEND_INTERFACE)Interface;
+    RtlZeroMemory(SuspendInterface, sizeof (XENBUS_SUSPEND_INTERFACE));
+
+    SuspendInterface->Interface.Size = sizeof (XENBUS_SUSPEND_INTERFACE);
+    SuspendInterface->Interface.Version = (USHORT)Version;
+    SuspendInterface->Interface.Context = XENBUS_CONTEXT;
+    SuspendInterface->Acquire = SuspendAcquire;
+    SuspendInterface->Release = SuspendRelease;
+    SuspendInterface->Register = SuspendRegister;
+    SuspendInterface->Deregister = SuspendDeregister;
+
+    return STATUS_SUCCESS;
+}
+
+// DEBUG: a single callback (STORE's), dumped to stdout on request
+
+struct _XENBUS_DEBUG_CALLBACK {
+    PSTR                    Prefix;
+    XENBUS_DEBUG_FUNCTION   Function;
+    PVOID                   Argument;
+};
+
+static PXENBUS_DEBUG_CALLBACK   StoreDebugCallback;
+
+static NTSTATUS
+DebugAcquire(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+DebugRelease(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+}
+
+static NTSTATUS
+DebugRegister(
+    _In_ PINTERFACE                 Interface,
+    _In_ PSTR                       Prefix,
+    _In_ XENBUS_DEBUG_FUNCTION      Function,
+    _In_opt_ PVOID                  Argument,
+    _Outptr_ PXENBUS_DEBUG_CALLBACK *Callback
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3P(StoreDebugCallback, ==, NULL);
+
+    *Callback = calloc(1, sizeof (XENBUS_DEBUG_CALLBACK));
+    if (*Callback == NULL)
+        return STATUS_NO_MEMORY;
+
+    (*Callback)->Prefix = Prefix;
+    (*Callback)->Function = Function;
+    (*Callback)->Argument = Argument;
+
+    StoreDebugCallback = *Callback;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+DebugPrintf(
+    _In_ PINTERFACE Interface,
+    _In_ PCSTR      Format,
+    ...
+    )
+{
+    CHAR            Buffer[1024];
+    va_list         Arguments;
+
+    UNREFERENCED_PARAMETER(Interface);
+
+    va_start(Arguments, Format);
+    (VOID) RtlStringCbVPrintfA(Buffer, sizeof (Buffer), Format, Arguments);
+    va_end(Arguments);
+
+    printf("%s: %s", StoreDebugCallback->Prefix, Buffer);
+}
+
+static VOID
+DebugTrigger(
+    _In_ PINTERFACE                 Interface,
+    _In_opt_ PXENBUS_DEBUG_CALLBACK Callback
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    if (Callback == NULL)
+        Callback = StoreDebugCallback;
+
+    if (Callback != NULL)
+        Callback->Function(Callback->Argument, FALSE);
+}
+
+static VOID
+DebugDeregister(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_DEBUG_CALLBACK Callback
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3P(Callback, ==, StoreDebugCallback);
+    StoreDebugCallback = NULL;
+
+    free(Callback);
+}
+
+NTSTATUS
+DebugGetInterface(
+    _In_ PXENBUS_DEBUG_CONTEXT  Context,
+    _In_ ULONG                  Version,
+    _Inout_ PINTERFACE          Interface,
+    _In_ ULONG                  Size
+    )
+{
+    PXENBUS_DEBUG_INTERFACE     DebugInterface;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Version != XENBUS_DEBUG_INTERFACE_VERSION_MAX ||
+        Size < sizeof (XENBUS_DEBUG_INTERFACE))
+        return STATUS_NOT_SUPPORTED;
+
+    DebugInterface = (PXENBUS_DEBUG_INTERFACE)Interface;
+    RtlZeroMemory(DebugInterface, sizeof (XENBUS_DEBUG_INTERFACE));
+
+    DebugInterface->Interface.Size = sizeof (XENBUS_DEBUG_INTERFACE);
+    DebugInterface->Interface.Version = (USHORT)Version;
+    DebugInterface->Interface.Context = XENBUS_CONTEXT;
+    DebugInterface->DebugAcquire = DebugAcquire;
+    DebugInterface->DebugRelease = DebugRelease;
+    DebugInterface->DebugRegister = DebugRegister;
+    DebugInterface->DebugPrintf = DebugPrintf;
+    DebugInterface->DebugTrigger = DebugTrigger;
+    DebugInterface->DebugDeregister = DebugDeregister;
+
+    return STATUS_SUCCESS;
+}
+
+// CACHE: a free list under the owner's lock, which is roughly what the
+// real cache does once its magazines are empty. As in the real thing the
+// lock callbacks are invoked at DISPATCH_LEVEL.
+
+struct _XENBUS_CACHE {
+    ULONG                       Size;
+    XENBUS_CACHE_CTOR           Ctor;
+    XENBUS_CACHE_DTOR           Dtor;
+    XENBUS_CACHE_ACQUIRE_LOCK   AcquireLock;
+    XENBUS_CACHE_RELEASE_LOCK   ReleaseLock;
+    PVOID                       Argument;
+    PVOID                       *Objects;
+    ULONG                       Count;
+    ULONG                       Maximum;
+};
+
+static NTSTATUS
+CacheAcquire(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+CacheRelease(
+    _In_ PINTERFACE Interface
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+}
+
+static NTSTATUS
+CacheCreate(
+    _In_ PINTERFACE                 Interface,
+    _In_ PCSTR                      Name,
+    _In_ ULONG                      Size,
+    _In_ ULONG                      Reservation,
+    _In_ ULONG                      Cap,
+    _In_ XENBUS_CACHE_CTOR          Ctor,
+    _In_ XENBUS_CACHE_DTOR          Dtor,
+    _In_ XENBUS_CACHE_ACQUIRE_LOCK  AcquireLock,
+    _In_ XENBUS_CACHE_RELEASE_LOCK  ReleaseLock,
+    _In_opt_ PVOID                  Argument,
+    _Outptr_ PXENBUS_CACHE          *Cache
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+    UNREFERENCED_PARAMETER(Name);
+    UNREFERENCED_PARAMETER(Reservation);
+    UNREFERENCED_PARAMETER(Cap);
+
+    *Cache = calloc(1, sizeof (XENBUS_CACHE));
+    if (*Cache == NULL)
+        return STATUS_NO_MEMORY;
+
+    (*Cache)->Size = Size;
+    (*Cache)->Ctor = Ctor;
+    (*Cache)->Dtor = Dtor;
+    (*Cache)->AcquireLock = AcquireLock;
+    (*Cache)->ReleaseLock = ReleaseLock;
+    (*Cache)->Argument = Argument;
+
+    return STATUS_SUCCESS;
+}
+
+static PVOID
+CacheGet(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ BOOLEAN        Locked
+    )
+{
+    KIRQL               Irql;
+    PVOID               Object;
+
+    UNREFERENCED_PARAMETER(Interface);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    if (!Locked)
+        Cache->AcquireLock(Cache->Argument);
+
+    Object = (Cache->Count != 0) ? Cache->Objects[--Cache->Count] : NULL;
+
+    if (!Locked)
+        Cache->ReleaseLock(Cache->Argument);
+
+    KeLowerIrql(Irql);
+
+    if (Object != NULL)
+        return Object;
+
+    Object = calloc(1, Cache->Size);
+    if (Object == NULL)
+        return NULL;
+
+    if (!NT_SUCCESS(Cache->Ctor(Cache->Argument, Object))) {
+        free(Object);
+        return NULL;
+    }
+
+    return Object;
+}
+
+static VOID
+CachePut(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ PVOID          Object,
+    _In_ BOOLEAN        Locked
+    )
+{
+    KIRQL               Irql;
+
+    UNREFERENCED_PARAMETER(Interface);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    if (!Locked)
+        Cache->AcquireLock(Cache->Argument);
+
+    if (Cache->Count == Cache->Maximum) {
+        ULONG   Maximum = (Cache->Maximum != 0) ? Cache->Maximum * 2 : 16;
+        PVOID   *Objects = realloc(Cache->Objects, Maximum * sizeof (PVOID));
+
+        if (Objects == NULL) {
+            if (!Locked)
+                Cache->ReleaseLock(Cache->Argument);
+
+            KeLowerIrql(Irql);
+
+            Cache->Dtor(Cache->Argument, Object);
+            free(Object);
+            return;
+        }
+
+        Cache->Objects = Objects;
+        Cache->Maximum = Maximum;
+    }
+
+    Cache->Objects[Cache->Count++] = Object;
+
+    if (!Locked)
+        Cache->ReleaseLock(Cache->Argument);
+
+    KeLowerIrql(Irql);
+}
+
+static VOID
+CacheDestroy(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    while (Cache->Count != 0) {
+        PVOID   Object = Cache->Objects[--Cache->Count];
+
+        Cache->Dtor(Cache->Argument, Object);
+        free(Object);
+    }
+
+    free(Cache->Objects);
+    free(Cache);
+}
+
+NTSTATUS
+CacheGetInterface(
+    _In_ PXENBUS_CACHE_CONTEXT  Context,
+    _In_ ULONG                  Version,
+    _Inout_ PINTERFACE          Interface,
+    _In_ ULONG                  Size
+    )
+{
+    PXENBUS_CACHE_INTERFACE     CacheInterface;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    if (Version != XENBUS_CACHE_INTERFACE_VERSION_MAX ||
+        Size < sizeof (XENBUS_CACHE_INTERFACE))
+        return STATUS_NOT_SUPPORTED;
+
+    CacheInterface = (PXENBUS_CACHE_INTERFACE)Interface;
+    RtlZeroMemory(CacheInterface, sizeof (XENBUS_CACHE_INTERFACE));
+
+    CacheInterface->Interface.Size = sizeof (XENBUS_CACHE_INTERFACE);
+    CacheInterface->Interface.Version = (USHORT)Version;
+    CacheInterface->Interface.Context = XENBUS_CONTEXT;
+    CacheInterface->CacheAcquire = CacheAcquire;
+    CacheInterface->CacheRelease = CacheRelease;
+    CacheInterface->CacheCreate = CacheCreate;
+    CacheInterface->CacheGet = CacheGet;
+    CacheInterface->CachePut = CachePut;
+    CacheInterface->CacheDestroy = CacheDestroy;
+
+    return STATUS_SUCCESS;
+}
+
+// FDO
+
+PXENBUS_SUSPEND_CONTEXT
+FdoGetSuspendContext(
+    _In_ PXENBUS_FDO    Fdo
+    )
+{
+    UNREFERENCED_PARAMETER(Fdo);
+
+    return XENBUS_CONTEXT;
+}
+
+PXENBUS_EVTCHN_CONTEXT
+FdoGetEvtchnContext(
+    _In_ PXENBUS_FDO    Fdo
+    )
+{
+    UNREFERENCED_PARAMETER(Fdo);
+
+    return XENBUS_CONTEXT;
+}
+
+PXENBUS_DEBUG_CONTEXT
+FdoGetDebugContext(
+    _In_ PXENBUS_FDO    Fdo
+    )
+{
+    UNREFERENCED_PARAMETER(Fdo);
+
+    return XENBUS_CONTEXT;
+}
+
+PXENBUS_CACHE_CONTEXT
+FdoGetCacheContext(
+    _In_ PXENBUS_FDO    Fdo
+    )
+{
+    UNREFERENCED_PARAMETER(Fdo);
+
+    return XENBUS_CONTEXT;
+}
+
+PXENBUS_GNTTAB_CONTEXT
+FdoGetGnttabContext(
+    _In_ PXENBUS_FDO    Fdo
+    )
+{
+    UNREFERENCED_PARAMETER(Fdo);
+
+    return XENBUS_CONTEXT;
+}
+
+// DRIVER and REGISTRY: the only value read is StoreReadCache
+
+HANDLE
+DriverGetParametersKey(
+    VOID
+    )
+{
+    return XENBUS_CONTEXT;
+}
+
+NTSTATUS
+RegistryQueryDwordValue(
+    _In_ HANDLE         Key,
+    _In_ PSTR           Name,
+    _Out_ PULONG        Value
+    )
+{
+    UNREFERENCED_PARAMETER(Key);
+
+    if (strcmp(Name, "StoreReadCache") != 0)
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    *Value = StoreCacheEnabled;
+    return STATUS_SUCCESS;
+}
+
+// XEN
+
+NTSTATUS
+HvmGetParam(
+    _In_ ULONG          Parameter,
+    _Out_ PULONGLONG    Value
+    )
+{
+    if (Parameter != HVM_PARAM_STORE_EVTCHN)
+        return STATUS_NOT_SUPPORTED;
+
+    *Value = STORE_EVTCHN_PORT;
+    return STATUS_SUCCESS;
+}
+
+VOID
+LogPrintf(
+    _In_ LOG_LEVEL  Level,
+    _In_ PCSTR      Format,
+    ...
+    )
+{
+    va_list         Arguments;
+    ULONG           DbgLevel;
+
+    DbgLevel = (Level & (LOG_LEVEL_ERROR | LOG_LEVEL_CRITICAL)) ?
+               DPFLTR_ERROR_LEVEL :
+               (Level & LOG_LEVEL_WARNING) ?
+               DPFLTR_WARNING_LEVEL :
+               DPFLTR_INFO_LEVEL;
+
+    va_start(Arguments, Format);
+    (VOID) vDbgPrintExWithPrefix("xen|", DPFLTR_IHVDRIVER_ID, DbgLevel,
+                                 Format, Arguments);
+    va_end(Arguments);
+}
+
+VOID
+ModuleLookup(
+    _In_ ULONG_PTR                      Address,
+    _Outptr_result_maybenull_z_ PSTR    *Name,
+    _Out_ PULONG_PTR                    Offset
+    )
+{
+    *Name = NULL;
+    *Offset = Address;
+}
+
+// THREAD
+
+struct _XENBUS_THREAD {
+    pthread_t               Thread;
+    XENBUS_THREAD_FUNCTION  Function;
+    PVOID                   Context;
+    KEVENT                  Event;
+    BOOLEAN                 Alerted;
+};
+
+static PVOID
+ThreadFunction(
+    PVOID           Argument
+    )
+{
+    PXENBUS_THREAD  Self = Argument;
+
+    (VOID) Self->Function(Self, Self->Context);
+
+    return NULL;
+}
+
+NTSTATUS
+ThreadCreate(
+    _In_ XENBUS_THREAD_FUNCTION Function,
+    _In_ PVOID                  Context,
+    _Outptr_ PXENBUS_THREAD     *Thread
+    )
+{
+    *Thread = calloc(1, sizeof (XENBUS_THREAD));
+    if (*Thread == NULL)
+        return STATUS_NO_MEMORY;
+
+    (*Thread)->Function = Function;
+    (*Thread)->Context = Context;
+    KeInitializeEvent(&(*Thread)->Event, NotificationEvent, FALSE);
+
+    if (pthread_create(&(*Thread)->Thread, NULL, ThreadFunction, *Thread) != 0) {
+        free(*Thread);
+        *Thread = NULL;
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+PKEVENT
+ThreadGetEvent(
+    _In_ PXENBUS_THREAD Thread
+    )
+{
+    return &Thread->Event;
+}
+
+BOOLEAN
+ThreadIsAlerted(
+    _In_ PXENBUS_THREAD Thread
+    )
+{
+    return __atomic_load_n(&Thread->Alerted, __ATOMIC_ACQUIRE);
+}
+
+VOID
+ThreadAlert(
+    _In_ PXENBUS_THREAD Thread
+    )
+{
+    __atomic_store_n(&Thread->Alerted, TRUE, __ATOMIC_RELEASE);
+    (VOID) KeSetEvent(&Thread->Event, 0, FALSE);
+}
+
+VOID
+ThreadJoin(
+    _In_ PXENBUS_THREAD Thread
+    )
+{
+    pthread_join(Thread->Thread, NULL);
+    free(Thread);
+}
+
+VOID
+XenbusInitialize(
+    _In_ PVOID      Shared,
+    _In_ BOOLEAN    CacheEnabled
+    )
+{
+    pthread_condattr_t  Attributes;
+
+    pthread_condattr_init(&Attributes);
+    pthread_condattr_setclock(&Attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&StoreChannelCondition, &Attributes);
+    pthread_condattr_destroy(&Attributes);
+
+    StoreShared = Shared;
+    StoreCacheEnabled = CacheEnabled;
+}
+
+VOID
+XenbusTeardown(
+    VOID
+    )
+{
+    StoreShared = NULL;
+    StoreCacheEnabled = FALSE;
+}
+
+VOID
+XenbusDebugDump(
+    VOID
+    )
+{
+    if (StoreDebugCallback != NULL)
+        StoreDebugCallback->Function(StoreDebugCallback->Argument, FALSE);
+}
@@ -0,0 +1,1134 @@
+/* Copyright (c) Xen Project.
+ * Copyright (c) Cloud Software Group, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms,
+ * with or without modification, are permitted provided
+ * that the following conditions are met:
+ *
+ * *   Redistributions of source code must retain the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the
+ *     following disclaimer in the documentation and/or other
+ *     materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+// A mock xenstored. A single service thread plays the part of the
+// backend: it consumes requests from the shared xenstore_domain_interface,
+// answers them from an in-memory tree and raises the guest's event
+// channel whenever it has produced or consumed anything.
+//
+// Transactions are accepted but provide no isolation: operations take
+// effect immediately and a commit only fails when a conflict is injected.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ntddk.h>
+#include <xen.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "dbg_print.h"
+#include "assert.h"
+
+#include "storebench.h"
+
+#define XENSTORED_DOMAIN_PATH   "/local/domain/0"
+
+#define XENSTORED_HASH_SIZE     4096
+
+typedef struct _XENSTORED_NODE {
+    struct _XENSTORED_NODE  *Next;          // Hash chain
+    struct _XENSTORED_NODE  *Parent;
+    LIST_ENTRY              ListEntry;      // In the parent's ChildList
+    LIST_ENTRY              ChildList;
+    PSTR                    Path;
+    PSTR                    Name;           // Last component of Path
+    PCHAR                   Value;
+    ULONG                   Length;
+    ULONGLONG               Generation;     // Bumped when children change
+} XENSTORED_NODE, *PXENSTORED_NODE;
+
+typedef struct _XENSTORED_WATCH {
+    LIST_ENTRY  ListEntry;
+    PSTR        Path;           // As registered by the guest
+    PSTR        AbsolutePath;
+    PSTR        Token;
+} XENSTORED_WATCH, *PXENSTORED_WATCH;
+
+typedef struct _XENSTORED_MESSAGE {
+    LIST_ENTRY  ListEntry;
+    BOOLEAN     WatchEvent;
+    ULONG       Length;
+    ULONG       Offset;
+    CHAR        Data[1];
+} XENSTORED_MESSAGE, *PXENSTORED_MESSAGE;
+
+typedef struct _XENSTORED_CONTEXT {
+    struct xenstore_domain_interface    *Shared;
+    ULONG                               Delay;
+    ULONG                               ConflictRate;
+    ULONG                               Seed;
+    pthread_t                           Thread;
+    pthread_mutex_t                     Lock;
+    pthread_cond_t                      Condition;
+    ULONG                               Pending;
+    BOOLEAN                             Stopping;
+    struct {
+        struct xsd_sockmsg              Header;
+        CHAR                            Payload[XENSTORE_PAYLOAD_MAX];
+    }                                   Input;
+    ULONG                               InputLength;
+    XENSTORE_RING_IDX                   InputStart;
+    LIST_ENTRY                          OutputList;
+    BOOLEAN                             Stalled;
+    PXENSTORED_NODE                     Hash[XENSTORED_HASH_SIZE];
+    PXENSTORED_NODE                     Root;
+    ULONGLONG                           Generation;
+    LIST_ENTRY                          WatchList;
+    uint32_t                            TransactionId;
+    XENSTORED_STATISTICS                Statistics;
+} XENSTORED_CONTEXT, *PXENSTORED_CONTEXT;
+
+static XENSTORED_CONTEXT    Xenstored;
+
+#define XENSTORED_COUNT(_Name, _Delta) \
+    __atomic_add_fetch(&Xenstored.Statistics._Name, (_Delta), __ATOMIC_RELAXED)
+
+static ULONG
+XenstoredHash(
+    _In_ PCSTR  Path
+    )
+{
+    ULONG       Hash = 2166136261u;
+
+    while (*Path != '\0')
+        Hash = (Hash ^ (UCHAR)*Path++) * 16777619u;
+
+    return Hash % XENSTORED_HASH_SIZE;
+}
+
+static PXENSTORED_NODE
+XenstoredLookup(
+    _In_ PCSTR      Path
+    )
+{
+    PXENSTORED_NODE Node;
+
+    for (Node = Xenstored.Hash[XenstoredHash(Path)];
+         Node != NULL;
+         Node = Node->Next)
+        if (strcmp(Node->Path, Path) == 0)
+            break;
+
+    return Node;
+}
+
+static PXENSTORED_NODE
+XenstoredCreateNode(
+    _In_opt_ PXENSTORED_NODE    Parent,
+    _In_ PCSTR                  Path
+    )
+{
+    PXENSTORED_NODE             Node;
+    ULONG                       Hash;
+
+    Node = calloc(1, sizeof (XENSTORED_NODE));
+    if (Node == NULL)
+        goto fail1;
+
+    Node->Path = strdup(Path);
+    if (Node->Path == NULL)
+        goto fail2;
+
+    Node->Name = strrchr(Node->Path, '/') + 1;
+    Node->Value = calloc(1, 1);
+    if (Node->Value == NULL)
+        goto fail3;
+
+    InitializeListHead(&Node->ChildList);
+    Node->Generation = ++Xenstored.Generation;
+
+    Hash = XenstoredHash(Path);
+    Node->Next = Xenstored.Hash[Hash];
+    Xenstored.Hash[Hash] = Node;
+
+    Node->Parent = Parent;
+    if (Parent != NULL) {
+        InsertTailList(&Parent->ChildList, &Node->ListEntry);
+        Parent->Generation = ++Xenstored.Generation;
+    }
+
+    return Node;
+
+fail3:
+    free(Node->Path);
+
+fail2:
+    free(Node);
+
+fail1:
+    return NULL;
+}
+
+static VOID
+XenstoredDestroyNode(
+    _In_ PXENSTORED_NODE    Node
+    )
+{
+    PXENSTORED_NODE         *Link;
+
+    while (!IsListEmpty(&Node->ChildList))
+        XenstoredDestroyNode(CONTAINING_RECORD(Node->ChildList.Flink,
+                                               XENSTORED_NODE,
+                                               ListEntry));
+
+    for (Link = &Xenstored.Hash[XenstoredHash(Node->Path)];
+         *Link != Node;
+         Link = &(*Link)->Next)
+        ASSERT(*Link != NULL);
+
+    *Link = Node->Next;
+
+    if (Node->Parent != NULL) {
+        RemoveEntryList(&Node->ListEntry);
+        Node->Parent->Generation = ++Xenstored.Generation;
+    }
+
+    free(Node->Value);
+    free(Node->Path);
+    free(Node);
+}
+
+// Creates any missing ancestors too, as xenstored does for a write
+static PXENSTORED_NODE
+XenstoredCreatePath(
+    _In_ PCSTR      Path
+    )
+{
+    PXENSTORED_NODE Node;
+    PXENSTORED_NODE Parent;
+    PSTR            Copy;
+    PSTR            Separator;
+
+    Node = XenstoredLookup(Path);
+    if (Node != NULL)
+        return Node;
+
+    Copy = strdup(Path);
+    if (Copy == NULL)
+        return NULL;
+
+    Separator = strrchr(Copy, '/');
+    if (Separator == Copy) {
+        Parent = Xenstored.Root;
+    } else {
+        *Separator = '\0';
+        Parent = XenstoredCreatePath(Copy);
+    }
+
+    free(Copy);
+
+    if (Parent == NULL)
+        return NULL;
+
+    return XenstoredCreateNode(Parent, Path);
+}
+
+static BOOLEAN
+XenstoredIsSubPath(
+    _In_ PCSTR  Path,
+    _In_ PCSTR  SubPath
+    )
+{
+    ULONG       Length = (ULONG)strlen(Path);
+
+    if (strncmp(Path, SubPath, Length) != 0)
+        return FALSE;
+
+    return (SubPath[Length] == '\0' ||
+            SubPath[Length] == '/' ||
+            strcmp(Path, "/") == 0) ?
+           TRUE :
+           FALSE;
+}
+
+static PSTR
+XenstoredAbsolutePath(
+    _In_ PCSTR  Path
+    )
+{
+    PSTR        Buffer;
+    ULONG       Length;
+
+    if (Path[0] == '/')
+        return strdup(Path);
+
+    Length = sizeof (XENSTORED_DOMAIN_PATH "/") + (ULONG)strlen(Path);
+
+    Buffer = malloc(Length);
+    if (Buffer == NULL)
+        return NULL;
+
+    (VOID) snprintf(Buffer, Length, XENSTORED_DOMAIN_PATH "/%s", Path);
+    return Buffer;
+}
+
+static VOID
+XenstoredQueue(
+    _In_ enum xsd_sockmsg_type  Type,
+    _In_ uint32_t               RequestId,
+    _In_ uint32_t               TransactionId,
+    _In_reads_bytes_(Length) PCSTR Payload,
+    _In_ ULONG                  Length
+    )
+{
+    PXENSTORED_MESSAGE          Message;
+    struct xsd_sockmsg          Header;
+
+    ASSERT3U(Length, <, XENSTORE_PAYLOAD_MAX);
+
+    Message = malloc(FIELD_OFFSET(XENSTORED_MESSAGE, Data) +
+                     sizeof (struct xsd_sockmsg) +
+                     Length);
+    if (Message == NULL) {
+        WdkBug("OUT OF MEMORY", 0, 0);
+        return;
+    }
+
+    Header.type = Type;
+    Header.req_id = RequestId;
+    Header.tx_id = TransactionId;
+    Header.len = Length;
+
+    Message->WatchEvent = (Type == XS_WATCH_EVENT) ? TRUE : FALSE;
+    Message->Length = sizeof (struct xsd_sockmsg) + Length;
+    Message->Offset = 0;
+    RtlCopyMemory(Message->Data, &Header, sizeof (struct xsd_sockmsg));
+    RtlCopyMemory(Message->Data + sizeof (struct xsd_sockmsg), Payload, Length);
+
+    InsertTailList(&Xenstored.OutputList, &Message->ListEntry);
+}
+
+static VOID
+XenstoredReply(
+    _In_ enum xsd_sockmsg_type  Type,
+    _In_reads_bytes_(Length) PCSTR Payload,
+    _In_ ULONG                  Length
+    )
+{
+    XenstoredQueue(Type,
+                   Xenstored.Input.Header.req_id,
+                   Xenstored.Input.Header.tx_id,
+                   Payload,
+                   Length);
+}
+
+static VOID
+XenstoredError(
+    _In_ PCSTR  Error
+    )
+{
+    XenstoredReply(XS_ERROR, Error, (ULONG)strlen(Error) + 1);
+}
+
+static VOID
+XenstoredOk(
+    VOID
+    )
+{
+    XenstoredReply(Xenstored.Input.Header.type, "OK", sizeof ("OK"));
+}
+
+static VOID
+XenstoredFireWatches(
+    _In_ PCSTR      Path,
+    _In_ BOOLEAN    Recursive
+    )
+{
+    PLIST_ENTRY     ListEntry;
+
+    for (ListEntry = Xenstored.WatchList.Flink;
+         ListEntry != &Xenstored.WatchList;
+         ListEntry = ListEntry->Flink) {
+        PXENSTORED_WATCH    Watch;
+        CHAR                Payload[XENSTORE_PAYLOAD_MAX];
+        PCSTR               EventPath;
+        ULONG               Length;
+
+        Watch = CONTAINING_RECORD(ListEntry, XENSTORED_WATCH, ListEntry);
+
+        if (XenstoredIsSubPath(Watch->AbsolutePath, Path))
+            EventPath = Path;
+        else if (Recursive && XenstoredIsSubPath(Path, Watch->AbsolutePath))
+            EventPath = Watch->AbsolutePath;
+        else
+            continue;
+
+        // Relative watches see relative paths
+        if (Watch->Path[0] != '/')
+            EventPath += sizeof (XENSTORED_DOMAIN_PATH);
+
+        Length = (ULONG)snprintf(Payload, sizeof (Payload), "%s%c%s",
+                                 EventPath, '\0', Watch->Token) + 1;
+        ASSERT3U(Length, <, sizeof (Payload));
+
+        XenstoredQueue(XS_WATCH_EVENT, 0, 0, Payload, Length);
+    }
+}
+
+static VOID
+XenstoredRead(
+    _In_ PCSTR      Path
+    )
+{
+    PXENSTORED_NODE Node = XenstoredLookup(Path);
+
+    if (Node == NULL) {
+        XenstoredError("ENOENT");
+        return;
+    }
+
+    XenstoredReply(XS_READ, Node->Value, Node->Length);
+}
+
+static VOID
+XenstoredWrite(
+    _In_ PCSTR                  Path,
+    _In_reads_bytes_(Length) PCSTR Value,
+    _In_ ULONG                  Length
+    )
+{
+    PXENSTORED_NODE             Node;
+    PCHAR                       Buffer;
+
+    Node = XenstoredCreatePath(Path);
+    if (Node == NULL)
+        goto fail1;
+
+    Buffer = malloc(__max(Length, 1));
+    if (Buffer == NULL)
+        goto fail2;
+
+    RtlCopyMemory(Buffer, Value, Length);
+
+    free(Node->Value);
+    Node->Value = Buffer;
+    Node->Length = Length;
+
+    XenstoredFireWatches(Path, FALSE);
+    XenstoredOk();
+    return;
+
+fail2:
+fail1:
+    XenstoredError("ENOMEM");
+}
+
+static VOID
+XenstoredMkdir(
+    _In_ PCSTR      Path
+    )
+{
+    BOOLEAN         Exists = (XenstoredLookup(Path) != NULL) ? TRUE : FALSE;
+
+    if (XenstoredCreatePath(Path) == NULL) {
+        XenstoredError("ENOMEM");
+        return;
+    }
+
+    if (!Exists)
+        XenstoredFireWatches(Path, FALSE);
+
+    XenstoredOk();
+}
+
+static VOID
+XenstoredRm(
+    _In_ PCSTR      Path
+    )
+{
+    PXENSTORED_NODE Node = XenstoredLookup(Path);
+
+    if (Node == NULL) {
+        XenstoredError("ENOENT");
+        return;
+    }
+
+    if (Node == Xenstored.Root) {
+        XenstoredError("EINVAL");
+        return;
+    }
+
+    XenstoredDestroyNode(Node);
+
+    XenstoredFireWatches(Path, TRUE);
+    XenstoredOk();
+}
+
+static VOID
+XenstoredDirectory(
+    _In_ PCSTR      Path
+    )
+{
+    PXENSTORED_NODE Node = XenstoredLookup(Path);
+    CHAR            Payload[XENSTORE_PAYLOAD_MAX];
+    ULONG           Length;
+    PLIST_ENTRY     ListEntry;
+
+    if (Node == NULL) {
+        XenstoredError("ENOENT");
+        return;
+    }
+
+    Length = 0;
+    for (ListEntry = Node->ChildList.Flink;
+         ListEntry != &Node->ChildList;
+         ListEntry = ListEntry->Flink) {
+        PXENSTORED_NODE Child;
+        ULONG           NameLength;
+
+        Child = CONTAINING_RECORD(ListEntry, XENSTORED_NODE, ListEntry);
+        NameLength = (ULONG)strlen(Child->Name) + 1;
+
+        if (Length + NameLength >= sizeof (Payload)) {
+            XenstoredError("E2BIG");
+            return;
+        }
+
+        RtlCopyMemory(Payload + Length, Child->Name, NameLength);
+        Length += NameLength;
+    }
+
+    XenstoredReply(XS_DIRECTORY, Payload, Length);
+}
+
+// Payload is the generation followed by as many names as fit, starting
+// at Offset bytes into the full list. The last part has an extra NUL.
+static VOID
+XenstoredDirectoryPart(
+    _In_ PCSTR      Path,
+    _In_ ULONG      Offset
+    )
+{
+    PXENSTORED_NODE Node = XenstoredLookup(Path);
+    CHAR            Payload[XENSTORE_PAYLOAD_MAX];
+    ULONG           Length;
+    ULONG           Position;
+    PLIST_ENTRY     ListEntry;
+
+    if (Node == NULL) {
+        XenstoredError("ENOENT");
+        return;
+    }
+
+    Length = (ULONG)snprintf(Payload, sizeof (Payload), "%llu",
+                             (unsigned long long)Node->Generation) + 1;
+
+    Position = 0;
+    for (ListEntry = Node->ChildList.Flink;
+         ListEntry != &Node->ChildList;
+         ListEntry = ListEntry->Flink) {
+        PXENSTORED_NODE Child;
+        ULONG           NameLength;
+
+        Child = CONTAINING_RECORD(ListEntry, XENSTORED_NODE, ListEntry);
+        NameLength = (ULONG)strlen(Child->Name) + 1;
+
+        if (Position >= Offset) {
+            // Leave room for the final NUL
+            if (Length + NameLength + 1 >= sizeof (Payload))
+                break;
+
+            RtlCopyMemory(Payload + Length, Child->Name, NameLength);
+            Length += NameLength;
+        }
+
+        Position += NameLength;
+    }
+
+    if (ListEntry == &Node->ChildList)
+        Payload[Length++] = '\0';
+
+    XenstoredReply(XS_DIRECTORY_PART, Payload, Length);
+}
+
+static VOID
+XenstoredWatch(
+    _In_ PCSTR          Path,
+    _In_ PCSTR          Token
+    )
+{
+    PXENSTORED_WATCH    Watch;
+
+    Watch = calloc(1, sizeof (XENSTORED_WATCH));
+    if (Watch == NULL)
+        goto fail1;
+
+    Watch->Path = strdup(Path);
+    if (Watch->Path == NULL)
+        goto fail2;
+
+    Watch->AbsolutePath = XenstoredAbsolutePath(Path);
+    if (Watch->AbsolutePath == NULL)
+        goto fail3;
+
+    Watch->Token = strdup(Token);
+    if (Watch->Token == NULL)
+        goto fail4;
+
+    InsertTailList(&Xenstored.WatchList, &Watch->ListEntry);
+
+    XenstoredOk();
+
+    // A new watch always fires once, straight away
+    XenstoredQueue(XS_WATCH_EVENT, 0, 0,
+                   Xenstored.Input.Payload, Xenstored.Input.Header.len);
+    return;
+
+fail4:
+    free(Watch->AbsolutePath);
+
+fail3:
+    free(Watch->Path);
+
+fail2:
+    free(Watch);
+
+fail1:
+    XenstoredError("ENOMEM");
+}
+
+static VOID
+XenstoredFreeWatch(
+    _In_ PXENSTORED_WATCH   Watch
+    )
+{
+    RemoveEntryList(&Watch->ListEntry);
+
+    free(Watch->Token);
+    free(Watch->AbsolutePath);
+    free(Watch->Path);
+    free(Watch);
+}
+
+static VOID
+XenstoredUnwatch(
+    _In_ PCSTR      Path,
+    _In_ PCSTR      Token
+    )
+{
+    PLIST_ENTRY     ListEntry;
+
+    for (ListEntry = Xenstored.WatchList.Flink;
+         ListEntry != &Xenstored.WatchList;
+         ListEntry = ListEntry->Flink) {
+        PXENSTORED_WATCH    Watch;
+
+        Watch = CONTAINING_RECORD(ListEntry, XENSTORED_WATCH, ListEntry);
+
+        if (strcmp(Watch->Path, Path) == 0 &&
+            strcmp(Watch->Token, Token) == 0) {
+            XenstoredFreeWatch(Watch);
+            XenstoredOk();
+            return;
+        }
+    }
+
+    XenstoredError("ENOENT");
+}
+
+static VOID
+XenstoredTransactionStart(
+    VOID
+    )
+{
+    CHAR    Payload[sizeof ("4294967295")];
+    ULONG   Length;
+
+    if (++Xenstored.TransactionId == 0)
+        Xenstored.TransactionId = 1;
+
+    Length = (ULONG)snprintf(Payload, sizeof (Payload), "%u",
+                             Xenstored.TransactionId) + 1;
+
+    XenstoredReply(XS_TRANSACTION_START, Payload, Length);
+}
+
+static VOID
+XenstoredTransactionEnd(
+    _In_ PCSTR  Commit
+    )
+{
+    if (strcmp(Commit, "T") == 0 &&
+        (ULONG)(rand_r(&Xenstored.Seed) % 100) < Xenstored.ConflictRate) {
+        XenstoredError("EAGAIN");
+        return;
+    }
+
+    XenstoredOk();
+}
+
+// Splits the payload into at most two NUL terminated strings. Anything
+// after the second NUL (or after the first, if Second is NULL) is
+// returned through Rest.
+static BOOLEAN
+XenstoredParse(
+    _Outptr_ PCSTR              *First,
+    _Outptr_opt_ PCSTR          *Second,
+    _Outptr_opt_ PCSTR          *Rest,
+    _Out_opt_ PULONG            RestLength
+    )
+{
+    PCHAR                       Payload = Xenstored.Input.Payload;
+    ULONG                       Length = Xenstored.Input.Header.len;
+    PCHAR                       End;
+
+    End = memchr(Payload, '\0', Length);
+    if (End == NULL)
+        return FALSE;
+
+    *First = Payload;
+    Length -= (ULONG)(End + 1 - Payload);
+    Payload = End + 1;
+
+    if (Second != NULL) {
+        End = memchr(Payload, '\0', Length);
+        if (End == NULL)
+            return FALSE;
+
+        *Second = Payload;
+        Length -= (ULONG)(End + 1 - Payload);
+        Payload = End + 1;
+    }
+
+    if (Rest != NULL) {
+        *Rest = Payload;
+        *RestLength = Length;
+    }
+
+    return TRUE;
+}
+
+static VOID
+XenstoredProcessRequest(
+    VOID
+    )
+{
+    enum xsd_sockmsg_type   Type = Xenstored.Input.Header.type;
+    PCSTR                   Path;
+    PCSTR                   Second;
+    PCSTR                   Rest;
+    ULONG                   RestLength;
+    PSTR                    AbsolutePath;
+
+    XENSTORED_COUNT(Requests, 1);
+
+    if (Xenstored.Delay != 0) {
+        struct timespec Delay;
+
+        Delay.tv_sec = Xenstored.Delay / 1000000;
+        Delay.tv_nsec = (Xenstored.Delay % 1000000) * 1000l;
+        (VOID) clock_nanosleep(CLOCK_MONOTONIC, 0, &Delay, NULL);
+    }
+
+    // The payload is not NUL terminated on the wire, but there is
+    // always room to do so
+    Xenstored.Input.Payload[Xenstored.Input.Header.len] = '\0';
+
+    switch (Type) {
+    case XS_TRANSACTION_START:
+        XenstoredTransactionStart();
+        return;
+
+    case XS_TRANSACTION_END:
+        if (!XenstoredParse(&Path, NULL, NULL, NULL))
+            goto invalid;
+
+        XenstoredTransactionEnd(Path);
+        return;
+
+    case XS_WATCH:
+    case XS_UNWATCH:
+        if (!XenstoredParse(&Path, &Second, NULL, NULL))
+            goto invalid;
+
+        if (Type == XS_WATCH)
+            XenstoredWatch(Path, Second);
+        else
+            XenstoredUnwatch(Path, Second);
+        return;
+
+    case XS_READ:
+    case XS_WRITE:
+    case XS_MKDIR:
+    case XS_RM:
+    case XS_DIRECTORY:
+    case XS_DIRECTORY_PART:
+    case XS_GET_PERMS:
+    case XS_SET_PERMS:
+        break;
+
+    default:
+        goto invalid;
+    }
+
+    if (!XenstoredParse(&Path, NULL, &Rest, &RestLength))
+        goto invalid;
+
+    AbsolutePath = XenstoredAbsolutePath(Path);
+    if (AbsolutePath == NULL) {
+        XenstoredError("ENOMEM");
+        return;
+    }
+
+    switch (Type) {
+    case XS_READ:
+        XenstoredRead(AbsolutePath);
+        break;
+
+    case XS_WRITE:
+        XenstoredWrite(AbsolutePath, Rest, RestLength);
+        break;
+
+    case XS_MKDIR:
+        XenstoredMkdir(AbsolutePath);
+        break;
+
+    case XS_RM:
+        XenstoredRm(AbsolutePath);
+        break;
+
+    case XS_DIRECTORY:
+        XenstoredDirectory(AbsolutePath);
+        break;
+
+    case XS_DIRECTORY_PART:
+        XenstoredDirectoryPart(AbsolutePath, (ULONG)strtoul(Rest, NULL, 10));
+        break;
+
+    case XS_GET_PERMS:
+        if (XenstoredLookup(AbsolutePath) == NULL)
+            XenstoredError("ENOENT");
+        else
+            XenstoredReply(XS_GET_PERMS, "n0", sizeof ("n0"));
+        break;
+
+    case XS_SET_PERMS:
+        if (XenstoredLookup(AbsolutePath) == NULL)
+            XenstoredError("ENOENT");
+        else
+            XenstoredOk();
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+    free(AbsolutePath);
+    return;
+
+invalid:
+    XenstoredError("EINVAL");
+}
+
+static BOOLEAN
+XenstoredConsumeRequests(
+    VOID
+    )
+{
+    struct xenstore_domain_interface    *Shared = Xenstored.Shared;
+    XENSTORE_RING_IDX                   cons;
+    XENSTORE_RING_IDX                   prod;
+    BOOLEAN                             Progress;
+
+    cons = Shared->req_cons;
+    prod = __atomic_load_n(&Shared->req_prod, __ATOMIC_ACQUIRE);
+
+    Progress = FALSE;
+    while (cons != prod) {
+        ULONG   Index;
+        ULONG   Length;
+        ULONG   Total;
+
+        Total = sizeof (struct xsd_sockmsg);
+        if (Xenstored.InputLength >= Total)
+            Total += Xenstored.Input.Header.len;
+
+        if (Xenstored.InputLength == 0)
+            Xenstored.InputStart = cons;
+
+        Index = MASK_XENSTORE_IDX(cons);
+
+        Length = Total - Xenstored.InputLength;
+        Length = __min(Length, prod - cons);
+        Length = __min(Length, XENSTORE_RING_SIZE - Index);
+
+        RtlCopyMemory((PCHAR)&Xenstored.Input + Xenstored.InputLength,
+                      &Shared->req[Index],
+                      Length);
+
+        Xenstored.InputLength += Length;
+        cons += Length;
+
+        // Hand the space back before doing any work
+        __atomic_store_n(&Shared->req_cons, cons, __ATOMIC_RELEASE);
+        XENSTORED_COUNT(RequestBytes, Length);
+        Progress = TRUE;
+
+        if (Xenstored.InputLength == sizeof (struct xsd_sockmsg) &&
+            Xenstored.Input.Header.len >= XENSTORE_PAYLOAD_MAX)
+            WdkBug("OVERSIZED REQUEST", Xenstored.Input.Header.type,
+                   Xenstored.Input.Header.len);
+
+        if (Xenstored.InputLength < sizeof (struct xsd_sockmsg) ||
+            Xenstored.InputLength < sizeof (struct xsd_sockmsg) +
+                                    Xenstored.Input.Header.len)
+            continue;
+
+        if (MASK_XENSTORE_IDX(Xenstored.InputStart) + Xenstored.InputLength >
+            XENSTORE_RING_SIZE)
+            XENSTORED_COUNT(RequestWraps, 1);
+
+        XenstoredProcessRequest();
+        Xenstored.InputLength = 0;
+    }
+
+    return Progress;
+}
+
+static BOOLEAN
+XenstoredProduceResponses(
+    VOID
+    )
+{
+    struct xenstore_domain_interface    *Shared = Xenstored.Shared;
+    XENSTORE_RING_IDX                   cons;
+    XENSTORE_RING_IDX                   prod;
+    BOOLEAN                             Progress;
+
+    cons = __atomic_load_n(&Shared->rsp_cons, __ATOMIC_ACQUIRE);
+    prod = Shared->rsp_prod;
+
+    Progress = FALSE;
+    while (!IsListEmpty(&Xenstored.OutputList)) {
+        PXENSTORED_MESSAGE  Message;
+        ULONG               Index;
+        ULONG               Length;
+
+        Message = CONTAINING_RECORD(Xenstored.OutputList.Flink,
+                                    XENSTORED_MESSAGE,
+                                    ListEntry);
+
+        if (prod - cons == XENSTORE_RING_SIZE) {
+            if (!Xenstored.Stalled)
+                XENSTORED_COUNT(ResponseStalls, 1);
+
+            Xenstored.Stalled = TRUE;
+            break;
+        }
+
+        Xenstored.Stalled = FALSE;
+
+        Index = MASK_XENSTORE_IDX(prod);
+
+        if (Message->Offset == 0 && Index + Message->Length > XENSTORE_RING_SIZE)
+            XENSTORED_COUNT(ResponseWraps, 1);
+
+        Length = Message->Length - Message->Offset;
+        Length = __min(Length, XENSTORE_RING_SIZE - (prod - cons));
+        Length = __min(Length, XENSTORE_RING_SIZE - Index);
+
+        RtlCopyMemory(&Shared->rsp[Index], Message->Data + Message->Offset, Length);
+
+        Message->Offset += Length;
+        prod += Length;
+
+        XENSTORED_COUNT(ResponseBytes, Length);
+        Progress = TRUE;
+
+        if (Message->Offset != Message->Length)
+            continue;
+
+        if (Message->WatchEvent)
+            XENSTORED_COUNT(WatchEvents, 1);
+        else
+            XENSTORED_COUNT(Responses, 1);
+
+        RemoveEntryList(&Message->ListEntry);
+        free(Message);
+    }
+
+    __atomic_store_n(&Shared->rsp_prod, prod, __ATOMIC_RELEASE);
+
+    return Progress;
+}
+
+static PVOID
+XenstoredThread(
+    PVOID   Argument
+    )
+{
+    ULONG   Pending = 0;
+
+    UNREFERENCED_PARAMETER(Argument);
+
+    for (;;) {
+        BOOLEAN Progress;
+
+        pthread_mutex_lock(&Xenstored.Lock);
+        while (Xenstored.Pending == Pending && !Xenstored.Stopping)
+            pthread_cond_wait(&Xenstored.Condition, &Xenstored.Lock);
+
+        Pending = Xenstored.Pending;
+        pthread_mutex_unlock(&Xenstored.Lock);
+
+        if (Xenstored.Stopping)
+            break;
+
+        XENSTORED_COUNT(Wakeups, 1);
+
+        do {
+            Progress = XenstoredConsumeRequests();
+            Progress |= XenstoredProduceResponses();
+
+            if (Progress) {
+                XENSTORED_COUNT(Notifications, 1);
+                XenbusNotifyGuest();
+            }
+        } while (Progress);
+    }
+
+    return NULL;
+}
+
+VOID
+XenstoredNotify(
+    VOID
+    )
+{
+    pthread_mutex_lock(&Xenstored.Lock);
+    Xenstored.Pending++;
+    pthread_cond_signal(&Xenstored.Condition);
+    pthread_mutex_unlock(&Xenstored.Lock);
+}
+
+VOID
+XenstoredQueryStatistics(
+    _Out_ PXENSTORED_STATISTICS Statistics
+    )
+{
+    ULONGLONG                   *Source = (ULONGLONG *)&Xenstored.Statistics;
+    ULONGLONG                   *Destination = (ULONGLONG *)Statistics;
+    ULONG                       Index;
+
+    for (Index = 0;
+         Index < sizeof (XENSTORED_STATISTICS) / sizeof (ULONGLONG);
+         Index++)
+        Destination[Index] = __atomic_load_n(&Source[Index], __ATOMIC_RELAXED);
+}
+
+PVOID
+XenstoredInitialize(
+    _In_ ULONG  Delay,
+    _In_ ULONG  ConflictRate
+    )
+{
+    RtlZeroMemory(&Xenstored, sizeof (XENSTORED_CONTEXT));
+
+    Xenstored.Shared = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+    if (Xenstored.Shared == NULL)
+        goto fail1;
+
+    RtlZeroMemory(Xenstored.Shared, PAGE_SIZE);
+
+    Xenstored.Delay = Delay;
+    Xenstored.ConflictRate = ConflictRate;
+    Xenstored.Seed = 1;
+
+    InitializeListHead(&Xenstored.OutputList);
+    InitializeListHead(&Xenstored.WatchList);
+
+    Xenstored.Root = XenstoredCreateNode(NULL, "/");
+    if (Xenstored.Root == NULL)
+        goto fail2;
+
+    // The root is the only node whose Name is not after its last '/'
+    Xenstored.Root->Name = Xenstored.Root->Path + 1;
+
+    if (XenstoredCreatePath(XENSTORED_DOMAIN_PATH) == NULL)
+        goto fail3;
+
+    pthread_mutex_init(&Xenstored.Lock, NULL);
+    pthread_cond_init(&Xenstored.Condition, NULL);
+
+    if (pthread_create(&Xenstored.Thread, NULL, XenstoredThread, NULL) != 0)
+        goto fail4;
+
+    return Xenstored.Shared;
+
+fail4:
+    pthread_cond_destroy(&Xenstored.Condition);
+    pthread_mutex_destroy(&Xenstored.Lock);
+
+fail3:
+    XenstoredDestroyNode(Xenstored.Root);
+
+fail2:
+    free(Xenstored.Shared);
+
+fail1:
+    return NULL;
+}
+
+VOID
+XenstoredTeardown(
+    VOID
+    )
+{
+    pthread_mutex_lock(&Xenstored.Lock);
+    Xenstored.Stopping = TRUE;
+    pthread_cond_signal(&Xenstored.Condition);
+    pthread_mutex_unlock(&Xenstored.Lock);
+
+    pthread_join(Xenstored.Thread, NULL);
+
+    pthread_cond_destroy(&Xenstored.Condition);
+    pthread_mutex_destroy(&Xenstored.Lock);
+
+    while (!IsListEmpty(&Xenstored.OutputList)) {
+        PLIST_ENTRY ListEntry = RemoveHeadList(&Xenstored.OutputList);
+
+        free(CONTAINING_RECORD(ListEntry, XENSTORED_MESSAGE, ListEntry));
+    }
+
+    while (!IsListEmpty(&Xenstored.WatchList))
+        XenstoredFreeWatch(CONTAINING_RECORD(Xenstored.WatchList.Flink,
+                                             XENSTORED_WATCH,
+                                             ListEntry));
+
+    XenstoredDestroyNode(Xenstored.Root);
+    free(Xenstored.Shared);
+
+    RtlZeroMemory(&Xenstored, sizeof (XENSTORED_CONTEXT));
+}
@@ -37,6 +37,9 @@
 
 #include "thread.h"
 #include "cache.h"
+#include "hash_table.h"
+#include "driver.h"
+#include "registry.h"
 #include "dbg_print.h"
 #include "assert.h"
 #include "util.h"
@@ -47,31 +50,119 @@ RtlRandomEx (
     __inout PULONG Seed
     );
 
-#define XENBUS_CACHE_MAGAZINE_SLOTS   6
+#define XENBUS_CACHE_MAGAZINE_SLOTS_MINIMUM 2
+#define XENBUS_CACHE_MAGAZINE_SLOTS_DEFAULT 6
+#define XENBUS_CACHE_MAGAZINE_SLOTS_MAXIMUM 64
 
 typedef struct _XENBUS_CACHE_MAGAZINE {
-    PVOID   Slot[XENBUS_CACHE_MAGAZINE_SLOTS];
+    LIST_ENTRY  ListEntry;
+    ULONG       Size;
+    ULONG       Count;
+    PVOID       Slot[1];
 } XENBUS_CACHE_MAGAZINE, *PXENBUS_CACHE_MAGAZINE;
 
+//
+// Each CPU has a 'loaded' magazine and a 'previous' magazine. The
+// previous magazine is always either full, empty or absent so that a
+// single swap is sufficient to satisfy a Get or a Put without touching
+// the depot.
+//
+typedef struct _XENBUS_CACHE_CPU {
+    PXENBUS_CACHE_MAGAZINE  Loaded;
+    PXENBUS_CACHE_MAGAZINE  Previous;
+    ULONG                   Operations;
+    ULONG                   Misses;
+    ULONGLONG               MagazineHits;
+    ULONGLONG               DepotHits;
+    ULONGLONG               SlabHits;
+    ULONGLONG               SlabCreations;
+    ULONGLONG               CtorCalls;
+    ULONGLONG               LockAcquisitions;
+    ULONGLONG               LockHoldTicks;
+} XENBUS_CACHE_CPU, *PXENBUS_CACHE_CPU;
+
+typedef struct _XENBUS_CACHE_DEPOT {
+    LIST_ENTRY  List;
+    ULONG       Count;
+    ULONG       Minimum;
+} XENBUS_CACHE_DEPOT, *PXENBUS_CACHE_DEPOT;
+
 #define XENBUS_CACHE_SLAB_MAGIC 'BALS'
 
+//
+// Each bit in Summary is set if the corresponding word of Mask has at
+// least one clear bit, so a clear bit can be found with two bit-scans per
+// 1024 bits. Bits beyond Size in the last word of Mask are kept set.
+//
 typedef struct _XENBUS_CACHE_MASK {
     ULONG   Size;
     ULONG   Count;
+    ULONG   Words;
+    PULONG  Summary;
     ULONG   Mask[1];
 } XENBUS_CACHE_MASK, *PXENBUS_CACHE_MASK;
 
 #define BITS_PER_ULONG  (sizeof (ULONG) * 8)
 
+//
+// Slabs are filed in lists according to their occupancy: bucket 0 holds
+// empty slabs, the last bucket holds full slabs and the buckets in between
+// hold partially occupied slabs in order of increasing occupancy.
+//
+#define XENBUS_CACHE_SLAB_BUCKETS   10
+#define XENBUS_CACHE_SLAB_EMPTY     0
+#define XENBUS_CACHE_SLAB_FULL      (XENBUS_CACHE_SLAB_BUCKETS - 1)
+
+//
+// A slab is 2^Order contiguous (virtual) pages. The order is chosen when
+// the cache is created as the smallest that wastes no more than
+// 1/XENBUS_CACHE_SLAB_WASTE_FRACTION of the slab. For objects of at least
+// XENBUS_CACHE_SLAB_OFF_SLAB_MINIMUM bytes the slab header is allocated
+// separately so that it does not displace an object.
+//
+#define XENBUS_CACHE_SLAB_ORDER_MAXIMUM     3
+#define XENBUS_CACHE_SLAB_ORDER_LIMIT       8
+#define XENBUS_CACHE_SLAB_WASTE_FRACTION    8
+#define XENBUS_CACHE_SLAB_OFF_SLAB_MINIMUM  (PAGE_SIZE / 8)
+
 typedef struct _XENBUS_CACHE_SLAB {
     ULONG               Magic;
     PXENBUS_CACHE       Cache;
+    PUCHAR              Base;
     LIST_ENTRY          ListEntry;
+    ULONG               Node;
+    ULONG               Bucket;
+    ULONG               Colour;
     PXENBUS_CACHE_MASK  Constructed;
     PXENBUS_CACHE_MASK  Allocated;
-    UCHAR               Buffer[1];
+    PUCHAR              Buffer;
 } XENBUS_CACHE_SLAB, *PXENBUS_CACHE_SLAB;
 
+//
+// Slabs are allocated from, and filed on, the NUMA node of the CPU that
+// needed them so that objects are handed out from node-local memory
+// wherever possible.
+//
+typedef struct _XENBUS_CACHE_NODE {
+    LIST_ENTRY  SlabList[XENBUS_CACHE_SLAB_BUCKETS];
+    ULONG       Count;
+    ULONG       Allocated;
+    ULONG       Slabs;
+} XENBUS_CACHE_NODE, *PXENBUS_CACHE_NODE;
+
+//
+// The monitor keeps the peak number of objects allocated from slabs in
+// each of the last few periods. Empty slabs are only reclaimed beyond the
+// largest of those peaks (the working set) plus a hysteresis margin, so
+// that a cache is not shrunk just before the next burst.
+//
+#define XENBUS_CACHE_MONITOR_PERIOD 5
+
+#define XENBUS_CACHE_WORKING_SET_PERIODS_DEFAULT    12
+#define XENBUS_CACHE_WORKING_SET_PERIODS_MAXIMUM    60
+#define XENBUS_CACHE_WORKING_SET_HYSTERESIS_DEFAULT 25
+#define XENBUS_CACHE_WORKING_SET_HYSTERESIS_MAXIMUM 100
+
 #define MAXNAMELEN      128
 
 struct _XENBUS_CACHE {
@@ -85,11 +176,39 @@ struct _XENBUS_CACHE {
     VOID                    (*AcquireLock)(PVOID);
     VOID                    (*ReleaseLock)(PVOID);
     PVOID                   Argument;
-    LIST_ENTRY              SlabList;
-    PLIST_ENTRY             Cursor;
+    ULONG                   SlabOrder;
+    ULONG                   SlabObjects;
+    ULONG                   SlabWaste;
+    BOOLEAN                 OffSlab;
+    ULONG                   ColourAlignment;
+    ULONG                   Colours;
+    ULONG                   NextColour;
+    PXENBUS_HASH_TABLE      SlabTable;
+    PXENBUS_CACHE_NODE      Node;
+    ULONG                   NodeCount;
     ULONG                   Count;
-    PXENBUS_CACHE_MAGAZINE  Magazine;
-    ULONG                   MagazineCount;
+    ULONG                   Allocated;
+    ULONG                   PeakAllocated;
+    ULONG                   History[XENBUS_CACHE_WORKING_SET_PERIODS_MAXIMUM];
+    ULONG                   HistoryIndex;
+    ULONG                   WorkingSet;
+    ULONG                   ReclaimTarget;
+    ULONG                   Periods;
+    ULONG                   LastReclaimPeriod;
+    ULONG                   LastReclaimSlabs;
+    ULONG                   LastReclaimObjects;
+    ULONG                   ReclaimedSlabs;
+    PXENBUS_CACHE_CPU       Cpu;
+    ULONG                   CpuCount;
+    XENBUS_CACHE_DEPOT      FullDepot;
+    XENBUS_CACHE_DEPOT      EmptyDepot;
+    ULONG                   MagazineSize;
+    ULONG                   LockAcquisitions;
+    ULONG                   LastOperations;
+    ULONG                   LastMisses;
+    ULONG                   LastLockAcquisitions;
+    ULONG                   MissRate;
+    ULONG                   LockRate;
     LONG                    CurrentSlabs;
     LONG                    MaximumSlabs;
     LONG                    CurrentObjects;
@@ -104,6 +223,11 @@ struct _XENBUS_CACHE_CONTEXT {
     PXENBUS_DEBUG_CALLBACK  DebugCallback;
     PXENBUS_THREAD          MonitorThread;
     LIST_ENTRY              List;
+    ULONG                   MagazineSizeMinimum;
+    ULONG                   MagazineSizeMaximum;
+    ULONG                   SlabOrderMaximum;
+    ULONG                   WorkingSetPeriods;
+    ULONG                   WorkingSetHysteresis;
 };
 
 #define CACHE_TAG   'HCAC'
@@ -124,6 +248,50 @@ __CacheFree(
     __FreePoolWithTag(Buffer, CACHE_TAG);
 }
 
+#if defined(NTDDI_WIN10_VB) && (NTDDI_VERSION >= NTDDI_WIN10_VB)
+#define XENBUS_CACHE_NODE_PREFERENCE 1
+
+typedef PVOID (*EXALLOCATEPOOL3)(POOL_FLAGS, SIZE_T, ULONG, PCPOOL_EXTENDED_PARAMETER, ULONG);
+
+static EXALLOCATEPOOL3  __CacheExAllocatePool3;
+#endif
+
+//
+// Slab memory is allocated from non-paged pool on the requested NUMA
+// node where the kernel provides ExAllocatePool3(). Otherwise the pool
+// allocates from the node of the current CPU, so the node is updated to
+// match and the slab is filed under the node it really came from.
+//
+static PVOID
+CacheAllocateSlabMemory(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          Length,
+    _Inout_ PULONG      Node
+    )
+{
+#ifdef XENBUS_CACHE_NODE_PREFERENCE
+    if (__CacheExAllocatePool3 != NULL) {
+        POOL_EXTENDED_PARAMETER Parameter;
+
+        RtlZeroMemory(&Parameter, sizeof (POOL_EXTENDED_PARAMETER));
+        Parameter.Type = PoolExtendedParameterNumaNode;
+        Parameter.PreferredNode = *Node;
+
+        return __CacheExAllocatePool3(POOL_FLAG_NON_PAGED,
+                                      Length,
+                                      CACHE_TAG,
+                                      &Parameter,
+                                      1);
+    }
+#endif
+
+    *Node = KeGetCurrentNodeNumber();
+    if (*Node >= Cache->NodeCount)
+        *Node = 0;
+
+    return __CacheAllocate(Length);
+}
+
 static FORCEINLINE VOID
 _IRQL_requires_(DISPATCH_LEVEL)
 __CacheAcquireLock(
@@ -162,43 +330,240 @@ __CacheDtor(
     Cache->Dtor(Cache->Argument, Object);
 }
 
+static FORCEINLINE PXENBUS_CACHE_CPU
+_IRQL_requires_(DISPATCH_LEVEL)
+__CacheGetCpu(
+    _In_ PXENBUS_CACHE  Cache
+    )
+{
+    ULONG               Index = KeGetCurrentProcessorNumberEx(NULL);
+
+    ASSERT3U(Index, <, Cache->CpuCount);
+    return &Cache->Cpu[Index];
+}
+
+//
+// The 64-bit per-CPU counters are only updated by their own CPU but may be
+// read from any CPU, so they are always loaded and stored in a single
+// access to avoid torn values on x86.
+//
+static FORCEINLINE VOID
+__CacheCounterAdd(
+    _Inout_ PULONGLONG  Counter,
+    _In_ ULONGLONG      Delta
+    )
+{
+    WriteULong64NoFence(Counter, ReadULong64NoFence(Counter) + Delta);
+}
+
+#define __CacheCounterIncrement(_Counter) \
+        __CacheCounterAdd((_Counter), 1)
+
+//
+// Querying the performance counter can be expensive under a hypervisor so
+// only one in every XENBUS_CACHE_LOCK_HOLD_SAMPLE acquisitions of the cache
+// lock is timed. The total hold time is estimated from the sample.
+//
+#define XENBUS_CACHE_LOCK_HOLD_SAMPLE   64
+
+static FORCEINLINE BOOLEAN
+__CacheLockHoldIsSampled(
+    _In_ PXENBUS_CACHE_CPU  Cpu
+    )
+{
+    return ((Cpu->LockAcquisitions % XENBUS_CACHE_LOCK_HOLD_SAMPLE) == 0) ?
+           TRUE :
+           FALSE;
+}
+
+static FORCEINLINE ULONGLONG
+__CacheCounterRead(
+    _In_ PULONGLONG Counter
+    )
+{
+    return ReadULong64NoFence(Counter);
+}
+
 static PVOID
 CacheGetObjectFromMagazine(
-    _In_ PXENBUS_CACHE_MAGAZINE Magazine
+    _In_opt_ PXENBUS_CACHE_MAGAZINE Magazine
     )
 {
-    ULONG                       Index;
-
-    for (Index = 0; Index < XENBUS_CACHE_MAGAZINE_SLOTS; Index++) {
-        PVOID   Object;
+    PVOID                           Object;
 
-        if (Magazine->Slot[Index] != NULL) {
-            Object = Magazine->Slot[Index];
-            Magazine->Slot[Index] = NULL;
+    if (Magazine == NULL || Magazine->Count == 0)
+        return NULL;
 
-            return Object;
-        }
-    }
+    --Magazine->Count;
+    Object = Magazine->Slot[Magazine->Count];
+    Magazine->Slot[Magazine->Count] = NULL;
 
-    return NULL;
+    return Object;
 }
 
 static NTSTATUS
 CachePutObjectToMagazine(
-    _In_ PXENBUS_CACHE_MAGAZINE Magazine,
-    _In_ PVOID                  Object
+    _In_opt_ PXENBUS_CACHE_MAGAZINE Magazine,
+    _In_ PVOID                      Object
     )
 {
-    ULONG                       Index;
+    if (Magazine == NULL || Magazine->Count == Magazine->Size)
+        return STATUS_UNSUCCESSFUL;
 
-    for (Index = 0; Index < XENBUS_CACHE_MAGAZINE_SLOTS; Index++) {
-        if (Magazine->Slot[Index] == NULL) {
-            Magazine->Slot[Index] = Object;
-            return STATUS_SUCCESS;
-        }
-    }
+    Magazine->Slot[Magazine->Count++] = Object;
+
+    return STATUS_SUCCESS;
+}
+
+static FORCEINLINE BOOLEAN
+__CacheMagazineIsEmpty(
+    _In_opt_ PXENBUS_CACHE_MAGAZINE Magazine
+    )
+{
+    return (Magazine != NULL && Magazine->Count == 0) ? TRUE : FALSE;
+}
+
+static FORCEINLINE BOOLEAN
+__CacheMagazineIsFull(
+    _In_opt_ PXENBUS_CACHE_MAGAZINE Magazine
+    )
+{
+    return (Magazine != NULL &&
+            Magazine->Count == Magazine->Size) ? TRUE : FALSE;
+}
+
+static FORCEINLINE VOID
+__CacheSwapMagazines(
+    _In_ PXENBUS_CACHE_CPU  Cpu
+    )
+{
+    PXENBUS_CACHE_MAGAZINE  Magazine;
+
+    Magazine = Cpu->Loaded;
+    Cpu->Loaded = Cpu->Previous;
+    Cpu->Previous = Magazine;
+}
+
+static PXENBUS_CACHE_MAGAZINE
+CacheMagazineCreate(
+    _In_ ULONG              Size
+    )
+{
+    PXENBUS_CACHE_MAGAZINE  Magazine;
+
+    ASSERT(Size != 0);
 
-    return STATUS_UNSUCCESSFUL;
+    Magazine = __CacheAllocate(FIELD_OFFSET(XENBUS_CACHE_MAGAZINE, Slot) +
+                               (sizeof (PVOID) * Size));
+    if (Magazine == NULL)
+        return NULL;
+
+    Magazine->Size = Size;
+
+    return Magazine;
+}
+
+static VOID
+CacheMagazineDestroy(
+    _In_ PXENBUS_CACHE_MAGAZINE Magazine
+    )
+{
+    ULONG                       Size = Magazine->Size;
+
+    ASSERT3U(Magazine->Count, ==, 0);
+    Magazine->Size = 0;
+
+    ASSERT(IsZeroMemory(Magazine,
+                        FIELD_OFFSET(XENBUS_CACHE_MAGAZINE, Slot) +
+                        (sizeof (PVOID) * Size)));
+    __CacheFree(Magazine);
+}
+
+static VOID
+CacheDepotInitialize(
+    _Out_ PXENBUS_CACHE_DEPOT   Depot
+    )
+{
+    InitializeListHead(&Depot->List);
+    Depot->Count = 0;
+    Depot->Minimum = 0;
+}
+
+static VOID
+CacheDepotTeardown(
+    _In_ PXENBUS_CACHE_DEPOT    Depot
+    )
+{
+    ASSERT(IsListEmpty(&Depot->List));
+    ASSERT3U(Depot->Count, ==, 0);
+
+    RtlZeroMemory(Depot, sizeof (XENBUS_CACHE_DEPOT));
+}
+
+// Must be called with lock held
+static VOID
+CacheDepotInsert(
+    _In_ PXENBUS_CACHE_DEPOT    Depot,
+    _In_ PXENBUS_CACHE_MAGAZINE Magazine
+    )
+{
+    InsertTailList(&Depot->List, &Magazine->ListEntry);
+    Depot->Count++;
+}
+
+// Must be called with lock held
+static PXENBUS_CACHE_MAGAZINE
+CacheDepotRemove(
+    _In_ PXENBUS_CACHE_DEPOT    Depot
+    )
+{
+    PLIST_ENTRY                 ListEntry;
+
+    if (IsListEmpty(&Depot->List))
+        return NULL;
+
+    ListEntry = RemoveTailList(&Depot->List);
+    RtlZeroMemory(ListEntry, sizeof (LIST_ENTRY));
+
+    ASSERT(Depot->Count != 0);
+    --Depot->Count;
+
+    //
+    // Track the low water mark so that the monitor can tell how many
+    // magazines were not needed over the last period.
+    //
+    if (Depot->Count < Depot->Minimum)
+        Depot->Minimum = Depot->Count;
+
+    return CONTAINING_RECORD(ListEntry, XENBUS_CACHE_MAGAZINE, ListEntry);
+}
+
+static VOID
+CacheNodeInitialize(
+    _Out_ PXENBUS_CACHE_NODE    Node
+    )
+{
+    ULONG                       Bucket;
+
+    for (Bucket = 0; Bucket < XENBUS_CACHE_SLAB_BUCKETS; Bucket++)
+        InitializeListHead(&Node->SlabList[Bucket]);
+}
+
+static VOID
+CacheNodeTeardown(
+    _In_ PXENBUS_CACHE_NODE Node
+    )
+{
+    ULONG                   Bucket;
+
+    ASSERT3U(Node->Slabs, ==, 0);
+    ASSERT3U(Node->Allocated, ==, 0);
+    ASSERT3U(Node->Count, ==, 0);
+
+    for (Bucket = 0; Bucket < XENBUS_CACHE_SLAB_BUCKETS; Bucket++) {
+        ASSERT(IsListEmpty(&Node->SlabList[Bucket]));
+        RtlZeroMemory(&Node->SlabList[Bucket], sizeof (LIST_ENTRY));
+    }
 }
 
 static PXENBUS_CACHE_MASK
@@ -206,17 +571,33 @@ CacheMaskCreate(
     _In_ ULONG          Size
     )
 {
+    ULONG               Words;
+    ULONG               SummaryWords;
     ULONG               NumberOfBytes;
     PXENBUS_CACHE_MASK  Mask;
+    ULONG               Index;
+
+    Words = P2ROUNDUP(ULONG, Size, BITS_PER_ULONG) / BITS_PER_ULONG;
+    SummaryWords = P2ROUNDUP(ULONG, Words, BITS_PER_ULONG) / BITS_PER_ULONG;
 
     NumberOfBytes = FIELD_OFFSET(XENBUS_CACHE_MASK, Mask) +
-        (P2ROUNDUP(ULONG, Size, BITS_PER_ULONG) / 8);
+        (sizeof (ULONG) * (Words + SummaryWords));
 
     Mask = __CacheAllocate(NumberOfBytes);
     if (Mask == NULL)
         goto fail1;
 
     Mask->Size = Size;
+    Mask->Words = Words;
+    Mask->Summary = &Mask->Mask[Words];
+
+    // Every word starts with clear bits
+    for (Index = 0; Index < Words; Index++)
+        Mask->Summary[Index / BITS_PER_ULONG] |= 1u << (Index % BITS_PER_ULONG);
+
+    // Padding bits beyond Size must never be found clear
+    if (Size % BITS_PER_ULONG != 0)
+        Mask->Mask[Words - 1] = ~((1u << (Size % BITS_PER_ULONG)) - 1);
 
     return Mask;
 
@@ -248,6 +629,9 @@ __CacheMaskSet(
     Mask->Mask[Index] |= Value;
     ASSERT(Mask->Count < Mask->Size);
     Mask->Count++;
+
+    if (Mask->Mask[Index] == ~0u)
+        Mask->Summary[Index / BITS_PER_ULONG] &= ~(1u << (Index % BITS_PER_ULONG));
 }
 
 static FORCEINLINE BOOLEAN
@@ -279,6 +663,40 @@ __CacheMaskClear(
     --Mask->Count;
     ASSERT(Mask->Mask[Index] & Value);
     Mask->Mask[Index] &= ~Value;
+
+    Mask->Summary[Index / BITS_PER_ULONG] |= 1u << (Index % BITS_PER_ULONG);
+}
+
+static FORCEINLINE BOOLEAN
+__CacheMaskScanClear(
+    _In_ PXENBUS_CACHE_MASK Mask,
+    _Out_ PULONG            Bit
+    )
+{
+    ULONG                   SummaryWords;
+    ULONG                   Index;
+
+    SummaryWords = P2ROUNDUP(ULONG, Mask->Words, BITS_PER_ULONG) / BITS_PER_ULONG;
+
+    for (Index = 0; Index < SummaryWords; Index++) {
+        ULONG   Word;
+        ULONG   Offset;
+
+        if (!_BitScanForward(&Word, Mask->Summary[Index]))
+            continue;
+
+        Word += Index * BITS_PER_ULONG;
+        ASSERT3U(Word, <, Mask->Words);
+
+        (VOID) _BitScanForward(&Offset, ~Mask->Mask[Word]);
+
+        *Bit = (Word * BITS_PER_ULONG) + Offset;
+        ASSERT3U(*Bit, <, Mask->Size);
+
+        return TRUE;
+    }
+
+    return FALSE;
 }
 
 static ULONG
@@ -297,97 +715,211 @@ CacheMaskCount(
     return Mask->Count;
 }
 
-static VOID
-CacheInsertSlab(
-    _In_ PXENBUS_CACHE      Cache,
-    _In_ PXENBUS_CACHE_SLAB New
+static FORCEINLINE ULONG
+__CacheSlabBucket(
+    _In_ PXENBUS_CACHE_SLAB Slab
     )
 {
-#define INSERT_BEFORE(_ListEntry, _New)             \
-        do {                                        \
-            (_New)->Blink = (_ListEntry)->Blink;    \
-            (_ListEntry)->Blink->Flink = (_New);    \
-                                                    \
-            (_ListEntry)->Blink = (_New);           \
-            (_New)->Flink = (_ListEntry);           \
-        } while (FALSE)
+    ULONG                   Count = CacheMaskCount(Slab->Allocated);
+    ULONG                   Size = CacheMaskSize(Slab->Allocated);
 
-    PLIST_ENTRY             ListEntry;
+    if (Count == 0)
+        return XENBUS_CACHE_SLAB_EMPTY;
 
-    ASSERT(CacheMaskCount(New->Allocated) < CacheMaskSize(New->Allocated));
+    if (Count == Size)
+        return XENBUS_CACHE_SLAB_FULL;
 
-    Cache->Cursor = NULL;
+    return 1 + (ULONG)(((ULONGLONG)Count * (XENBUS_CACHE_SLAB_BUCKETS - 2)) /
+                       Size);
+}
 
-    for (ListEntry = Cache->SlabList.Flink;
-         ListEntry != &Cache->SlabList;
-         ListEntry = ListEntry->Flink) {
-        PXENBUS_CACHE_SLAB  Slab;
+//
+// A single page slab with an on-slab header is found from any of its
+// objects by rounding down to the page. Otherwise slabs are found by
+// looking up the page frame of the object in the cache's slab table,
+// which has an entry for every page of every such slab.
+//
+static FORCEINLINE BOOLEAN
+__CacheSlabIsIndexed(
+    _In_ PXENBUS_CACHE  Cache
+    )
+{
+    return (Cache->SlabOrder != 0 || Cache->OffSlab) ? TRUE : FALSE;
+}
 
-        Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+static FORCEINLINE ULONG_PTR
+__CacheSlabKey(
+    _In_ PVOID  Address
+    )
+{
+    return (ULONG_PTR)Address >> PAGE_SHIFT;
+}
 
-        if (CacheMaskCount(Slab->Allocated) < CacheMaskCount(New->Allocated)) {
-            INSERT_BEFORE(ListEntry, &New->ListEntry);
-            goto done;
-        }
+static VOID
+CacheSlabLayout(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          OrderMaximum
+    )
+{
+    ULONG               Header;
+    ULONG               Minimum;
+    ULONG               Order;
 
-        if (CacheMaskCount(Slab->Allocated) < CacheMaskSize(Slab->Allocated) &&
-            Cache->Cursor == NULL)
-            Cache->Cursor = ListEntry;
-    }
+    Cache->OffSlab = (Cache->Size >= XENBUS_CACHE_SLAB_OFF_SLAB_MINIMUM) ?
+                     TRUE :
+                     FALSE;
+    Header = (Cache->OffSlab) ? 0 : sizeof (XENBUS_CACHE_SLAB);
 
-    InsertTailList(&Cache->SlabList, &New->ListEntry);
+    Minimum = 0;
+    while ((PAGE_SIZE << Minimum) < Header + Cache->Size)
+        Minimum++;
+
+    OrderMaximum = __max(OrderMaximum, Minimum);
+
+    for (Order = Minimum; Order <= OrderMaximum; Order++) {
+        ULONG   Bytes = PAGE_SIZE << Order;
+        ULONG   Count = (Bytes - Header) / Cache->Size;
+        ULONG   Waste = Bytes - (Count * Cache->Size);
 
-done:
-    if (Cache->Cursor == NULL) {
         //
-        // A newly inserted slab has either just been created, or has just had
-        // an object freed back to it. Either will it should never be full.
+        // Keep the order with the smallest proportion of waste, stopping
+        // as soon as an order is within bounds.
         //
-        ASSERT(CacheMaskCount(New->Allocated) < CacheMaskSize(New->Allocated));
-        Cache->Cursor = &New->ListEntry;
+        if (Order == Minimum ||
+            (ULONGLONG)Waste * (PAGE_SIZE << Cache->SlabOrder) <
+            (ULONGLONG)Cache->SlabWaste * Bytes) {
+            Cache->SlabOrder = Order;
+            Cache->SlabObjects = Count;
+            Cache->SlabWaste = Waste;
+        }
+
+        if (Waste * XENBUS_CACHE_SLAB_WASTE_FRACTION <= Bytes)
+            break;
     }
 
-#undef  INSERT_BEFORE
+    ASSERT(Cache->SlabObjects != 0);
+
+    //
+    // Use the bytes left over after the header and objects to stagger the
+    // start of successive slabs by a cache line, so that the same object in
+    // different slabs does not always land in the same CPU cache sets.
+    //
+    Cache->ColourAlignment = KeGetRecommendedSharedDataAlignment();
+    ASSERT(Cache->ColourAlignment != 0);
+
+    Cache->Colours = ((Cache->SlabWaste - Header) / Cache->ColourAlignment) + 1;
 }
 
-#if DBG
+// Must be called with lock held
 static VOID
-CacheAudit(
-    _In_ PXENBUS_CACHE  Cache
+CacheInsertSlab(
+    _In_ PXENBUS_CACHE      Cache,
+    _In_ PXENBUS_CACHE_SLAB Slab
+    )
+{
+    Slab->Bucket = __CacheSlabBucket(Slab);
+    ASSERT3U(Slab->Bucket, <, XENBUS_CACHE_SLAB_BUCKETS);
+
+    ASSERT3U(Slab->Node, <, Cache->NodeCount);
+    InsertHeadList(&Cache->Node[Slab->Node].SlabList[Slab->Bucket],
+                   &Slab->ListEntry);
+}
+
+// Must be called with lock held
+static VOID
+CacheRefileSlab(
+    _In_ PXENBUS_CACHE      Cache,
+    _In_ PXENBUS_CACHE_SLAB Slab
     )
 {
-    ULONG               Count = ULONG_MAX;
-    PLIST_ENTRY         ListEntry;
+    if (__CacheSlabBucket(Slab) == Slab->Bucket)
+        return;
+
+    RemoveEntryList(&Slab->ListEntry);
+    CacheInsertSlab(Cache, Slab);
+}
+
+// Must be called with lock held
+static PXENBUS_CACHE_SLAB
+CacheFindSlab(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          Node
+    )
+{
+    PLIST_ENTRY         SlabList;
+    LONG                Bucket;
+
+    ASSERT3U(Node, <, Cache->NodeCount);
+    SlabList = Cache->Node[Node].SlabList;
 
     //
-    // The cursor should point at the first slab that is not fully
-    // occupied.
+    // Prefer the most occupied slab that still has space so that
+    // allocations are concentrated and empty slabs can be spilled.
     //
-    for (ListEntry = Cache->SlabList.Flink;
-         ListEntry != &Cache->SlabList;
-         ListEntry = ListEntry->Flink) {
-        PXENBUS_CACHE_SLAB  Slab;
+    for (Bucket = XENBUS_CACHE_SLAB_FULL - 1;
+         Bucket >= XENBUS_CACHE_SLAB_EMPTY;
+         --Bucket) {
+        PLIST_ENTRY ListEntry;
 
-        Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+        if (IsListEmpty(&SlabList[Bucket]))
+            continue;
 
-        if (CacheMaskCount(Slab->Allocated) < CacheMaskSize(Slab->Allocated)) {
-            ASSERT3P(Cache->Cursor, ==, ListEntry);
-            break;
-        }
+        ListEntry = SlabList[Bucket].Flink;
+
+        return CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
     }
 
-    // Slabs should be kept in order of maximum to minimum occupancy
-    for (ListEntry = Cache->SlabList.Flink;
-         ListEntry != &Cache->SlabList;
-         ListEntry = ListEntry->Flink) {
-        PXENBUS_CACHE_SLAB  Slab;
+    return NULL;
+}
 
-        Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+#if DBG
+static VOID
+CacheAudit(
+    _In_ PXENBUS_CACHE  Cache
+    )
+{
+    ULONG               Index;
+    ULONG               Count;
 
-        ASSERT3U(CacheMaskCount(Slab->Allocated), <=, Count);
+    //
+    // Every slab should be filed in the bucket matching its occupancy on
+    // its own node, and the total capacity of all slabs should match the
+    // node and cache counts.
+    //
+    Count = 0;
+    for (Index = 0; Index < Cache->NodeCount; Index++) {
+        PXENBUS_CACHE_NODE  Node = &Cache->Node[Index];
+        ULONG               NodeCount;
+        ULONG               Allocated;
+        ULONG               Bucket;
+
+        NodeCount = 0;
+        Allocated = 0;
+        for (Bucket = 0; Bucket < XENBUS_CACHE_SLAB_BUCKETS; Bucket++) {
+            PLIST_ENTRY ListEntry;
+
+            for (ListEntry = Node->SlabList[Bucket].Flink;
+                 ListEntry != &Node->SlabList[Bucket];
+                 ListEntry = ListEntry->Flink) {
+                PXENBUS_CACHE_SLAB  Slab;
+
+                Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+
+                ASSERT3U(Slab->Node, ==, Index);
+                ASSERT3U(Slab->Bucket, ==, Bucket);
+                ASSERT3U(__CacheSlabBucket(Slab), ==, Bucket);
+
+                NodeCount += CacheMaskSize(Slab->Allocated);
+                Allocated += CacheMaskCount(Slab->Allocated);
+            }
+        }
 
-        Count = CacheMaskCount(Slab->Allocated);
+        ASSERT3U(NodeCount, ==, Node->Count);
+        ASSERT3U(Allocated, ==, Node->Allocated);
+        Count += NodeCount;
     }
+
+    ASSERT3U(Count, ==, Cache->Count);
 }
 #else
 #define CacheAudit(_Cache) ((VOID)(_Cache))
@@ -396,48 +928,95 @@ CacheAudit(
 // Must be called with lock held
 static NTSTATUS
 CacheCreateSlab(
-    _In_ PXENBUS_CACHE  Cache
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          Node
     )
 {
+    PUCHAR              Base;
     PXENBUS_CACHE_SLAB  Slab;
-    ULONG               NumberOfBytes;
+    ULONG               Pages;
     ULONG               Count;
+    ULONG               Index;
     LONG                SlabCount;
     NTSTATUS            status;
 
-    NumberOfBytes = P2ROUNDUP(ULONG,
-                              FIELD_OFFSET(XENBUS_CACHE_SLAB, Buffer) +
-                              Cache->Size,
-                              PAGE_SIZE);
-    Count = (NumberOfBytes - FIELD_OFFSET(XENBUS_CACHE_SLAB, Buffer)) /
-            Cache->Size;
+    Pages = 1u << Cache->SlabOrder;
+    Count = Cache->SlabObjects;
     ASSERT(Count != 0);
 
     status = STATUS_INSUFFICIENT_RESOURCES;
     if (Cache->Count + Count > Cache->Cap)
         goto fail1;
 
-    Slab = __CacheAllocate(NumberOfBytes);
-    ASSERT3P(Slab, ==, PAGE_ALIGN(Slab));
+    ASSERT3U(Node, <, Cache->NodeCount);
+
+    //
+    // Slabs are created with the cache lock held, possibly at
+    // DISPATCH_LEVEL, so they must come from non-paged pool rather than
+    // from the MDL page allocators. Pool allocations of a page or more
+    // are page aligned.
+    //
+    Base = CacheAllocateSlabMemory(Cache, Pages << PAGE_SHIFT, &Node);
 
     status = STATUS_NO_MEMORY;
-    if (Slab == NULL)
+    if (Base == NULL)
         goto fail2;
 
-    RtlZeroMemory(Slab, NumberOfBytes);
+    ASSERT3P(Base, ==, PAGE_ALIGN(Base));
+
+    ASSERT3U(Node, <, Cache->NodeCount);
+
+    RtlZeroMemory(Base, Pages << PAGE_SHIFT);
+
+    if (Cache->OffSlab) {
+        Slab = __CacheAllocate(sizeof (XENBUS_CACHE_SLAB));
+
+        status = STATUS_NO_MEMORY;
+        if (Slab == NULL)
+            goto fail3;
+
+        Slab->Buffer = Base;
+    } else {
+        Slab = (PXENBUS_CACHE_SLAB)Base;
+        Slab->Buffer = Base + sizeof (XENBUS_CACHE_SLAB);
+    }
+
+    Slab->Colour = Cache->NextColour;
+    Slab->Buffer += Slab->Colour * Cache->ColourAlignment;
+
+    ASSERT3P(Slab->Buffer + (Count * Cache->Size), <=, Base + (Pages << PAGE_SHIFT));
 
     Slab->Magic = XENBUS_CACHE_SLAB_MAGIC;
     Slab->Cache = Cache;
+    Slab->Base = Base;
+    Slab->Node = Node;
 
     Slab->Constructed = CacheMaskCreate(Count);
     if (Slab->Constructed == NULL)
-        goto fail3;
+        goto fail4;
 
     Slab->Allocated = CacheMaskCreate(Count);
     if (Slab->Allocated == NULL)
-        goto fail4;
+        goto fail5;
+
+    if (__CacheSlabIsIndexed(Cache)) {
+        for (Index = 0; Index < Pages; Index++) {
+            status = HashTableAdd(Cache->SlabTable,
+                                  __CacheSlabKey(Base + (Index << PAGE_SHIFT)),
+                                  (ULONG_PTR)Slab);
+            if (!NT_SUCCESS(status))
+                goto fail6;
+        }
+    }
+
+    if (++Cache->NextColour == Cache->Colours)
+        Cache->NextColour = 0;
+
+    __CacheCounterIncrement(&__CacheGetCpu(Cache)->SlabCreations);
 
     CacheInsertSlab(Cache, Slab);
+    Cache->Node[Node].Count += Count;
+    Cache->Node[Node].Slabs++;
     Cache->Count += Count;
 
     SlabCount = InterlockedIncrement(&Cache->CurrentSlabs);
@@ -446,15 +1025,30 @@ CacheCreateSlab(
 
     return STATUS_SUCCESS;
 
+fail6:
+    Error("fail6\n");
+
+    while (Index-- != 0)
+        (VOID) HashTableRemove(Cache->SlabTable,
+                               __CacheSlabKey(Base + (Index << PAGE_SHIFT)));
+
+    CacheMaskDestroy(Slab->Allocated);
+
+fail5:
+    Error("fail5\n");
+
+    CacheMaskDestroy(Slab->Constructed);
+
 fail4:
     Error("fail4\n");
 
-    CacheMaskDestroy(Slab->Constructed);
+    if (Cache->OffSlab)
+        __CacheFree(Slab);
 
 fail3:
     Error("fail3\n");
 
-    __CacheFree(Slab);
+    __CacheFree(Base);
 
 fail2:
     Error("fail2\n");
@@ -472,21 +1066,23 @@ CacheDestroySlab(
     _In_ PXENBUS_CACHE_SLAB Slab
     )
 {
+    PXENBUS_CACHE_NODE      Node;
+    PUCHAR                  Base;
     LONG                    Index;
 
+    ASSERT3U(Slab->Node, <, Cache->NodeCount);
+    Node = &Cache->Node[Slab->Node];
+
+    ASSERT3U(Node->Count, >=, CacheMaskSize(Slab->Allocated));
+    Node->Count -= CacheMaskSize(Slab->Allocated);
+
+    ASSERT(Node->Slabs != 0);
+    --Node->Slabs;
+
     ASSERT3U(Cache->Count, >=, CacheMaskSize(Slab->Allocated));
     Cache->Count -= CacheMaskSize(Slab->Allocated);
 
-    //
-    // The cursor slab should always be the first slab in the list that is not
-    // fully occupied. If we are destroying it then clearly it is empty, but
-    // it may be one of several empty slabs. Set the cursor to the current
-    // cursor's Flink so that it will either point at the next empty slab, or
-    // the list anchor if there are no more empty slabs.
-    //
-    if (Cache->Cursor == &Slab->ListEntry)
-        Cache->Cursor = Slab->ListEntry.Flink;
-
+    ASSERT3U(Slab->Bucket, ==, XENBUS_CACHE_SLAB_EMPTY);
     RemoveEntryList(&Slab->ListEntry);
     CacheAudit(Cache);
 
@@ -505,7 +1101,23 @@ CacheDestroySlab(
 
     CacheMaskDestroy(Slab->Allocated);
     CacheMaskDestroy(Slab->Constructed);
-    __CacheFree(Slab);
+
+    Base = Slab->Base;
+
+    if (__CacheSlabIsIndexed(Cache)) {
+        for (Index = 0; Index < (LONG)(1u << Cache->SlabOrder); Index++) {
+            NTSTATUS    status;
+
+            status = HashTableRemove(Cache->SlabTable,
+                                     __CacheSlabKey(Base + (Index << PAGE_SHIFT)));
+            ASSERT(NT_SUCCESS(status));
+        }
+    }
+
+    if (Cache->OffSlab)
+        __CacheFree(Slab);
+
+    __CacheFree(Base);
 }
 
 // Must be called with lock held
@@ -528,25 +1140,24 @@ CacheGetObjectFromSlab(
 	    goto fail1;
 
     //
-    // If there are unallocated but constructed objects then look for one of those,
-    // otherwise look for a free unconstructed object. (NOTE: The 'Constructed' mask
-    // should always be contiguous).
+    // Only constructed objects can be allocated and the 'Constructed' mask
+    // should always be contiguous, so the first clear bit in the 'Allocated'
+    // mask is either an unallocated but constructed object or, if there are
+    // none of those, the first unconstructed object.
     //
-    Index = (CacheMaskCount(Slab->Allocated) < CacheMaskCount(Slab->Constructed)) ?
-        0 : CacheMaskCount(Slab->Constructed);
-
-    while (Index < CacheMaskSize(Slab->Allocated)) {
-        if (!__CacheMaskTest(Slab->Allocated, Index))
-            break;
+    if (!__CacheMaskScanClear(Slab->Allocated, &Index))
+        goto fail1;
 
-        Index++;
-    }
+    ASSERT(IMPLY(CacheMaskCount(Slab->Allocated) < CacheMaskCount(Slab->Constructed),
+                 Index < CacheMaskCount(Slab->Constructed)));
 
     Object = (PVOID)&Slab->Buffer[Index * Cache->Size];
     ASSERT3U(Index, ==, (ULONG)((PUCHAR)Object - &Slab->Buffer[0]) /
              Cache->Size);
 
     if (!__CacheMaskTest(Slab->Constructed, Index)) {
+        __CacheCounterIncrement(&__CacheGetCpu(Cache)->CtorCalls);
+
         status = __CacheCtor(Cache, Object);
         if (!NT_SUCCESS(status))
             goto fail2;
@@ -555,6 +1166,10 @@ CacheGetObjectFromSlab(
     }
 
     __CacheMaskSet(Slab->Allocated, Index);
+    Cache->Node[Slab->Node].Allocated++;
+
+    if (++Cache->Allocated > Cache->PeakAllocated)
+        Cache->PeakAllocated = Cache->Allocated;
 
     return Object;
 
@@ -583,210 +1198,684 @@ CachePutObjectToSlab(
     BUG_ON(Index >= CacheMaskSize(Slab->Allocated));
 
     __CacheMaskClear(Slab->Allocated, Index);
+
+    ASSERT(Cache->Node[Slab->Node].Allocated != 0);
+    --Cache->Node[Slab->Node].Allocated;
+
+    ASSERT(Cache->Allocated != 0);
+    --Cache->Allocated;
 }
 
+// Must be called with lock held
+static VOID
+CacheReturnObjectToSlab(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ PVOID          Object
+    )
+{
+    PXENBUS_CACHE_SLAB  Slab;
+
+    if (__CacheSlabIsIndexed(Cache)) {
+        ULONG_PTR   Value;
+        NTSTATUS    status;
+
+        status = HashTableLookup(Cache->SlabTable,
+                                 __CacheSlabKey(Object),
+                                 &Value);
+        BUG_ON(!NT_SUCCESS(status));
+
+        Slab = (PXENBUS_CACHE_SLAB)Value;
+    } else {
+        Slab = (PXENBUS_CACHE_SLAB)PAGE_ALIGN(Object);
+    }
+
+    ASSERT3U(Slab->Magic, ==, XENBUS_CACHE_SLAB_MAGIC);
+    ASSERT3P(Slab->Cache, ==, Cache);
+
+    CachePutObjectToSlab(Slab, Object);
+    CacheRefileSlab(Cache, Slab);
+}
+
+// Must be called with lock held
+static VOID
+CacheDrainMagazine(
+    _In_ PXENBUS_CACHE          Cache,
+    _In_ PXENBUS_CACHE_MAGAZINE Magazine
+    )
+{
+    PVOID                       Object;
+
+    while ((Object = CacheGetObjectFromMagazine(Magazine)) != NULL)
+        CacheReturnObjectToSlab(Cache, Object);
+}
+
+//
+// Exchange the CPU's empty magazines for a full one from the depot.
+// Must be called with lock held.
+//
 static PVOID
-CacheGet(
+CacheGetObjectFromDepot(
+    _In_ PXENBUS_CACHE      Cache,
+    _In_ PXENBUS_CACHE_CPU  Cpu
+    )
+{
+    PXENBUS_CACHE_MAGAZINE  Magazine;
+
+    Magazine = CacheDepotRemove(&Cache->FullDepot);
+    if (Magazine == NULL)
+        return NULL;
+
+    ASSERT(__CacheMagazineIsFull(Magazine));
+
+    if (Cpu->Previous != NULL) {
+        ASSERT(__CacheMagazineIsEmpty(Cpu->Previous));
+
+        //
+        // Magazines of a stale size are freed rather than recycled so that
+        // the depot converges on the current magazine size.
+        //
+        if (Cpu->Previous->Size == Cache->MagazineSize)
+            CacheDepotInsert(&Cache->EmptyDepot, Cpu->Previous);
+        else
+            CacheMagazineDestroy(Cpu->Previous);
+    }
+
+    ASSERT(Cpu->Loaded == NULL || __CacheMagazineIsEmpty(Cpu->Loaded));
+    Cpu->Previous = Cpu->Loaded;
+    Cpu->Loaded = Magazine;
+
+    return CacheGetObjectFromMagazine(Cpu->Loaded);
+}
+
+//
+// Exchange the CPU's full magazines for an empty one from the depot,
+// creating a new empty magazine if necessary. Must be called with lock held.
+//
+static NTSTATUS
+CachePutObjectToDepot(
+    _In_ PXENBUS_CACHE      Cache,
+    _In_ PXENBUS_CACHE_CPU  Cpu,
+    _In_ PVOID              Object
+    )
+{
+    PXENBUS_CACHE_MAGAZINE  Magazine;
+
+    Magazine = CacheDepotRemove(&Cache->EmptyDepot);
+    if (Magazine != NULL && Magazine->Size != Cache->MagazineSize) {
+        CacheMagazineDestroy(Magazine);
+        Magazine = NULL;
+    }
+
+    if (Magazine == NULL)
+        Magazine = CacheMagazineCreate(Cache->MagazineSize);
+
+    if (Magazine == NULL)
+        return STATUS_NO_MEMORY;
+
+    ASSERT(__CacheMagazineIsEmpty(Magazine));
+
+    if (Cpu->Previous != NULL) {
+        ASSERT(__CacheMagazineIsFull(Cpu->Previous));
+        CacheDepotInsert(&Cache->FullDepot, Cpu->Previous);
+    }
+
+    ASSERT(Cpu->Loaded == NULL || __CacheMagazineIsFull(Cpu->Loaded));
+    Cpu->Previous = Cpu->Loaded;
+    Cpu->Loaded = Magazine;
+
+    return CachePutObjectToMagazine(Cpu->Loaded, Object);
+}
+
+// Must be called with lock held
+static PVOID
+CacheGetObjectFromSlabs(
+    _In_ PXENBUS_CACHE  Cache
+    )
+{
+    ULONG               Node;
+    PXENBUS_CACHE_SLAB  Slab;
+    PVOID               Object;
+    NTSTATUS            status;
+
+    Node = KeGetCurrentNodeNumber();
+    if (Node >= Cache->NodeCount)
+        Node = 0;
+
+    Slab = CacheFindSlab(Cache, Node);
+    if (Slab != NULL)
+        goto found;
+
+    status = CacheCreateSlab(Cache, Node);
+    if (NT_SUCCESS(status)) {
+        Slab = CacheFindSlab(Cache, Node);
+        ASSERT(Slab != NULL);
+        goto found;
+    }
+
+    //
+    // If no slab could be created locally (e.g. because the cache has hit
+    // its cap) then fall back to objects on the other nodes.
+    //
+    for (Node = 0; Node < Cache->NodeCount; Node++) {
+        Slab = CacheFindSlab(Cache, Node);
+        if (Slab != NULL)
+            goto found;
+    }
+
+    return NULL;
+
+found:
+    Object = CacheGetObjectFromSlab(Slab);
+    CacheRefileSlab(Cache, Slab);
+
+    return Object;
+}
+
+//
+// Objects are taken from the CPU's magazines until they run dry; after that
+// the cache lock is acquired once and the remainder of the batch is satisfied
+// by exchanging whole magazines with the depot and, as a last resort, from
+// the slabs.
+//
+static ULONG
+CacheGetBatch(
     _In_ PINTERFACE         Interface,
     _In_ PXENBUS_CACHE      Cache,
+    _Out_writes_to_(Count, return) PVOID *Objects,
+    _In_ ULONG              Count,
     _In_ BOOLEAN            Locked
     )
 {
     KIRQL                   Irql;
-    ULONG                   Index;
-    PXENBUS_CACHE_MAGAZINE  Magazine;
+    PXENBUS_CACHE_CPU       Cpu;
+    BOOLEAN                 Acquired;
+    BOOLEAN                 Timed;
+    LARGE_INTEGER           Start;
+    ULONG                   Obtained;
     PVOID                   Object;
     LONG                    ObjectCount;
 
     UNREFERENCED_PARAMETER(Interface);
 
     ASSERT(Cache != NULL);
+    ASSERT(Objects != NULL);
 
     KeRaiseIrql(DISPATCH_LEVEL, &Irql);
-    Index = KeGetCurrentProcessorNumberEx(NULL);
+    Cpu = __CacheGetCpu(Cache);
 
-    ASSERT3U(Index, <, Cache->MagazineCount);
-    Magazine = &Cache->Magazine[Index];
+    Acquired = FALSE;
+    Timed = FALSE;
+    Start.QuadPart = 0;
 
-    Object = CacheGetObjectFromMagazine(Magazine);
-    if (Object != NULL)
-        goto done;
+    for (Obtained = 0; Obtained < Count; Obtained++) {
+        Cpu->Operations++;
 
-    if (!Locked)
-        __CacheAcquireLock(Cache);
+        Object = CacheGetObjectFromMagazine(Cpu->Loaded);
+        if (Object != NULL) {
+            __CacheCounterIncrement(&Cpu->MagazineHits);
+            goto next;
+        }
 
-again:
-    if (Cache->Cursor != &Cache->SlabList) {
-        PLIST_ENTRY         ListEntry = Cache->Cursor;
-        PXENBUS_CACHE_SLAB  Slab;
+        Cpu->Misses++;
 
-        Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+        if (__CacheMagazineIsFull(Cpu->Previous)) {
+            __CacheSwapMagazines(Cpu);
 
-        Object = CacheGetObjectFromSlab(Slab);
+            Object = CacheGetObjectFromMagazine(Cpu->Loaded);
+            ASSERT(Object != NULL);
 
-        //
-        // If the slab is now fully occupied, ove the cursor on to the next
-        // slab. If there are no more slabed then Flink will be pointing at
-        // Cache->SlabList so we will create a new slab next time round, if
-        // necessary.
-        //
-        if (CacheMaskCount(Slab->Allocated) == CacheMaskSize(Slab->Allocated))
-            Cache->Cursor = Slab->ListEntry.Flink;
-    } else {
-        NTSTATUS status;
+            __CacheCounterIncrement(&Cpu->MagazineHits);
+            goto next;
+        }
+
+        if (!Acquired) {
+            if (!Locked)
+                __CacheAcquireLock(Cache);
+
+            Timed = __CacheLockHoldIsSampled(Cpu);
+            if (Timed)
+                Start = KeQueryPerformanceCounter(NULL);
+
+            Cache->LockAcquisitions++;
+            __CacheCounterIncrement(&Cpu->LockAcquisitions);
+            Acquired = TRUE;
+        }
+
+        Object = CacheGetObjectFromDepot(Cache, Cpu);
+        if (Object != NULL) {
+            __CacheCounterIncrement(&Cpu->DepotHits);
+            goto next;
+        }
+
+        Object = CacheGetObjectFromSlabs(Cache);
+        if (Object == NULL)
+            break;
+
+        __CacheCounterIncrement(&Cpu->SlabHits);
+
+next:
+        Objects[Obtained] = Object;
+    }
+
+    if (Acquired) {
+        CacheAudit(Cache);
+
+        if (Timed)
+            __CacheCounterAdd(&Cpu->LockHoldTicks,
+                              KeQueryPerformanceCounter(NULL).QuadPart -
+                              Start.QuadPart);
+
+        if (!Locked)
+            __CacheReleaseLock(Cache);
+    }
+
+    if (Obtained != 0) {
+        ObjectCount = __InterlockedAdd(&Cache->CurrentObjects, (LONG)Obtained);
+        if (ObjectCount > Cache->MaximumObjects)
+            Cache->MaximumObjects = ObjectCount;
+    }
+
+    KeLowerIrql(Irql);
+
+    return Obtained;
+}
+
+static PVOID
+CacheGet(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ BOOLEAN        Locked
+    )
+{
+    PVOID               Object;
+
+    if (CacheGetBatch(Interface, Cache, &Object, 1, Locked) == 0)
+        return NULL;
+
+    return Object;
+}
+
+//
+// Objects are pushed into the CPU's magazines until they fill; after that
+// the cache lock is acquired once and the remainder of the batch is handed
+// to the depot a magazine at a time, falling back to the slabs if no empty
+// magazine can be found.
+//
+static VOID
+CachePutBatch(
+    _In_ PINTERFACE         Interface,
+    _In_ PXENBUS_CACHE      Cache,
+    _In_reads_(Count) PVOID *Objects,
+    _In_ ULONG              Count,
+    _In_ BOOLEAN            Locked
+    )
+{
+    KIRQL                   Irql;
+    PXENBUS_CACHE_CPU       Cpu;
+    BOOLEAN                 Acquired;
+    BOOLEAN                 Timed;
+    LARGE_INTEGER           Start;
+    ULONG                   Returned;
+    PVOID                   Object;
+    NTSTATUS                status;
+
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT(Cache != NULL);
+    ASSERT(Objects != NULL);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    Cpu = __CacheGetCpu(Cache);
+
+    Acquired = FALSE;
+    Timed = FALSE;
+    Start.QuadPart = 0;
+
+    for (Returned = 0; Returned < Count; Returned++) {
+        Object = Objects[Returned];
+        ASSERT(Object != NULL);
+
+        Cpu->Operations++;
+
+        status = CachePutObjectToMagazine(Cpu->Loaded, Object);
+        if (NT_SUCCESS(status)) {
+            __CacheCounterIncrement(&Cpu->MagazineHits);
+            continue;
+        }
+
+        Cpu->Misses++;
+
+        if (__CacheMagazineIsEmpty(Cpu->Previous)) {
+            __CacheSwapMagazines(Cpu);
+
+            status = CachePutObjectToMagazine(Cpu->Loaded, Object);
+            ASSERT(NT_SUCCESS(status));
+
+            __CacheCounterIncrement(&Cpu->MagazineHits);
+            continue;
+        }
+
+        if (!Acquired) {
+            if (!Locked)
+                __CacheAcquireLock(Cache);
+
+            Timed = __CacheLockHoldIsSampled(Cpu);
+            if (Timed)
+                Start = KeQueryPerformanceCounter(NULL);
+
+            Cache->LockAcquisitions++;
+            __CacheCounterIncrement(&Cpu->LockAcquisitions);
+            Acquired = TRUE;
+        }
+
+        status = CachePutObjectToDepot(Cache, Cpu, Object);
+        if (NT_SUCCESS(status)) {
+            __CacheCounterIncrement(&Cpu->DepotHits);
+            continue;
+        }
+
+        CacheReturnObjectToSlab(Cache, Object);
+        __CacheCounterIncrement(&Cpu->SlabHits);
+    }
+
+    if (Acquired) {
+        CacheAudit(Cache);
+
+        if (Timed)
+            __CacheCounterAdd(&Cpu->LockHoldTicks,
+                              KeQueryPerformanceCounter(NULL).QuadPart -
+                              Start.QuadPart);
+
+        if (!Locked)
+            __CacheReleaseLock(Cache);
+    }
+
+    if (Count != 0) {
+        ASSERT3U((ULONG)Cache->CurrentObjects, >=, Count);
+        (VOID) __InterlockedSubtract(&Cache->CurrentObjects, (LONG)Count);
+    }
+
+    KeLowerIrql(Irql);
+}
+
+static VOID
+CachePut(
+    _In_ PINTERFACE     Interface,
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ PVOID          Object,
+    _In_ BOOLEAN        Locked
+    )
+{
+    ASSERT(Object != NULL);
+
+    CachePutBatch(Interface, Cache, &Object, 1, Locked);
+}
+
+static NTSTATUS
+CacheFill(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          Count
+    )
+{
+    KIRQL               Irql;
+    ULONG               Node;
+    NTSTATUS            status;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    __CacheAcquireLock(Cache);
+
+    // Spread the slabs over all nodes, starting with the local one. (If
+    // slabs cannot be placed on a chosen node they all end up local.)
+    Node = KeGetCurrentNodeNumber();
+
+    status = STATUS_SUCCESS;
+    while (Cache->Count < Count) {
+        status = CacheCreateSlab(Cache, Node % Cache->NodeCount);
+        if (!NT_SUCCESS(status))
+            break;
+
+        Node++;
+    }
+
+    CacheAudit(Cache);
+
+    __CacheReleaseLock(Cache);
+    KeLowerIrql(Irql);
+
+    return status;
+}
+
+// Must be called with lock held
+static VOID
+__CacheSpill(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          Count
+    )
+{
+    ULONG               Index;
+
+    if (Cache->Count <= Count)
+        goto done;
+
+    for (Index = 0; Index < Cache->NodeCount; Index++) {
+        PLIST_ENTRY SlabList = Cache->Node[Index].SlabList;
 
-        ASSERT3P(Cache->Cursor, ==, &Cache->SlabList);
+        while (!IsListEmpty(&SlabList[XENBUS_CACHE_SLAB_EMPTY])) {
+            PLIST_ENTRY         ListEntry;
+            PXENBUS_CACHE_SLAB  Slab;
 
-        status = CacheCreateSlab(Cache);
-        if (NT_SUCCESS(status)) {
-            ASSERT(Cache->Cursor != &Cache->SlabList);
-            goto again;
-        }
-    }
+            ListEntry = SlabList[XENBUS_CACHE_SLAB_EMPTY].Blink;
 
-    CacheAudit(Cache);
+            Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+            ASSERT3U(CacheMaskCount(Slab->Allocated), ==, 0);
 
-    if (!Locked)
-        __CacheReleaseLock(Cache);
+            ASSERT(Cache->Count >= CacheMaskSize(Slab->Allocated));
+            if (Cache->Count - CacheMaskSize(Slab->Allocated) < Count)
+                goto done;
 
-done:
-    if (Object != NULL) {
-        ObjectCount = InterlockedIncrement(&Cache->CurrentObjects);
-        if (ObjectCount > Cache->MaximumObjects)
-            Cache->MaximumObjects = ObjectCount;
+            CacheDestroySlab(Cache, Slab);
+        }
     }
 
-    KeLowerIrql(Irql);
-
-    return Object;
+done:
+    CacheAudit(Cache);
 }
 
 static VOID
-CachePut(
-    _In_ PINTERFACE         Interface,
-    _In_ PXENBUS_CACHE      Cache,
-    _In_ PVOID              Object,
-    _In_ BOOLEAN            Locked
+CacheSpill(
+    _In_ PXENBUS_CACHE  Cache,
+    _In_ ULONG          Count
     )
 {
-    KIRQL                   Irql;
-    ULONG                   Index;
-    PXENBUS_CACHE_MAGAZINE  Magazine;
-    PXENBUS_CACHE_SLAB      Slab;
-    NTSTATUS                status;
-
-    UNREFERENCED_PARAMETER(Interface);
-
-    ASSERT(Cache != NULL);
-    ASSERT(Object != NULL);
+    KIRQL               Irql;
 
     KeRaiseIrql(DISPATCH_LEVEL, &Irql);
-    Index = KeGetCurrentProcessorNumberEx(NULL);
+    __CacheAcquireLock(Cache);
 
-    ASSERT3U(Index, <, Cache->MagazineCount);
-    Magazine = &Cache->Magazine[Index];
+    __CacheSpill(Cache, Count);
 
-    status = CachePutObjectToMagazine(Magazine, Object);
+    __CacheReleaseLock(Cache);
+    KeLowerIrql(Irql);
+}
 
-    if (NT_SUCCESS(status))
-        goto done;
+// Must be called with lock held
+static VOID
+CacheDepotFlush(
+    _In_ PXENBUS_CACHE          Cache,
+    _In_ PXENBUS_CACHE_DEPOT    Depot,
+    _In_ ULONG                  Count
+    )
+{
+    while (Count-- != 0) {
+        PXENBUS_CACHE_MAGAZINE  Magazine;
 
-    Slab = (PXENBUS_CACHE_SLAB)PAGE_ALIGN(Object);
-    ASSERT3U(Slab->Magic, ==, XENBUS_CACHE_SLAB_MAGIC);
+        Magazine = CacheDepotRemove(Depot);
+        if (Magazine == NULL)
+            break;
 
-    if (!Locked)
-        __CacheAcquireLock(Cache);
+        CacheDrainMagazine(Cache, Magazine);
+        CacheMagazineDestroy(Magazine);
+    }
+}
 
-    CachePutObjectToSlab(Slab, Object);
+static VOID
+CacheReap(
+    _In_ PXENBUS_CACHE  Cache
+    )
+{
+    KIRQL               Irql;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    __CacheAcquireLock(Cache);
 
     //
-    // To maintain the order, and the invariant that the cursor always points,
-    // to the first slab with available space we must remove this slab from the
-    // list and re-insert it at it's (now) correct location.
+    // Any magazines that stayed in the depot for the whole of the last
+    // period were not part of the working set, so free them.
     //
-    RemoveEntryList(&Slab->ListEntry);
-    CacheInsertSlab(Cache, Slab);
-
-    CacheAudit(Cache);
+    CacheDepotFlush(Cache, &Cache->FullDepot, Cache->FullDepot.Minimum);
+    CacheDepotFlush(Cache, &Cache->EmptyDepot, Cache->EmptyDepot.Minimum);
 
-    if (!Locked)
-        __CacheReleaseLock(Cache);
+    Cache->FullDepot.Minimum = Cache->FullDepot.Count;
+    Cache->EmptyDepot.Minimum = Cache->EmptyDepot.Count;
 
-done:
-    ASSERT(Cache->CurrentObjects != 0);
-    InterlockedDecrement(&Cache->CurrentObjects);
+    CacheAudit(Cache);
 
+    __CacheReleaseLock(Cache);
     KeLowerIrql(Irql);
 }
 
-static NTSTATUS
-CacheFill(
-    _In_ PXENBUS_CACHE  Cache,
-    _In_ ULONG          Count
+static VOID
+CacheReclaim(
+    _In_ PXENBUS_CACHE_CONTEXT  Context,
+    _In_ PXENBUS_CACHE          Cache
     )
 {
-    KIRQL               Irql;
-    NTSTATUS            status;
+    KIRQL                       Irql;
+    ULONG                       Index;
+    ULONG                       WorkingSet;
+    ULONG                       Target;
+    ULONG                       Slabs;
+    ULONG                       Count;
 
     KeRaiseIrql(DISPATCH_LEVEL, &Irql);
     __CacheAcquireLock(Cache);
 
-    status = STATUS_SUCCESS;
-    while (Cache->Count < Count) {
-        status = CacheCreateSlab(Cache);
-        if (!NT_SUCCESS(status))
-            break;
-    }
+    Cache->Periods++;
 
-    CacheAudit(Cache);
+    // Close the current period and start the next at the current level
+    ASSERT3U(Cache->HistoryIndex, <, Context->WorkingSetPeriods);
+    Cache->History[Cache->HistoryIndex] = Cache->PeakAllocated;
+    Cache->HistoryIndex = (Cache->HistoryIndex + 1) % Context->WorkingSetPeriods;
+    Cache->PeakAllocated = Cache->Allocated;
+
+    WorkingSet = 0;
+    for (Index = 0; Index < Context->WorkingSetPeriods; Index++)
+        WorkingSet = __max(WorkingSet, Cache->History[Index]);
+
+    Target = WorkingSet +
+             (ULONG)(((ULONGLONG)WorkingSet * Context->WorkingSetHysteresis) / 100);
+    Target = __max(Target, Cache->Reservation);
+
+    Cache->WorkingSet = WorkingSet;
+    Cache->ReclaimTarget = Target;
+
+    Slabs = (ULONG)Cache->CurrentSlabs;
+    Count = Cache->Count;
+
+    __CacheSpill(Cache, Target);
+
+    if ((ULONG)Cache->CurrentSlabs < Slabs) {
+        Cache->LastReclaimPeriod = Cache->Periods;
+        Cache->LastReclaimSlabs = Slabs - (ULONG)Cache->CurrentSlabs;
+        Cache->LastReclaimObjects = Count - Cache->Count;
+        Cache->ReclaimedSlabs += Cache->LastReclaimSlabs;
+    }
 
     __CacheReleaseLock(Cache);
     KeLowerIrql(Irql);
-
-    return status;
 }
 
+//
+// Magazine sizing: if more than XENBUS_CACHE_GROW_THRESHOLD percent of
+// operations in the last monitor period had to take the cache lock then
+// double the magazine size. If the cache has been (almost) idle then halve
+// it so that large magazines don't pin objects unnecessarily.
+//
+#define XENBUS_CACHE_GROW_THRESHOLD     10
+#define XENBUS_CACHE_CONTENTION_MINIMUM 64
+#define XENBUS_CACHE_IDLE_OPERATIONS    64
+
 static VOID
-CacheSpill(
-    _In_ PXENBUS_CACHE  Cache,
-    _In_ ULONG          Count
+CacheResize(
+    _In_ PXENBUS_CACHE_CONTEXT  Context,
+    _In_ PXENBUS_CACHE          Cache
     )
 {
-    KIRQL               Irql;
-    PLIST_ENTRY         ListEntry;
+    KIRQL                       Irql;
+    ULONG                       Operations;
+    ULONG                       Misses;
+    ULONG                       LockAcquisitions;
+    ULONG                       Index;
+    ULONG                       Size;
+
+    Operations = 0;
+    Misses = 0;
+
+    for (Index = 0; Index < Cache->CpuCount; Index++) {
+        PXENBUS_CACHE_CPU   Cpu = &Cache->Cpu[Index];
+
+        Operations += Cpu->Operations;
+        Misses += Cpu->Misses;
+    }
 
     KeRaiseIrql(DISPATCH_LEVEL, &Irql);
     __CacheAcquireLock(Cache);
 
-    if (Cache->Count <= Count)
-        goto done;
+    LockAcquisitions = Cache->LockAcquisitions;
+
+    // Counters may wrap so only deltas are meaningful
+    Operations -= Cache->LastOperations;
+    Misses -= Cache->LastMisses;
+    LockAcquisitions -= Cache->LastLockAcquisitions;
 
-    while (!IsListEmpty(&Cache->SlabList)) {
-        PXENBUS_CACHE_SLAB  Slab;
+    Cache->LastOperations += Operations;
+    Cache->LastMisses += Misses;
+    Cache->LastLockAcquisitions += LockAcquisitions;
 
-        ListEntry = Cache->SlabList.Blink;
-        ASSERT(ListEntry != &Cache->SlabList);
+    if (Operations == 0) {
+        Cache->MissRate = 0;
+        Cache->LockRate = 0;
+    } else {
+        Cache->MissRate = (ULONG)(((ULONGLONG)Misses * 100) / Operations);
+        Cache->LockRate = (ULONG)(((ULONGLONG)LockAcquisitions * 100) / Operations);
+    }
 
-        Slab = CONTAINING_RECORD(ListEntry, XENBUS_CACHE_SLAB, ListEntry);
+    Size = Cache->MagazineSize;
 
-        //
-        // Slabs are kept in order of maximum to minimum occupancy so we know
-        // that if the last slab in the list is not empty, then none of the
-        // slabs before it will be empty.
-        //
-        if (CacheMaskCount(Slab->Allocated) != 0)
-            break;
+    if (Cache->LockRate > XENBUS_CACHE_GROW_THRESHOLD &&
+        LockAcquisitions >= XENBUS_CACHE_CONTENTION_MINIMUM)
+        Size = __min(Size * 2, Context->MagazineSizeMaximum);
+    else if (Operations < XENBUS_CACHE_IDLE_OPERATIONS)
+        Size = __max(Size / 2, Context->MagazineSizeMinimum);
 
-        ASSERT(Cache->Count >= CacheMaskSize(Slab->Allocated));
-        if (Cache->Count - CacheMaskSize(Slab->Allocated) < Count)
-            break;
+    if (Size != Cache->MagazineSize) {
+        Trace("%s: %u -> %u (MissRate = %u%% LockRate = %u%%)\n",
+              Cache->Name,
+              Cache->MagazineSize,
+              Size,
+              Cache->MissRate,
+              Cache->LockRate);
 
-        CacheDestroySlab(Cache, Slab);
-    }
+        Cache->MagazineSize = Size;
 
-    CacheAudit(Cache);
+        //
+        // Empty magazines in the depot are all now the wrong size. Full
+        // ones are still usable and will be freed when they are emptied.
+        //
+        CacheDepotFlush(Cache, &Cache->EmptyDepot, ULONG_MAX);
+        Cache->EmptyDepot.Minimum = 0;
+    }
 
-done:
     __CacheReleaseLock(Cache);
     KeLowerIrql(Irql);
 }
@@ -802,20 +1891,37 @@ __CacheFlushMagazines(
     KeRaiseIrql(DISPATCH_LEVEL, &Irql);
     __CacheAcquireLock(Cache);
 
-    for (Index = 0; Index < Cache->MagazineCount; Index++) {
-        PXENBUS_CACHE_MAGAZINE  Magazine = &Cache->Magazine[Index];
-        PVOID                   Object;
+    for (Index = 0; Index < Cache->CpuCount; Index++) {
+        PXENBUS_CACHE_CPU   Cpu = &Cache->Cpu[Index];
 
-        while ((Object = CacheGetObjectFromMagazine(Magazine)) != NULL) {
-            PXENBUS_CACHE_SLAB  Slab;
-
-            Slab = (PXENBUS_CACHE_SLAB)PAGE_ALIGN(Object);
-            ASSERT3U(Slab->Magic, ==, XENBUS_CACHE_SLAB_MAGIC);
+        if (Cpu->Loaded != NULL) {
+            CacheDrainMagazine(Cache, Cpu->Loaded);
+            CacheMagazineDestroy(Cpu->Loaded);
+            Cpu->Loaded = NULL;
+        }
 
-            CachePutObjectToSlab(Slab, Object);
+        if (Cpu->Previous != NULL) {
+            CacheDrainMagazine(Cache, Cpu->Previous);
+            CacheMagazineDestroy(Cpu->Previous);
+            Cpu->Previous = NULL;
         }
+
+        Cpu->Misses = 0;
+        Cpu->Operations = 0;
+        Cpu->MagazineHits = 0;
+        Cpu->DepotHits = 0;
+        Cpu->SlabHits = 0;
+        Cpu->SlabCreations = 0;
+        Cpu->CtorCalls = 0;
+        Cpu->LockAcquisitions = 0;
+        Cpu->LockHoldTicks = 0;
     }
 
+    CacheDepotFlush(Cache, &Cache->FullDepot, ULONG_MAX);
+    CacheDepotFlush(Cache, &Cache->EmptyDepot, ULONG_MAX);
+
+    CacheAudit(Cache);
+
     __CacheReleaseLock(Cache);
     KeLowerIrql(Irql);
 }
@@ -837,6 +1943,7 @@ CacheCreate(
 {
     PXENBUS_CACHE_CONTEXT   Context = Interface->Context;
     KIRQL                   Irql;
+    ULONG                   Index;
     NTSTATUS                status;
 
     ASSERT(Name != NULL);
@@ -868,6 +1975,9 @@ CacheCreate(
         Cap = ULONG_MAX;
 
     (*Cache)->Size = Size;
+    (*Cache)->MagazineSize = __min(__max(XENBUS_CACHE_MAGAZINE_SLOTS_DEFAULT,
+                                         Context->MagazineSizeMinimum),
+                                   Context->MagazineSizeMaximum);
     (*Cache)->Reservation = Reservation;
     (*Cache)->Cap = Cap;
     (*Cache)->Ctor = Ctor;
@@ -876,24 +1986,40 @@ CacheCreate(
     (*Cache)->ReleaseLock = ReleaseLock;
     (*Cache)->Argument = Argument;
 
-    InitializeListHead(&(*Cache)->SlabList);
-    (*Cache)->Cursor = &(*Cache)->SlabList;
+    CacheSlabLayout(*Cache, Context->SlabOrderMaximum);
 
-    status = STATUS_INVALID_PARAMETER;
-    if ((*Cache)->Reservation > (*Cache)->Cap)
+    status = HashTableCreate(&(*Cache)->SlabTable);
+    if (!NT_SUCCESS(status))
         goto fail3;
 
-    status = CacheFill(*Cache, (*Cache)->Reservation);
-    if (!NT_SUCCESS(status))
+    (*Cache)->NodeCount = KeQueryHighestNodeNumber() + 1;
+    (*Cache)->Node = __CacheAllocate(sizeof (XENBUS_CACHE_NODE) * (*Cache)->NodeCount);
+
+    status = STATUS_NO_MEMORY;
+    if ((*Cache)->Node == NULL)
         goto fail4;
 
-    (*Cache)->MagazineCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
-    (*Cache)->Magazine = __CacheAllocate(sizeof (XENBUS_CACHE_MAGAZINE) * (*Cache)->MagazineCount);
+    for (Index = 0; Index < (*Cache)->NodeCount; Index++)
+        CacheNodeInitialize(&(*Cache)->Node[Index]);
 
-    status = STATUS_NO_MEMORY;
-    if ((*Cache)->Magazine == NULL)
+    CacheDepotInitialize(&(*Cache)->FullDepot);
+    CacheDepotInitialize(&(*Cache)->EmptyDepot);
+
+    status = STATUS_INVALID_PARAMETER;
+    if ((*Cache)->Reservation > (*Cache)->Cap)
         goto fail5;
 
+    (*Cache)->CpuCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    (*Cache)->Cpu = __CacheAllocate(sizeof (XENBUS_CACHE_CPU) * (*Cache)->CpuCount);
+
+    status = STATUS_NO_MEMORY;
+    if ((*Cache)->Cpu == NULL)
+        goto fail6;
+
+    status = CacheFill(*Cache, (*Cache)->Reservation);
+    if (!NT_SUCCESS(status))
+        goto fail7;
+
     KeAcquireSpinLock(&Context->Lock, &Irql);
     InsertTailList(&Context->List, &(*Cache)->ListEntry);
     KeReleaseSpinLock(&Context->Lock, Irql);
@@ -902,22 +2028,51 @@ CacheCreate(
 
     return STATUS_SUCCESS;
 
+fail7:
+    Error("fail7\n");
+
+    CacheSpill(*Cache, 0);
+
+    // Only the statistics can have been touched
+    RtlZeroMemory((*Cache)->Cpu, sizeof (XENBUS_CACHE_CPU) * (*Cache)->CpuCount);
+    __CacheFree((*Cache)->Cpu);
+    (*Cache)->Cpu = NULL;
+
+fail6:
+    Error("fail6\n");
+
+    (*Cache)->CpuCount = 0;
+
 fail5:
     Error("fail5\n");
 
-    (*Cache)->MagazineCount = 0;
+    CacheDepotTeardown(&(*Cache)->EmptyDepot);
+    CacheDepotTeardown(&(*Cache)->FullDepot);
 
-    CacheSpill(*Cache, 0);
+    for (Index = 0; Index < (*Cache)->NodeCount; Index++)
+        CacheNodeTeardown(&(*Cache)->Node[Index]);
+
+    __CacheFree((*Cache)->Node);
+    (*Cache)->Node = NULL;
 
 fail4:
     Error("fail4\n");
 
+    (*Cache)->NodeCount = 0;
+
+    HashTableDestroy((*Cache)->SlabTable);
+    (*Cache)->SlabTable = NULL;
+
 fail3:
     Error("fail3\n");
 
-    (*Cache)->Cursor = NULL;
-    ASSERT(IsListEmpty(&(*Cache)->SlabList));
-    RtlZeroMemory(&(*Cache)->SlabList, sizeof (LIST_ENTRY));
+    (*Cache)->NextColour = 0;
+    (*Cache)->Colours = 0;
+    (*Cache)->ColourAlignment = 0;
+    (*Cache)->OffSlab = FALSE;
+    (*Cache)->SlabWaste = 0;
+    (*Cache)->SlabObjects = 0;
+    (*Cache)->SlabOrder = 0;
 
     (*Cache)->Argument = NULL;
     (*Cache)->ReleaseLock = NULL;
@@ -926,6 +2081,7 @@ fail3:
     (*Cache)->Ctor = NULL;
     (*Cache)->Cap = 0;
     (*Cache)->Reservation = 0;
+    (*Cache)->MagazineSize = 0;
     (*Cache)->Size = 0;
 
 fail2:
@@ -977,6 +2133,7 @@ CacheDestroy(
 {
     PXENBUS_CACHE_CONTEXT   Context = Interface->Context;
     KIRQL                   Irql;
+    ULONG                   Index;
 
     ASSERT(Cache != NULL);
 
@@ -990,22 +2147,61 @@ CacheDestroy(
 
     __CacheFlushMagazines(Cache);
 
-    ASSERT(IsZeroMemory(Cache->Magazine, sizeof (XENBUS_CACHE_MAGAZINE) * Cache->MagazineCount));
-    __CacheFree(Cache->Magazine);
-    Cache->Magazine = NULL;
-    Cache->MagazineCount = 0;
+    ASSERT(IsZeroMemory(Cache->Cpu, sizeof (XENBUS_CACHE_CPU) * Cache->CpuCount));
+    __CacheFree(Cache->Cpu);
+    Cache->Cpu = NULL;
+    Cache->CpuCount = 0;
+
+    CacheDepotTeardown(&Cache->EmptyDepot);
+    CacheDepotTeardown(&Cache->FullDepot);
+
+    Cache->LockRate = 0;
+    Cache->MissRate = 0;
+    Cache->LastLockAcquisitions = 0;
+    Cache->LastMisses = 0;
+    Cache->LastOperations = 0;
+    Cache->LockAcquisitions = 0;
+    Cache->MagazineSize = 0;
 
     CacheSpill(Cache, 0);
 
+    ASSERT3U(Cache->Allocated, ==, 0);
+    Cache->PeakAllocated = 0;
+    RtlZeroMemory(Cache->History, sizeof (Cache->History));
+    Cache->HistoryIndex = 0;
+    Cache->WorkingSet = 0;
+    Cache->ReclaimTarget = 0;
+    Cache->Periods = 0;
+    Cache->LastReclaimPeriod = 0;
+    Cache->LastReclaimSlabs = 0;
+    Cache->LastReclaimObjects = 0;
+    Cache->ReclaimedSlabs = 0;
+
     ASSERT(Cache->CurrentObjects == 0);
     Cache->MaximumObjects = 0;
 
     ASSERT(Cache->CurrentSlabs == 0);
     Cache->MaximumSlabs = 0;
 
-    Cache->Cursor = NULL;
-    ASSERT(IsListEmpty(&Cache->SlabList));
-    RtlZeroMemory(&Cache->SlabList, sizeof (LIST_ENTRY));
+    for (Index = 0; Index < Cache->NodeCount; Index++)
+        CacheNodeTeardown(&Cache->Node[Index]);
+
+    ASSERT(IsZeroMemory(Cache->Node, sizeof (XENBUS_CACHE_NODE) * Cache->NodeCount));
+    __CacheFree(Cache->Node);
+    Cache->Node = NULL;
+    Cache->NodeCount = 0;
+
+    HashTableDestroy(Cache->SlabTable);
+    Cache->SlabTable = NULL;
+
+    Cache->NextColour = 0;
+    Cache->Colours = 0;
+    Cache->ColourAlignment = 0;
+
+    Cache->OffSlab = FALSE;
+    Cache->SlabWaste = 0;
+    Cache->SlabObjects = 0;
+    Cache->SlabOrder = 0;
 
     Cache->Argument = NULL;
     Cache->ReleaseLock = NULL;
@@ -1024,6 +2220,70 @@ CacheDestroy(
     Trace("<====\n");
 }
 
+static VOID
+CacheGetStatistics(
+    _In_ PXENBUS_CACHE              Cache,
+    _Out_ PXENBUS_CACHE_STATISTICS  Statistics
+    )
+{
+    LARGE_INTEGER                   Frequency;
+    ULONGLONG                       Ticks;
+    ULONG                           Index;
+
+    RtlZeroMemory(Statistics, sizeof (XENBUS_CACHE_STATISTICS));
+
+    Statistics->Size = Cache->Size;
+    Statistics->Reservation = Cache->Reservation;
+    Statistics->Cap = Cache->Cap;
+    Statistics->Count = Cache->Count;
+    Statistics->CurrentObjects = (ULONG)Cache->CurrentObjects;
+    Statistics->MaximumObjects = (ULONG)Cache->MaximumObjects;
+    Statistics->CurrentSlabs = (ULONG)Cache->CurrentSlabs;
+    Statistics->MaximumSlabs = (ULONG)Cache->MaximumSlabs;
+    Statistics->MagazineSize = Cache->MagazineSize;
+
+    //
+    // The per-CPU counters are read without synchronization so the
+    // totals are only approximate while the cache is in use.
+    //
+    Ticks = 0;
+    for (Index = 0; Index < Cache->CpuCount; Index++) {
+        PXENBUS_CACHE_CPU   Cpu = &Cache->Cpu[Index];
+
+        Statistics->MagazineHits += __CacheCounterRead(&Cpu->MagazineHits);
+        Statistics->DepotHits += __CacheCounterRead(&Cpu->DepotHits);
+        Statistics->SlabHits += __CacheCounterRead(&Cpu->SlabHits);
+        Statistics->SlabCreations += __CacheCounterRead(&Cpu->SlabCreations);
+        Statistics->CtorCalls += __CacheCounterRead(&Cpu->CtorCalls);
+        Statistics->LockAcquisitions += __CacheCounterRead(&Cpu->LockAcquisitions);
+        Ticks += __CacheCounterRead(&Cpu->LockHoldTicks);
+    }
+
+    Ticks *= XENBUS_CACHE_LOCK_HOLD_SAMPLE;
+
+    (VOID) KeQueryPerformanceCounter(&Frequency);
+    ASSERT(Frequency.QuadPart != 0);
+
+    Statistics->LockHoldTime =
+        ((Ticks / Frequency.QuadPart) * 1000000ull) +
+        (((Ticks % Frequency.QuadPart) * 1000000ull) / Frequency.QuadPart);
+}
+
+static VOID
+CacheQueryStatistics(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_CACHE              Cache,
+    _Out_ PXENBUS_CACHE_STATISTICS  Statistics
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT(Cache != NULL);
+    ASSERT(Statistics != NULL);
+
+    CacheGetStatistics(Cache, Statistics);
+}
+
 static VOID
 CacheDebugCallback(
     _In_ PVOID              Argument,
@@ -1044,20 +2304,97 @@ CacheDebugCallback(
         for (ListEntry = Context->List.Flink;
              ListEntry != &Context->List;
              ListEntry = ListEntry->Flink) {
-            PXENBUS_CACHE   Cache;
+            PXENBUS_CACHE           Cache;
+            XENBUS_CACHE_STATISTICS Statistics;
+            ULONG                   Index;
 
             Cache = CONTAINING_RECORD(ListEntry, XENBUS_CACHE, ListEntry);
 
             XENBUS_DEBUG(Printf,
                          &Context->DebugInterface,
-                         "- %s: Count = %d, Reservation = %d, Objects = %d / %d, Slabs = %d / %d\n",
+                         "- %s: Count = %d, Reservation = %d, Objects = %d / %d, Slabs = %d / %d, Depot = %u full / %u empty\n",
                          Cache->Name,
                          Cache->Count,
                          Cache->Reservation,
                          Cache->CurrentObjects,
                          Cache->MaximumObjects,
                          Cache->CurrentSlabs,
-                         Cache->MaximumSlabs);
+                         Cache->MaximumSlabs,
+                         Cache->FullDepot.Count,
+                         Cache->EmptyDepot.Count);
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "  MagazineSize = %u, MissRate = %u%%, LockRate = %u%%\n",
+                         Cache->MagazineSize,
+                         Cache->MissRate,
+                         Cache->LockRate);
+
+            CacheGetStatistics(Cache, &Statistics);
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "  Hits: Magazine = %llu, Depot = %llu, Slab = %llu\n",
+                         Statistics.MagazineHits,
+                         Statistics.DepotHits,
+                         Statistics.SlabHits);
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "  SlabCreations = %llu, CtorCalls = %llu, LockAcquisitions = %llu, LockHoldTime = %lluus\n",
+                         Statistics.SlabCreations,
+                         Statistics.CtorCalls,
+                         Statistics.LockAcquisitions,
+                         Statistics.LockHoldTime);
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "  SlabOrder = %u, SlabObjects = %u, Header = %s, Waste = %u bytes/slab (%u bytes)\n",
+                         Cache->SlabOrder,
+                         Cache->SlabObjects,
+                         (Cache->OffSlab) ? "OFF-SLAB" : "ON-SLAB",
+                         Cache->SlabWaste,
+                         Cache->SlabWaste * (ULONG)Cache->CurrentSlabs);
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "  Colours = %u x %u bytes, NextColour = %u\n",
+                         Cache->Colours,
+                         Cache->ColourAlignment,
+                         Cache->NextColour);
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "  Reclaim: Window = %us, Hysteresis = %u%%, WorkingSet = %u, Target = %u\n",
+                         Context->WorkingSetPeriods * XENBUS_CACHE_MONITOR_PERIOD,
+                         Context->WorkingSetHysteresis,
+                         Cache->WorkingSet,
+                         Cache->ReclaimTarget);
+
+            if (Cache->LastReclaimPeriod != 0)
+                XENBUS_DEBUG(Printf,
+                             &Context->DebugInterface,
+                             "  LastReclaim: %us ago, Slabs = %u, Objects = %u (Total Slabs = %u)\n",
+                             (Cache->Periods - Cache->LastReclaimPeriod) *
+                             XENBUS_CACHE_MONITOR_PERIOD,
+                             Cache->LastReclaimSlabs,
+                             Cache->LastReclaimObjects,
+                             Cache->ReclaimedSlabs);
+
+            for (Index = 0; Index < Cache->NodeCount; Index++) {
+                PXENBUS_CACHE_NODE  Node = &Cache->Node[Index];
+
+                if (Node->Slabs == 0)
+                    continue;
+
+                XENBUS_DEBUG(Printf,
+                             &Context->DebugInterface,
+                             "  Node[%u]: Objects = %u / %u, Slabs = %u\n",
+                             Index,
+                             Node->Allocated,
+                             Node->Count,
+                             Node->Slabs);
+            }
         }
     }
 }
@@ -1067,8 +2404,6 @@ CacheDebugCallback(
 #define TIME_S(_s)          (TIME_MS((_s) * 1000))
 #define TIME_RELATIVE(_t)   (-(_t))
 
-#define XENBUS_CACHE_MONITOR_PERIOD 5
-
 static NTSTATUS
 CacheMonitor(
     _In_ PXENBUS_THREAD     Self,
@@ -1111,11 +2446,12 @@ CacheMonitor(
 
             Cache = CONTAINING_RECORD(ListEntry, XENBUS_CACHE, ListEntry);
 
+            CacheResize(Context, Cache);
+            CacheReap(Cache);
+            CacheReclaim(Context, Cache);
+
             if (Cache->Count < Cache->Reservation)
                 CacheFill(Cache, Cache->Reservation);
-            else if (Cache->Count > Cache->Reservation)
-                CacheSpill(Cache,
-                           __max(Cache->Reservation, (Cache->Count / 2)));
         }
 
 loop:
@@ -1229,12 +2565,43 @@ static struct _XENBUS_CACHE_INTERFACE_V2 CacheInterfaceVersion2 = {
     CacheDestroy
 };
 
+static struct _XENBUS_CACHE_INTERFACE_V3 CacheInterfaceVersion3 = {
+    { sizeof (struct _XENBUS_CACHE_INTERFACE_V3), 3, NULL, NULL, NULL },
+    CacheAcquire,
+    CacheRelease,
+    CacheCreate,
+    CacheGet,
+    CachePut,
+    CacheGetBatch,
+    CachePutBatch,
+    CacheDestroy
+};
+
+static struct _XENBUS_CACHE_INTERFACE_V4 CacheInterfaceVersion4 = {
+    { sizeof (struct _XENBUS_CACHE_INTERFACE_V4), 4, NULL, NULL, NULL },
+    CacheAcquire,
+    CacheRelease,
+    CacheCreate,
+    CacheGet,
+    CachePut,
+    CacheGetBatch,
+    CachePutBatch,
+    CacheQueryStatistics,
+    CacheDestroy
+};
+
 NTSTATUS
 CacheInitialize(
     _In_ PXENBUS_FDO                Fdo,
     _Outptr_ PXENBUS_CACHE_CONTEXT  *Context
     )
 {
+    HANDLE                          ParametersKey;
+    ULONG                           MagazineSizeMinimum;
+    ULONG                           MagazineSizeMaximum;
+    ULONG                           SlabOrderMaximum;
+    ULONG                           WorkingSetPeriods;
+    ULONG                           WorkingSetHysteresis;
     NTSTATUS                        status;
 
     Trace("====>\n");
@@ -1255,6 +2622,60 @@ CacheInitialize(
     InitializeListHead(&(*Context)->List);
     KeInitializeSpinLock(&(*Context)->Lock);
 
+#ifdef XENBUS_CACHE_NODE_PREFERENCE
+    {
+        UNICODE_STRING  Unicode;
+
+        RtlInitUnicodeString(&Unicode, L"ExAllocatePool3");
+        __CacheExAllocatePool3 = (EXALLOCATEPOOL3)MmGetSystemRoutineAddress(&Unicode);
+    }
+#endif
+
+    ParametersKey = DriverGetParametersKey();
+
+    status = RegistryQueryDwordValue(ParametersKey,
+                                     "CacheMagazineSizeMinimum",
+                                     &MagazineSizeMinimum);
+    if (!NT_SUCCESS(status))
+        MagazineSizeMinimum = XENBUS_CACHE_MAGAZINE_SLOTS_MINIMUM;
+
+    status = RegistryQueryDwordValue(ParametersKey,
+                                     "CacheMagazineSizeMaximum",
+                                     &MagazineSizeMaximum);
+    if (!NT_SUCCESS(status))
+        MagazineSizeMaximum = XENBUS_CACHE_MAGAZINE_SLOTS_MAXIMUM;
+
+    (*Context)->MagazineSizeMinimum = __max(MagazineSizeMinimum, 1);
+    (*Context)->MagazineSizeMaximum = __max(MagazineSizeMaximum,
+                                            (*Context)->MagazineSizeMinimum);
+
+    status = RegistryQueryDwordValue(ParametersKey,
+                                     "CacheSlabOrderMaximum",
+                                     &SlabOrderMaximum);
+    if (!NT_SUCCESS(status))
+        SlabOrderMaximum = XENBUS_CACHE_SLAB_ORDER_MAXIMUM;
+
+    (*Context)->SlabOrderMaximum = __min(SlabOrderMaximum,
+                                         XENBUS_CACHE_SLAB_ORDER_LIMIT);
+
+    status = RegistryQueryDwordValue(ParametersKey,
+                                     "CacheWorkingSetPeriods",
+                                     &WorkingSetPeriods);
+    if (!NT_SUCCESS(status))
+        WorkingSetPeriods = XENBUS_CACHE_WORKING_SET_PERIODS_DEFAULT;
+
+    (*Context)->WorkingSetPeriods = __min(__max(WorkingSetPeriods, 1),
+                                          XENBUS_CACHE_WORKING_SET_PERIODS_MAXIMUM);
+
+    status = RegistryQueryDwordValue(ParametersKey,
+                                     "CacheWorkingSetHysteresis",
+                                     &WorkingSetHysteresis);
+    if (!NT_SUCCESS(status))
+        WorkingSetHysteresis = XENBUS_CACHE_WORKING_SET_HYSTERESIS_DEFAULT;
+
+    (*Context)->WorkingSetHysteresis = __min(WorkingSetHysteresis,
+                                             XENBUS_CACHE_WORKING_SET_HYSTERESIS_MAXIMUM);
+
     status = ThreadCreate(CacheMonitor, *Context, &(*Context)->MonitorThread);
     if (!NT_SUCCESS(status))
         goto fail2;
@@ -1268,6 +2689,12 @@ CacheInitialize(
 fail2:
     Error("fail2\n");
 
+    (*Context)->WorkingSetHysteresis = 0;
+    (*Context)->WorkingSetPeriods = 0;
+    (*Context)->SlabOrderMaximum = 0;
+    (*Context)->MagazineSizeMaximum = 0;
+    (*Context)->MagazineSizeMinimum = 0;
+
     RtlZeroMemory(&(*Context)->Lock, sizeof (KSPIN_LOCK));
     RtlZeroMemory(&(*Context)->List, sizeof (LIST_ENTRY));
 
@@ -1330,6 +2757,40 @@ CacheGetInterface(
         status = STATUS_SUCCESS;
         break;
     }
+    case 3: {
+        struct _XENBUS_CACHE_INTERFACE_V3   *CacheInterface;
+
+        CacheInterface = (struct _XENBUS_CACHE_INTERFACE_V3 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_CACHE_INTERFACE_V3))
+            break;
+
+        *CacheInterface = CacheInterfaceVersion3;
+
+        ASSERT3U(Interface->Version, ==, Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 4: {
+        struct _XENBUS_CACHE_INTERFACE_V4   *CacheInterface;
+
+        CacheInterface = (struct _XENBUS_CACHE_INTERFACE_V4 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_CACHE_INTERFACE_V4))
+            break;
+
+        *CacheInterface = CacheInterfaceVersion4;
+
+        ASSERT3U(Interface->Version, ==, Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
     default:
         status = STATUS_NOT_SUPPORTED;
         break;
@@ -1359,6 +2820,12 @@ CacheTeardown(
     ThreadJoin(Context->MonitorThread);
     Context->MonitorThread = NULL;
 
+    Context->WorkingSetHysteresis = 0;
+    Context->WorkingSetPeriods = 0;
+    Context->SlabOrderMaximum = 0;
+    Context->MagazineSizeMaximum = 0;
+    Context->MagazineSizeMinimum = 0;
+
     RtlZeroMemory(&Context->Lock, sizeof (KSPIN_LOCK));
     RtlZeroMemory(&Context->List, sizeof (LIST_ENTRY));
 
@@ -39,7 +39,6 @@
 #include "evtchn_2l.h"
 #include "evtchn_fifo.h"
 #include "fdo.h"
-#include "hash_table.h"
 #include "registry.h"
 #include "dbg_print.h"
 #include "assert.h"
@@ -101,6 +100,20 @@ typedef struct _XENBUS_EVTCHN_PROCESSOR {
     BOOLEAN                 UpcallEnabled;
 } XENBUS_EVTCHN_PROCESSOR, *PXENBUS_EVTCHN_PROCESSOR;
 
+//
+// Ports are small dense integers so channels are indexed directly by
+// port number through a two-level table. Leaves are allocated on demand
+// and are only freed on teardown, so a lookup never needs a lock.
+//
+#define XENBUS_EVTCHN_TABLE_LEAF_SHIFT  9
+#define XENBUS_EVTCHN_TABLE_LEAF_SIZE   (1ul << XENBUS_EVTCHN_TABLE_LEAF_SHIFT)
+#define XENBUS_EVTCHN_TABLE_LEAF_MASK   (XENBUS_EVTCHN_TABLE_LEAF_SIZE - 1)
+#define XENBUS_EVTCHN_TABLE_ROOT_SIZE   \
+        (EVTCHN_FIFO_NR_CHANNELS >> XENBUS_EVTCHN_TABLE_LEAF_SHIFT)
+
+C_ASSERT(EVTCHN_2L_NR_CHANNELS <= EVTCHN_FIFO_NR_CHANNELS);
+C_ASSERT((EVTCHN_FIFO_NR_CHANNELS & XENBUS_EVTCHN_TABLE_LEAF_MASK) == 0);
+
 struct _XENBUS_EVTCHN_CONTEXT {
     PXENBUS_FDO                     Fdo;
     KSPIN_LOCK                      Lock;
@@ -119,7 +132,8 @@ struct _XENBUS_EVTCHN_CONTEXT {
     XENBUS_EVTCHN_ABI               EvtchnAbi;
     BOOLEAN                         UseEvtchnFifoAbi;
     BOOLEAN                         UseEvtchnUpcall;
-    PXENBUS_HASH_TABLE              Table;
+    PXENBUS_EVTCHN_CHANNEL          *Table[XENBUS_EVTCHN_TABLE_ROOT_SIZE];
+    LONG                            TableLeaves;
     LIST_ENTRY                      List;
 };
 
@@ -141,6 +155,139 @@ __EvtchnFree(
     __FreePoolWithTag(Buffer, XENBUS_EVTCHN_TAG);
 }
 
+static NTSTATUS
+EvtchnTableAdd(
+    _In_ PXENBUS_EVTCHN_CONTEXT Context,
+    _In_ ULONG                  LocalPort,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel
+    )
+{
+    ULONG                       Index;
+    PXENBUS_EVTCHN_CHANNEL      *Leaf;
+    PXENBUS_EVTCHN_CHANNEL      Old;
+    NTSTATUS                    status;
+
+    Index = LocalPort >> XENBUS_EVTCHN_TABLE_LEAF_SHIFT;
+
+    status = STATUS_INVALID_PARAMETER;
+    if (Index >= XENBUS_EVTCHN_TABLE_ROOT_SIZE)
+        goto fail1;
+
+    Leaf = Context->Table[Index];
+    if (Leaf == NULL) {
+        PXENBUS_EVTCHN_CHANNEL  *New;
+
+        New = __EvtchnAllocate(sizeof (PXENBUS_EVTCHN_CHANNEL) *
+                               XENBUS_EVTCHN_TABLE_LEAF_SIZE);
+
+        status = STATUS_NO_MEMORY;
+        if (New == NULL)
+            goto fail2;
+
+        // Another processor may have installed the leaf in the meantime
+        Leaf = InterlockedCompareExchangePointer((PVOID *)&Context->Table[Index],
+                                                 New,
+                                                 NULL);
+        if (Leaf == NULL) {
+            Leaf = New;
+            InterlockedIncrement(&Context->TableLeaves);
+        } else {
+            __EvtchnFree(New);
+        }
+    }
+
+    //
+    // The channel must be fully initialized before it becomes visible
+    // to EvtchnPollCallback(). The interlocked operation is a full barrier.
+    //
+    Old = InterlockedCompareExchangePointer((PVOID *)&Leaf[LocalPort & XENBUS_EVTCHN_TABLE_LEAF_MASK],
+                                            Channel,
+                                            NULL);
+
+    status = STATUS_OBJECT_NAME_COLLISION;
+    if (Old != NULL)
+        goto fail3;
+
+    return STATUS_SUCCESS;
+
+fail3:
+    Error("fail3\n");
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return status;
+}
+
+static VOID
+EvtchnTableRemove(
+    _In_ PXENBUS_EVTCHN_CONTEXT Context,
+    _In_ ULONG                  LocalPort,
+    _In_ PXENBUS_EVTCHN_CHANNEL Channel
+    )
+{
+    ULONG                       Index;
+    PXENBUS_EVTCHN_CHANNEL      *Leaf;
+    PXENBUS_EVTCHN_CHANNEL      Old;
+
+    Index = LocalPort >> XENBUS_EVTCHN_TABLE_LEAF_SHIFT;
+    ASSERT3U(Index, <, XENBUS_EVTCHN_TABLE_ROOT_SIZE);
+
+    Leaf = Context->Table[Index];
+    ASSERT(Leaf != NULL);
+
+    Old = InterlockedExchangePointer((PVOID *)&Leaf[LocalPort & XENBUS_EVTCHN_TABLE_LEAF_MASK],
+                                     NULL);
+    ASSERT3P(Old, ==, Channel);
+}
+
+static FORCEINLINE PXENBUS_EVTCHN_CHANNEL
+__EvtchnTableLookup(
+    _In_ PXENBUS_EVTCHN_CONTEXT Context,
+    _In_ ULONG                  LocalPort
+    )
+{
+    ULONG                       Index;
+    PXENBUS_EVTCHN_CHANNEL      *Leaf;
+
+    Index = LocalPort >> XENBUS_EVTCHN_TABLE_LEAF_SHIFT;
+    if (Index >= XENBUS_EVTCHN_TABLE_ROOT_SIZE)
+        return NULL;
+
+    Leaf = *(PXENBUS_EVTCHN_CHANNEL * volatile *)&Context->Table[Index];
+    if (Leaf == NULL)
+        return NULL;
+
+    return *(PXENBUS_EVTCHN_CHANNEL volatile *)&Leaf[LocalPort & XENBUS_EVTCHN_TABLE_LEAF_MASK];
+}
+
+static VOID
+EvtchnTableDestroy(
+    _In_ PXENBUS_EVTCHN_CONTEXT Context
+    )
+{
+    ULONG                       Index;
+
+    for (Index = 0; Index < XENBUS_EVTCHN_TABLE_ROOT_SIZE; Index++) {
+        PXENBUS_EVTCHN_CHANNEL  *Leaf = Context->Table[Index];
+
+        if (Leaf == NULL)
+            continue;
+
+        ASSERT(IsZeroMemory(Leaf, sizeof (PXENBUS_EVTCHN_CHANNEL) *
+                                  XENBUS_EVTCHN_TABLE_LEAF_SIZE));
+        __EvtchnFree(Leaf);
+
+        Context->Table[Index] = NULL;
+        --Context->TableLeaves;
+    }
+
+    ASSERT3U(Context->TableLeaves, ==, 0);
+}
+
 static NTSTATUS
 EvtchnOpenFixed(
     _In_ PXENBUS_EVTCHN_CONTEXT Context,
@@ -390,9 +537,7 @@ EvtchnOpen(
     if (!NT_SUCCESS(status))
         goto fail3;
 
-    status = HashTableAdd(Context->Table,
-                          LocalPort,
-                          (ULONG_PTR)Channel);
+    status = EvtchnTableAdd(Context, LocalPort, Channel);
     if (!NT_SUCCESS(status))
         goto fail4;
 
@@ -501,12 +646,9 @@ EvtchnPollCallback(
     PXENBUS_EVTCHN_CONTEXT      Context = Processor->Context;
     ULONG                       Cpu = Processor->Cpu;
     PXENBUS_EVTCHN_CHANNEL      Channel;
-    NTSTATUS                    status;
 
-    status = HashTableLookup(Context->Table,
-                             LocalPort,
-                             (PULONG_PTR)&Channel);
-    if (!NT_SUCCESS(status))
+    Channel = __EvtchnTableLookup(Context, LocalPort);
+    if (Channel == NULL)
         goto done;
 
     ASSERT3U(Channel->LocalPort, ==, LocalPort);
@@ -942,16 +1084,13 @@ EvtchnClose(
     Trace("%u\n", LocalPort);
 
     if (Channel->Active) {
-        NTSTATUS    status;
-
         Channel->Active = FALSE;
 
         XENBUS_EVTCHN_ABI(PortDisable,
                           &Context->EvtchnAbi,
                           LocalPort);
 
-        status = HashTableRemove(Context->Table, LocalPort);
-        ASSERT(NT_SUCCESS(status));
+        EvtchnTableRemove(Context, LocalPort, Channel);
 
         //
         // The event may be pending on a CPU queue so we mark it as
@@ -1416,13 +1555,9 @@ EvtchnSuspendCallbackEarly(
         ASSERT3U(Channel->Magic, ==, XENBUS_EVTCHN_CHANNEL_MAGIC);
 
         if (Channel->Active) {
-            ULONG       LocalPort = Channel->LocalPort;
-            NTSTATUS    status;
-
             Channel->Active = FALSE;
 
-            status = HashTableRemove(Context->Table, LocalPort);
-            ASSERT(NT_SUCCESS(status));
+            EvtchnTableRemove(Context, Channel->LocalPort, Channel);
         }
     }
 }
@@ -1908,18 +2043,14 @@ EvtchnInitialize(
     if (*Context == NULL)
         goto fail1;
 
-    status = HashTableCreate(&(*Context)->Table);
-    if (!NT_SUCCESS(status))
-        goto fail2;
-
     status = EvtchnTwoLevelInitialize(Fdo,
                                       &(*Context)->EvtchnTwoLevelContext);
     if (!NT_SUCCESS(status))
-        goto fail3;
+        goto fail2;
 
     status = EvtchnFifoInitialize(Fdo, &(*Context)->EvtchnFifoContext);
     if (!NT_SUCCESS(status))
-        goto fail4;
+        goto fail3;
 
     ParametersKey = DriverGetParametersKey();
 
@@ -1969,17 +2100,11 @@ EvtchnInitialize(
 
     return STATUS_SUCCESS;
 
-fail4:
-    Error("fail4\n");
-
-    EvtchnTwoLevelTeardown((*Context)->EvtchnTwoLevelContext);
-    (*Context)->EvtchnTwoLevelContext = NULL;
-
 fail3:
     Error("fail3\n");
 
-    HashTableDestroy((*Context)->Table);
-    (*Context)->Table = NULL;
+    EvtchnTwoLevelTeardown((*Context)->EvtchnTwoLevelContext);
+    (*Context)->EvtchnTwoLevelContext = NULL;
 
 fail2:
     Error("fail2\n");
@@ -2140,8 +2265,7 @@ EvtchnTeardown(
     EvtchnTwoLevelTeardown(Context->EvtchnTwoLevelContext);
     Context->EvtchnTwoLevelContext = NULL;
 
-    HashTableDestroy(Context->Table);
-    Context->Table = NULL;
+    EvtchnTableDestroy(Context);
 
     ASSERT(IsZeroMemory(Context, sizeof (XENBUS_EVTCHN_CONTEXT)));
     __EvtchnFree(Context);
@@ -41,6 +41,8 @@
 #include "evtchn.h"
 #include "thread.h"
 #include "fdo.h"
+#include "driver.h"
+#include "registry.h"
 #include "dbg_print.h"
 #include "assert.h"
 #include "util.h"
@@ -61,16 +63,73 @@ struct _XENBUS_STORE_TRANSACTION {
     BOOLEAN     Active; // Must be tested at >= DISPATCH_LEVEL
 };
 
-#define STORE_WATCH_MAGIC 'CTAW'
+// Transactions run by StoreTransactionRun() are re-tried on clash, with
+// a randomized delay that doubles on each attempt up to a maximum
+#define XENBUS_STORE_TRANSACTION_ATTEMPTS       8
+#define XENBUS_STORE_TRANSACTION_BACKOFF_MIN    1   // ms
+#define XENBUS_STORE_TRANSACTION_BACKOFF_MAX    64  // ms
 
-struct _XENBUS_STORE_WATCH {
+#define XENBUS_STORE_RETRY_CALLERS_MAXIMUM      32
+
+typedef struct _XENBUS_STORE_RETRY {
     LIST_ENTRY  ListEntry;
-    ULONG       Magic;
     PVOID       Caller;
-    USHORT      Id;
-    PSTR        Path;
-    PKEVENT     Event;
-    BOOLEAN     Active; // Must be tested at >= DISPATCH_LEVEL
+    ULONG       Transactions;
+    ULONG       Retries;
+    ULONG       Exhausted;
+} XENBUS_STORE_RETRY, *PXENBUS_STORE_RETRY;
+
+#define STORE_WATCH_MAGIC 'CTAW'
+
+#define XENBUS_STORE_WATCH_QUEUE_DEPTH_MAXIMUM  1024
+#define XENBUS_STORE_WATCH_INTERVAL_MAXIMUM     10000   // ms
+
+typedef struct _XENBUS_STORE_WATCH_NODE  XENBUS_STORE_WATCH_NODE, *PXENBUS_STORE_WATCH_NODE;
+
+// A single XS_WATCH is shared by all watches on the same path or
+// beneath it. Events are passed on to each of them in turn.
+typedef struct _XENBUS_STORE_REGISTRATION {
+    LIST_ENTRY                  ListEntry;
+    PVOID                       Caller;
+    USHORT                      Id;
+    BOOLEAN                     Active; // Must be tested at >= DISPATCH_LEVEL
+    LIST_ENTRY                  WatchList;
+    ULONG                       Count;
+    PXENBUS_STORE_WATCH_NODE    Node;   // NULL if not available for sharing
+    CHAR                        Path[1];
+} XENBUS_STORE_REGISTRATION, *PXENBUS_STORE_REGISTRATION;
+
+// Registrations available for sharing are found using a trie with a
+// node per path component
+struct _XENBUS_STORE_WATCH_NODE {
+    LIST_ENTRY                  ListEntry;
+    PXENBUS_STORE_WATCH_NODE    Parent;
+    LIST_ENTRY                  ChildList;
+    PXENBUS_STORE_REGISTRATION  Registration;
+    CHAR                        Name[1];
+};
+
+struct _XENBUS_STORE_WATCH {
+    LIST_ENTRY                  ListEntry;
+    ULONG                       Magic;
+    PVOID                       Caller;
+    PXENBUS_STORE_REGISTRATION  Registration;
+    LIST_ENTRY                  RegistrationListEntry;
+    PSTR                        Path;
+    PKEVENT                     Event;
+    BOOLEAN                     Active; // Must be tested at >= DISPATCH_LEVEL
+    PSTR                        *Queue;
+    ULONG                       QueueDepth;
+    ULONG                       QueueProducer;
+    ULONG                       QueueConsumer;
+    BOOLEAN                     QueueOverflow;
+    ULONG                       QueueDropped;
+    ULONG                       Interval;
+    KTIMER                      Timer;
+    KDPC                        Dpc;
+    BOOLEAN                     Debouncing;
+    BOOLEAN                     Pending;
+    ULONG                       Suppressed;
 };
 
 typedef enum _XENBUS_STORE_REQUEST_STATE {
@@ -95,11 +154,19 @@ enum {
 
 typedef struct _XENBUS_STORE_RESPONSE {
     struct xsd_sockmsg      Header;
-    CHAR                    Data[XENSTORE_PAYLOAD_MAX];
     XENBUS_STORE_SEGMENT    Segment[XENBUS_STORE_RESPONSE_SEGMENT_COUNT];
     ULONG                   Index;
+    ULONG                   Size;
+    CHAR                    Data[XENSTORE_PAYLOAD_MAX];
 } XENBUS_STORE_RESPONSE, *PXENBUS_STORE_RESPONSE;
 
+// Most payloads are short so responses are taken from a cache of
+// objects with room for this much data. Anything larger is allocated
+// once its length is known.
+#define XENBUS_STORE_RESPONSE_SMALL_SIZE    256
+
+C_ASSERT(XENBUS_STORE_RESPONSE_SMALL_SIZE < XENSTORE_PAYLOAD_MAX);
+
 #define XENBUS_STORE_REQUEST_SEGMENT_COUNT  8
 
 typedef struct _XENBUS_STORE_REQUEST {
@@ -110,8 +177,64 @@ typedef struct _XENBUS_STORE_REQUEST {
     ULONG                               Index;
     LIST_ENTRY                          ListEntry;
     PXENBUS_STORE_RESPONSE              Response;
+    XENBUS_STORE_COMPLETION_FUNCTION    Function;
+    PVOID                               Argument;
+    PSTR                                Buffer;
+    PSTR                                ReadBuffer;
+    ULONG                               ReadLength;
+    LONGLONG                            Prepared;
+    LONGLONG                            Sent;
+    BOOLEAN                             Stalled;
 } XENBUS_STORE_REQUEST, *PXENBUS_STORE_REQUEST;
 
+C_ASSERT(XS_DIRECTORY_PART < XENBUS_STORE_LATENCY_TYPES);
+
+typedef struct _XENBUS_STORE_INDEX_ENTRY {
+    ULONG   Key;
+    PVOID   Value;
+} XENBUS_STORE_INDEX_ENTRY, *PXENBUS_STORE_INDEX_ENTRY;
+
+#define XENBUS_STORE_INDEX_SIZE_MINIMUM 32
+
+typedef struct _XENBUS_STORE_INDEX {
+    PXENBUS_STORE_INDEX_ENTRY   Entry;
+    ULONG                       Size;
+    ULONG                       Count;
+    ULONG                       Missing;
+} XENBUS_STORE_INDEX, *PXENBUS_STORE_INDEX;
+
+#define XENBUS_STORE_CACHE_BUCKETS          64
+#define XENBUS_STORE_CACHE_SIZE_MAXIMUM     256
+
+typedef struct _XENBUS_STORE_CACHE_ENTRY {
+    LIST_ENTRY  ListEntry;
+    LIST_ENTRY  BucketListEntry;
+    ULONG       Hash;
+    PSTR        Path;
+    ULONG       Length;
+    CHAR        Data[1];
+} XENBUS_STORE_CACHE_ENTRY, *PXENBUS_STORE_CACHE_ENTRY;
+
+#define XENBUS_STORE_ENUMERATOR_MAGIC   'MUNE'
+
+struct _XENBUS_STORE_ENUMERATOR {
+    ULONG                       Magic;
+    PXENBUS_STORE_TRANSACTION   Transaction;
+    PSTR                        Path;
+    ULONG                       Offset;
+    ULONGLONG                   Generation;
+    BOOLEAN                     Complete;
+    CHAR                        Names[XENSTORE_PAYLOAD_MAX + 2];  // Double-NUL terminate
+};
+
+typedef struct _XENBUS_STORE_TREE_BUFFER {
+    PSTR    Data;
+    ULONG   Length;
+    ULONG   Size;
+} XENBUS_STORE_TREE_BUFFER, *PXENBUS_STORE_TREE_BUFFER;
+
+#define XENBUS_STORE_TREE_BATCH 32
+
 #define XENBUS_STORE_BUFFER_MAGIC   'FFUB'
 
 typedef struct _XENBUS_STORE_BUFFER {
@@ -130,15 +253,38 @@ struct _XENBUS_STORE_CONTEXT {
     USHORT                              RequestId;
     LIST_ENTRY                          SubmittedList;
     LIST_ENTRY                          PendingList;
+    XENBUS_STORE_INDEX                  RequestIndex;
+    LIST_ENTRY                          CompletedList;
     LIST_ENTRY                          TransactionList;
+    LIST_ENTRY                          RetryList;
+    ULONG                               RetryCount;
     USHORT                              WatchId;
     LIST_ENTRY                          WatchList;
+    LIST_ENTRY                          RegistrationList;
+    XENBUS_STORE_INDEX                  WatchIndex;
+    XENBUS_STORE_WATCH_NODE             WatchRoot;
+    ULONG                               WatchShares;
     LIST_ENTRY                          BufferList;
+    BOOLEAN                             CacheEnabled;
+    LIST_ENTRY                          CacheList;
+    LIST_ENTRY                          CacheBucket[XENBUS_STORE_CACHE_BUCKETS];
+    ULONG                               CacheCount;
+    ULONG                               CacheGeneration;
+    ULONG                               CacheHits;
+    ULONG                               CacheMisses;
+    ULONG                               CacheInvalidations;
     KDPC                                Dpc;
     ULONG                               Polls;
     ULONG                               Dpcs;
     ULONG                               Events;
+    ULONG                               AsyncRequests;
+    ULONG                               AsyncCompletions;
+    ULONG                               RingStalls;
+    XENBUS_STORE_LATENCY                Latency[XENBUS_STORE_LATENCY_TYPES];
     XENBUS_STORE_RESPONSE               Response;
+    XENBUS_CACHE_INTERFACE              CacheInterface;
+    KSPIN_LOCK                          ResponseLock;
+    PXENBUS_CACHE                       ResponseCache;
     XENBUS_EVTCHN_INTERFACE             EvtchnInterface;
     PHYSICAL_ADDRESS                    Address;
     PXENBUS_EVTCHN_CHANNEL              Channel;
@@ -172,6 +318,187 @@ __StoreFree(
     __FreePoolWithTag(Buffer, XENBUS_STORE_TAG);
 }
 
+// Must be called with lock held
+static VOID
+StoreIndexResize(
+    _In_ PXENBUS_STORE_INDEX    Index,
+    _In_ ULONG                  Size
+    )
+{
+    PXENBUS_STORE_INDEX_ENTRY   Entry;
+    ULONG                       Slot;
+
+    ASSERT3U(Size & (Size - 1), ==, 0);
+    ASSERT3U(Size, >, Index->Count);
+
+    Entry = __StoreAllocate(sizeof (XENBUS_STORE_INDEX_ENTRY) * Size);
+    if (Entry == NULL)
+        return;
+
+    for (Slot = 0; Slot < Index->Size; Slot++) {
+        PXENBUS_STORE_INDEX_ENTRY   Old = &Index->Entry[Slot];
+        ULONG                       New;
+
+        if (Old->Value == NULL)
+            continue;
+
+        New = Old->Key & (Size - 1);
+        while (Entry[New].Value != NULL)
+            New = (New + 1) & (Size - 1);
+
+        Entry[New] = *Old;
+    }
+
+    if (Index->Entry != NULL)
+        __StoreFree(Index->Entry);
+
+    Index->Entry = Entry;
+    Index->Size = Size;
+}
+
+// Must be called with lock held
+static VOID
+StoreIndexInsert(
+    _In_ PXENBUS_STORE_INDEX    Index,
+    _In_ ULONG                  Key,
+    _In_ PVOID                  Value
+    )
+{
+    ULONG                       Slot;
+
+    ASSERT(Value != NULL);
+
+    // Keep the load factor below one half so that probe sequences stay
+    // short
+    if ((Index->Count + 1) * 2 > Index->Size)
+        StoreIndexResize(Index,
+                         __max(Index->Size * 2,
+                               XENBUS_STORE_INDEX_SIZE_MINIMUM));
+
+    //
+    // Always keep at least one slot empty, otherwise a probe for an
+    // absent key would never terminate.
+    //
+    if (Index->Count + 1 >= Index->Size) {
+        // Callers fall back to a list scan while anything is missing
+        Index->Missing++;
+        return;
+    }
+
+    Slot = Key & (Index->Size - 1);
+    while (Index->Entry[Slot].Value != NULL)
+        Slot = (Slot + 1) & (Index->Size - 1);
+
+    Index->Entry[Slot].Key = Key;
+    Index->Entry[Slot].Value = Value;
+    Index->Count++;
+}
+
+// Must be called with lock held
+static PVOID
+StoreIndexLookup(
+    _In_ PXENBUS_STORE_INDEX    Index,
+    _In_ ULONG                  Key
+    )
+{
+    ULONG                       Slot;
+    ULONG                       Probe;
+
+    if (Index->Count == 0)
+        return NULL;
+
+    Slot = Key & (Index->Size - 1);
+    for (Probe = 0; Probe < Index->Size; Probe++) {
+        if (Index->Entry[Slot].Value == NULL)
+            break;
+
+        if (Index->Entry[Slot].Key == Key)
+            return Index->Entry[Slot].Value;
+
+        Slot = (Slot + 1) & (Index->Size - 1);
+    }
+
+    return NULL;
+}
+
+// Must be called with lock held
+static VOID
+StoreIndexRemove(
+    _In_ PXENBUS_STORE_INDEX    Index,
+    _In_ ULONG                  Key,
+    _In_ PVOID                  Value
+    )
+{
+    ULONG                       Mask;
+    ULONG                       Slot;
+    ULONG                       Probe;
+    ULONG                       Next;
+
+    if (Index->Count == 0)
+        goto missing;
+
+    Mask = Index->Size - 1;
+
+    Slot = Key & Mask;
+    for (Probe = 0; Probe < Index->Size; Probe++) {
+        if (Index->Entry[Slot].Value == NULL)
+            goto missing;
+
+        if (Index->Entry[Slot].Value == Value)
+            goto found;
+
+        Slot = (Slot + 1) & Mask;
+    }
+
+    goto missing;
+
+found:
+    ASSERT3U(Index->Entry[Slot].Key, ==, Key);
+
+    // Shift back any following entries that would no longer be
+    // reachable from their home slot
+    Next = Slot;
+    for (;;) {
+        ULONG   Home;
+
+        Next = (Next + 1) & Mask;
+        if (Index->Entry[Next].Value == NULL)
+            break;
+
+        Home = Index->Entry[Next].Key & Mask;
+        if (((Next - Home) & Mask) < ((Next - Slot) & Mask))
+            continue;
+
+        Index->Entry[Slot] = Index->Entry[Next];
+        Slot = Next;
+    }
+
+    Index->Entry[Slot].Key = 0;
+    Index->Entry[Slot].Value = NULL;
+    --Index->Count;
+
+    return;
+
+missing:
+    ASSERT(Index->Missing != 0);
+    --Index->Missing;
+}
+
+static VOID
+StoreIndexTeardown(
+    _In_ PXENBUS_STORE_INDEX    Index
+    )
+{
+    ASSERT3U(Index->Count, ==, 0);
+    ASSERT3U(Index->Missing, ==, 0);
+
+    if (Index->Entry != NULL)
+        __StoreFree(Index->Entry);
+
+    Index->Entry = NULL;
+    Index->Size = 0;
+}
+
 static NTSTATUS
 StorePrepareRequest(
     _In_ PXENBUS_STORE_CONTEXT          Context,
@@ -199,6 +526,8 @@ StorePrepareRequest(
         Id = 0;
     }
 
+    Request->Prepared = KeQueryPerformanceCounter(NULL).QuadPart;
+
     Request->Header.type = Type;
     Request->Header.tx_id = Id;
     Request->Header.len = 0;
@@ -359,13 +688,26 @@ StoreSendRequests(
             Request->Index++;
         }
 
-        if (Request->Index < Request->Count)
+        if (Request->Index < Request->Count) {
+            // Only count each request once, however long it waits
+            if (!Request->Stalled) {
+                Request->Stalled = TRUE;
+                Context->RingStalls++;
+                Context->Latency[Request->Header.type].Stalls++;
+            }
+
             break;
+        }
+
+        Request->Sent = KeQueryPerformanceCounter(NULL).QuadPart;
 
         ListEntry = RemoveHeadList(&Context->SubmittedList);
         ASSERT3P(ListEntry, ==, &Request->ListEntry);
 
         InsertTailList(&Context->PendingList, &Request->ListEntry);
+        StoreIndexInsert(&Context->RequestIndex,
+                         Request->Header.req_id,
+                         Request);
         Request->State = XENBUS_STORE_REQUEST_PENDING;
     }
 }
@@ -476,6 +818,7 @@ StoreVerifyHeader(
     Valid = TRUE;
 
     if (Header->type != XS_DIRECTORY &&
+        Header->type != XS_DIRECTORY_PART &&
         Header->type != XS_READ &&
         Header->type != XS_WATCH &&
         Header->type != XS_UNWATCH &&
@@ -499,6 +842,59 @@ StoreVerifyHeader(
     return Valid;
 }
 
+static PXENBUS_STORE_REQUEST
+StoreFindRequest(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ uint32_t               req_id
+    )
+{
+    PLIST_ENTRY                 ListEntry;
+    PXENBUS_STORE_REQUEST       Request;
+
+    Request = StoreIndexLookup(&Context->RequestIndex, req_id);
+    if (Request != NULL || Context->RequestIndex.Missing == 0)
+        return Request;
+
+    for (ListEntry = Context->PendingList.Flink;
+         ListEntry != &Context->PendingList;
+         ListEntry = ListEntry->Flink) {
+
+        Request = CONTAINING_RECORD(ListEntry, XENBUS_STORE_REQUEST, ListEntry);
+
+        if (Request->Header.req_id == req_id)
+            break;
+
+        Request = NULL;
+    }
+
+    return Request;
+}
+
+// Must be called with lock held
+static PSTR
+StorePayloadData(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response = &Context->Response;
+    PXENBUS_STORE_REQUEST       Request;
+
+    if (Response->Header.type != XS_READ)
+        goto done;
+
+    Request = StoreFindRequest(Context, Response->Header.req_id);
+    if (Request == NULL || Request->ReadBuffer == NULL)
+        goto done;
+
+    // If the value fits then it can be copied straight from the ring
+    // into the caller's buffer
+    if (Response->Header.len <= Request->ReadLength)
+        return Request->ReadBuffer;
+
+done:
+    return Response->Data;
+}
+
 static NTSTATUS
 StoreReceiveResponse(
     _In_ PXENBUS_STORE_CONTEXT      Context,
@@ -523,7 +919,7 @@ StoreReceiveResponse(
         goto done;
 
     Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length = Response->Header.len;
-    Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data = Response->Data;
+    Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data = StorePayloadData(Context);
 
 payload:
     status = StoreReceiveSegment(Context,
@@ -534,54 +930,34 @@ done:
     return status;
 }
 
-static PXENBUS_STORE_REQUEST
-StoreFindRequest(
-    _In_ PXENBUS_STORE_CONTEXT  Context,
-    _In_ uint32_t               req_id
-    )
-{
-    PLIST_ENTRY                 ListEntry;
-    PXENBUS_STORE_REQUEST       Request;
-
-    Request = NULL;
-    for (ListEntry = Context->PendingList.Flink;
-         ListEntry != &Context->PendingList;
-         ListEntry = ListEntry->Flink) {
-
-        Request = CONTAINING_RECORD(ListEntry, XENBUS_STORE_REQUEST, ListEntry);
-
-        if (Request->Header.req_id == req_id)
-            break;
-
-        Request = NULL;
-    }
-
-    return Request;
-}
-
-static PXENBUS_STORE_WATCH
-StoreFindWatch(
+static PXENBUS_STORE_REGISTRATION
+StoreFindRegistration(
     _In_ PXENBUS_STORE_CONTEXT  Context,
     _In_ USHORT                 Id
     )
 {
     PLIST_ENTRY                 ListEntry;
-    PXENBUS_STORE_WATCH         Watch;
+    PXENBUS_STORE_REGISTRATION  Registration;
 
-    Watch = NULL;
-    for (ListEntry = Context->WatchList.Flink;
-         ListEntry != &Context->WatchList;
+    Registration = StoreIndexLookup(&Context->WatchIndex, Id);
+    if (Registration != NULL || Context->WatchIndex.Missing == 0)
+        return Registration;
+
+    for (ListEntry = Context->RegistrationList.Flink;
+         ListEntry != &Context->RegistrationList;
          ListEntry = ListEntry->Flink) {
 
-        Watch = CONTAINING_RECORD(ListEntry, XENBUS_STORE_WATCH, ListEntry);
+        Registration = CONTAINING_RECORD(ListEntry,
+                                         XENBUS_STORE_REGISTRATION,
+                                         ListEntry);
 
-        if (Watch->Id == Id)
+        if (Registration->Id == Id)
             break;
 
-        Watch = NULL;
+        Registration = NULL;
     }
 
-    return Watch;
+    return Registration;
 }
 
 static USHORT
@@ -590,12 +966,12 @@ StoreNextWatchId(
     )
 {
     USHORT                      Id;
-    PXENBUS_STORE_WATCH         Watch;
+    PXENBUS_STORE_REGISTRATION  Registration;
 
     do {
         Id = Context->WatchId++;
-        Watch = StoreFindWatch(Context, Id);
-    } while (Watch != NULL);
+        Registration = StoreFindRegistration(Context, Id);
+    } while (Registration != NULL);
 
     return Id;
 }
@@ -677,522 +1053,2595 @@ fail1:
     return STATUS_UNSUCCESSFUL;
 }
 
-static VOID
-StoreProcessWatchEvent(
-    _In_ PXENBUS_STORE_CONTEXT  Context
+static BOOLEAN
+StoreIsSubPath(
+    _In_ PSTR       Path,
+    _In_opt_ PSTR   Prefix,
+    _In_ PSTR       Node
     )
 {
-    PXENBUS_STORE_RESPONSE      Response;
-    PSTR                        Path;
-    PVOID                       Caller;
-    USHORT                      Id;
-    PXENBUS_STORE_WATCH         Watch;
-    NTSTATUS                    status;
-
-    Response = &Context->Response;
-
-    ASSERT3U(Response->Header.req_id, ==, 0);
-
-    status = StoreParseWatchEvent(Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data,
-                                  Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length,
-                                  &Path,
-                                  &Caller,
-                                  &Id);
-    if (!NT_SUCCESS(status))
-        return;
-
-    Trace("%04x (%s)\n", Id, Path);
-
-    Watch = StoreFindWatch(Context, Id);
-
-    if (Watch == NULL) {
-        PSTR        Name;
-        ULONG_PTR   Offset;
+    size_t          Length;
 
-        ModuleLookup((ULONG_PTR)Caller, &Name, &Offset);
-        if (Name != NULL)
-            Warning("SPURIOUS WATCH EVENT (%s) FOR %s + %p\n",
-                    Path,
-                    Name,
-                    Offset);
-        else
-            Warning("SPURIOUS WATCH EVENT (%s) FOR %p\n",
-                    Path,
-                    Caller);
+    // Is Path the same as, or beneath, the concatenation of Prefix and
+    // Node?
+    if (Prefix != NULL) {
+        Length = strlen(Prefix);
+        if (strncmp(Path, Prefix, Length) != 0)
+            return FALSE;
 
-        return;
+        Path += Length;
+        if (*Path++ != '/')
+            return FALSE;
     }
 
-    ASSERT3P(Caller, ==, Watch->Caller);
+    Length = strlen(Node);
+    if (strncmp(Path, Node, Length) != 0)
+        return FALSE;
 
-    if (Watch->Active)
-        KeSetEvent(Watch->Event, 0, FALSE);
+    Path += Length;
+    return (*Path == '\0' || *Path == '/') ? TRUE : FALSE;
 }
 
-static VOID
-StoreResetResponse(
-    _In_ PXENBUS_STORE_CONTEXT  Context
+// Must be called with lock held
+static PXENBUS_STORE_WATCH_NODE
+StoreWatchNodeFind(
+    _In_ PXENBUS_STORE_WATCH_NODE   Parent,
+    _In_ PSTR                       Name,
+    _In_ ULONG                      Length
     )
 {
-    PXENBUS_STORE_RESPONSE      Response;
-    PXENBUS_STORE_SEGMENT       Segment;
+    PLIST_ENTRY                     ListEntry;
 
-    Response = &Context->Response;
+    for (ListEntry = Parent->ChildList.Flink;
+         ListEntry != &Parent->ChildList;
+         ListEntry = ListEntry->Flink) {
+        PXENBUS_STORE_WATCH_NODE    Node;
 
-    RtlZeroMemory(Response, sizeof (XENBUS_STORE_RESPONSE));
+        Node = CONTAINING_RECORD(ListEntry, XENBUS_STORE_WATCH_NODE, ListEntry);
 
-    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_HEADER_SEGMENT];
+        if (strncmp(Node->Name, Name, Length) == 0 &&
+            Node->Name[Length] == '\0')
+            return Node;
+    }
 
-    Segment->Data = (PSTR)&Response->Header;
-    Segment->Offset = 0;
-    Segment->Length = sizeof (struct xsd_sockmsg);
+    return NULL;
 }
 
+// Must be called with lock held
 static VOID
-StoreCopyResponse(
+StoreWatchNodePrune(
     _In_ PXENBUS_STORE_CONTEXT      Context,
-    _Out_ PXENBUS_STORE_RESPONSE    Response
+    _In_ PXENBUS_STORE_WATCH_NODE   Node
     )
 {
-    PXENBUS_STORE_SEGMENT           Segment;
-
-    ASSERT(Response != NULL);
-    *Response = Context->Response;
+    while (Node != &Context->WatchRoot &&
+           Node->Registration == NULL &&
+           IsListEmpty(&Node->ChildList)) {
+        PXENBUS_STORE_WATCH_NODE    Parent = Node->Parent;
 
-    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_HEADER_SEGMENT];
-    ASSERT3P(Segment->Data, ==, (PSTR)&Context->Response.Header);
-    Segment->Data = (PSTR)&Response->Header;
+        RemoveEntryList(&Node->ListEntry);
+        __StoreFree(Node);
 
-    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT];
-    if (Segment->Length != 0) {
-        ASSERT3P(Segment->Data, ==, Context->Response.Data);
-        Segment->Data = Response->Data;
-    } else {
-        ASSERT3P(Segment->Data, ==, NULL);
+        Node = Parent;
     }
 }
 
-static VOID
-StoreFreeResponse(
-    _In_ PXENBUS_STORE_RESPONSE Response
+// Must be called with lock held
+static PXENBUS_STORE_REGISTRATION
+StoreLookupRegistration(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PSTR                   Path
     )
 {
-    __StoreFree(Response);
+    PXENBUS_STORE_WATCH_NODE    Node;
+
+    // Find the shallowest active registration that covers Path. A path
+    // starting with a '/' has an empty first component so absolute and
+    // relative paths never match each other.
+    Node = &Context->WatchRoot;
+    for (;;) {
+        PSTR    End = strchr(Path, '/');
+        ULONG   Length;
+
+        Length = (End != NULL) ? (ULONG)(End - Path) : (ULONG)strlen(Path);
+
+        Node = StoreWatchNodeFind(Node, Path, Length);
+        if (Node == NULL)
+            break;
+
+        if (Node->Registration != NULL && Node->Registration->Active)
+            return Node->Registration;
+
+        if (End == NULL)
+            break;
+
+        Path = End + 1;
+    }
+
+    return NULL;
 }
 
+// Must be called with lock held
 static VOID
-StoreProcessResponse(
-    _In_ PXENBUS_STORE_CONTEXT  Context
+StoreShareRegistration(
+    _In_ PXENBUS_STORE_CONTEXT      Context,
+    _In_ PXENBUS_STORE_REGISTRATION Registration
     )
 {
-    PXENBUS_STORE_RESPONSE      Response;
-    PXENBUS_STORE_REQUEST       Request;
+    PXENBUS_STORE_WATCH_NODE        Node;
+    PSTR                            Path;
 
-    Response = &Context->Response;
+    ASSERT3P(Registration->Node, ==, NULL);
 
-    if (StoreIgnoreHeaderType(Response->Header.type)) {
-        Warning("IGNORING RESPONSE TYPE %08X\n", Response->Header.type);
-        StoreResetResponse(Context);
-        return;
-    }
+    Path = Registration->Path;
 
-    if (Response->Header.type == XS_WATCH_EVENT) {
-        StoreProcessWatchEvent(Context);
-        StoreResetResponse(Context);
-        return;
+    Node = &Context->WatchRoot;
+    for (;;) {
+        PSTR                        End = strchr(Path, '/');
+        ULONG                       Length;
+        PXENBUS_STORE_WATCH_NODE    Child;
+
+        Length = (End != NULL) ? (ULONG)(End - Path) : (ULONG)strlen(Path);
+
+        Child = StoreWatchNodeFind(Node, Path, Length);
+        if (Child == NULL) {
+            Child = __StoreAllocate(FIELD_OFFSET(XENBUS_STORE_WATCH_NODE, Name) +
+                                    Length + sizeof (CHAR));
+
+            // The registration simply won't be shared
+            if (Child == NULL)
+                goto fail1;
+
+            RtlCopyMemory(Child->Name, Path, Length);
+            InitializeListHead(&Child->ChildList);
+            Child->Parent = Node;
+            InsertTailList(&Node->ChildList, &Child->ListEntry);
+        }
+
+        Node = Child;
+
+        if (End == NULL)
+            break;
+
+        Path = End + 1;
     }
 
-    Request = StoreFindRequest(Context, Response->Header.req_id);
-    if (Request == NULL) {
-        Warning("SPURIOUS RESPONSE ID %08X\n", Response->Header.req_id);
-        StoreResetResponse(Context);
-        return;
+    if (Node->Registration != NULL) {
+        // Another watch on the same path raced with this one
+        if (Node->Registration->Active)
+            return;
+
+        // Anything else did not survive a resume and is just waiting
+        // for its watches to be removed
+        Node->Registration->Node = NULL;
     }
 
-    ASSERT3U(Request->State, ==, XENBUS_STORE_REQUEST_PENDING);
+    Node->Registration = Registration;
+    Registration->Node = Node;
+    return;
 
-    RemoveEntryList(&Request->ListEntry);
+fail1:
+    StoreWatchNodePrune(Context, Node);
+}
 
-    StoreCopyResponse(Context, Request->Response);
-    StoreResetResponse(Context);
+// Must be called with lock held
+static VOID
+StoreUnshareRegistration(
+    _In_ PXENBUS_STORE_CONTEXT      Context,
+    _In_ PXENBUS_STORE_REGISTRATION Registration
+    )
+{
+    PXENBUS_STORE_WATCH_NODE        Node = Registration->Node;
 
-    Request->State = XENBUS_STORE_REQUEST_COMPLETED;
+    if (Node == NULL)
+        return;
 
-    KeMemoryBarrier();
+    ASSERT3P(Node->Registration, ==, Registration);
+    Node->Registration = NULL;
+    Registration->Node = NULL;
+
+    StoreWatchNodePrune(Context, Node);
 }
 
 static ULONG
-StorePollLocked(
-    _In_ PXENBUS_STORE_CONTEXT  Context
+StoreCacheHash(
+    _In_ PSTR   Path
     )
 {
-    ULONG                       Count;
-    ULONG                       Read;
-    ULONG                       Written;
-    NTSTATUS                    status;
-
-    ASSERT3U(KeGetCurrentIrql(), ==, DISPATCH_LEVEL);
-
-    Context->Polls++;
+    ULONG       Hash;
 
-    Count = XENBUS_EVTCHN(GetCount,
-                          &Context->EvtchnInterface,
-                          Context->Channel);
+    Hash = 5381;
+    while (*Path != '\0')
+        Hash = (Hash << 5) + Hash + (UCHAR)*Path++;
 
-    KeMemoryBarrier();
+    return Hash;
+}
 
-    do {
-        Read = Written = 0;
+// Must be called with lock held
+static PXENBUS_STORE_CACHE_ENTRY
+StoreCacheFind(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PSTR                   Path,
+    _In_ ULONG                  Hash
+    )
+{
+    PLIST_ENTRY                 Bucket;
+    PLIST_ENTRY                 ListEntry;
 
-        StoreSendRequests(Context, &Written);
-        if (Written != 0)
-            (VOID) XENBUS_EVTCHN(Send,
-                                 &Context->EvtchnInterface,
-                                 Context->Channel);
+    Bucket = &Context->CacheBucket[Hash % XENBUS_STORE_CACHE_BUCKETS];
 
-        status = StoreReceiveResponse(Context, &Read);
-        if (NT_SUCCESS(status))
-            StoreProcessResponse(Context);
+    for (ListEntry = Bucket->Flink;
+         ListEntry != Bucket;
+         ListEntry = ListEntry->Flink) {
+        PXENBUS_STORE_CACHE_ENTRY   Entry;
 
-        if (Read != 0)
-            (VOID) XENBUS_EVTCHN(Send,
-                                 &Context->EvtchnInterface,
-                                 Context->Channel);
+        Entry = CONTAINING_RECORD(ListEntry,
+                                  XENBUS_STORE_CACHE_ENTRY,
+                                  BucketListEntry);
 
-    } while (Written != 0 || Read != 0);
+        if (Entry->Hash == Hash && strcmp(Entry->Path, Path) == 0)
+            return Entry;
+    }
 
-    return Count;
+    return NULL;
 }
 
-static FORCEINLINE VOID
-__StorePoll(
-    _In_ PXENBUS_STORE_CONTEXT  Context
+// Must be called with lock held
+static VOID
+StoreCacheRemove(
+    _In_ PXENBUS_STORE_CONTEXT      Context,
+    _In_ PXENBUS_STORE_CACHE_ENTRY  Entry
     )
 {
-    KeAcquireSpinLockAtDpcLevel(&Context->Lock);
-    if (Context->References != 0)
-        (VOID) StorePollLocked(Context);
-    KeReleaseSpinLockFromDpcLevel(&Context->Lock);
+    RemoveEntryList(&Entry->BucketListEntry);
+    RemoveEntryList(&Entry->ListEntry);
+
+    ASSERT(Context->CacheCount != 0);
+    --Context->CacheCount;
+
+    __StoreFree(Entry);
 }
 
-static
-_Function_class_(KDEFERRED_ROUTINE)
-_IRQL_requires_max_(DISPATCH_LEVEL)
-_IRQL_requires_min_(DISPATCH_LEVEL)
-_IRQL_requires_(DISPATCH_LEVEL)
-_IRQL_requires_same_
-VOID
-StoreDpc(
-    _In_ PKDPC              Dpc,
-    _In_ PVOID              _Context,
-    _In_ PVOID              Argument1,
-    _In_ PVOID              Argument2
+// Must be called with lock held
+static VOID
+StoreCacheInvalidate(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_opt_ PSTR               Prefix,
+    _In_opt_ PSTR               Node
     )
 {
-    PXENBUS_STORE_CONTEXT   Context = _Context;
+    PLIST_ENTRY                 ListEntry;
 
-    UNREFERENCED_PARAMETER(Dpc);
-    UNREFERENCED_PARAMETER(Argument1);
-    UNREFERENCED_PARAMETER(Argument2);
+    // Any read in flight may have raced with the change so make sure
+    // its result is not added to the cache.
+    Context->CacheGeneration++;
 
-    ASSERT(Context != NULL);
-    __StorePoll(Context);
-}
+    ListEntry = Context->CacheList.Flink;
+    while (ListEntry != &Context->CacheList) {
+        PLIST_ENTRY                 Next = ListEntry->Flink;
+        PXENBUS_STORE_CACHE_ENTRY   Entry;
 
-#define TIME_US(_us)        ((_us) * 10)
-#define TIME_MS(_ms)        (TIME_US((_ms) * 1000))
-#define TIME_S(_s)          (TIME_MS((_s) * 1000))
-#define TIME_RELATIVE(_t)   (-(_t))
+        Entry = CONTAINING_RECORD(ListEntry,
+                                  XENBUS_STORE_CACHE_ENTRY,
+                                  ListEntry);
 
-#define XENBUS_STORE_POLL_PERIOD 5
+        // A NULL Node flushes the whole cache
+        if (Node == NULL || StoreIsSubPath(Entry->Path, Prefix, Node)) {
+            StoreCacheRemove(Context, Entry);
+            Context->CacheInvalidations++;
+        }
 
-static PXENBUS_STORE_RESPONSE
-StoreSubmitRequest(
+        ListEntry = Next;
+    }
+}
+
+// Must be called with lock held
+static BOOLEAN
+StoreCacheIsCovered(
     _In_ PXENBUS_STORE_CONTEXT  Context,
-    _In_ PXENBUS_STORE_REQUEST  Request
+    _In_ PSTR                   Path
     )
 {
-    PXENBUS_STORE_RESPONSE      Response;
-    KIRQL                       Irql;
-    ULONG                       Count;
-    XENBUS_STORE_REQUEST_STATE  State;
-    LARGE_INTEGER               Timeout;
-    NTSTATUS                    status;
-
-    ASSERT3U(Request->State, ==, XENBUS_STORE_REQUEST_PREPARED);
+    return (StoreLookupRegistration(Context, Path) != NULL) ? TRUE : FALSE;
+}
 
-    Request->Response = __StoreAllocate(sizeof (XENBUS_STORE_RESPONSE));
+// Must be called with lock held
+static VOID
+StoreQueueWatchEvent(
+    _In_ PXENBUS_STORE_WATCH    Watch,
+    _In_ PSTR                   Path
+    )
+{
+    ULONG                       Length;
+    PSTR                        Copy;
 
-    status = STATUS_NO_MEMORY;
-    if (Request->Response == NULL)
+    if (Watch->QueueProducer - Watch->QueueConsumer == Watch->QueueDepth)
         goto fail1;
 
-    // Make sure we don't suspend
-    ASSERT3U(KeGetCurrentIrql(), <=, DISPATCH_LEVEL);
-    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    Length = (ULONG)strlen(Path) + sizeof (CHAR);
 
-    KeAcquireSpinLockAtDpcLevel(&Context->Lock);
+    Copy = __StoreAllocate(Length);
+    if (Copy == NULL)
+        goto fail2;
 
-    InsertTailList(&Context->SubmittedList, &Request->ListEntry);
+    RtlCopyMemory(Copy, Path, Length);
 
-    Request->State = XENBUS_STORE_REQUEST_SUBMITTED;
+    Watch->Queue[Watch->QueueProducer++ % Watch->QueueDepth] = Copy;
+    return;
 
-    Count = StorePollLocked(Context);
+fail2:
+fail1:
+    // The watcher will have to rescan to find what it missed
+    Watch->QueueOverflow = TRUE;
+    Watch->QueueDropped++;
+}
 
-    KeMemoryBarrier();
-    State = Request->State;
+// Must be called with lock held
+static VOID
+StoreFlushWatchQueue(
+    _In_ PXENBUS_STORE_WATCH    Watch
+    )
+{
+    while (Watch->QueueConsumer != Watch->QueueProducer) {
+        ULONG   Index = Watch->QueueConsumer++ % Watch->QueueDepth;
 
-    Timeout.QuadPart = TIME_RELATIVE(TIME_S(XENBUS_STORE_POLL_PERIOD));
+        __StoreFree(Watch->Queue[Index]);
+        Watch->Queue[Index] = NULL;
+    }
+}
 
-    while (State != XENBUS_STORE_REQUEST_COMPLETED) {
-        status = XENBUS_EVTCHN(Wait,
-                               &Context->EvtchnInterface,
-                               Context->Channel,
-                               Count + 1,
-                               &Timeout);
-        if (status == STATUS_TIMEOUT)
-            Warning("TIMED OUT\n");
+#define TIME_US(_us)        ((_us) * 10)
+#define TIME_MS(_ms)        (TIME_US((_ms) * 1000))
+#define TIME_S(_s)          (TIME_MS((_s) * 1000))
+#define TIME_RELATIVE(_t)   (-(_t))
 
-        Count = StorePollLocked(Context);
+// Must be called with lock held
+static VOID
+StoreSignalWatch(
+    _In_ PXENBUS_STORE_WATCH    Watch
+    )
+{
+    LARGE_INTEGER               Timeout;
 
-        KeMemoryBarrier();
-        State = Request->State;
+    if (Watch->Interval == 0) {
+        KeSetEvent(Watch->Event, 0, FALSE);
+        return;
     }
 
-    KeReleaseSpinLockFromDpcLevel(&Context->Lock);
-
-    Response = Request->Response;
-    ASSERT(Response == NULL ||
-           Response->Header.type == XS_ERROR ||
-           Response->Header.type == Request->Header.type);
-
-    RtlZeroMemory(Request, sizeof (XENBUS_STORE_REQUEST));
+    // The first event wakes the watcher at once. Any that follow within
+    // the interval are collapsed into a single wakeup when it expires.
+    if (Watch->Debouncing) {
+        if (Watch->Pending)
+            Watch->Suppressed++;
+        else
+            Watch->Pending = TRUE;
 
-    KeLowerIrql(Irql);
+        return;
+    }
 
-    return Response;
+    KeSetEvent(Watch->Event, 0, FALSE);
 
-fail1:
-    Error("fail1 (%08x)\n", status);
+    Watch->Debouncing = TRUE;
 
-    return NULL;
+    Timeout.QuadPart = TIME_RELATIVE(TIME_MS((LONGLONG)Watch->Interval));
+    KeSetTimer(&Watch->Timer, Timeout, &Watch->Dpc);
 }
 
-static NTSTATUS
-StoreCheckResponse(
-    _In_ PXENBUS_STORE_RESPONSE Response
+static
+_Function_class_(KDEFERRED_ROUTINE)
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_IRQL_requires_min_(DISPATCH_LEVEL)
+_IRQL_requires_(DISPATCH_LEVEL)
+_IRQL_requires_same_
+VOID
+StoreWatchDpc(
+    _In_ PKDPC              Dpc,
+    _In_ PVOID              _Context,
+    _In_ PVOID              Argument1,
+    _In_ PVOID              Argument2
     )
 {
-    NTSTATUS                    status;
+    PXENBUS_STORE_CONTEXT   Context = _Context;
+    PXENBUS_STORE_WATCH     Watch;
+    LARGE_INTEGER           Timeout;
 
-    status = STATUS_SUCCESS;
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
 
-    if (Response->Header.type == XS_ERROR) {
-        PSTR    Error;
-        ULONG   Length;
-        ULONG   Index;
+    ASSERT(Context != NULL);
 
-        Error = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
-        Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
+    Watch = CONTAINING_RECORD(Dpc, XENBUS_STORE_WATCH, Dpc);
 
-        if (strncmp(Error, "EQUOTA", Length) == 0) {
-            status = STATUS_QUOTA_EXCEEDED;
-            goto done;
-        }
+    KeAcquireSpinLockAtDpcLevel(&Context->Lock);
 
-        for (Index = 0;
-             Index < sizeof (xsd_errors) / sizeof (xsd_errors[0]);
-             Index++) {
-            struct xsd_errors   *Entry = &xsd_errors[Index];
+    ASSERT(Watch->Debouncing);
 
-            if (strncmp(Error, Entry->errstring, Length) == 0) {
-                ERRNO_TO_STATUS(Entry->errnum, status);
-                goto done;
-            }
-        }
+    // Keep collapsing events until an interval passes without any. The
+    // timer is never re-armed for an inactive watch.
+    if (Watch->Active && Watch->Pending) {
+        Watch->Pending = FALSE;
+        KeSetEvent(Watch->Event, 0, FALSE);
 
-        status = STATUS_UNSUCCESSFUL;
+        Timeout.QuadPart = TIME_RELATIVE(TIME_MS((LONGLONG)Watch->Interval));
+        KeSetTimer(&Watch->Timer, Timeout, &Watch->Dpc);
+    } else {
+        Watch->Pending = FALSE;
+        Watch->Debouncing = FALSE;
     }
 
-done:
-    return status;
+    KeReleaseSpinLockFromDpcLevel(&Context->Lock);
 }
 
-static PXENBUS_STORE_BUFFER
-StoreCopyPayload(
+static VOID
+StoreProcessWatchEvent(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response;
+    PSTR                        Path;
+    PVOID                       Caller;
+    USHORT                      Id;
+    PXENBUS_STORE_REGISTRATION  Registration;
+    PLIST_ENTRY                 ListEntry;
+    NTSTATUS                    status;
+
+    Response = &Context->Response;
+
+    ASSERT3U(Response->Header.req_id, ==, 0);
+
+    status = StoreParseWatchEvent(Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data,
+                                  Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length,
+                                  &Path,
+                                  &Caller,
+                                  &Id);
+    if (!NT_SUCCESS(status))
+        return;
+
+    Trace("%04x (%s)\n", Id, Path);
+
+    StoreCacheInvalidate(Context, NULL, Path);
+
+    Registration = StoreFindRegistration(Context, Id);
+
+    if (Registration == NULL) {
+        PSTR        Name;
+        ULONG_PTR   Offset;
+
+        ModuleLookup((ULONG_PTR)Caller, &Name, &Offset);
+        if (Name != NULL)
+            Warning("SPURIOUS WATCH EVENT (%s) FOR %s + %p\n",
+                    Path,
+                    Name,
+                    Offset);
+        else
+            Warning("SPURIOUS WATCH EVENT (%s) FOR %p\n",
+                    Path,
+                    Caller);
+
+        return;
+    }
+
+    ASSERT3P(Caller, ==, Registration->Caller);
+
+    if (!Registration->Active)
+        return;
+
+    for (ListEntry = Registration->WatchList.Flink;
+         ListEntry != &Registration->WatchList;
+         ListEntry = ListEntry->Flink) {
+        PXENBUS_STORE_WATCH Watch;
+        PSTR                Match;
+
+        Watch = CONTAINING_RECORD(ListEntry,
+                                  XENBUS_STORE_WATCH,
+                                  RegistrationListEntry);
+
+        if (!Watch->Active)
+            continue;
+
+        // The event may be for something beneath the watch or, if an
+        // ancestor was removed, for something above it. In the latter
+        // case report the watched path, as XenStore would have done.
+        if (StoreIsSubPath(Path, NULL, Watch->Path))
+            Match = Path;
+        else if (StoreIsSubPath(Watch->Path, NULL, Path))
+            Match = Watch->Path;
+        else
+            continue;
+
+        if (Watch->Queue != NULL)
+            StoreQueueWatchEvent(Watch, Match);
+
+        StoreSignalWatch(Watch);
+    }
+}
+
+static VOID
+StoreResetResponse(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response;
+    PXENBUS_STORE_SEGMENT       Segment;
+
+    Response = &Context->Response;
+
+    RtlZeroMemory(Response, sizeof (XENBUS_STORE_RESPONSE));
+
+    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_HEADER_SEGMENT];
+
+    Segment->Data = (PSTR)&Response->Header;
+    Segment->Offset = 0;
+    Segment->Length = sizeof (struct xsd_sockmsg);
+}
+
+static NTSTATUS
+StoreResponseCtor(
+    _In_ PVOID              Argument,
+    _In_ PVOID              Object
+    )
+{
+    UNREFERENCED_PARAMETER(Argument);
+    UNREFERENCED_PARAMETER(Object);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+StoreResponseDtor(
+    _In_ PVOID              Argument,
+    _In_ PVOID              Object
+    )
+{
+    UNREFERENCED_PARAMETER(Argument);
+    UNREFERENCED_PARAMETER(Object);
+}
+
+static VOID
+StoreResponseAcquireLock(
+    _In_ PVOID              Argument
+    )
+{
+    PXENBUS_STORE_CONTEXT   Context = Argument;
+
+    KeAcquireSpinLockAtDpcLevel(&Context->ResponseLock);
+}
+
+static VOID
+StoreResponseReleaseLock(
+    _In_ PVOID              Argument
+    )
+{
+    PXENBUS_STORE_CONTEXT   Context = Argument;
+
+    KeReleaseSpinLockFromDpcLevel(&Context->ResponseLock);
+}
+
+static PXENBUS_STORE_RESPONSE
+StoreAllocateResponse(
     _In_ PXENBUS_STORE_CONTEXT  Context,
-    _In_ PXENBUS_STORE_RESPONSE Response,
-    _In_ PVOID                  Caller
+    _In_ ULONG                  Length
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response;
+
+    // Leave room for a NUL terminator
+    if (Length < XENBUS_STORE_RESPONSE_SMALL_SIZE) {
+        Response = XENBUS_CACHE(Get,
+                                &Context->CacheInterface,
+                                Context->ResponseCache,
+                                FALSE);
+        if (Response == NULL)
+            return NULL;
+
+        Response->Size = XENBUS_STORE_RESPONSE_SMALL_SIZE;
+    } else {
+        Response = __StoreAllocate(sizeof (XENBUS_STORE_RESPONSE));
+        if (Response == NULL)
+            return NULL;
+
+        Response->Size = XENSTORE_PAYLOAD_MAX;
+    }
+
+    return Response;
+}
+
+static VOID
+StoreCopyResponse(
+    _In_ PXENBUS_STORE_CONTEXT      Context,
+    _Inout_ PXENBUS_STORE_RESPONSE  Response
+    )
+{
+    PXENBUS_STORE_SEGMENT           Segment;
+
+    ASSERT(Response != NULL);
+
+    // Only copy as much of the payload as was received
+    Response->Header = Context->Response.Header;
+    Response->Segment[XENBUS_STORE_RESPONSE_HEADER_SEGMENT] =
+        Context->Response.Segment[XENBUS_STORE_RESPONSE_HEADER_SEGMENT];
+    Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT] =
+        Context->Response.Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT];
+    Response->Index = Context->Response.Index;
+
+    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_HEADER_SEGMENT];
+    ASSERT3P(Segment->Data, ==, (PSTR)&Context->Response.Header);
+    Segment->Data = (PSTR)&Response->Header;
+
+    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT];
+    if (Segment->Length != 0) {
+        // A payload received directly into a caller's buffer stays there
+        if (Segment->Data == Context->Response.Data) {
+            ASSERT3U(Segment->Length, <, Response->Size);
+            RtlCopyMemory(Response->Data, Segment->Data, Segment->Length);
+            Response->Data[Segment->Length] = '\0';
+
+            Segment->Data = Response->Data;
+        }
+    } else {
+        ASSERT3P(Segment->Data, ==, NULL);
+    }
+}
+
+static VOID
+StoreFreeResponse(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_RESPONSE Response
+    )
+{
+    if (Response->Size == XENBUS_STORE_RESPONSE_SMALL_SIZE) {
+        XENBUS_CACHE(Put,
+                     &Context->CacheInterface,
+                     Context->ResponseCache,
+                     Response,
+                     FALSE);
+    } else {
+        ASSERT3U(Response->Size, ==, XENSTORE_PAYLOAD_MAX);
+        __StoreFree(Response);
+    }
+}
+
+static NTSTATUS
+StoreCheckResponse(
+    _In_ PXENBUS_STORE_RESPONSE Response
     )
 {
-    PSTR                        Data;
-    ULONG                       Length;
-    PXENBUS_STORE_BUFFER        Buffer;
-    KIRQL                       Irql;
     NTSTATUS                    status;
 
-    Data = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
-    Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
+    status = STATUS_SUCCESS;
+
+    if (Response->Header.type == XS_ERROR) {
+        PSTR    Error;
+        ULONG   Length;
+        ULONG   Index;
+
+        Error = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
+        Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
+
+        if (strncmp(Error, "EQUOTA", Length) == 0) {
+            status = STATUS_QUOTA_EXCEEDED;
+            goto done;
+        }
+
+        for (Index = 0;
+             Index < sizeof (xsd_errors) / sizeof (xsd_errors[0]);
+             Index++) {
+            struct xsd_errors   *Entry = &xsd_errors[Index];
+
+            if (strncmp(Error, Entry->errstring, Length) == 0) {
+                ERRNO_TO_STATUS(Entry->errnum, status);
+                goto done;
+            }
+        }
+
+        status = STATUS_UNSUCCESSFUL;
+    }
+
+done:
+    return status;
+}
+
+static ULONG
+StoreLatencyBucket(
+    _In_ LONGLONG   Ticks,
+    _In_ LONGLONG   Frequency
+    )
+{
+    ULONGLONG       Microseconds;
+    ULONG           Bucket;
+
+    if (Ticks <= 0)
+        return 0;
+
+    Microseconds = (((ULONGLONG)Ticks / Frequency) * 1000000ull) +
+                   ((((ULONGLONG)Ticks % Frequency) * 1000000ull) / Frequency);
+
+    Bucket = 0;
+    while ((Microseconds >>= 1) != 0 &&
+           Bucket < XENBUS_STORE_LATENCY_BUCKETS - 1)
+        Bucket++;
+
+    return Bucket;
+}
+
+// Must be called with lock held
+static VOID
+StoreRecordLatency(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_REQUEST  Request
+    )
+{
+    PXENBUS_STORE_LATENCY       Latency;
+    LARGE_INTEGER               Frequency;
+    LONGLONG                    Completed;
+
+    Completed = KeQueryPerformanceCounter(&Frequency).QuadPart;
+    ASSERT(Frequency.QuadPart != 0);
+
+    Latency = &Context->Latency[Request->Header.type];
+
+    Latency->Count++;
+    Latency->QueueTime[StoreLatencyBucket(Request->Sent - Request->Prepared,
+                                          Frequency.QuadPart)]++;
+    Latency->ServiceTime[StoreLatencyBucket(Completed - Request->Sent,
+                                            Frequency.QuadPart)]++;
+}
+
+static VOID
+StoreProcessResponse(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response;
+    PXENBUS_STORE_REQUEST       Request;
+    PXENBUS_STORE_SEGMENT       Segment;
+
+    Response = &Context->Response;
+
+    if (StoreIgnoreHeaderType(Response->Header.type)) {
+        Warning("IGNORING RESPONSE TYPE %08X\n", Response->Header.type);
+        StoreResetResponse(Context);
+        return;
+    }
+
+    if (Response->Header.type == XS_WATCH_EVENT) {
+        StoreProcessWatchEvent(Context);
+        StoreResetResponse(Context);
+        return;
+    }
+
+    Request = StoreFindRequest(Context, Response->Header.req_id);
+    if (Request == NULL) {
+        Warning("SPURIOUS RESPONSE ID %08X\n", Response->Header.req_id);
+        StoreResetResponse(Context);
+        return;
+    }
+
+    ASSERT3U(Request->State, ==, XENBUS_STORE_REQUEST_PENDING);
+
+    RemoveEntryList(&Request->ListEntry);
+    StoreIndexRemove(&Context->RequestIndex,
+                     Request->Header.req_id,
+                     Request);
+
+    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT];
+    if (Segment->Data == Response->Data &&
+        Segment->Length >= Request->Response->Size) {
+        PXENBUS_STORE_RESPONSE  Large;
+
+        Large = StoreAllocateResponse(Context, Segment->Length);
+        if (Large != NULL) {
+            StoreFreeResponse(Context, Request->Response);
+            Request->Response = Large;
+        } else {
+            Warning("NO MEMORY FOR RESPONSE ID %08X\n", Response->Header.req_id);
+
+            // Fail the request rather than leave it pending
+            Response->Header.type = XS_ERROR;
+            Response->Header.len = sizeof ("ENOMEM");
+            RtlCopyMemory(Response->Data, "ENOMEM", sizeof ("ENOMEM"));
+            Segment->Length = sizeof ("ENOMEM");
+        }
+    }
+
+    StoreCopyResponse(Context, Request->Response);
+    StoreResetResponse(Context);
+
+    StoreRecordLatency(Context, Request);
+
+    Request->State = XENBUS_STORE_REQUEST_COMPLETED;
+
+    // Asynchronous requests are completed outside the lock
+    if (Request->Function != NULL) {
+        InsertTailList(&Context->CompletedList, &Request->ListEntry);
+        Context->AsyncCompletions++;
+    }
+
+    KeMemoryBarrier();
+}
+
+static ULONG
+StorePollLocked(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    ULONG                       Count;
+    ULONG                       Read;
+    ULONG                       Written;
+    NTSTATUS                    status;
+
+    ASSERT3U(KeGetCurrentIrql(), ==, DISPATCH_LEVEL);
+
+    Context->Polls++;
+
+    Count = XENBUS_EVTCHN(GetCount,
+                          &Context->EvtchnInterface,
+                          Context->Channel);
+
+    KeMemoryBarrier();
+
+    do {
+        Read = Written = 0;
+
+        StoreSendRequests(Context, &Written);
+        if (Written != 0)
+            (VOID) XENBUS_EVTCHN(Send,
+                                 &Context->EvtchnInterface,
+                                 Context->Channel);
+
+        status = StoreReceiveResponse(Context, &Read);
+        if (NT_SUCCESS(status))
+            StoreProcessResponse(Context);
+
+        if (Read != 0)
+            (VOID) XENBUS_EVTCHN(Send,
+                                 &Context->EvtchnInterface,
+                                 Context->Channel);
+
+    } while (Written != 0 || Read != 0);
+
+    return Count;
+}
+
+// Must be called with lock held
+static FORCEINLINE VOID
+__StoreQueueCompletions(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    if (IsListEmpty(&Context->CompletedList))
+        return;
+
+    if (KeInsertQueueDpc(&Context->Dpc, NULL, NULL))
+        Context->Dpcs++;
+}
+
+static VOID
+StoreCompleteRequest(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_REQUEST  Request
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response;
+    PSTR                        Value;
+    NTSTATUS                    status;
+
+    ASSERT3U(Request->State, ==, XENBUS_STORE_REQUEST_COMPLETED);
+    ASSERT(Request->Function != NULL);
+
+    Response = Request->Response;
+    ASSERT(Response->Header.type == XS_ERROR ||
+           Response->Header.type == Request->Header.type);
+
+    status = StoreCheckResponse(Response);
+
+    if (Request->Header.type == XS_WRITE) {
+        KeAcquireSpinLockAtDpcLevel(&Context->Lock);
+        StoreCacheInvalidate(Context, NULL, Request->Buffer);
+        KeReleaseSpinLockFromDpcLevel(&Context->Lock);
+    }
+
+    Value = NULL;
+    if (NT_SUCCESS(status) && Response->Header.type == XS_READ) {
+        // The response was zeroed before the payload was copied in
+        Value = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
+        if (Value == NULL)
+            Value = "";
+    }
+
+    Request->Function(Request->Argument, status, Value);
+
+    StoreFreeResponse(Context, Response);
+    __StoreFree(Request->Buffer);
+
+    RtlZeroMemory(Request, sizeof (XENBUS_STORE_REQUEST));
+    __StoreFree(Request);
+}
+
+static FORCEINLINE VOID
+__StorePoll(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    LIST_ENTRY                  List;
+
+    InitializeListHead(&List);
+
+    KeAcquireSpinLockAtDpcLevel(&Context->Lock);
+    if (Context->References != 0)
+        (VOID) StorePollLocked(Context);
+
+    while (!IsListEmpty(&Context->CompletedList)) {
+        PLIST_ENTRY ListEntry;
+
+        ListEntry = RemoveHeadList(&Context->CompletedList);
+        InsertTailList(&List, ListEntry);
+    }
+    KeReleaseSpinLockFromDpcLevel(&Context->Lock);
+
+    while (!IsListEmpty(&List)) {
+        PLIST_ENTRY             ListEntry;
+        PXENBUS_STORE_REQUEST   Request;
+
+        ListEntry = RemoveHeadList(&List);
+        Request = CONTAINING_RECORD(ListEntry, XENBUS_STORE_REQUEST, ListEntry);
+
+        StoreCompleteRequest(Context, Request);
+    }
+}
+
+static
+_Function_class_(KDEFERRED_ROUTINE)
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_IRQL_requires_min_(DISPATCH_LEVEL)
+_IRQL_requires_(DISPATCH_LEVEL)
+_IRQL_requires_same_
+VOID
+StoreDpc(
+    _In_ PKDPC              Dpc,
+    _In_ PVOID              _Context,
+    _In_ PVOID              Argument1,
+    _In_ PVOID              Argument2
+    )
+{
+    PXENBUS_STORE_CONTEXT   Context = _Context;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    ASSERT(Context != NULL);
+    __StorePoll(Context);
+}
+
+#define XENBUS_STORE_POLL_PERIOD 5
+
+static NTSTATUS
+StoreSubmitRequests(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _Inout_updates_(NumberRequests)
+    PXENBUS_STORE_REQUEST       Requests,
+    _In_ ULONG                  NumberRequests
+    )
+{
+    KIRQL                       Irql;
+    ULONG                       Count;
+    ULONG                       Index;
+    XENBUS_STORE_REQUEST_STATE  State;
+    LARGE_INTEGER               Timeout;
+    NTSTATUS                    status;
+
+    for (Index = 0; Index < NumberRequests; Index++) {
+        PXENBUS_STORE_REQUEST   Request = &Requests[Index];
+
+        ASSERT3U(Request->State, ==, XENBUS_STORE_REQUEST_PREPARED);
+
+        Request->Response = StoreAllocateResponse(Context, 0);
+
+        status = STATUS_NO_MEMORY;
+        if (Request->Response == NULL)
+            goto fail1;
+    }
+
+    // Make sure we don't suspend
+    ASSERT3U(KeGetCurrentIrql(), <=, DISPATCH_LEVEL);
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    KeAcquireSpinLockAtDpcLevel(&Context->Lock);
+
+    for (Index = 0; Index < NumberRequests; Index++) {
+        PXENBUS_STORE_REQUEST   Request = &Requests[Index];
+
+        InsertTailList(&Context->SubmittedList, &Request->ListEntry);
+
+        Request->State = XENBUS_STORE_REQUEST_SUBMITTED;
+    }
+
+    // All the requests are copied into the ring before the single
+    // notification sent by StorePollLocked()
+    Count = StorePollLocked(Context);
+
+    Timeout.QuadPart = TIME_RELATIVE(TIME_S(XENBUS_STORE_POLL_PERIOD));
+
+    Index = 0;
+    while (Index < NumberRequests) {
+        KeMemoryBarrier();
+        State = Requests[Index].State;
+
+        if (State == XENBUS_STORE_REQUEST_COMPLETED) {
+            Index++;
+            continue;
+        }
+
+        status = XENBUS_EVTCHN(Wait,
+                               &Context->EvtchnInterface,
+                               Context->Channel,
+                               Count + 1,
+                               &Timeout);
+        if (status == STATUS_TIMEOUT)
+            Warning("TIMED OUT\n");
+
+        Count = StorePollLocked(Context);
+    }
+
+    __StoreQueueCompletions(Context);
+
+    KeReleaseSpinLockFromDpcLevel(&Context->Lock);
+
+    for (Index = 0; Index < NumberRequests; Index++)
+        ASSERT(Requests[Index].Response->Header.type == XS_ERROR ||
+               Requests[Index].Response->Header.type == Requests[Index].Header.type);
+
+    KeLowerIrql(Irql);
+
+    return STATUS_SUCCESS;
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    while (Index != 0) {
+        PXENBUS_STORE_REQUEST   Request = &Requests[--Index];
+
+        StoreFreeResponse(Context, Request->Response);
+        Request->Response = NULL;
+    }
+
+    return status;
+}
+
+static PXENBUS_STORE_RESPONSE
+StoreSubmitRequest(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_REQUEST  Request
+    )
+{
+    PXENBUS_STORE_RESPONSE      Response;
+    NTSTATUS                    status;
+
+    status = StoreSubmitRequests(Context, Request, 1);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    Response = Request->Response;
+
+    RtlZeroMemory(Request, sizeof (XENBUS_STORE_REQUEST));
+
+    return Response;
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    RtlZeroMemory(Request, sizeof (XENBUS_STORE_REQUEST));
+
+    return NULL;
+}
+
+static PXENBUS_STORE_BUFFER
+StoreAllocateBuffer(
+    _In_reads_bytes_opt_(Length) PSTR   Data,
+    _In_ ULONG                          Length,
+    _In_ PVOID                          Caller
+    )
+{
+    PXENBUS_STORE_BUFFER                Buffer;
+
+    Buffer = __StoreAllocate(FIELD_OFFSET(XENBUS_STORE_BUFFER, Data) +
+                             Length +
+                             (sizeof (CHAR) * 2));  // Double-NUL terminate
+    if (Buffer == NULL)
+        return NULL;
+
+    Buffer->Magic = XENBUS_STORE_BUFFER_MAGIC;
+    Buffer->Length = Length;
+    Buffer->Caller = Caller;
+
+    RtlCopyMemory(Buffer->Data, Data, Length);
+
+    return Buffer;
+}
+
+static PXENBUS_STORE_BUFFER
+StoreCopyPayload(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_RESPONSE Response,
+    _In_ PVOID                  Caller
+    )
+{
+    PSTR                        Data;
+    ULONG                       Length;
+    PXENBUS_STORE_BUFFER        Buffer;
+    KIRQL                       Irql;
+    NTSTATUS                    status;
+
+    Data = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
+    Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
+
+    Buffer = StoreAllocateBuffer(Data, Length, Caller);
+
+    status  = STATUS_NO_MEMORY;
+    if (Buffer == NULL)
+        goto fail1;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    InsertTailList(&Context->BufferList, &Buffer->ListEntry);
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return Buffer;
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return NULL;
+}
+
+static VOID
+StoreFreePayload(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_BUFFER   Buffer
+    )
+{
+    KIRQL                       Irql;
+
+    ASSERT3U(Buffer->Magic, ==, XENBUS_STORE_BUFFER_MAGIC);
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    RemoveEntryList(&Buffer->ListEntry);
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    __StoreFree(Buffer);
+}
+
+static VOID
+StoreFree(
+    _In_ PINTERFACE         Interface,
+    _In_ PSTR               Value
+    )
+{
+    PXENBUS_STORE_CONTEXT   Context = Interface->Context;
+    PXENBUS_STORE_BUFFER    Buffer;
+
+    Buffer = CONTAINING_RECORD(Value, XENBUS_STORE_BUFFER, Data);
+
+    StoreFreePayload(Context, Buffer);
+}
+
+extern USHORT
+RtlCaptureStackBackTrace(
+    __in        ULONG   FramesToSkip,
+    __in        ULONG   FramesToCapture,
+    __out       PVOID   *BackTrace,
+    __out_opt   PULONG  BackTraceHash
+    );
+
+static NTSTATUS
+StoreCheckPathLength(
+    _In_opt_ PSTR   Prefix,
+    _In_ PSTR       Node
+    )
+{
+    size_t          MaximumLength;
+    size_t          Length;
+
+    if (Prefix != NULL) {
+        MaximumLength = (Prefix[0] == '/' || Prefix[0] == '\0') ?
+                    XENSTORE_ABS_PATH_MAX :
+                    XENSTORE_REL_PATH_MAX;
+
+        Length = strlen(Prefix);
+        if (Length > MaximumLength)
+            goto fail1;
+        MaximumLength -= Length;
+
+        if (MaximumLength < 1)
+            goto fail2;
+        MaximumLength -= 1;
+    } else {
+        MaximumLength = Node[0] == '/' ?
+                            XENSTORE_ABS_PATH_MAX :
+                            XENSTORE_REL_PATH_MAX;
+    }
+
+    Length = strlen(Node);
+    if (Length > MaximumLength)
+        goto fail3;
+    MaximumLength -= Length;
+
+    if (MaximumLength < 1)
+        goto fail4;
+
+    return STATUS_SUCCESS;
+
+fail4:
+fail3:
+fail2:
+fail1:
+    return STATUS_INVALID_BUFFER_SIZE;
+}
+
+static PSTR
+StoreAllocatePath(
+    _In_opt_ PSTR   Prefix,
+    _In_ PSTR       Node
+    )
+{
+    ULONG           Length;
+    PSTR            Path;
+    NTSTATUS        status;
+
+    if (Prefix == NULL)
+        Length = (ULONG)strlen(Node) + sizeof (CHAR);
+    else
+        Length = (ULONG)strlen(Prefix) + 1 + (ULONG)strlen(Node) + sizeof (CHAR);
+
+    Path = __StoreAllocate(Length);
+    if (Path == NULL)
+        return NULL;
+
+    status = (Prefix == NULL) ?
+             RtlStringCbPrintfA(Path, Length, "%s", Node) :
+             RtlStringCbPrintfA(Path, Length, "%s/%s", Prefix, Node);
+    ASSERT(NT_SUCCESS(status));
+
+    return Path;
+}
+
+static PXENBUS_STORE_BUFFER
+StoreCacheRead(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PSTR                   Path,
+    _In_ PVOID                  Caller,
+    _Out_ PULONG                Generation
+    )
+{
+    PXENBUS_STORE_CACHE_ENTRY   Entry;
+    PXENBUS_STORE_BUFFER        Buffer;
+    KIRQL                       Irql;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    Entry = StoreCacheFind(Context, Path, StoreCacheHash(Path));
+    if (Entry == NULL) {
+        // Sample the generation before the read is submitted
+        *Generation = Context->CacheGeneration;
+        Context->CacheMisses++;
+
+        Buffer = NULL;
+        goto done;
+    }
+
+    Buffer = StoreAllocateBuffer(Entry->Data, Entry->Length, Caller);
+    if (Buffer == NULL) {
+        *Generation = Context->CacheGeneration;
+        goto done;
+    }
+
+    InsertTailList(&Context->BufferList, &Buffer->ListEntry);
+
+    // Keep the list in least-recently-used order
+    RemoveEntryList(&Entry->ListEntry);
+    InsertHeadList(&Context->CacheList, &Entry->ListEntry);
+
+    Context->CacheHits++;
+
+done:
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return Buffer;
+}
+
+static VOID
+StoreCacheUpdate(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PSTR                   Path,
+    _In_ PXENBUS_STORE_BUFFER   Buffer,
+    _In_ ULONG                  Generation
+    )
+{
+    ULONG                       Length;
+    PXENBUS_STORE_CACHE_ENTRY   Entry;
+    KIRQL                       Irql;
+
+    Length = (ULONG)strlen(Path) + sizeof (CHAR);
+
+    Entry = __StoreAllocate(FIELD_OFFSET(XENBUS_STORE_CACHE_ENTRY, Data) +
+                            Buffer->Length +
+                            Length);
+    if (Entry == NULL)
+        return;
+
+    Entry->Hash = StoreCacheHash(Path);
+    Entry->Length = Buffer->Length;
+    RtlCopyMemory(Entry->Data, Buffer->Data, Buffer->Length);
+
+    Entry->Path = Entry->Data + Entry->Length;
+    RtlCopyMemory(Entry->Path, Path, Length);
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    // The value can only be cached if nothing has been invalidated since
+    // the read was submitted, and if a watch will tell us when it changes
+    if (Generation != Context->CacheGeneration ||
+        !StoreCacheIsCovered(Context, Path) ||
+        StoreCacheFind(Context, Path, Entry->Hash) != NULL)
+        goto fail1;
+
+    if (Context->CacheCount == XENBUS_STORE_CACHE_SIZE_MAXIMUM) {
+        PXENBUS_STORE_CACHE_ENTRY   Oldest;
+
+        Oldest = CONTAINING_RECORD(Context->CacheList.Blink,
+                                   XENBUS_STORE_CACHE_ENTRY,
+                                   ListEntry);
+        StoreCacheRemove(Context, Oldest);
+    }
+
+    InsertHeadList(&Context->CacheList, &Entry->ListEntry);
+    InsertTailList(&Context->CacheBucket[Entry->Hash % XENBUS_STORE_CACHE_BUCKETS],
+                   &Entry->BucketListEntry);
+    Context->CacheCount++;
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return;
+
+fail1:
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    __StoreFree(Entry);
+}
+
+static VOID
+StoreCacheInvalidatePath(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_opt_ PSTR               Prefix,
+    _In_opt_ PSTR               Node
+    )
+{
+    KIRQL                       Irql;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    StoreCacheInvalidate(Context, Prefix, Node);
+    KeReleaseSpinLock(&Context->Lock, Irql);
+}
+
+static NTSTATUS
+StoreRead(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _Outptr_result_z_ PSTR              *Value
+    )
+{
+    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
+    PVOID                               Caller;
+    XENBUS_STORE_REQUEST                Request;
+    KIRQL                               Irql;
+    PXENBUS_STORE_RESPONSE              Response;
+    PXENBUS_STORE_BUFFER                Buffer;
+    PSTR                                Path;
+    ULONG                               Generation;
+    NTSTATUS                            status;
+
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
+
+    // Reads within a transaction must always be seen by xenstored
+    Path = (Context->CacheEnabled && Transaction == NULL) ?
+           StoreAllocatePath(Prefix, Node) :
+           NULL;
+    Generation = 0;
+
+    if (Path != NULL) {
+        Buffer = StoreCacheRead(Context, Path, Caller, &Generation);
+        if (Buffer != NULL) {
+            __StoreFree(Path);
+            goto done;
+        }
+    }
+
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    if (Prefix == NULL) {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_READ,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    } else {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_READ,
+                                     Prefix, strlen(Prefix),
+                                     "/", 1,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail2;
+
+    Response = StoreSubmitRequest(Context, &Request);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail3;
+
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
+        goto fail4;
+
+    Buffer = StoreCopyPayload(Context, Response, Caller);
+
+    status = STATUS_NO_MEMORY;
+    if (Buffer == NULL)
+        goto fail5;
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    if (Path != NULL) {
+        StoreCacheUpdate(Context, Path, Buffer, Generation);
+        __StoreFree(Path);
+    }
+
+done:
+    *Value = Buffer->Data;
+
+    return STATUS_SUCCESS;
+
+fail5:
+fail4:
+    StoreFreeResponse(Context, Response);
+
+fail3:
+fail2:
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    if (Path != NULL)
+        __StoreFree(Path);
+
+fail1:
+    return status;
+}
+
+static NTSTATUS
+StoreReadBuffer(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _Out_writes_z_(Length) PSTR         Value,
+    _In_ ULONG                          Length,
+    _Out_opt_ PULONG                    ValueLength
+    )
+{
+    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
+    XENBUS_STORE_REQUEST                Request;
+    KIRQL                               Irql;
+    PXENBUS_STORE_RESPONSE              Response;
+    PXENBUS_STORE_SEGMENT               Segment;
+    NTSTATUS                            status;
+
+    status = STATUS_INVALID_PARAMETER;
+    if (Length == 0)
+        goto fail1;
+
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
+        goto fail2;
+
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    if (Prefix == NULL) {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_READ,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    } else {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_READ,
+                                     Prefix, strlen(Prefix),
+                                     "/", 1,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail3;
+
+    // Leave room for the terminator
+    Request.ReadBuffer = Value;
+    Request.ReadLength = Length - 1;
+
+    Response = StoreSubmitRequest(Context, &Request);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail4;
+
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
+        goto fail5;
+
+    Segment = &Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT];
+
+    if (ValueLength != NULL)
+        *ValueLength = Segment->Length;
+
+    status = STATUS_BUFFER_OVERFLOW;
+    if (Segment->Length != 0 && Segment->Data != Value)
+        goto fail6;
+
+    Value[Segment->Length] = '\0';
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    return STATUS_SUCCESS;
+
+fail6:
+fail5:
+    StoreFreeResponse(Context, Response);
+
+fail4:
+fail3:
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+fail2:
+fail1:
+    return status;
+}
+
+static NTSTATUS
+StoreWrite(
+    _In_ PXENBUS_STORE_CONTEXT          Context,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _In_ PSTR                           Value
+    )
+{
+    XENBUS_STORE_REQUEST                Request;
+    KIRQL                               Irql;
+    PXENBUS_STORE_RESPONSE              Response;
+    NTSTATUS                            status;
+
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    if (Prefix == NULL) {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_WRITE,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     Value, strlen(Value),
+                                     NULL, 0);
+    } else {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_WRITE,
+                                     Prefix, strlen(Prefix),
+                                     "/", 1,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     Value, strlen(Value),
+                                     NULL, 0);
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    Response = StoreSubmitRequest(Context, &Request);
+
+    StoreCacheInvalidatePath(Context, Prefix, Node);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail2;
+
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
+        goto fail3;
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    return STATUS_SUCCESS;
+
+fail3:
+    StoreFreeResponse(Context, Response);
+
+fail2:
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+fail1:
+    return status;
+}
+
+static NTSTATUS
+StoreFormatValue(
+    _In_ PCSTR              Format,
+    _In_ va_list            Arguments,
+    _Outptr_result_z_ PSTR  *Value
+    )
+{
+    PSTR                    Buffer;
+    ULONG                   Length;
+    NTSTATUS                status;
+
+    Length = 32;
+    for (;;) {
+        Buffer = __StoreAllocate(Length);
+
+        status = STATUS_NO_MEMORY;
+        if (Buffer == NULL)
+            goto fail1;
+
+        status = RtlStringCbVPrintfA(Buffer,
+                                     Length,
+                                     Format,
+                                     Arguments);
+        if (NT_SUCCESS(status))
+            break;
+
+        if (status != STATUS_BUFFER_OVERFLOW)
+            goto fail2;
+
+        status = STATUS_INVALID_BUFFER_SIZE;
+        Length <<= 1;
+        if (Length > 1024)
+            goto fail3;
+
+        __StoreFree(Buffer);
+    }
+
+    *Value = Buffer;
+
+    return STATUS_SUCCESS;
+
+fail3:
+fail2:
+    __StoreFree(Buffer);
+
+fail1:
+    return status;
+}
+
+static NTSTATUS
+StoreVPrintf(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _In_ PCSTR                          Format,
+    _In_ va_list                        Arguments
+    )
+{
+    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
+    PSTR                                Buffer;
+    NTSTATUS                            status;
+
+    status = StoreFormatValue(Format, Arguments, &Buffer);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    status = StoreWrite(Context,
+                          Transaction,
+                          Prefix,
+                          Node,
+                          Buffer);
+    if (!NT_SUCCESS(status))
+        goto fail2;
+
+    __StoreFree(Buffer);
+
+    return STATUS_SUCCESS;
+
+fail2:
+    __StoreFree(Buffer);
+
+fail1:
+    return status;
+}
+
+static NTSTATUS
+StorePrintf(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _In_ PCSTR                          Format,
+    ...
+    )
+{
+    va_list                             Arguments;
+    NTSTATUS                            status;
+
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    va_start(Arguments, Format);
+    status = StoreVPrintf(Interface,
+                            Transaction,
+                            Prefix,
+                            Node,
+                            Format,
+                            Arguments);
+    va_end(Arguments);
+
+    return status;
+
+fail1:
+    return status;
+}
+
+static NTSTATUS
+StoreSubmitAsync(
+    _In_ PXENBUS_STORE_CONTEXT              Context,
+    _In_opt_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_ enum xsd_sockmsg_type              Type,
+    _In_opt_ PSTR                           Prefix,
+    _In_ PSTR                               Node,
+    _In_opt_ PSTR                           Value,
+    _In_ XENBUS_STORE_COMPLETION_FUNCTION   Function,
+    _In_opt_ PVOID                          Argument
+    )
+{
+    ULONG                                   PathLength;
+    ULONG                                   ValueLength;
+    PSTR                                    Buffer;
+    PXENBUS_STORE_REQUEST                   Request;
+    PXENBUS_STORE_RESPONSE                  Response;
+    KIRQL                                   Irql;
+    NTSTATUS                                status;
+
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    if (Prefix == NULL)
+        PathLength = (ULONG)strlen(Node) + sizeof (CHAR);
+    else
+        PathLength = (ULONG)strlen(Prefix) + 1 + (ULONG)strlen(Node) + sizeof (CHAR);
+
+    ValueLength = (Value != NULL) ? (ULONG)strlen(Value) : 0;
+
+    // The request segments must remain valid after we return so take
+    // a copy of the path and value.
+    Buffer = __StoreAllocate(PathLength + ValueLength);
+
+    status = STATUS_NO_MEMORY;
+    if (Buffer == NULL)
+        goto fail2;
+
+    status = (Prefix == NULL) ?
+             RtlStringCbPrintfA(Buffer, PathLength, "%s", Node) :
+             RtlStringCbPrintfA(Buffer, PathLength, "%s/%s", Prefix, Node);
+    ASSERT(NT_SUCCESS(status));
+
+    if (Value != NULL)
+        RtlCopyMemory(Buffer + PathLength, Value, ValueLength);
+
+    Request = __StoreAllocate(sizeof (XENBUS_STORE_REQUEST));
+
+    status = STATUS_NO_MEMORY;
+    if (Request == NULL)
+        goto fail3;
+
+    Response = StoreAllocateResponse(Context, 0);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail4;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    if (Value == NULL) {
+        status = StorePrepareRequest(Context,
+                                     Request,
+                                     Transaction,
+                                     Type,
+                                     Buffer, PathLength,
+                                     NULL, 0);
+    } else {
+        status = StorePrepareRequest(Context,
+                                     Request,
+                                     Transaction,
+                                     Type,
+                                     Buffer, PathLength,
+                                     Buffer + PathLength, ValueLength,
+                                     NULL, 0);
+    }
+
+    if (!NT_SUCCESS(status))
+        goto fail5;
+
+    Request->Response = Response;
+    Request->Function = Function;
+    Request->Argument = Argument;
+    Request->Buffer = Buffer;
+
+    InsertTailList(&Context->SubmittedList, &Request->ListEntry);
+
+    Request->State = XENBUS_STORE_REQUEST_SUBMITTED;
+    Context->AsyncRequests++;
+
+    // Push the request into the ring but do not wait for the response.
+    // Completion happens in StoreDpc.
+    (VOID) StorePollLocked(Context);
+    __StoreQueueCompletions(Context);
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return STATUS_SUCCESS;
+
+fail5:
+    Error("fail5\n");
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    StoreFreeResponse(Context, Response);
+
+fail4:
+    Error("fail4\n");
+
+    ASSERT(IsZeroMemory(Request, sizeof (XENBUS_STORE_REQUEST)));
+    __StoreFree(Request);
+
+fail3:
+    Error("fail3\n");
+
+    __StoreFree(Buffer);
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return status;
+}
+
+static NTSTATUS
+StoreReadAsync(
+    _In_ PINTERFACE                         Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_opt_ PSTR                           Prefix,
+    _In_ PSTR                               Node,
+    _In_ XENBUS_STORE_COMPLETION_FUNCTION   Function,
+    _In_opt_ PVOID                          Argument
+    )
+{
+    PXENBUS_STORE_CONTEXT                   Context = Interface->Context;
+
+    return StoreSubmitAsync(Context,
+                            Transaction,
+                            XS_READ,
+                            Prefix,
+                            Node,
+                            NULL,
+                            Function,
+                            Argument);
+}
+
+static NTSTATUS
+StorePrintfAsync(
+    _In_ PINTERFACE                         Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_opt_ PSTR                           Prefix,
+    _In_ PSTR                               Node,
+    _In_ XENBUS_STORE_COMPLETION_FUNCTION   Function,
+    _In_opt_ PVOID                          Argument,
+    _In_ PCSTR                              Format,
+    ...
+    )
+{
+    PXENBUS_STORE_CONTEXT                   Context = Interface->Context;
+    va_list                                 Arguments;
+    PSTR                                    Buffer;
+    NTSTATUS                                status;
+
+    va_start(Arguments, Format);
+    status = StoreFormatValue(Format, Arguments, &Buffer);
+    va_end(Arguments);
+
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    status = StoreSubmitAsync(Context,
+                              Transaction,
+                              XS_WRITE,
+                              Prefix,
+                              Node,
+                              Buffer,
+                              Function,
+                              Argument);
+    if (!NT_SUCCESS(status))
+        goto fail2;
+
+    __StoreFree(Buffer);
+
+    return STATUS_SUCCESS;
+
+fail2:
+    __StoreFree(Buffer);
+
+fail1:
+    return status;
+}
+
+// Must be called with lock held
+static NTSTATUS
+StorePrepareOperation(
+    _In_ PXENBUS_STORE_CONTEXT          Context,
+    _Out_ PXENBUS_STORE_REQUEST         Request,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_ PXENBUS_STORE_OPERATION        Operation
+    )
+{
+    enum xsd_sockmsg_type               Type;
+    PSTR                                Prefix;
+    PSTR                                Node;
+    PSTR                                Value;
+
+    Prefix = Operation->Prefix;
+    Node = Operation->Node;
+
+    switch (Operation->Type) {
+    case XENBUS_STORE_OPERATION_TYPE_READ:
+        Type = XS_READ;
+        Value = NULL;
+        break;
+
+    case XENBUS_STORE_OPERATION_TYPE_WRITE:
+        Type = XS_WRITE;
+        Value = Operation->Value;
+        if (Value == NULL)
+            return STATUS_INVALID_PARAMETER;
+        break;
+
+    case XENBUS_STORE_OPERATION_TYPE_REMOVE:
+        Type = XS_RM;
+        Value = NULL;
+        break;
+
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Prefix == NULL) {
+        if (Value == NULL)
+            return StorePrepareRequest(Context,
+                                       Request,
+                                       Transaction,
+                                       Type,
+                                       Node, strlen(Node),
+                                       "", 1,
+                                       NULL, 0);
+
+        return StorePrepareRequest(Context,
+                                   Request,
+                                   Transaction,
+                                   Type,
+                                   Node, strlen(Node),
+                                   "", 1,
+                                   Value, strlen(Value),
+                                   NULL, 0);
+    }
+
+    if (Value == NULL)
+        return StorePrepareRequest(Context,
+                                   Request,
+                                   Transaction,
+                                   Type,
+                                   Prefix, strlen(Prefix),
+                                   "/", 1,
+                                   Node, strlen(Node),
+                                   "", 1,
+                                   NULL, 0);
+
+    return StorePrepareRequest(Context,
+                               Request,
+                               Transaction,
+                               Type,
+                               Prefix, strlen(Prefix),
+                               "/", 1,
+                               Node, strlen(Node),
+                               "", 1,
+                               Value, strlen(Value),
+                               NULL, 0);
+}
+
+static NTSTATUS
+StoreSubmitBatch(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _Inout_updates_(NumberOperations)
+    PXENBUS_STORE_OPERATION             Operations,
+    _In_ ULONG                          NumberOperations
+    )
+{
+    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
+    PVOID                               Caller;
+    ULONG                               Length;
+    PXENBUS_STORE_REQUEST               Requests;
+    KIRQL                               Irql;
+    ULONG                               Index;
+    NTSTATUS                            status;
+
+    status = STATUS_INVALID_PARAMETER;
+    if (NumberOperations == 0)
+        goto fail1;
+
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
+
+    for (Index = 0; Index < NumberOperations; Index++) {
+        PXENBUS_STORE_OPERATION Operation = &Operations[Index];
+
+        if (Operation->Type == XENBUS_STORE_OPERATION_TYPE_READ)
+            Operation->Value = NULL;
+
+        Operation->Status = STATUS_PENDING;
+
+        status = StoreCheckPathLength(Operation->Prefix, Operation->Node);
+        if (!NT_SUCCESS(status))
+            goto fail2;
+    }
+
+    status = RtlULongMult(sizeof (XENBUS_STORE_REQUEST),
+                          NumberOperations,
+                          &Length);
+    if (!NT_SUCCESS(status))
+        goto fail3;
+
+    Requests = __StoreAllocate(Length);
+
+    status = STATUS_NO_MEMORY;
+    if (Requests == NULL)
+        goto fail4;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    status = STATUS_SUCCESS;
+    for (Index = 0; Index < NumberOperations; Index++) {
+        status = StorePrepareOperation(Context,
+                                       &Requests[Index],
+                                       Transaction,
+                                       &Operations[Index]);
+        if (!NT_SUCCESS(status))
+            break;
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail5;
+
+    status = StoreSubmitRequests(Context, Requests, NumberOperations);
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    for (Index = 0; Index < NumberOperations; Index++) {
+        PXENBUS_STORE_OPERATION Operation = &Operations[Index];
+
+        if (Operation->Type != XENBUS_STORE_OPERATION_TYPE_READ)
+            StoreCacheInvalidate(Context, Operation->Prefix, Operation->Node);
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail6;
+
+    for (Index = 0; Index < NumberOperations; Index++) {
+        PXENBUS_STORE_OPERATION Operation = &Operations[Index];
+        PXENBUS_STORE_RESPONSE  Response = Requests[Index].Response;
+
+        Operation->Status = StoreCheckResponse(Response);
+
+        if (NT_SUCCESS(Operation->Status) &&
+            Operation->Type == XENBUS_STORE_OPERATION_TYPE_READ) {
+            PXENBUS_STORE_BUFFER    Buffer;
+
+            Buffer = StoreCopyPayload(Context, Response, Caller);
+            if (Buffer != NULL)
+                Operation->Value = Buffer->Data;
+            else
+                Operation->Status = STATUS_NO_MEMORY;
+        }
+
+        // Report the first failure, if any
+        if (NT_SUCCESS(status))
+            status = Operation->Status;
+
+        StoreFreeResponse(Context, Response);
+    }
+
+    RtlZeroMemory(Requests, Length);
+    __StoreFree(Requests);
+
+    return status;
+
+fail6:
+    Error("fail6\n");
+
+fail5:
+    Error("fail5\n");
+
+    RtlZeroMemory(Requests, Length);
+    __StoreFree(Requests);
+
+fail4:
+    Error("fail4\n");
+
+fail3:
+    Error("fail3\n");
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return status;
+}
+
+static NTSTATUS
+StoreRemove(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node
+    )
+{
+    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
+    XENBUS_STORE_REQUEST                Request;
+    KIRQL                               Irql;
+    PXENBUS_STORE_RESPONSE              Response;
+    NTSTATUS                            status;
+
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    if (Prefix == NULL) {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_RM,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    } else {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_RM,
+                                     Prefix, strlen(Prefix),
+                                     "/", 1,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail2;
+
+    Response = StoreSubmitRequest(Context, &Request);
+
+    StoreCacheInvalidatePath(Context, Prefix, Node);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail3;
+
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
+        goto fail4;
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    return STATUS_SUCCESS;
+
+fail4:
+    StoreFreeResponse(Context, Response);
+
+fail3:
+fail2:
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+fail1:
+    return status;
+}
 
-    Buffer = __StoreAllocate(FIELD_OFFSET(XENBUS_STORE_BUFFER, Data) +
-                             Length +
-                             (sizeof (CHAR) * 2));  // Double-NUL terminate
+static NTSTATUS
+StoreDirectory(
+    _In_ PINTERFACE                     Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_opt_ PSTR                       Prefix,
+    _In_ PSTR                           Node,
+    _Outptr_result_z_ PSTR              *Value
+    )
+{
+    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
+    PVOID                               Caller;
+    XENBUS_STORE_REQUEST                Request;
+    KIRQL                               Irql;
+    PXENBUS_STORE_RESPONSE              Response;
+    PXENBUS_STORE_BUFFER                Buffer;
+    NTSTATUS                            status;
 
-    status  = STATUS_NO_MEMORY;
-    if (Buffer == NULL)
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
         goto fail1;
 
-    Buffer->Magic = XENBUS_STORE_BUFFER_MAGIC;
-    Buffer->Length = Length;
-    Buffer->Caller = Caller;
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
 
-    RtlCopyMemory(Buffer->Data, Data, Length);
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
-    InsertTailList(&Context->BufferList, &Buffer->ListEntry);
+
+    if (Prefix == NULL) {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_DIRECTORY,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    } else {
+        status = StorePrepareRequest(Context,
+                                     &Request,
+                                     Transaction,
+                                     XS_DIRECTORY,
+                                     Prefix, strlen(Prefix),
+                                     "/", 1,
+                                     Node, strlen(Node),
+                                     "", 1,
+                                     NULL, 0);
+    }
+
     KeReleaseSpinLock(&Context->Lock, Irql);
 
-    return Buffer;
+    if (!NT_SUCCESS(status))
+        goto fail2;
 
-fail1:
-    Error("fail1 (%08x)\n", status);
+    Response = StoreSubmitRequest(Context, &Request);
 
-    return NULL;
-}
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail3;
 
-static VOID
-StoreFreePayload(
-    _In_ PXENBUS_STORE_CONTEXT  Context,
-    _In_ PXENBUS_STORE_BUFFER   Buffer
-    )
-{
-    KIRQL                       Irql;
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
+        goto fail4;
 
-    ASSERT3U(Buffer->Magic, ==, XENBUS_STORE_BUFFER_MAGIC);
+    Buffer = StoreCopyPayload(Context, Response, Caller);
 
-    KeAcquireSpinLock(&Context->Lock, &Irql);
-    RemoveEntryList(&Buffer->ListEntry);
-    KeReleaseSpinLock(&Context->Lock, Irql);
+    status = STATUS_NO_MEMORY;
+    if (Buffer == NULL)
+        goto fail5;
 
-    __StoreFree(Buffer);
+    status = STATUS_OBJECT_PATH_NOT_FOUND;
+    if (Buffer->Length == 0)
+        goto fail6;
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    *Value = Buffer->Data;
+
+    return STATUS_SUCCESS;
+
+fail6:
+    StoreFreePayload(Context, Buffer);
+
+fail5:
+fail4:
+    StoreFreeResponse(Context, Response);
+
+fail3:
+fail2:
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+fail1:
+    return status;
 }
 
-static VOID
-StoreFree(
-    _In_ PINTERFACE         Interface,
-    _In_ PSTR               Value
+static NTSTATUS
+StoreEnumerateStart(
+    _In_ PINTERFACE                         Interface,
+    _In_opt_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_opt_ PSTR                           Prefix,
+    _In_ PSTR                               Node,
+    _Outptr_ PXENBUS_STORE_ENUMERATOR       *Enumerator
     )
 {
-    PXENBUS_STORE_CONTEXT   Context = Interface->Context;
-    PXENBUS_STORE_BUFFER    Buffer;
+    NTSTATUS                                status;
 
-    Buffer = CONTAINING_RECORD(Value, XENBUS_STORE_BUFFER, Data);
+    UNREFERENCED_PARAMETER(Interface);
 
-    StoreFreePayload(Context, Buffer);
-}
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
+        goto fail1;
 
-extern USHORT
-RtlCaptureStackBackTrace(
-    __in        ULONG   FramesToSkip,
-    __in        ULONG   FramesToCapture,
-    __out       PVOID   *BackTrace,
-    __out_opt   PULONG  BackTraceHash
-    );
+    *Enumerator = __StoreAllocate(sizeof (XENBUS_STORE_ENUMERATOR));
+
+    status = STATUS_NO_MEMORY;
+    if (*Enumerator == NULL)
+        goto fail2;
+
+    (*Enumerator)->Path = StoreAllocatePath(Prefix, Node);
+
+    status = STATUS_NO_MEMORY;
+    if ((*Enumerator)->Path == NULL)
+        goto fail3;
+
+    (*Enumerator)->Magic = XENBUS_STORE_ENUMERATOR_MAGIC;
+    (*Enumerator)->Transaction = Transaction;
+
+    return STATUS_SUCCESS;
+
+fail3:
+    Error("fail3\n");
+
+    ASSERT(IsZeroMemory(*Enumerator, sizeof (XENBUS_STORE_ENUMERATOR)));
+    __StoreFree(*Enumerator);
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return status;
+}
 
 static NTSTATUS
-StoreCheckPathLength(
-    _In_opt_ PSTR   Prefix,
-    _In_ PSTR       Node
+StoreEnumerateNext(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_ENUMERATOR   Enumerator,
+    _Outptr_result_z_ PSTR          *Names
     )
 {
-    size_t          MaximumLength;
-    size_t          Length;
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    CHAR                            Offset[sizeof ("4294967295")];
+    XENBUS_STORE_REQUEST            Request;
+    KIRQL                           Irql;
+    PXENBUS_STORE_RESPONSE          Response;
+    PSTR                            Data;
+    ULONG                           Length;
+    ULONG                           GenerationLength;
+    ULONGLONG                       Generation;
+    BOOLEAN                         Complete;
+    NTSTATUS                        status;
 
-    if (Prefix != NULL) {
-        MaximumLength = (Prefix[0] == '/' || Prefix[0] == '\0') ?
-                    XENSTORE_ABS_PATH_MAX :
-                    XENSTORE_REL_PATH_MAX;
+    ASSERT3U(Enumerator->Magic, ==, XENBUS_STORE_ENUMERATOR_MAGIC);
 
-        Length = strlen(Prefix);
-        if (Length > MaximumLength)
-            goto fail1;
-        MaximumLength -= Length;
+    status = STATUS_NO_MORE_ENTRIES;
+    if (Enumerator->Complete)
+        goto fail1;
 
-        if (MaximumLength < 1)
-            goto fail2;
-        MaximumLength -= 1;
-    } else {
-        MaximumLength = Node[0] == '/' ?
-                            XENSTORE_ABS_PATH_MAX :
-                            XENSTORE_REL_PATH_MAX;
-    }
+    status = RtlStringCbPrintfA(Offset,
+                                sizeof (Offset),
+                                "%lu",
+                                Enumerator->Offset);
+    ASSERT(NT_SUCCESS(status));
 
-    Length = strlen(Node);
-    if (Length > MaximumLength)
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    status = StorePrepareRequest(Context,
+                                 &Request,
+                                 Enumerator->Transaction,
+                                 XS_DIRECTORY_PART,
+                                 Enumerator->Path, strlen(Enumerator->Path),
+                                 "", 1,
+                                 Offset, strlen(Offset),
+                                 "", 1,
+                                 NULL, 0);
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail2;
+
+    Response = StoreSubmitRequest(Context, &Request);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
         goto fail3;
-    MaximumLength -= Length;
 
-    if (MaximumLength < 1)
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
         goto fail4;
 
+    Data = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
+    Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
+
+    // The payload starts with the generation count of the node...
+    GenerationLength = 0;
+    while (GenerationLength < Length && Data[GenerationLength] != '\0')
+        GenerationLength++;
+
+    status = STATUS_UNSUCCESSFUL;
+    if (GenerationLength == 0 || GenerationLength == Length)
+        goto fail5;
+
+    Generation = _strtoui64(Data, NULL, 10);
+
+    // ...which must not change between parts, otherwise the offset no
+    // longer means anything
+    status = STATUS_RETRY;
+    if (Enumerator->Offset != 0 && Generation != Enumerator->Generation)
+        goto fail6;
+
+    Data += GenerationLength + 1;
+    Length -= GenerationLength + 1;
+
+    // ...followed by NUL terminated names, with an extra NUL if this is
+    // the last part
+    Complete = (Length != 0 &&
+                Data[Length - 1] == '\0' &&
+                (Length == 1 || Data[Length - 2] == '\0')) ?
+               TRUE :
+               FALSE;
+    if (Complete)
+        --Length;
+
+    status = STATUS_UNSUCCESSFUL;
+    if (Length != 0 && Data[Length - 1] != '\0')
+        goto fail7;
+
+    if (Length == 0 && !Complete)
+        goto fail8;
+
+    RtlCopyMemory(Enumerator->Names, Data, Length);
+    Enumerator->Names[Length] = '\0';
+    Enumerator->Names[Length + 1] = '\0';
+
+    Enumerator->Generation = Generation;
+    Enumerator->Offset += Length;
+    Enumerator->Complete = Complete;
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    if (Length == 0) {
+        ASSERT(Complete);
+        return STATUS_NO_MORE_ENTRIES;
+    }
+
+    *Names = Enumerator->Names;
+
     return STATUS_SUCCESS;
 
+fail8:
+fail7:
+fail6:
+    if (status == STATUS_RETRY) {
+        // Start again from the beginning on the next call
+        Enumerator->Offset = 0;
+        Enumerator->Generation = 0;
+    }
+
+fail5:
 fail4:
+    StoreFreeResponse(Context, Response);
+
 fail3:
 fail2:
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
 fail1:
-    return STATUS_INVALID_BUFFER_SIZE;
+    return status;
+}
+
+static VOID
+StoreEnumerateEnd(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_ENUMERATOR   Enumerator
+    )
+{
+    UNREFERENCED_PARAMETER(Interface);
+
+    ASSERT3U(Enumerator->Magic, ==, XENBUS_STORE_ENUMERATOR_MAGIC);
+
+    __StoreFree(Enumerator->Path);
+
+    RtlZeroMemory(Enumerator, sizeof (XENBUS_STORE_ENUMERATOR));
+    __StoreFree(Enumerator);
 }
 
 static NTSTATUS
-StoreRead(
+StoreTransactionStart(
     _In_ PINTERFACE                     Interface,
-    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_opt_ PSTR                       Prefix,
-    _In_ PSTR                           Node,
-    _Outptr_result_z_ PSTR              *Value
+    _Outptr_ PXENBUS_STORE_TRANSACTION  *Transaction
     )
 {
     PXENBUS_STORE_CONTEXT               Context = Interface->Context;
-    PVOID                               Caller;
     XENBUS_STORE_REQUEST                Request;
-    KIRQL                               Irql;
     PXENBUS_STORE_RESPONSE              Response;
-    PXENBUS_STORE_BUFFER                Buffer;
+    KIRQL                               Irql;
     NTSTATUS                            status;
 
-    status = StoreCheckPathLength(Prefix, Node);
-    if (!NT_SUCCESS(status))
+    *Transaction = __StoreAllocate(sizeof (XENBUS_STORE_TRANSACTION));
+
+    status = STATUS_NO_MEMORY;
+    if (*Transaction == NULL)
         goto fail1;
 
-    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
+    (*Transaction)->Magic = STORE_TRANSACTION_MAGIC;
+    (VOID) RtlCaptureStackBackTrace(1, 1, &(*Transaction)->Caller, NULL);
 
     RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
 
-    if (Prefix == NULL) {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_READ,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     NULL, 0);
-    } else {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_READ,
-                                     Prefix, strlen(Prefix),
-                                     "/", 1,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     NULL, 0);
-    }
+    status = StorePrepareRequest(Context,
+                                 &Request,
+                                 NULL,
+                                 XS_TRANSACTION_START,
+                                 "", 1,
+                                 NULL, 0);
 
     KeReleaseSpinLock(&Context->Lock, Irql);
-
     if (!NT_SUCCESS(status))
         goto fail2;
 
@@ -1206,70 +3655,75 @@ StoreRead(
     if (!NT_SUCCESS(status))
         goto fail4;
 
-    Buffer = StoreCopyPayload(Context, Response, Caller);
-
-    status = STATUS_NO_MEMORY;
-    if (Buffer == NULL)
-        goto fail5;
+    (*Transaction)->Id = (uint32_t)strtoul(Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data,
+                                           NULL,
+                                           10);
+    ASSERT((*Transaction)->Id != 0);
 
-    StoreFreeResponse(Response);
+    StoreFreeResponse(Context, Response);
     ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
 
-    *Value = Buffer->Data;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    (*Transaction)->Active = TRUE;
+    InsertTailList(&Context->TransactionList, &(*Transaction)->ListEntry);
+    KeReleaseSpinLock(&Context->Lock, Irql);
 
     return STATUS_SUCCESS;
 
-fail5:
 fail4:
-    StoreFreeResponse(Response);
+    Error("fail4\n");
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
 
 fail3:
+    Error("fail3\n");
+
 fail2:
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    Error("fail2\n");
+
+    (*Transaction)->Caller = NULL;
+    (*Transaction)->Magic = 0;
+
+    ASSERT(IsZeroMemory(*Transaction, sizeof (XENBUS_STORE_TRANSACTION)));
+    __StoreFree(*Transaction);
+    *Transaction = NULL;
 
 fail1:
+    Error("fail1 (%08x)\n", status);
+
     return status;
 }
 
 static NTSTATUS
-StoreWrite(
-    _In_ PXENBUS_STORE_CONTEXT          Context,
-    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_opt_ PSTR                       Prefix,
-    _In_ PSTR                           Node,
-    _In_ PSTR                           Value
+StoreTransactionEnd(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_ BOOLEAN                    Commit
     )
 {
-    XENBUS_STORE_REQUEST                Request;
-    KIRQL                               Irql;
-    PXENBUS_STORE_RESPONSE              Response;
-    NTSTATUS                            status;
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    XENBUS_STORE_REQUEST            Request;
+    PXENBUS_STORE_RESPONSE          Response;
+    KIRQL                           Irql;
+    NTSTATUS                        status;
+
+    ASSERT3U(Transaction->Magic, ==, STORE_TRANSACTION_MAGIC);
 
     RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
 
-    if (Prefix == NULL) {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_WRITE,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     Value, strlen(Value),
-                                     NULL, 0);
-    } else {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_WRITE,
-                                     Prefix, strlen(Prefix),
-                                     "/", 1,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     Value, strlen(Value),
-                                     NULL, 0);
-    }
+    status = STATUS_RETRY;
+    if (!Transaction->Active)
+        goto done;
+
+    status = StorePrepareRequest(Context,
+                                 &Request,
+                                 Transaction,
+                                 XS_TRANSACTION_END,
+                                 (Commit) ? "T" : "F", 2,
+                                 NULL, 0);
 
     KeReleaseSpinLock(&Context->Lock, Irql);
 
@@ -1278,356 +3732,662 @@ StoreWrite(
 
     Response = StoreSubmitRequest(Context, &Request);
 
+    // We do not know which keys the transaction modified
+    if (Commit)
+        StoreCacheInvalidatePath(Context, NULL, NULL);
+
     status = STATUS_NO_MEMORY;
     if (Response == NULL)
         goto fail2;
 
     status = StoreCheckResponse(Response);
-    if (!NT_SUCCESS(status))
+    if (!NT_SUCCESS(status) && status != STATUS_RETRY)
         goto fail3;
 
-    StoreFreeResponse(Response);
+    StoreFreeResponse(Context, Response);
     ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
 
-    return STATUS_SUCCESS;
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    Transaction->Active = FALSE;
+
+done:
+    RemoveEntryList(&Transaction->ListEntry);
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    RtlZeroMemory(&Transaction->ListEntry, sizeof (LIST_ENTRY));
+
+    Transaction->Id = 0;
+
+    Transaction->Caller = NULL;
+    Transaction->Magic = 0;
+
+    ASSERT(IsZeroMemory(Transaction, sizeof (XENBUS_STORE_TRANSACTION)));
+    __StoreFree(Transaction);
+
+    return status;
 
 fail3:
-    StoreFreeResponse(Response);
+    Error("fail3\n");
+
+    ASSERT3U(status, !=, STATUS_RETRY);
+
+    StoreFreeResponse(Context, Response);
 
 fail2:
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    Error("fail2\n");
 
 fail1:
+    Error("fail1 (%08x)\n", status);
+
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
     return status;
 }
 
+// Must be called with lock held
+static PXENBUS_STORE_RETRY
+StoreGetRetry(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PVOID                  Caller
+    )
+{
+    PLIST_ENTRY                 ListEntry;
+    PXENBUS_STORE_RETRY         Retry;
+
+    for (ListEntry = Context->RetryList.Flink;
+         ListEntry != &Context->RetryList;
+         ListEntry = ListEntry->Flink) {
+        Retry = CONTAINING_RECORD(ListEntry, XENBUS_STORE_RETRY, ListEntry);
+
+        if (Retry->Caller == Caller)
+            return Retry;
+    }
+
+    if (Context->RetryCount == XENBUS_STORE_RETRY_CALLERS_MAXIMUM)
+        return NULL;
+
+    Retry = __StoreAllocate(sizeof (XENBUS_STORE_RETRY));
+    if (Retry == NULL)
+        return NULL;
+
+    Retry->Caller = Caller;
+
+    InsertTailList(&Context->RetryList, &Retry->ListEntry);
+    Context->RetryCount++;
+
+    return Retry;
+}
+
+static VOID
+StoreRecordRetries(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PVOID                  Caller,
+    _In_ ULONG                  Retries,
+    _In_ BOOLEAN                Exhausted
+    )
+{
+    PXENBUS_STORE_RETRY         Retry;
+    KIRQL                       Irql;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    Retry = StoreGetRetry(Context, Caller);
+    if (Retry != NULL) {
+        Retry->Transactions++;
+        Retry->Retries += Retries;
+        if (Exhausted)
+            Retry->Exhausted++;
+    }
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+}
+
+static VOID
+StoreBackoff(
+    _In_ ULONG      Attempt,
+    _Inout_ PULONG  Seed
+    )
+{
+    ULONG           Limit;
+    ULONG           Delay;
+    LARGE_INTEGER   Timeout;
+
+    ASSERT3U(KeGetCurrentIrql(), <, DISPATCH_LEVEL);
+    ASSERT(Attempt != 0);
+
+    Limit = XENBUS_STORE_TRANSACTION_BACKOFF_MIN * 1000;
+    while (--Attempt != 0 &&
+           Limit < XENBUS_STORE_TRANSACTION_BACKOFF_MAX * 1000)
+        Limit <<= 1;
+
+    // Pick a delay in the upper half of the window so that clashing
+    // callers are spread out but the backoff still grows
+    Delay = (Limit / 2) + (RtlRandomEx(Seed) % (Limit / 2));
+
+    Timeout.QuadPart = TIME_RELATIVE(TIME_US((LONGLONG)Delay));
+    (VOID) KeDelayExecutionThread(KernelMode, FALSE, &Timeout);
+}
+
 static NTSTATUS
-StoreVPrintf(
-    _In_ PINTERFACE                     Interface,
-    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_opt_ PSTR                       Prefix,
-    _In_ PSTR                           Node,
-    _In_ PCSTR                          Format,
-    _In_ va_list                        Arguments
+__StoreTransactionRun(
+    _In_ PINTERFACE                         Interface,
+    _In_ PVOID                              Caller,
+    _In_ XENBUS_STORE_TRANSACTION_FUNCTION  Function,
+    _In_opt_ PVOID                          Argument
     )
 {
-    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
-    PSTR                                Buffer;
-    ULONG                               Length;
-    NTSTATUS                            status;
+    PXENBUS_STORE_CONTEXT                   Context = Interface->Context;
+    PXENBUS_STORE_TRANSACTION               Transaction;
+    ULONG                                   Retries;
+    ULONG                                   Seed;
+    NTSTATUS                                status;
 
-    Length = 32;
-    for (;;) {
-        Buffer = __StoreAllocate(Length);
+    ASSERT3U(KeGetCurrentIrql(), <, DISPATCH_LEVEL);
 
-        status = STATUS_NO_MEMORY;
-        if (Buffer == NULL)
-            goto fail1;
+    Seed = KeQueryPerformanceCounter(NULL).LowPart ^
+           (ULONG)(ULONG_PTR)Caller;
 
-        status = RtlStringCbVPrintfA(Buffer,
-                                     Length,
-                                     Format,
-                                     Arguments);
+    Retries = 0;
+    for (;;) {
+        status = StoreTransactionStart(Interface, &Transaction);
+        if (!NT_SUCCESS(status))
+            break;
+
+        status = Function(Argument, Transaction);
         if (NT_SUCCESS(status))
+            status = StoreTransactionEnd(Interface, Transaction, TRUE);
+        else
+            (VOID) StoreTransactionEnd(Interface, Transaction, FALSE);
+
+        if (status != STATUS_RETRY ||
+            Retries == XENBUS_STORE_TRANSACTION_ATTEMPTS - 1)
             break;
 
-        if (status != STATUS_BUFFER_OVERFLOW)
-            goto fail2;
+        StoreBackoff(++Retries, &Seed);
+    }
+
+    StoreRecordRetries(Context,
+                       Caller,
+                       Retries,
+                       (status == STATUS_RETRY) ? TRUE : FALSE);
+
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    return STATUS_SUCCESS;
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return status;
+}
+
+static NTSTATUS
+StoreTransactionRun(
+    _In_ PINTERFACE                         Interface,
+    _In_ XENBUS_STORE_TRANSACTION_FUNCTION  Function,
+    _In_opt_ PVOID                          Argument
+    )
+{
+    PVOID                                   Caller;
+
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
+
+    return __StoreTransactionRun(Interface, Caller, Function, Argument);
+}
+
+static NTSTATUS
+StoreTreeAppend(
+    _Inout_ PXENBUS_STORE_TREE_BUFFER   Buffer,
+    _In_reads_bytes_opt_(Length) PCSTR  Data,
+    _In_ ULONG                          Length
+    )
+{
+    ULONG                               Required;
+    NTSTATUS                            status;
+
+    status = RtlULongAdd(Buffer->Length, Length, &Required);
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    if (Required > Buffer->Size) {
+        ULONG   Size;
+        PSTR    Data;
+
+        Size = __max(Buffer->Size, PAGE_SIZE);
+        while (Size < Required) {
+            status = RtlULongMult(Size, 2, &Size);
+            if (!NT_SUCCESS(status))
+                goto fail2;
+        }
 
-        status = STATUS_INVALID_BUFFER_SIZE;
-        Length <<= 1;
-        if (Length > 1024)
+        Data = __StoreAllocate(Size);
+
+        status = STATUS_NO_MEMORY;
+        if (Data == NULL)
             goto fail3;
 
-        __StoreFree(Buffer);
+        if (Buffer->Data != NULL) {
+            RtlCopyMemory(Data, Buffer->Data, Buffer->Length);
+            __StoreFree(Buffer->Data);
+        }
+
+        Buffer->Data = Data;
+        Buffer->Size = Size;
     }
 
-    status = StoreWrite(Context,
-                          Transaction,
-                          Prefix,
-                          Node,
-                          Buffer);
-    if (!NT_SUCCESS(status))
-        goto fail4;
+    if (Length != 0)
+        RtlCopyMemory(Buffer->Data + Buffer->Length, Data, Length);
 
-    __StoreFree(Buffer);
+    Buffer->Length = Required;
 
     return STATUS_SUCCESS;
 
-fail4:
 fail3:
 fail2:
-    __StoreFree(Buffer);
-
 fail1:
     return status;
 }
 
-static NTSTATUS
-StorePrintf(
-    _In_ PINTERFACE                     Interface,
-    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_opt_ PSTR                       Prefix,
-    _In_ PSTR                           Node,
-    _In_ PCSTR                          Format,
-    ...
+static VOID
+StoreTreeFree(
+    _Inout_ PXENBUS_STORE_TREE_BUFFER   Buffer
     )
 {
-    va_list                             Arguments;
-    NTSTATUS                            status;
-
-    status = StoreCheckPathLength(Prefix, Node);
-    if (!NT_SUCCESS(status))
-        goto fail1;
-
-    va_start(Arguments, Format);
-    status = StoreVPrintf(Interface,
-                            Transaction,
-                            Prefix,
-                            Node,
-                            Format,
-                            Arguments);
-    va_end(Arguments);
+    if (Buffer->Data != NULL)
+        __StoreFree(Buffer->Data);
 
-    return status;
+    RtlZeroMemory(Buffer, sizeof (XENBUS_STORE_TREE_BUFFER));
+}
 
-fail1:
-    return status;
+static NTSTATUS
+StorePrepareTreeRequest(
+    _In_ PXENBUS_STORE_CONTEXT      Context,
+    _Out_ PXENBUS_STORE_REQUEST     Request,
+    _In_ PXENBUS_STORE_TRANSACTION  Transaction,
+    _In_ enum xsd_sockmsg_type      Type,
+    _In_ PSTR                       Root,
+    _In_ PSTR                       Node
+    )
+{
+    if (*Node == '\0')
+        return StorePrepareRequest(Context,
+                                   Request,
+                                   Transaction,
+                                   Type,
+                                   Root, strlen(Root),
+                                   "", 1,
+                                   NULL, 0);
+
+    return StorePrepareRequest(Context,
+                               Request,
+                               Transaction,
+                               Type,
+                               Root, strlen(Root),
+                               "/", 1,
+                               Node, strlen(Node),
+                               "", 1,
+                               NULL, 0);
 }
 
 static NTSTATUS
-StoreRemove(
-    _In_ PINTERFACE                     Interface,
-    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_opt_ PSTR                       Prefix,
-    _In_ PSTR                           Node
+StoreReadTreeBatch(
+    _In_ PXENBUS_STORE_CONTEXT          Context,
+    _In_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_ PSTR                           Root,
+    _In_reads_(Count) PSTR              *Nodes,
+    _In_ ULONG                          Count,
+    _In_ BOOLEAN                        Read,
+    _In_ BOOLEAN                        Enumerate,
+    _Inout_ PXENBUS_STORE_REQUEST       Requests,
+    _Inout_ PXENBUS_STORE_TREE_BUFFER   Tree,
+    _Inout_ PXENBUS_STORE_TREE_BUFFER   Next
     )
 {
-    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
-    XENBUS_STORE_REQUEST                Request;
+    ULONG                               Number;
+    ULONG                               Index;
     KIRQL                               Irql;
-    PXENBUS_STORE_RESPONSE              Response;
     NTSTATUS                            status;
 
-    status = StoreCheckPathLength(Prefix, Node);
-    if (!NT_SUCCESS(status))
-        goto fail1;
+    ASSERT(Read || Enumerate);
 
-    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+    Number = 0;
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
 
-    if (Prefix == NULL) {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_RM,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     NULL, 0);
-    } else {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_RM,
-                                     Prefix, strlen(Prefix),
-                                     "/", 1,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     NULL, 0);
+    status = STATUS_SUCCESS;
+    for (Index = 0; Index < Count; Index++) {
+        if (Read) {
+            status = StorePrepareTreeRequest(Context,
+                                             &Requests[Number++],
+                                             Transaction,
+                                             XS_READ,
+                                             Root,
+                                             Nodes[Index]);
+            if (!NT_SUCCESS(status))
+                break;
+        }
+
+        if (Enumerate) {
+            status = StorePrepareTreeRequest(Context,
+                                             &Requests[Number++],
+                                             Transaction,
+                                             XS_DIRECTORY,
+                                             Root,
+                                             Nodes[Index]);
+            if (!NT_SUCCESS(status))
+                break;
+        }
     }
 
     KeReleaseSpinLock(&Context->Lock, Irql);
 
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    // All the requests for the batch go into the ring together
+    status = StoreSubmitRequests(Context, Requests, Number);
     if (!NT_SUCCESS(status))
         goto fail2;
 
-    Response = StoreSubmitRequest(Context, &Request);
+    Number = 0;
+    for (Index = 0; Index < Count; Index++) {
+        PSTR                    Node = Nodes[Index];
+        ULONG                   NodeLength = (ULONG)strlen(Node);
+        PXENBUS_STORE_RESPONSE  Response;
+        PSTR                    Data;
+        ULONG                   Length;
+
+        if (Read) {
+            Response = Requests[Number++].Response;
+
+            Data = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
+            Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
+
+            // Keys that cannot be read (e.g. because of their
+            // permissions) are simply left out
+            if (NT_SUCCESS(StoreCheckResponse(Response)) &&
+                NT_SUCCESS(status)) {
+                status = StoreTreeAppend(Tree, Node, NodeLength + 1);
+                if (NT_SUCCESS(status))
+                    status = StoreTreeAppend(Tree, Data, Length);
+                if (NT_SUCCESS(status))
+                    status = StoreTreeAppend(Tree, "", 1);
+            }
+        }
 
-    status = STATUS_NO_MEMORY;
-    if (Response == NULL)
-        goto fail3;
+        if (Enumerate) {
+            NTSTATUS    ResponseStatus;
 
-    status = StoreCheckResponse(Response);
-    if (!NT_SUCCESS(status))
-        goto fail4;
+            Response = Requests[Number++].Response;
 
-    StoreFreeResponse(Response);
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+            Data = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data;
+            Length = Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Length;
 
-    return STATUS_SUCCESS;
+            ResponseStatus = StoreCheckResponse(Response);
 
-fail4:
-    StoreFreeResponse(Response);
+            // Failing to enumerate the root of the tree is fatal
+            if (!NT_SUCCESS(ResponseStatus) && NodeLength == 0 &&
+                NT_SUCCESS(status))
+                status = ResponseStatus;
+
+            while (NT_SUCCESS(ResponseStatus) &&
+                   NT_SUCCESS(status) &&
+                   Length != 0) {
+                ULONG   NameLength;
+
+                NameLength = 0;
+                while (NameLength < Length && Data[NameLength] != '\0')
+                    NameLength++;
+
+                if (NameLength == 0)
+                    break;
+
+                if (NodeLength != 0) {
+                    status = StoreTreeAppend(Next, Node, NodeLength);
+                    if (NT_SUCCESS(status))
+                        status = StoreTreeAppend(Next, "/", 1);
+                }
+
+                if (NT_SUCCESS(status))
+                    status = StoreTreeAppend(Next, Data, NameLength);
+                if (NT_SUCCESS(status))
+                    status = StoreTreeAppend(Next, "", 1);
+
+                NameLength = __min(NameLength + 1, Length);
+
+                Data += NameLength;
+                Length -= NameLength;
+            }
+        }
+    }
+
+    for (Index = 0; Index < Number; Index++)
+        StoreFreeResponse(Context, Requests[Index].Response);
+
+    RtlZeroMemory(Requests, sizeof (XENBUS_STORE_REQUEST) * Number);
+
+    return status;
 
-fail3:
 fail2:
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    Error("fail2\n");
 
 fail1:
+    Error("fail1 (%08x)\n", status);
+
+    RtlZeroMemory(Requests, sizeof (XENBUS_STORE_REQUEST) * Number);
+
     return status;
 }
 
 static NTSTATUS
-StoreDirectory(
-    _In_ PINTERFACE                     Interface,
-    _In_opt_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_opt_ PSTR                       Prefix,
-    _In_ PSTR                           Node,
-    _Outptr_result_z_ PSTR              *Value
+StoreReadTreeLevel(
+    _In_ PXENBUS_STORE_CONTEXT          Context,
+    _In_ PXENBUS_STORE_TRANSACTION      Transaction,
+    _In_ PSTR                           Root,
+    _In_ PXENBUS_STORE_TREE_BUFFER      Level,
+    _In_ BOOLEAN                        Read,
+    _In_ BOOLEAN                        Enumerate,
+    _Inout_ PXENBUS_STORE_REQUEST       Requests,
+    _Inout_ PXENBUS_STORE_TREE_BUFFER   Tree,
+    _Inout_ PXENBUS_STORE_TREE_BUFFER   Next
     )
 {
-    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
-    PVOID                               Caller;
-    XENBUS_STORE_REQUEST                Request;
-    KIRQL                               Irql;
-    PXENBUS_STORE_RESPONSE              Response;
-    PXENBUS_STORE_BUFFER                Buffer;
+    PSTR                                Nodes[XENBUS_STORE_TREE_BATCH];
+    ULONG                               Count;
+    ULONG                               Offset;
     NTSTATUS                            status;
 
-    status = StoreCheckPathLength(Prefix, Node);
-    if (!NT_SUCCESS(status))
-        goto fail1;
-
-    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
-
-    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
-
-    KeAcquireSpinLock(&Context->Lock, &Irql);
+    Count = 0;
+    Offset = 0;
+    while (Offset < Level->Length) {
+        Nodes[Count++] = Level->Data + Offset;
+        Offset += (ULONG)strlen(Level->Data + Offset) + 1;
+
+        if (Count < XENBUS_STORE_TREE_BATCH && Offset < Level->Length)
+            continue;
+
+        status = StoreReadTreeBatch(Context,
+                                    Transaction,
+                                    Root,
+                                    Nodes,
+                                    Count,
+                                    Read,
+                                    Enumerate,
+                                    Requests,
+                                    Tree,
+                                    Next);
+        if (!NT_SUCCESS(status))
+            goto fail1;
 
-    if (Prefix == NULL) {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_DIRECTORY,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     NULL, 0);
-    } else {
-        status = StorePrepareRequest(Context,
-                                     &Request,
-                                     Transaction,
-                                     XS_DIRECTORY,
-                                     Prefix, strlen(Prefix),
-                                     "/", 1,
-                                     Node, strlen(Node),
-                                     "", 1,
-                                     NULL, 0);
+        Count = 0;
     }
 
-    KeReleaseSpinLock(&Context->Lock, Irql);
-
-    if (!NT_SUCCESS(status))
-        goto fail2;
-
-    Response = StoreSubmitRequest(Context, &Request);
+    return STATUS_SUCCESS;
 
-    status = STATUS_NO_MEMORY;
-    if (Response == NULL)
-        goto fail3;
+fail1:
+    Error("fail1 (%08x)\n", status);
 
-    status = StoreCheckResponse(Response);
-    if (!NT_SUCCESS(status))
-        goto fail4;
+    return status;
+}
 
-    Buffer = StoreCopyPayload(Context, Response, Caller);
+typedef struct _XENBUS_STORE_TREE_WALK {
+    PXENBUS_STORE_CONTEXT       Context;
+    PSTR                        Root;
+    ULONG                       Depth;
+    PXENBUS_STORE_REQUEST       Requests;
+    XENBUS_STORE_TREE_BUFFER    Tree;
+} XENBUS_STORE_TREE_WALK, *PXENBUS_STORE_TREE_WALK;
 
-    status = STATUS_NO_MEMORY;
-    if (Buffer == NULL)
-        goto fail5;
+static NTSTATUS
+StoreReadTreeWalk(
+    _In_opt_ PVOID                  Argument,
+    _In_ PXENBUS_STORE_TRANSACTION  Transaction
+    )
+{
+    PXENBUS_STORE_TREE_WALK         Walk = Argument;
+    XENBUS_STORE_TREE_BUFFER        Level;
+    XENBUS_STORE_TREE_BUFFER        Next;
+    ULONG                           Index;
+    NTSTATUS                        status;
 
-    status = STATUS_OBJECT_PATH_NOT_FOUND;
-    if (Buffer->Length == 0)
-        goto fail6;
+    ASSERT(Walk != NULL);
 
-    StoreFreeResponse(Response);
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    // Discard anything gathered by an earlier attempt
+    StoreTreeFree(&Walk->Tree);
 
-    *Value = Buffer->Data;
+    RtlZeroMemory(&Level, sizeof (XENBUS_STORE_TREE_BUFFER));
+    RtlZeroMemory(&Next, sizeof (XENBUS_STORE_TREE_BUFFER));
 
-    return STATUS_SUCCESS;
+    // The root is the only node at level 0 and is named by an empty
+    // relative path
+    status = StoreTreeAppend(&Level, "", 1);
 
-fail6:
-    StoreFreePayload(Context, Buffer);
+    // Walk the tree a level at a time, so the number of batches (and
+    // hence round trips) is proportional to depth rather than size.
+    // Nodes at the deepest level are read but not enumerated.
+    for (Index = 0; Index <= Walk->Depth && NT_SUCCESS(status); Index++) {
+        if (Level.Length == 0)
+            break;
 
-fail5:
-fail4:
-    StoreFreeResponse(Response);
+        status = StoreReadTreeLevel(Walk->Context,
+                                    Transaction,
+                                    Walk->Root,
+                                    &Level,
+                                    (Index != 0) ? TRUE : FALSE,
+                                    (Index != Walk->Depth) ? TRUE : FALSE,
+                                    Walk->Requests,
+                                    &Walk->Tree,
+                                    &Next);
+
+        StoreTreeFree(&Level);
+        Level = Next;
+        RtlZeroMemory(&Next, sizeof (XENBUS_STORE_TREE_BUFFER));
+    }
 
-fail3:
-fail2:
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    StoreTreeFree(&Level);
 
-fail1:
     return status;
 }
 
 static NTSTATUS
-StoreTransactionStart(
-    _In_ PINTERFACE                     Interface,
-    _Outptr_ PXENBUS_STORE_TRANSACTION  *Transaction
+StoreReadTree(
+    _In_ PINTERFACE             Interface,
+    _In_opt_ PSTR               Prefix,
+    _In_ PSTR                   Node,
+    _In_ ULONG                  Depth,
+    _Outptr_result_z_ PSTR      *Value
     )
 {
-    PXENBUS_STORE_CONTEXT               Context = Interface->Context;
-    XENBUS_STORE_REQUEST                Request;
-    PXENBUS_STORE_RESPONSE              Response;
-    KIRQL                               Irql;
-    NTSTATUS                            status;
+    PXENBUS_STORE_CONTEXT       Context = Interface->Context;
+    PVOID                       Caller;
+    PSTR                        Root;
+    PXENBUS_STORE_REQUEST       Requests;
+    XENBUS_STORE_TREE_WALK      Walk;
+    PXENBUS_STORE_BUFFER        Buffer;
+    KIRQL                       Irql;
+    NTSTATUS                    status;
 
-    *Transaction = __StoreAllocate(sizeof (XENBUS_STORE_TRANSACTION));
+    ASSERT3U(KeGetCurrentIrql(), <, DISPATCH_LEVEL);
 
-    status = STATUS_NO_MEMORY;
-    if (*Transaction == NULL)
+    status = StoreCheckPathLength(Prefix, Node);
+    if (!NT_SUCCESS(status))
         goto fail1;
 
-    (*Transaction)->Magic = STORE_TRANSACTION_MAGIC;
-    (VOID) RtlCaptureStackBackTrace(1, 1, &(*Transaction)->Caller, NULL);
-
-    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+    status = STATUS_INVALID_PARAMETER;
+    if (Depth == 0)
+        goto fail2;
 
-    KeAcquireSpinLock(&Context->Lock, &Irql);
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
 
-    status = StorePrepareRequest(Context,
-                                 &Request,
-                                 NULL,
-                                 XS_TRANSACTION_START,
-                                 "", 1,
-                                 NULL, 0);
+    Root = StoreAllocatePath(Prefix, Node);
 
-    KeReleaseSpinLock(&Context->Lock, Irql);
-    if (!NT_SUCCESS(status))
-        goto fail2;
+    status = STATUS_NO_MEMORY;
+    if (Root == NULL)
+        goto fail3;
 
-    Response = StoreSubmitRequest(Context, &Request);
+    // Each node may need both a read and a directory request
+    Requests = __StoreAllocate(sizeof (XENBUS_STORE_REQUEST) *
+                               XENBUS_STORE_TREE_BATCH * 2);
 
     status = STATUS_NO_MEMORY;
-    if (Response == NULL)
-        goto fail3;
+    if (Requests == NULL)
+        goto fail4;
 
-    status = StoreCheckResponse(Response);
+    RtlZeroMemory(&Walk, sizeof (XENBUS_STORE_TREE_WALK));
+
+    Walk.Context = Context;
+    Walk.Root = Root;
+    Walk.Depth = Depth;
+    Walk.Requests = Requests;
+
+    // Re-walk the tree if the transaction clashes, but only a bounded
+    // number of times and with a backoff in between (STATUS_RETRY is
+    // returned if the attempts run out)
+    status = __StoreTransactionRun(Interface,
+                                   Caller,
+                                   StoreReadTreeWalk,
+                                   &Walk);
     if (!NT_SUCCESS(status))
-        goto fail4;
+        goto fail5;
 
-    (*Transaction)->Id = (uint32_t)strtoul(Response->Segment[XENBUS_STORE_RESPONSE_PAYLOAD_SEGMENT].Data,
-                                           NULL,
-                                           10);
-    ASSERT((*Transaction)->Id != 0);
+    Buffer = StoreAllocateBuffer(Walk.Tree.Data, Walk.Tree.Length, Caller);
 
-    StoreFreeResponse(Response);
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    status = STATUS_NO_MEMORY;
+    if (Buffer == NULL)
+        goto fail6;
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
-    (*Transaction)->Active = TRUE;
-    InsertTailList(&Context->TransactionList, &(*Transaction)->ListEntry);
+    InsertTailList(&Context->BufferList, &Buffer->ListEntry);
     KeReleaseSpinLock(&Context->Lock, Irql);
 
+    StoreTreeFree(&Walk.Tree);
+
+    __StoreFree(Requests);
+    __StoreFree(Root);
+
+    *Value = Buffer->Data;
+
     return STATUS_SUCCESS;
 
+fail6:
+    Error("fail6\n");
+
+fail5:
+    Error("fail5\n");
+
+    // A failed commit may leave the result of the last walk behind
+    StoreTreeFree(&Walk.Tree);
+
+    ASSERT(IsZeroMemory(Requests,
+                        sizeof (XENBUS_STORE_REQUEST) *
+                        XENBUS_STORE_TREE_BATCH * 2));
+    __StoreFree(Requests);
+
 fail4:
     Error("fail4\n");
 
-    StoreFreeResponse(Response);
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    __StoreFree(Root);
 
 fail3:
     Error("fail3\n");
@@ -1635,116 +4395,96 @@ fail3:
 fail2:
     Error("fail2\n");
 
-    (*Transaction)->Caller = NULL;
-    (*Transaction)->Magic = 0;
-
-    ASSERT(IsZeroMemory(*Transaction, sizeof (XENBUS_STORE_TRANSACTION)));
-    __StoreFree(*Transaction);
-    *Transaction = NULL;
-
 fail1:
     Error("fail1 (%08x)\n", status);
 
     return status;
 }
 
-static NTSTATUS
-StoreTransactionEnd(
-    _In_ PINTERFACE                 Interface,
-    _In_ PXENBUS_STORE_TRANSACTION  Transaction,
-    _In_ BOOLEAN                    Commit
+// Must be called with lock held
+static VOID
+StoreAttachWatch(
+    _In_ PXENBUS_STORE_REGISTRATION Registration,
+    _In_ PXENBUS_STORE_WATCH        Watch
     )
 {
-    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
-    XENBUS_STORE_REQUEST            Request;
-    PXENBUS_STORE_RESPONSE          Response;
-    KIRQL                           Irql;
-    NTSTATUS                        status;
-
-    ASSERT3U(Transaction->Magic, ==, STORE_TRANSACTION_MAGIC);
+    ASSERT3P(Watch->Registration, ==, NULL);
 
-    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
-
-    KeAcquireSpinLock(&Context->Lock, &Irql);
+    InsertTailList(&Registration->WatchList, &Watch->RegistrationListEntry);
+    Registration->Count++;
 
-    status = STATUS_RETRY;
-    if (!Transaction->Active)
-        goto done;
+    Watch->Registration = Registration;
+    Watch->Active = TRUE;
+}
 
-    status = StorePrepareRequest(Context,
-                                 &Request,
-                                 Transaction,
-                                 XS_TRANSACTION_END,
-                                 (Commit) ? "T" : "F", 2,
-                                 NULL, 0);
+// Must be called with lock held
+static VOID
+StoreDetachWatch(
+    _In_ PXENBUS_STORE_WATCH    Watch
+    )
+{
+    PXENBUS_STORE_REGISTRATION  Registration = Watch->Registration;
 
-    KeReleaseSpinLock(&Context->Lock, Irql);
+    Watch->Active = FALSE;
 
-    if (!NT_SUCCESS(status))
-        goto fail1;
+    RemoveEntryList(&Watch->RegistrationListEntry);
+    RtlZeroMemory(&Watch->RegistrationListEntry, sizeof (LIST_ENTRY));
 
-    Response = StoreSubmitRequest(Context, &Request);
+    ASSERT(Registration->Count != 0);
+    --Registration->Count;
 
-    status = STATUS_NO_MEMORY;
-    if (Response == NULL)
-        goto fail2;
+    Watch->Registration = NULL;
+}
 
-    status = StoreCheckResponse(Response);
-    if (!NT_SUCCESS(status) && status != STATUS_RETRY)
-        goto fail3;
+static VOID
+StoreWatchStopDebounce(
+    _In_ PXENBUS_STORE_CONTEXT  Context,
+    _In_ PXENBUS_STORE_WATCH    Watch
+    )
+{
+    BOOLEAN                     Debouncing;
+    KIRQL                       Irql;
 
-    StoreFreeResponse(Response);
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    if (Watch->Interval == 0)
+        return;
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
-    Transaction->Active = FALSE;
-
-done:
-    RemoveEntryList(&Transaction->ListEntry);
+    ASSERT(!Watch->Active);
+    Debouncing = Watch->Debouncing;
     KeReleaseSpinLock(&Context->Lock, Irql);
 
-    RtlZeroMemory(&Transaction->ListEntry, sizeof (LIST_ENTRY));
-
-    Transaction->Id = 0;
-
-    Transaction->Caller = NULL;
-    Transaction->Magic = 0;
-
-    ASSERT(IsZeroMemory(Transaction, sizeof (XENBUS_STORE_TRANSACTION)));
-    __StoreFree(Transaction);
-
-    return status;
-
-fail3:
-    Error("fail3\n");
-
-    ASSERT3U(status, !=, STATUS_RETRY);
-
-    StoreFreeResponse(Response);
-
-fail2:
-    Error("fail2\n");
-
-fail1:
-    Error("fail1 (%08x)\n", status);
-
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    // The DPC will not re-arm the timer now that the watch is inactive,
+    // but it may already be queued or running
+    if (Debouncing && !KeCancelTimer(&Watch->Timer)) {
+        ASSERT3U(KeGetCurrentIrql(), ==, PASSIVE_LEVEL);
+        KeFlushQueuedDpcs();
+    }
 
-    return status;
+    Watch->Suppressed = 0;
+    Watch->Pending = FALSE;
+    Watch->Debouncing = FALSE;
+    RtlZeroMemory(&Watch->Dpc, sizeof (KDPC));
+    RtlZeroMemory(&Watch->Timer, sizeof (KTIMER));
+    Watch->Interval = 0;
 }
 
 static NTSTATUS
-StoreWatchAdd(
-    _In_ PINTERFACE                 Interface,
+StoreWatchCreate(
+    _In_ PXENBUS_STORE_CONTEXT      Context,
     _In_opt_ PSTR                   Prefix,
     _In_ PSTR                       Node,
     _In_ PKEVENT                    Event,
+    _In_ ULONG                      QueueDepth,
+    _In_ ULONG                      Interval,
+    _In_ PVOID                      Caller,
     _Outptr_ PXENBUS_STORE_WATCH    *Watch
     )
 {
-    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
     ULONG                           Length;
     PSTR                            Path;
+    PSTR                            *Queue;
+    PXENBUS_STORE_REGISTRATION      Registration;
+    PXENBUS_STORE_REGISTRATION      Shared;
     CHAR                            Token[TOKEN_LENGTH];
     XENBUS_STORE_REQUEST            Request;
     PXENBUS_STORE_RESPONSE          Response;
@@ -1755,6 +4495,10 @@ StoreWatchAdd(
     if (!NT_SUCCESS(status))
         goto fail1;
 
+    status = STATUS_INVALID_PARAMETER;
+    if (Interval > XENBUS_STORE_WATCH_INTERVAL_MAXIMUM)
+        goto fail1;
+
     *Watch = __StoreAllocate(sizeof (XENBUS_STORE_WATCH));
 
     status = STATUS_NO_MEMORY;
@@ -1762,7 +4506,7 @@ StoreWatchAdd(
         goto fail2;
 
     (*Watch)->Magic = STORE_WATCH_MAGIC;
-    (VOID) RtlCaptureStackBackTrace(1, 1, &(*Watch)->Caller, NULL);
+    (*Watch)->Caller = Caller;
 
     if (Prefix == NULL)
         Length = (ULONG)strlen(Node) + sizeof (CHAR);
@@ -1780,99 +4524,343 @@ StoreWatchAdd(
              RtlStringCbPrintfA(Path, Length, "%s/%s", Prefix, Node);
     ASSERT(NT_SUCCESS(status));
 
+    Queue = NULL;
+    if (QueueDepth != 0) {
+        status = STATUS_INVALID_PARAMETER;
+        if (QueueDepth > XENBUS_STORE_WATCH_QUEUE_DEPTH_MAXIMUM)
+            goto fail4;
+
+        Queue = __StoreAllocate(sizeof (PSTR) * QueueDepth);
+
+        status = STATUS_NO_MEMORY;
+        if (Queue == NULL)
+            goto fail5;
+    }
+
     (*Watch)->Path = Path;
     (*Watch)->Event = Event;
+    (*Watch)->Queue = Queue;
+    (*Watch)->QueueDepth = QueueDepth;
+
+    if (Interval != 0) {
+        KeInitializeTimer(&(*Watch)->Timer);
+        KeInitializeDpc(&(*Watch)->Dpc, StoreWatchDpc, Context);
+        (*Watch)->Interval = Interval;
+    }
+
+    Registration = __StoreAllocate(FIELD_OFFSET(XENBUS_STORE_REGISTRATION, Path) +
+                                   Length);
+
+    status = STATUS_NO_MEMORY;
+    if (Registration == NULL)
+        goto fail6;
+
+    RtlCopyMemory(Registration->Path, Path, Length);
+    Registration->Caller = Caller;
+    InitializeListHead(&Registration->WatchList);
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
-    (*Watch)->Id = StoreNextWatchId(Context);
-    (*Watch)->Active = TRUE;
+
+    Shared = StoreLookupRegistration(Context, Path);
+    if (Shared != NULL) {
+        StoreAttachWatch(Shared, *Watch);
+        InsertTailList(&Context->WatchList, &(*Watch)->ListEntry);
+        Context->WatchShares++;
+
+        // XenStore fires a watch as soon as it is registered so do
+        // the same here
+        if (Queue != NULL)
+            StoreQueueWatchEvent(*Watch, Path);
+
+        StoreSignalWatch(*Watch);
+
+        KeReleaseSpinLock(&Context->Lock, Irql);
+
+        __StoreFree(Registration);
+
+        return STATUS_SUCCESS;
+    }
+
+    Registration->Id = StoreNextWatchId(Context);
+    Registration->Active = TRUE;
+    InsertTailList(&Context->RegistrationList, &Registration->ListEntry);
+    StoreIndexInsert(&Context->WatchIndex, Registration->Id, Registration);
+
+    StoreAttachWatch(Registration, *Watch);
     InsertTailList(&Context->WatchList, &(*Watch)->ListEntry);
+
     KeReleaseSpinLock(&Context->Lock, Irql);
 
     status = RtlStringCbPrintfA(Token,
                                 sizeof (Token),
                                 "TOK|%p|%04X",
-                                (*Watch)->Caller,
-                                (*Watch)->Id);
+                                Registration->Caller,
+                                Registration->Id);
     ASSERT(NT_SUCCESS(status));
     ASSERT3U(strlen(Token), ==, TOKEN_LENGTH - 1);
 
-    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+    RtlZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    status = StorePrepareRequest(Context,
+                                 &Request,
+                                 NULL,
+                                 XS_WATCH,
+                                 Path, strlen(Path),
+                                 "", 1,
+                                 Token, strlen(Token),
+                                 "", 1,
+                                 NULL, 0);
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    if (!NT_SUCCESS(status))
+        goto fail7;
+
+    Response = StoreSubmitRequest(Context, &Request);
+
+    status = STATUS_NO_MEMORY;
+    if (Response == NULL)
+        goto fail8;
+
+    status = StoreCheckResponse(Response);
+    if (!NT_SUCCESS(status))
+        goto fail9;
+
+    StoreFreeResponse(Context, Response);
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    // Subsequent watches on the same path, or beneath it, can now use
+    // this registration
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    if (Registration->Active)
+        StoreShareRegistration(Context, Registration);
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return STATUS_SUCCESS;
+
+fail9:
+    Error("fail9\n");
+
+    StoreFreeResponse(Context, Response);
+
+fail8:
+    Error("fail8\n");
+
+fail7:
+    Error("fail7\n");
+
+    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    StoreDetachWatch(*Watch);
+    RemoveEntryList(&(*Watch)->ListEntry);
+
+    ASSERT3U(Registration->Count, ==, 0);
+    Registration->Active = FALSE;
+    StoreIndexRemove(&Context->WatchIndex, Registration->Id, Registration);
+    RemoveEntryList(&Registration->ListEntry);
+
+    if (Queue != NULL)
+        StoreFlushWatchQueue(*Watch);
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    RtlZeroMemory(&(*Watch)->ListEntry, sizeof (LIST_ENTRY));
+
+    __StoreFree(Registration);
+
+fail6:
+    Error("fail6\n");
+
+    StoreWatchStopDebounce(Context, *Watch);
+
+    (*Watch)->QueueDropped = 0;
+    (*Watch)->QueueOverflow = FALSE;
+    (*Watch)->QueueConsumer = 0;
+    (*Watch)->QueueProducer = 0;
+    (*Watch)->QueueDepth = 0;
+    (*Watch)->Queue = NULL;
+
+    (*Watch)->Event = NULL;
+    (*Watch)->Path = NULL;
+
+    if (Queue != NULL)
+        __StoreFree(Queue);
+
+fail5:
+    Error("fail5\n");
+
+fail4:
+    Error("fail4\n");
+
+    __StoreFree(Path);
+
+fail3:
+    Error("fail3\n");
+
+    (*Watch)->Caller = NULL;
+    (*Watch)->Magic = 0;
+
+    ASSERT(IsZeroMemory(*Watch, sizeof (XENBUS_STORE_WATCH)));
+    __StoreFree(*Watch);
+    *Watch = NULL;
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+    return status;
+}
+
+static NTSTATUS
+StoreWatchAdd(
+    _In_ PINTERFACE                 Interface,
+    _In_opt_ PSTR                   Prefix,
+    _In_ PSTR                       Node,
+    _In_ PKEVENT                    Event,
+    _Outptr_ PXENBUS_STORE_WATCH    *Watch
+    )
+{
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    PVOID                           Caller;
+
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
+
+    return StoreWatchCreate(Context,
+                            Prefix,
+                            Node,
+                            Event,
+                            0,
+                            0,
+                            Caller,
+                            Watch);
+}
 
-    KeAcquireSpinLock(&Context->Lock, &Irql);
+static NTSTATUS
+StoreWatchAddQueued(
+    _In_ PINTERFACE                 Interface,
+    _In_opt_ PSTR                   Prefix,
+    _In_ PSTR                       Node,
+    _In_ PKEVENT                    Event,
+    _In_ ULONG                      QueueDepth,
+    _Outptr_ PXENBUS_STORE_WATCH    *Watch
+    )
+{
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    PVOID                           Caller;
 
-    status = StorePrepareRequest(Context,
-                                 &Request,
-                                 NULL,
-                                 XS_WATCH,
-                                 Path, strlen(Path),
-                                 "", 1,
-                                 Token, strlen(Token),
-                                 "", 1,
-                                 NULL, 0);
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
 
-    KeReleaseSpinLock(&Context->Lock, Irql);
+    if (QueueDepth == 0)
+        return STATUS_INVALID_PARAMETER;
 
-    if (!NT_SUCCESS(status))
-        goto fail4;
+    return StoreWatchCreate(Context,
+                            Prefix,
+                            Node,
+                            Event,
+                            QueueDepth,
+                            0,
+                            Caller,
+                            Watch);
+}
 
-    Response = StoreSubmitRequest(Context, &Request);
+static NTSTATUS
+StoreWatchAddDebounced(
+    _In_ PINTERFACE                 Interface,
+    _In_opt_ PSTR                   Prefix,
+    _In_ PSTR                       Node,
+    _In_ PKEVENT                    Event,
+    _In_ ULONG                      Interval,
+    _Outptr_ PXENBUS_STORE_WATCH    *Watch
+    )
+{
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    PVOID                           Caller;
 
-    status = STATUS_NO_MEMORY;
-    if (Response == NULL)
-        goto fail5;
+    (VOID) RtlCaptureStackBackTrace(1, 1, &Caller, NULL);
 
-    status = StoreCheckResponse(Response);
-    if (!NT_SUCCESS(status))
-        goto fail6;
+    return StoreWatchCreate(Context,
+                            Prefix,
+                            Node,
+                            Event,
+                            0,
+                            Interval,
+                            Caller,
+                            Watch);
+}
 
-    StoreFreeResponse(Response);
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+static ULONG
+StoreWatchSuppressed(
+    _In_ PINTERFACE             Interface,
+    _In_ PXENBUS_STORE_WATCH    Watch
+    )
+{
+    PXENBUS_STORE_CONTEXT       Context = Interface->Context;
+    ULONG                       Suppressed;
+    KIRQL                       Irql;
 
-    return STATUS_SUCCESS;
+    ASSERT3U(Watch->Magic, ==, STORE_WATCH_MAGIC);
 
-fail6:
-    Error("fail6\n");
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    Suppressed = Watch->Suppressed;
+    KeReleaseSpinLock(&Context->Lock, Irql);
 
-    StoreFreeResponse(Response);
+    return Suppressed;
+}
 
-fail5:
-    Error("fail5\n");
+static NTSTATUS
+StoreWatchDequeue(
+    _In_ PINTERFACE                 Interface,
+    _In_ PXENBUS_STORE_WATCH        Watch,
+    _Out_writes_z_(Length) PSTR     Path,
+    _In_ ULONG                      Length,
+    _Out_ PBOOLEAN                  Overflow
+    )
+{
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    ULONG                           Index;
+    KIRQL                           Irql;
+    NTSTATUS                        status;
 
-    ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
+    ASSERT3U(Watch->Magic, ==, STORE_WATCH_MAGIC);
+
+    status = STATUS_INVALID_PARAMETER;
+    if (Watch->Queue == NULL)
+        goto fail1;
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
-    (*Watch)->Active = FALSE;
-    (*Watch)->Id = 0;
-    RemoveEntryList(&(*Watch)->ListEntry);
-    KeReleaseSpinLock(&Context->Lock, Irql);
 
-    RtlZeroMemory(&(*Watch)->ListEntry, sizeof (LIST_ENTRY));
+    *Overflow = Watch->QueueOverflow;
 
-    (*Watch)->Event = NULL;
-    (*Watch)->Path = NULL;
+    status = STATUS_NO_MORE_ENTRIES;
+    if (Watch->QueueConsumer == Watch->QueueProducer)
+        goto done;
 
-    __StoreFree(Path);
+    Index = Watch->QueueConsumer % Watch->QueueDepth;
 
-fail4:
-    Error("fail4\n");
+    status = RtlStringCbCopyA(Path, Length, Watch->Queue[Index]);
+    if (!NT_SUCCESS(status))
+        goto fail2;
 
-fail3:
-    Error("fail3\n");
+    __StoreFree(Watch->Queue[Index]);
+    Watch->Queue[Index] = NULL;
+    Watch->QueueConsumer++;
 
-    (*Watch)->Caller = NULL;
-    (*Watch)->Magic = 0;
+done:
+    Watch->QueueOverflow = FALSE;
 
-    ASSERT(IsZeroMemory(*Watch, sizeof (XENBUS_STORE_WATCH)));
-    __StoreFree(*Watch);
-    *Watch = NULL;
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return status;
 
 fail2:
-    Error("fail2\n");
+    KeReleaseSpinLock(&Context->Lock, Irql);
 
 fail1:
-    Error("fail1 (%08x)\n", status);
-
     return status;
 }
 
@@ -1883,6 +4871,7 @@ StoreWatchRemove(
     )
 {
     PXENBUS_STORE_CONTEXT       Context = Interface->Context;
+    PXENBUS_STORE_REGISTRATION  Registration;
     PSTR                        Path;
     CHAR                        Token[TOKEN_LENGTH];
     XENBUS_STORE_REQUEST        Request;
@@ -1893,12 +4882,13 @@ StoreWatchRemove(
     ASSERT3U(Watch->Magic, ==, STORE_WATCH_MAGIC);
 
     Path = Watch->Path;
+    Registration = Watch->Registration;
 
     status = RtlStringCbPrintfA(Token,
                                 sizeof (Token),
                                 "TOK|%p|%04X",
-                                Watch->Caller,
-                                Watch->Id);
+                                Registration->Caller,
+                                Registration->Id);
     ASSERT(NT_SUCCESS(status));
     ASSERT3U(strlen(Token), ==, TOKEN_LENGTH - 1);
 
@@ -1906,14 +4896,18 @@ StoreWatchRemove(
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
 
-    if (!Watch->Active)
+    // The registration is only dropped along with its last watch
+    if (!Registration->Active || Registration->Count > 1)
         goto done;
 
+    // Make sure nothing else starts sharing it
+    StoreUnshareRegistration(Context, Registration);
+
     status = StorePrepareRequest(Context,
                                  &Request,
                                  NULL,
                                  XS_UNWATCH,
-                                 Path, strlen(Path),
+                                 Registration->Path, strlen(Registration->Path),
                                  "", 1,
                                  Token, strlen(Token),
                                  "", 1,
@@ -1934,19 +4928,53 @@ StoreWatchRemove(
     if (!NT_SUCCESS(status))
         goto fail3;
 
-    StoreFreeResponse(Response);
+    StoreFreeResponse(Context, Response);
     ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
 
     KeAcquireSpinLock(&Context->Lock, &Irql);
-    Watch->Active = FALSE;
+    Registration->Active = FALSE;
 
 done:
-    Watch->Id = 0;
+    StoreDetachWatch(Watch);
     RemoveEntryList(&Watch->ListEntry);
+
+    if (Registration->Count == 0) {
+        StoreUnshareRegistration(Context, Registration);
+        StoreIndexRemove(&Context->WatchIndex,
+                         Registration->Id,
+                         Registration);
+        RemoveEntryList(&Registration->ListEntry);
+
+        // Entries beneath the path may no longer be covered by a watch
+        StoreCacheInvalidate(Context, NULL, Registration->Path);
+    } else {
+        Registration = NULL;
+    }
+
+    if (Watch->Queue != NULL)
+        StoreFlushWatchQueue(Watch);
+
     KeReleaseSpinLock(&Context->Lock, Irql);
 
+    StoreWatchStopDebounce(Context, Watch);
+
     RtlZeroMemory(&Watch->ListEntry, sizeof (LIST_ENTRY));
 
+    if (Registration != NULL) {
+        ASSERT(IsListEmpty(&Registration->WatchList));
+        __StoreFree(Registration);
+    }
+
+    if (Watch->Queue != NULL)
+        __StoreFree(Watch->Queue);
+
+    Watch->QueueDropped = 0;
+    Watch->QueueOverflow = FALSE;
+    Watch->QueueConsumer = 0;
+    Watch->QueueProducer = 0;
+    Watch->QueueDepth = 0;
+    Watch->Queue = NULL;
+
     Watch->Event = NULL;
     Watch->Path = NULL;
 
@@ -1963,7 +4991,7 @@ done:
 fail3:
     Error("fail3\n");
 
-    StoreFreeResponse(Response);
+    StoreFreeResponse(Context, Response);
 
 fail2:
     Error("fail2\n");
@@ -1973,9 +5001,37 @@ fail1:
 
     ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
 
+    // The watch is still in place so let it be shared again
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+
+    if (Registration->Active && Registration->Node == NULL)
+        StoreShareRegistration(Context, Registration);
+
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
     return status;
 }
 
+static NTSTATUS
+StoreQueryLatency(
+    _In_ PINTERFACE                 Interface,
+    _In_ ULONG                      Type,
+    _Out_ PXENBUS_STORE_LATENCY     Latency
+    )
+{
+    PXENBUS_STORE_CONTEXT           Context = Interface->Context;
+    KIRQL                           Irql;
+
+    if (Type >= XENBUS_STORE_LATENCY_TYPES)
+        return STATUS_INVALID_PARAMETER;
+
+    KeAcquireSpinLock(&Context->Lock, &Irql);
+    *Latency = Context->Latency[Type];
+    KeReleaseSpinLock(&Context->Lock, Irql);
+
+    return STATUS_SUCCESS;
+}
+
 static VOID
 StorePoll(
     _In_ PINTERFACE         Interface
@@ -1984,11 +5040,6 @@ StorePoll(
     __StorePoll(Interface->Context);
 }
 
-#define TIME_US(_us)        ((_us) * 10)
-#define TIME_MS(_ms)        (TIME_US((_ms) * 1000))
-#define TIME_S(_s)          (TIME_MS((_s) * 1000))
-#define TIME_RELATIVE(_t)   (-(_t))
-
 #define XENBUS_STORE_WATCHDOG_PERIOD 15
 
 static NTSTATUS
@@ -2052,6 +5103,7 @@ StoreWatchdog(
                                      &Context->EvtchnInterface,
                                      Context->Channel);
                 (VOID) StorePollLocked(Context);
+                __StoreQueueCompletions(Context);
             }
 
             KeMemoryBarrier();
@@ -2211,6 +5263,8 @@ StorePermissionsSet(
 
     Response = StoreSubmitRequest(Context, &Request);
 
+    StoreCacheInvalidatePath(Context, Prefix, Node);
+
     status = STATUS_NO_MEMORY;
     if (Response == NULL)
         goto fail6;
@@ -2219,7 +5273,7 @@ StorePermissionsSet(
     if (!NT_SUCCESS(status))
         goto fail7;
 
-    StoreFreeResponse(Response);
+    StoreFreeResponse(Context, Response);
     ASSERT(IsZeroMemory(&Request, sizeof (XENBUS_STORE_REQUEST)));
 
     __StoreFree(Path);
@@ -2229,7 +5283,7 @@ StorePermissionsSet(
 
 fail7:
     Error("fail7\n");
-    StoreFreeResponse(Response);
+    StoreFreeResponse(Context, Response);
 
 fail6:
     Error("fail6\n");
@@ -2396,6 +5450,73 @@ StoreSuspendCallbackEarly(
 
         Watch->Active = FALSE;
     }
+
+    for (ListEntry = Context->RegistrationList.Flink;
+         ListEntry != &(Context->RegistrationList);
+         ListEntry = ListEntry->Flink) {
+        PXENBUS_STORE_REGISTRATION  Registration;
+
+        Registration = CONTAINING_RECORD(ListEntry,
+                                         XENBUS_STORE_REGISTRATION,
+                                         ListEntry);
+
+        Registration->Active = FALSE;
+    }
+}
+
+// Must be called with lock held
+static VOID
+StoreResubmitRequests(
+    _In_ PXENBUS_STORE_CONTEXT  Context
+    )
+{
+    LIST_ENTRY                  List;
+
+    // Only asynchronous requests can be outstanding across a suspend.
+    // Anything not yet answered was lost with the old ring connection
+    // so send it again from the start, oldest first. Requests that are
+    // part of a transaction will be failed by xenstored since the
+    // transaction did not survive.
+    InitializeListHead(&List);
+
+    while (!IsListEmpty(&Context->PendingList)) {
+        PLIST_ENTRY             ListEntry;
+        PXENBUS_STORE_REQUEST   Request;
+
+        ListEntry = RemoveHeadList(&Context->PendingList);
+        Request = CONTAINING_RECORD(ListEntry, XENBUS_STORE_REQUEST, ListEntry);
+
+        StoreIndexRemove(&Context->RequestIndex,
+                         Request->Header.req_id,
+                         Request);
+
+        InsertTailList(&List, ListEntry);
+    }
+
+    while (!IsListEmpty(&Context->SubmittedList)) {
+        PLIST_ENTRY ListEntry;
+
+        ListEntry = RemoveHeadList(&Context->SubmittedList);
+        InsertTailList(&List, ListEntry);
+    }
+
+    while (!IsListEmpty(&List)) {
+        PLIST_ENTRY             ListEntry;
+        PXENBUS_STORE_REQUEST   Request;
+        ULONG                   Index;
+
+        ListEntry = RemoveHeadList(&List);
+        Request = CONTAINING_RECORD(ListEntry, XENBUS_STORE_REQUEST, ListEntry);
+
+        ASSERT(Request->Function != NULL);
+
+        for (Index = 0; Index < Request->Count; Index++)
+            Request->Segment[Index].Offset = 0;
+        Request->Index = 0;
+
+        InsertTailList(&Context->SubmittedList, &Request->ListEntry);
+        Request->State = XENBUS_STORE_REQUEST_SUBMITTED;
+    }
 }
 
 static VOID
@@ -2417,6 +5538,8 @@ StoreSuspendCallbackLate(
 
     StoreDisable(Context);
     StoreResetResponse(Context);
+    StoreResubmitRequests(Context);
+    StoreCacheInvalidate(Context, NULL, NULL);
     StoreEnable(Context);
 
     for (ListEntry = Context->WatchList.Flink;
@@ -2426,12 +5549,44 @@ StoreSuspendCallbackLate(
 
         Watch = CONTAINING_RECORD(ListEntry, XENBUS_STORE_WATCH, ListEntry);
 
+        // Any changes made while we were suspended were not queued
+        if (Watch->Queue != NULL)
+            Watch->QueueOverflow = TRUE;
+
         KeSetEvent(Watch->Event, 0, FALSE);
     }
 
     KeReleaseSpinLock(&Context->Lock, Irql);
 }
 
+static PCSTR
+StoreTypeName(
+    _In_ ULONG  Type
+    )
+{
+#define _STORE_TYPE_NAME(_Type)     \
+        case XS_ ## _Type:          \
+            return #_Type;
+
+    switch (Type) {
+    _STORE_TYPE_NAME(DIRECTORY);
+    _STORE_TYPE_NAME(READ);
+    _STORE_TYPE_NAME(WATCH);
+    _STORE_TYPE_NAME(UNWATCH);
+    _STORE_TYPE_NAME(TRANSACTION_START);
+    _STORE_TYPE_NAME(TRANSACTION_END);
+    _STORE_TYPE_NAME(WRITE);
+    _STORE_TYPE_NAME(RM);
+    _STORE_TYPE_NAME(SET_PERMS);
+    _STORE_TYPE_NAME(DIRECTORY_PART);
+    default:
+        break;
+    }
+
+    return ("UNKNOWN");
+#undef  _STORE_TYPE_NAME
+}
+
 static VOID
 StoreDebugCallback(
     _In_ PVOID              Argument,
@@ -2439,6 +5594,7 @@ StoreDebugCallback(
     )
 {
     PXENBUS_STORE_CONTEXT   Context = Argument;
+    ULONG                   Type;
 
     XENBUS_DEBUG(Printf,
                  &Context->DebugInterface,
@@ -2471,6 +5627,74 @@ StoreDebugCallback(
                  Context->Dpcs,
                  Context->Polls);
 
+    XENBUS_DEBUG(Printf,
+                 &Context->DebugInterface,
+                 "AsyncRequests = %lu AsyncCompletions = %lu\n",
+                 Context->AsyncRequests,
+                 Context->AsyncCompletions);
+
+    XENBUS_DEBUG(Printf,
+                 &Context->DebugInterface,
+                 "RingStalls = %lu\n",
+                 Context->RingStalls);
+
+    for (Type = 0; Type < XENBUS_STORE_LATENCY_TYPES; Type++) {
+        PXENBUS_STORE_LATENCY   Latency = &Context->Latency[Type];
+        ULONG                   Bucket;
+
+        if (Latency->Count == 0)
+            continue;
+
+        XENBUS_DEBUG(Printf,
+                     &Context->DebugInterface,
+                     "LATENCY: %s: Count = %llu Stalls = %llu\n",
+                     StoreTypeName(Type),
+                     Latency->Count,
+                     Latency->Stalls);
+
+        for (Bucket = 0; Bucket < XENBUS_STORE_LATENCY_BUCKETS; Bucket++) {
+            if (Latency->QueueTime[Bucket] == 0 &&
+                Latency->ServiceTime[Bucket] == 0)
+                continue;
+
+            XENBUS_DEBUG(Printf,
+                         &Context->DebugInterface,
+                         "- %s%lluus: Queue = %llu Service = %llu\n",
+                         (Bucket == XENBUS_STORE_LATENCY_BUCKETS - 1) ? ">=" : "<",
+                         (Bucket == XENBUS_STORE_LATENCY_BUCKETS - 1) ? 1ull << Bucket : 2ull << Bucket,
+                         Latency->QueueTime[Bucket],
+                         Latency->ServiceTime[Bucket]);
+        }
+    }
+
+    XENBUS_DEBUG(Printf,
+                 &Context->DebugInterface,
+                 "WatchShares = %lu\n",
+                 Context->WatchShares);
+
+    XENBUS_DEBUG(Printf,
+                 &Context->DebugInterface,
+                 "INDEX: Requests = %lu/%lu (%lu missing) Registrations = %lu/%lu (%lu missing)\n",
+                 Context->RequestIndex.Count,
+                 Context->RequestIndex.Size,
+                 Context->RequestIndex.Missing,
+                 Context->WatchIndex.Count,
+                 Context->WatchIndex.Size,
+                 Context->WatchIndex.Missing);
+
+    if (Context->CacheEnabled) {
+        ULONG   Lookups = Context->CacheHits + Context->CacheMisses;
+
+        XENBUS_DEBUG(Printf,
+                     &Context->DebugInterface,
+                     "CACHE: Entries = %lu Hits = %lu Misses = %lu (%lu%%) Invalidations = %lu\n",
+                     Context->CacheCount,
+                     Context->CacheHits,
+                     Context->CacheMisses,
+                     (Lookups != 0) ? (ULONG)(((ULONGLONG)Context->CacheHits * 100) / Lookups) : 0,
+                     Context->CacheInvalidations);
+    }
+
     if (!IsListEmpty(&Context->BufferList)) {
         PLIST_ENTRY ListEntry;
 
@@ -2528,7 +5752,7 @@ StoreDebugCallback(
                 XENBUS_DEBUG(Printf,
                              &Context->DebugInterface,
                              "- (%04X) ON %s BY %s + %p [%s]\n",
-                             Watch->Id,
+                             Watch->Registration->Id,
                              Watch->Path,
                              Name,
                              (PVOID)Offset,
@@ -2537,11 +5761,67 @@ StoreDebugCallback(
                 XENBUS_DEBUG(Printf,
                              &Context->DebugInterface,
                              "- (%04X) ON %s BY %p [%s]\n",
-                             Watch->Id,
+                             Watch->Registration->Id,
                              Watch->Path,
                              (PVOID)Watch->Caller,
                              (Watch->Active) ? "ACTIVE" : "EXPIRED");
             }
+
+            if (Watch->Queue != NULL)
+                XENBUS_DEBUG(Printf,
+                             &Context->DebugInterface,
+                             "  QUEUE: %lu/%lu Dropped = %lu%s\n",
+                             Watch->QueueProducer - Watch->QueueConsumer,
+                             Watch->QueueDepth,
+                             Watch->QueueDropped,
+                             (Watch->QueueOverflow) ? " [OVERFLOW]" : "");
+
+            if (Watch->Interval != 0)
+                XENBUS_DEBUG(Printf,
+                             &Context->DebugInterface,
+                             "  DEBOUNCE: %lums Suppressed = %lu%s\n",
+                             Watch->Interval,
+                             Watch->Suppressed,
+                             (Watch->Pending) ? " [PENDING]" : "");
+        }
+    }
+
+    if (!IsListEmpty(&Context->RetryList)) {
+        PLIST_ENTRY ListEntry;
+
+        XENBUS_DEBUG(Printf,
+                     &Context->DebugInterface,
+                     "RETRIES:\n");
+
+        for (ListEntry = Context->RetryList.Flink;
+             ListEntry != &(Context->RetryList);
+             ListEntry = ListEntry->Flink) {
+            PXENBUS_STORE_RETRY Retry;
+            PSTR                Name;
+            ULONG_PTR           Offset;
+
+            Retry = CONTAINING_RECORD(ListEntry, XENBUS_STORE_RETRY, ListEntry);
+
+            ModuleLookup((ULONG_PTR)Retry->Caller, &Name, &Offset);
+
+            if (Name != NULL) {
+                XENBUS_DEBUG(Printf,
+                             &Context->DebugInterface,
+                             "- %s + %p: Transactions = %lu Retries = %lu Exhausted = %lu\n",
+                             Name,
+                             (PVOID)Offset,
+                             Retry->Transactions,
+                             Retry->Retries,
+                             Retry->Exhausted);
+            } else {
+                XENBUS_DEBUG(Printf,
+                             &Context->DebugInterface,
+                             "- %p: Transactions = %lu Retries = %lu Exhausted = %lu\n",
+                             Retry->Caller,
+                             Retry->Transactions,
+                             Retry->Retries,
+                             Retry->Exhausted);
+            }
         }
     }
 
@@ -2658,6 +5938,26 @@ StoreAcquire(
     if (!NT_SUCCESS(status))
         goto fail9;
 
+    status = XENBUS_CACHE(Acquire, &Context->CacheInterface);
+    if (!NT_SUCCESS(status))
+        goto fail10;
+
+    status = XENBUS_CACHE(Create,
+                          &Context->CacheInterface,
+                          "store_response",
+                          FIELD_OFFSET(XENBUS_STORE_RESPONSE, Data) +
+                          XENBUS_STORE_RESPONSE_SMALL_SIZE,
+                          0,
+                          0,
+                          StoreResponseCtor,
+                          StoreResponseDtor,
+                          StoreResponseAcquireLock,
+                          StoreResponseReleaseLock,
+                          Context,
+                          &Context->ResponseCache);
+    if (!NT_SUCCESS(status))
+        goto fail11;
+
     Trace("<====\n");
 
 done:
@@ -2665,6 +5965,19 @@ done:
 
     return STATUS_SUCCESS;
 
+fail11:
+    Error("fail11\n");
+
+    XENBUS_CACHE(Release, &Context->CacheInterface);
+
+fail10:
+    Error("fail10\n");
+
+    XENBUS_DEBUG(Deregister,
+                 &Context->DebugInterface,
+                 Context->DebugCallback);
+    Context->DebugCallback = NULL;
+
 fail9:
     Error("fail9\n");
 
@@ -2751,6 +6064,16 @@ StoreRelease(
     if (!IsListEmpty(&Context->BufferList))
         BUG("OUTSTANDING BUFFER");
 
+    if (Context->AsyncRequests != Context->AsyncCompletions)
+        BUG("OUTSTANDING ASYNC REQUESTS");
+
+    XENBUS_CACHE(Destroy,
+                 &Context->CacheInterface,
+                 Context->ResponseCache);
+    Context->ResponseCache = NULL;
+
+    XENBUS_CACHE(Release, &Context->CacheInterface);
+
     XENBUS_DEBUG(Deregister,
                  &Context->DebugInterface,
                  Context->DebugCallback);
@@ -2770,6 +6093,8 @@ StoreRelease(
 
     XENBUS_SUSPEND(Release, &Context->SuspendInterface);
 
+    StoreCacheInvalidate(Context, NULL, NULL);
+
     (VOID) StorePollLocked(Context);
     StoreDisable(Context);
     RtlZeroMemory(&Context->Response, sizeof (XENBUS_STORE_RESPONSE));
@@ -2806,6 +6131,231 @@ static struct _XENBUS_STORE_INTERFACE_V2 StoreInterfaceVersion2 = {
     StorePoll
 };
 
+static struct _XENBUS_STORE_INTERFACE_V3 StoreInterfaceVersion3 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V3), 3, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync
+};
+
+static struct _XENBUS_STORE_INTERFACE_V4 StoreInterfaceVersion4 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V4), 4, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch
+};
+
+static struct _XENBUS_STORE_INTERFACE_V5 StoreInterfaceVersion5 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V5), 5, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue
+};
+
+static struct _XENBUS_STORE_INTERFACE_V6 StoreInterfaceVersion6 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V6), 6, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue,
+    StoreReadBuffer
+};
+
+static struct _XENBUS_STORE_INTERFACE_V7 StoreInterfaceVersion7 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V7), 7, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue,
+    StoreReadBuffer,
+    StoreEnumerateStart,
+    StoreEnumerateNext,
+    StoreEnumerateEnd
+};
+
+static struct _XENBUS_STORE_INTERFACE_V8 StoreInterfaceVersion8 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V8), 8, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue,
+    StoreReadBuffer,
+    StoreEnumerateStart,
+    StoreEnumerateNext,
+    StoreEnumerateEnd,
+    StoreReadTree
+};
+
+static struct _XENBUS_STORE_INTERFACE_V9 StoreInterfaceVersion9 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V9), 9, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue,
+    StoreReadBuffer,
+    StoreEnumerateStart,
+    StoreEnumerateNext,
+    StoreEnumerateEnd,
+    StoreReadTree,
+    StoreQueryLatency
+};
+
+static struct _XENBUS_STORE_INTERFACE_V10 StoreInterfaceVersion10 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V10), 10, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue,
+    StoreReadBuffer,
+    StoreEnumerateStart,
+    StoreEnumerateNext,
+    StoreEnumerateEnd,
+    StoreReadTree,
+    StoreQueryLatency,
+    StoreTransactionRun
+};
+
+static struct _XENBUS_STORE_INTERFACE_V11 StoreInterfaceVersion11 = {
+    { sizeof (struct _XENBUS_STORE_INTERFACE_V11), 11, NULL, NULL, NULL },
+    StoreAcquire,
+    StoreRelease,
+    StoreFree,
+    StoreRead,
+    StorePrintf,
+    StorePermissionsSet,
+    StoreRemove,
+    StoreDirectory,
+    StoreTransactionStart,
+    StoreTransactionEnd,
+    StoreWatchAdd,
+    StoreWatchRemove,
+    StorePoll,
+    StoreReadAsync,
+    StorePrintfAsync,
+    StoreSubmitBatch,
+    StoreWatchAddQueued,
+    StoreWatchDequeue,
+    StoreReadBuffer,
+    StoreEnumerateStart,
+    StoreEnumerateNext,
+    StoreEnumerateEnd,
+    StoreReadTree,
+    StoreQueryLatency,
+    StoreTransactionRun,
+    StoreWatchAddDebounced,
+    StoreWatchSuppressed
+};
+
 NTSTATUS
 StoreInitialize(
     _In_ PXENBUS_FDO                Fdo,
@@ -2814,6 +6364,9 @@ StoreInitialize(
 {
     LARGE_INTEGER                   Now;
     ULONG                           Seed;
+    HANDLE                          ParametersKey;
+    ULONG                           CacheEnabled;
+    ULONG                           Index;
     NTSTATUS                        status;
 
     Trace("====>\n");
@@ -2831,6 +6384,13 @@ StoreInitialize(
     ASSERT(NT_SUCCESS(status));
     ASSERT((*Context)->GnttabInterface.Interface.Context != NULL);
 
+    status = CacheGetInterface(FdoGetCacheContext(Fdo),
+                               XENBUS_CACHE_INTERFACE_VERSION_MAX,
+                               (PINTERFACE)&(*Context)->CacheInterface,
+                               sizeof ((*Context)->CacheInterface));
+    ASSERT(NT_SUCCESS(status));
+    ASSERT((*Context)->CacheInterface.Interface.Context != NULL);
+
     status = EvtchnGetInterface(FdoGetEvtchnContext(Fdo),
                                 XENBUS_EVTCHN_INTERFACE_VERSION_MAX,
                                 (PINTERFACE)&(*Context)->EvtchnInterface,
@@ -2853,6 +6413,7 @@ StoreInitialize(
     ASSERT((*Context)->DebugInterface.Interface.Context != NULL);
 
     KeInitializeSpinLock(&(*Context)->Lock);
+    KeInitializeSpinLock(&(*Context)->ResponseLock);
 
     KeQuerySystemTime(&Now);
     Seed = Now.LowPart;
@@ -2860,14 +6421,32 @@ StoreInitialize(
     (*Context)->RequestId = (USHORT)RtlRandomEx(&Seed);
     InitializeListHead(&(*Context)->SubmittedList);
     InitializeListHead(&(*Context)->PendingList);
+    InitializeListHead(&(*Context)->CompletedList);
 
     InitializeListHead(&(*Context)->TransactionList);
+    InitializeListHead(&(*Context)->RetryList);
 
     (*Context)->WatchId = (USHORT)RtlRandomEx(&Seed);
     InitializeListHead(&(*Context)->WatchList);
+    InitializeListHead(&(*Context)->RegistrationList);
+    InitializeListHead(&(*Context)->WatchRoot.ChildList);
 
     InitializeListHead(&(*Context)->BufferList);
 
+    ParametersKey = DriverGetParametersKey();
+
+    status = RegistryQueryDwordValue(ParametersKey,
+                                     "StoreReadCache",
+                                     &CacheEnabled);
+    if (!NT_SUCCESS(status))
+        CacheEnabled = 0;
+
+    (*Context)->CacheEnabled = (CacheEnabled != 0) ? TRUE : FALSE;
+
+    InitializeListHead(&(*Context)->CacheList);
+    for (Index = 0; Index < XENBUS_STORE_CACHE_BUCKETS; Index++)
+        InitializeListHead(&(*Context)->CacheBucket[Index]);
+
     KeInitializeDpc(&(*Context)->Dpc, StoreDpc, *Context);
 
     status = ThreadCreate(StoreWatchdog,
@@ -2887,17 +6466,27 @@ fail2:
 
     RtlZeroMemory(&(*Context)->Dpc, sizeof (KDPC));
 
+    RtlZeroMemory(&(*Context)->CacheBucket,
+                  sizeof (LIST_ENTRY) * XENBUS_STORE_CACHE_BUCKETS);
+    RtlZeroMemory(&(*Context)->CacheList, sizeof (LIST_ENTRY));
+    (*Context)->CacheEnabled = FALSE;
+
     RtlZeroMemory(&(*Context)->BufferList, sizeof (LIST_ENTRY));
 
+    RtlZeroMemory(&(*Context)->WatchRoot, sizeof (XENBUS_STORE_WATCH_NODE));
+    RtlZeroMemory(&(*Context)->RegistrationList, sizeof (LIST_ENTRY));
     RtlZeroMemory(&(*Context)->WatchList, sizeof (LIST_ENTRY));
     (*Context)->WatchId = 0;
 
+    RtlZeroMemory(&(*Context)->RetryList, sizeof (LIST_ENTRY));
     RtlZeroMemory(&(*Context)->TransactionList, sizeof (LIST_ENTRY));
 
+    RtlZeroMemory(&(*Context)->CompletedList, sizeof (LIST_ENTRY));
     RtlZeroMemory(&(*Context)->PendingList, sizeof (LIST_ENTRY));
     RtlZeroMemory(&(*Context)->SubmittedList, sizeof (LIST_ENTRY));
     (*Context)->RequestId = 0;
 
+    RtlZeroMemory(&(*Context)->ResponseLock, sizeof (KSPIN_LOCK));
     RtlZeroMemory(&(*Context)->Lock, sizeof (KSPIN_LOCK));
 
     RtlZeroMemory(&(*Context)->DebugInterface,
@@ -2909,6 +6498,9 @@ fail2:
     RtlZeroMemory(&(*Context)->EvtchnInterface,
                   sizeof (XENBUS_EVTCHN_INTERFACE));
 
+    RtlZeroMemory(&(*Context)->CacheInterface,
+                  sizeof (XENBUS_CACHE_INTERFACE));
+
     RtlZeroMemory(&(*Context)->GnttabInterface,
                   sizeof (XENBUS_GNTTAB_INTERFACE));
 
@@ -2951,6 +6543,159 @@ StoreGetInterface(
         status = STATUS_SUCCESS;
         break;
     }
+    case 3: {
+        struct _XENBUS_STORE_INTERFACE_V3  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V3 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V3))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion3;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 4: {
+        struct _XENBUS_STORE_INTERFACE_V4  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V4 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V4))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion4;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 5: {
+        struct _XENBUS_STORE_INTERFACE_V5  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V5 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V5))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion5;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 6: {
+        struct _XENBUS_STORE_INTERFACE_V6  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V6 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V6))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion6;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 7: {
+        struct _XENBUS_STORE_INTERFACE_V7  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V7 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V7))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion7;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 8: {
+        struct _XENBUS_STORE_INTERFACE_V8  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V8 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V8))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion8;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 9: {
+        struct _XENBUS_STORE_INTERFACE_V9  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V9 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V9))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion9;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 10: {
+        struct _XENBUS_STORE_INTERFACE_V10  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V10 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V10))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion10;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
+    case 11: {
+        struct _XENBUS_STORE_INTERFACE_V11  *StoreInterface;
+
+        StoreInterface = (struct _XENBUS_STORE_INTERFACE_V11 *)Interface;
+
+        status = STATUS_BUFFER_OVERFLOW;
+        if (Size < sizeof (struct _XENBUS_STORE_INTERFACE_V11))
+            break;
+
+        *StoreInterface = StoreInterfaceVersion11;
+
+        ASSERT3U(Interface->Version, == , Version);
+        Interface->Context = Context;
+
+        status = STATUS_SUCCESS;
+        break;
+    }
     default:
         status = STATUS_NOT_SUPPORTED;
         break;
@@ -2985,21 +6730,60 @@ StoreTeardown(
     Context->Dpcs = 0;
     Context->Events = 0;
 
+    Context->AsyncRequests = 0;
+    Context->AsyncCompletions = 0;
+
+    Context->RingStalls = 0;
+    RtlZeroMemory(Context->Latency, sizeof (Context->Latency));
+
     Context->Fdo = NULL;
 
     RtlZeroMemory(&Context->Dpc, sizeof (KDPC));
 
+    Context->CacheInvalidations = 0;
+    Context->CacheMisses = 0;
+    Context->CacheHits = 0;
+    Context->CacheGeneration = 0;
+
+    ASSERT3U(Context->CacheCount, ==, 0);
+    RtlZeroMemory(&Context->CacheBucket,
+                  sizeof (LIST_ENTRY) * XENBUS_STORE_CACHE_BUCKETS);
+    RtlZeroMemory(&Context->CacheList, sizeof (LIST_ENTRY));
+    Context->CacheEnabled = FALSE;
+
     RtlZeroMemory(&Context->BufferList, sizeof (LIST_ENTRY));
 
+    Context->WatchShares = 0;
+    ASSERT(IsListEmpty(&Context->WatchRoot.ChildList));
+    RtlZeroMemory(&Context->WatchRoot, sizeof (XENBUS_STORE_WATCH_NODE));
+    StoreIndexTeardown(&Context->WatchIndex);
+    RtlZeroMemory(&Context->RegistrationList, sizeof (LIST_ENTRY));
     RtlZeroMemory(&Context->WatchList, sizeof (LIST_ENTRY));
     Context->WatchId = 0;
 
+    while (!IsListEmpty(&Context->RetryList)) {
+        PLIST_ENTRY         ListEntry;
+        PXENBUS_STORE_RETRY Retry;
+
+        ListEntry = RemoveHeadList(&Context->RetryList);
+        Retry = CONTAINING_RECORD(ListEntry, XENBUS_STORE_RETRY, ListEntry);
+
+        __StoreFree(Retry);
+        --Context->RetryCount;
+    }
+    ASSERT3U(Context->RetryCount, ==, 0);
+    RtlZeroMemory(&Context->RetryList, sizeof (LIST_ENTRY));
+
     RtlZeroMemory(&Context->TransactionList, sizeof (LIST_ENTRY));
 
+    ASSERT(IsListEmpty(&Context->CompletedList));
+    RtlZeroMemory(&Context->CompletedList, sizeof (LIST_ENTRY));
+    StoreIndexTeardown(&Context->RequestIndex);
     RtlZeroMemory(&Context->PendingList, sizeof (LIST_ENTRY));
     RtlZeroMemory(&Context->SubmittedList, sizeof (LIST_ENTRY));
     Context->RequestId = 0;
 
+    RtlZeroMemory(&Context->ResponseLock, sizeof (KSPIN_LOCK));
     RtlZeroMemory(&Context->Lock, sizeof (KSPIN_LOCK));
 
     RtlZeroMemory(&Context->DebugInterface,
@@ -3011,6 +6795,9 @@ StoreTeardown(
     RtlZeroMemory(&Context->EvtchnInterface,
                   sizeof (XENBUS_EVTCHN_INTERFACE));
 
+    RtlZeroMemory(&Context->CacheInterface,
+                  sizeof (XENBUS_CACHE_INTERFACE));
+
     RtlZeroMemory(&Context->GnttabInterface,
                   sizeof (XENBUS_GNTTAB_INTERFACE));
 